@@ -11,4 +11,22 @@
 // above I/O interfaces and don't want to include the above I/O headers.
 #include "marisa/trie.h"
 
+// "marisa/tuner.h" provides automatic selection of dictionary settings.
+#include "marisa/tuner.h"
+
+// "marisa/trie-handle.h" provides replacement of dictionaries under readers.
+#include "marisa/trie-handle.h"
+
+// "marisa/numa-trie.h" provides replicas of a dictionary on NUMA nodes.
+#include "marisa/numa-trie.h"
+
+// "marisa/trie-set.h" provides a file of named dictionaries.
+#include "marisa/trie-set.h"
+
+// "marisa/result-cache.h" provides a per-thread cache of lookup results.
+#include "marisa/result-cache.h"
+
+// "marisa/description.h" reports the structure of a dictionary.
+#include "marisa/description.h"
+
 #endif  // MARISA_H_
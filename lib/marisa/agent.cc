@@ -4,8 +4,14 @@
 #include "marisa/grimoire/trie.h"
 
 namespace marisa {
+namespace {
 
-Agent::Agent() : query_(), key_(), state_() {} 
+// empty_stats is returned by stats() of an agent which has not counted.
+const Stats empty_stats;
+
+}  // namespace
+
+Agent::Agent() : query_(), key_(), state_(), stats_() {}
 
 Agent::~Agent() {}
 
@@ -38,6 +44,16 @@ void Agent::init_state() {
   MARISA_THROW_IF(state_.get() == NULL, MARISA_MEMORY_ERROR);
 }
 
+const Stats &Agent::stats() const {
+  return (stats_.get() != NULL) ? *stats_ : empty_stats;
+}
+
+void Agent::init_stats() {
+  MARISA_THROW_IF(stats_.get() != NULL, MARISA_STATE_ERROR);
+  stats_.reset(new (std::nothrow) Stats);
+  MARISA_THROW_IF(stats_.get() == NULL, MARISA_MEMORY_ERROR);
+}
+
 void Agent::clear() {
   Agent().swap(*this);
 }
@@ -46,6 +62,7 @@ void Agent::swap(Agent &rhs) {
   query_.swap(rhs.query_);
   key_.swap(rhs.key_);
   state_.swap(rhs.state_);
+  stats_.swap(rhs.stats_);
 }
 
 }  // namespace marisa
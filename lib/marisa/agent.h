@@ -3,6 +3,7 @@
 
 #include "marisa/key.h"
 #include "marisa/query.h"
+#include "marisa/stats.h"
 
 namespace marisa {
 namespace grimoire {
@@ -50,6 +51,18 @@ class Agent {
     key_.set_id(id);
   }
 
+  // stats() counts the work of the queries given with this agent until it
+  // is cleared by stats().clear(). See marisa/stats.h. The counters are
+  // allocated on the first count or the first call of the non-const
+  // stats(), so that an agent does not carry them by default.
+  const Stats &stats() const;
+  Stats &stats() {
+    if (stats_.get() == NULL) {
+      init_stats();
+    }
+    return *stats_;
+  }
+
   bool has_state() const {
     return state_.get() != NULL;
   }
@@ -62,6 +75,9 @@ class Agent {
   Query query_;
   Key key_;
   scoped_ptr<grimoire::trie::State> state_;
+  scoped_ptr<Stats> stats_;
+
+  void init_stats();
 
   // Disallows copy and assignment.
   Agent(const Agent &);
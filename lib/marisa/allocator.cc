@@ -0,0 +1,323 @@
+#if (defined _WIN32) || (defined _WIN64)
+ #include <windows.h>
+#else  // (defined _WIN32) || (defined _WIN64)
+ #include <sys/mman.h>
+ #include <unistd.h>
+ #ifdef __linux__
+  #include <sched.h>
+  #include <sys/syscall.h>
+ #endif  // __linux__
+#endif  // (defined _WIN32) || (defined _WIN64)
+
+#include <cstdio>
+#include <new>
+
+#include "marisa/allocator.h"
+
+// getcpu() of glibc uses the vDSO, which is much faster than a syscall.
+#if (defined __GLIBC__) && (defined __GLIBC_PREREQ)
+ #if __GLIBC_PREREQ(2, 29)
+  #define MARISA_HAS_GETCPU
+ #endif  // __GLIBC_PREREQ(2, 29)
+#endif  // (defined __GLIBC__) && (defined __GLIBC_PREREQ)
+
+namespace marisa {
+namespace {
+
+// Blocks from the heap are rounded up so that they keep the alignment of
+// ArenaAllocator.
+const std::size_t BLOCK_ALIGNMENT = 16;
+
+std::size_t round_up(std::size_t size, std::size_t unit) {
+  return ((size + unit - 1) / unit) * unit;
+}
+
+void *allocate_heap(std::size_t size) {
+  return new (std::nothrow) char[size];
+}
+
+void deallocate_heap(void *ptr) {
+  delete [] static_cast<char *>(ptr);
+}
+
+#if !(defined _WIN32) && !(defined _WIN64)
+std::size_t get_page_size() {
+  const long page_size = ::sysconf(_SC_PAGESIZE);
+  return (page_size > 0) ? (std::size_t)page_size : 4096;
+}
+
+// map_anonymous() maps `size' bytes aligned to `alignment', which is a
+// multiple of the page size, by trimming a larger mapping.
+void *map_anonymous(std::size_t size, std::size_t alignment) {
+  if (size > (MARISA_SIZE_MAX - alignment)) {
+    return NULL;
+  }
+  void * const region = ::mmap(NULL, size + alignment,
+      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED) {
+    return NULL;
+  }
+  char * const begin = static_cast<char *>(region);
+  const std::size_t head_size =
+      (alignment - ((std::size_t)begin % alignment)) % alignment;
+  if (head_size != 0) {
+    ::munmap(begin, head_size);
+  }
+  if (head_size != alignment) {
+    ::munmap(begin + head_size + size, alignment - head_size);
+  }
+  return begin + head_size;
+}
+#endif  // !(defined _WIN32) && !(defined _WIN64)
+
+#ifdef __linux__
+// read_node_list() reads a list of nodes, such as "0-3" or "0,2-3", and
+// returns one more than the largest node, or 0 if the file is not
+// available. `*listed' tells whether `node' is in the list.
+std::size_t read_node_list(const char *path, std::size_t node,
+    bool *listed) {
+  *listed = false;
+  std::FILE * const file = std::fopen(path, "r");
+  if (file == NULL) {
+    return 0;
+  }
+  std::size_t end = 0;
+  std::size_t first = 0;
+  std::size_t value = 0;
+  bool in_range = false;
+  bool has_value = false;
+  for (int c = std::fgetc(file); ; c = std::fgetc(file)) {
+    if ((c >= '0') && (c <= '9')) {
+      value = (value * 10) + (std::size_t)(c - '0');
+      has_value = true;
+    } else if ((c == '-') && has_value) {
+      first = value;
+      value = 0;
+      in_range = true;
+      has_value = false;
+    } else {
+      if (has_value) {
+        if (!in_range) {
+          first = value;
+        }
+        if ((node >= first) && (node <= value)) {
+          *listed = true;
+        }
+        end = ((value + 1) > end) ? (value + 1) : end;
+      }
+      value = 0;
+      in_range = false;
+      has_value = false;
+      if (c == EOF) {
+        break;
+      }
+    }
+  }
+  std::fclose(file);
+  return end;
+}
+#endif  // __linux__
+
+}  // namespace
+
+#if (defined _WIN32) || (defined _WIN64)
+void *HugePageAllocator::allocate(std::size_t size) {
+  return allocate_heap(size);
+}
+
+void HugePageAllocator::deallocate(void *ptr, std::size_t) {
+  deallocate_heap(ptr);
+}
+#else  // (defined _WIN32) || (defined _WIN64)
+void *HugePageAllocator::allocate(std::size_t size) {
+  if ((size == 0) || (size < min_size_)) {
+    return allocate_heap(size);
+  }
+  const std::size_t length = round_up(size, HUGE_PAGE_SIZE);
+  void * const ptr = map_anonymous(length, HUGE_PAGE_SIZE);
+  if (ptr == NULL) {
+    return NULL;
+  }
+ #ifdef MADV_HUGEPAGE
+  ::madvise(ptr, length, MADV_HUGEPAGE);
+ #endif  // MADV_HUGEPAGE
+  return ptr;
+}
+
+void HugePageAllocator::deallocate(void *ptr, std::size_t size) {
+  if ((size == 0) || (size < min_size_)) {
+    deallocate_heap(ptr);
+  } else if (ptr != NULL) {
+    ::munmap(ptr, round_up(size, HUGE_PAGE_SIZE));
+  }
+}
+#endif  // (defined _WIN32) || (defined _WIN64)
+
+#if (defined __linux__) && (defined SYS_mbind)
+void *NumaAllocator::allocate(std::size_t size) {
+  if (size == 0) {
+    return allocate_heap(size);
+  }
+  const std::size_t page_size = get_page_size();
+  const std::size_t length = round_up(size, page_size);
+  void * const ptr = map_anonymous(length, page_size);
+  if (ptr == NULL) {
+    return NULL;
+  }
+
+  // MPOL_BIND is 2 in <numaif.h>. The node mask is an array of longs. A
+  // block which cannot be bound, for example to a node without memory, is
+  // left to the default policy.
+  enum { MPOL_BIND_POLICY = 2 };
+  const std::size_t NUM_MASK_BITS = sizeof(unsigned long) * 8;
+  unsigned long node_mask[16] = {};
+  bool is_bound = false;
+  if (node_ < (NUM_MASK_BITS * 16)) {
+    node_mask[node_ / NUM_MASK_BITS] = 1UL << (node_ % NUM_MASK_BITS);
+    is_bound = ::syscall(SYS_mbind, ptr, length, MPOL_BIND_POLICY,
+        node_mask, NUM_MASK_BITS * 16 + 1, 0) == 0;
+  }
+  if (!is_bound) {
+    unbound_size_ += size;
+  }
+  return ptr;
+}
+
+void NumaAllocator::deallocate(void *ptr, std::size_t size) {
+  if (size == 0) {
+    deallocate_heap(ptr);
+  } else if (ptr != NULL) {
+    ::munmap(ptr, round_up(size, get_page_size()));
+  }
+}
+#else  // (defined __linux__) && (defined SYS_mbind)
+void *NumaAllocator::allocate(std::size_t size) {
+  void * const ptr = allocate_heap(size);
+  if (ptr != NULL) {
+    unbound_size_ += size;
+  }
+  return ptr;
+}
+
+void NumaAllocator::deallocate(void *ptr, std::size_t) {
+  deallocate_heap(ptr);
+}
+#endif  // (defined __linux__) && (defined SYS_mbind)
+
+#ifdef __linux__
+std::size_t NumaAllocator::num_nodes() {
+  bool listed;
+  const std::size_t end =
+      read_node_list("/sys/devices/system/node/online", 0, &listed);
+  return (end != 0) ? end : 1;
+}
+
+bool NumaAllocator::has_memory(std::size_t node) {
+  bool listed;
+  if (read_node_list("/sys/devices/system/node/has_memory", node,
+      &listed) == 0) {
+    return node < num_nodes();
+  }
+  return listed;
+}
+
+std::size_t NumaAllocator::current_node() {
+  unsigned cpu = 0;
+  unsigned node = 0;
+ #if defined MARISA_HAS_GETCPU
+  if (::getcpu(&cpu, &node) != 0) {
+    return 0;
+  }
+ #elif defined SYS_getcpu
+  if (::syscall(SYS_getcpu, &cpu, &node, NULL) != 0) {
+    return 0;
+  }
+ #endif  // MARISA_HAS_GETCPU
+  return node;
+}
+#else  // __linux__
+std::size_t NumaAllocator::num_nodes() {
+  return 1;
+}
+
+bool NumaAllocator::has_memory(std::size_t node) {
+  return node == 0;
+}
+
+std::size_t NumaAllocator::current_node() {
+  return 0;
+}
+#endif  // __linux__
+
+#undef MARISA_HAS_GETCPU
+
+ArenaAllocator::ArenaAllocator(std::size_t chunk_size)
+    : Allocator(), chunks_(), num_chunks_(0), capacity_(0),
+      chunk_size_(chunk_size), chunk_pos_(0), total_size_(0),
+      used_size_(0) {}
+
+ArenaAllocator::~ArenaAllocator() {
+  for (std::size_t i = 0; i < num_chunks_; ++i) {
+    deallocate_heap(chunks_[i].ptr);
+  }
+}
+
+void *ArenaAllocator::allocate(std::size_t size) {
+  if (size > (MARISA_SIZE_MAX - BLOCK_ALIGNMENT)) {
+    return NULL;
+  }
+  size = round_up(size, BLOCK_ALIGNMENT);
+  if ((num_chunks_ != 0) &&
+      (size <= (chunks_[num_chunks_ - 1].size - chunk_pos_))) {
+    char * const ptr = chunks_[num_chunks_ - 1].ptr + chunk_pos_;
+    chunk_pos_ += size;
+    used_size_ += size;
+    return ptr;
+  }
+
+  if (num_chunks_ == capacity_) {
+    const std::size_t new_capacity = (capacity_ != 0) ? (capacity_ * 2) : 16;
+    scoped_array<Chunk> new_chunks(new (std::nothrow) Chunk[new_capacity]);
+    if (new_chunks.get() == NULL) {
+      return NULL;
+    }
+    for (std::size_t i = 0; i < num_chunks_; ++i) {
+      new_chunks[i] = chunks_[i];
+    }
+    chunks_.swap(new_chunks);
+    capacity_ = new_capacity;
+  }
+
+  // A block larger than a chunk gets a chunk of its own.
+  const std::size_t chunk_size = (size > chunk_size_) ? size : chunk_size_;
+  char * const ptr = static_cast<char *>(
+      allocate_heap((chunk_size != 0) ? chunk_size : BLOCK_ALIGNMENT));
+  if (ptr == NULL) {
+    return NULL;
+  }
+  chunks_[num_chunks_].ptr = ptr;
+  chunks_[num_chunks_].size = chunk_size;
+  ++num_chunks_;
+  chunk_pos_ = size;
+  total_size_ += chunk_size;
+  used_size_ += size;
+  return ptr;
+}
+
+void ArenaAllocator::deallocate(void *, std::size_t) {}
+
+void ArenaAllocator::clear() {
+  ArenaAllocator(chunk_size_).swap(*this);
+}
+
+void ArenaAllocator::swap(ArenaAllocator &rhs) {
+  chunks_.swap(rhs.chunks_);
+  marisa::swap(num_chunks_, rhs.num_chunks_);
+  marisa::swap(capacity_, rhs.capacity_);
+  marisa::swap(chunk_size_, rhs.chunk_size_);
+  marisa::swap(chunk_pos_, rhs.chunk_pos_);
+  marisa::swap(total_size_, rhs.total_size_);
+  marisa::swap(used_size_, rhs.used_size_);
+}
+
+}  // namespace marisa
@@ -0,0 +1,133 @@
+#ifndef MARISA_ALLOCATOR_H_
+#define MARISA_ALLOCATOR_H_
+
+#include "marisa/base.h"
+
+namespace marisa {
+
+// Allocator provides memory for the arrays of dictionaries. allocate()
+// returns a block aligned to at least 16 bytes, or NULL on failure, and
+// may be called with size 0. deallocate() is given the size passed to
+// allocate(). An allocator must outlive the dictionaries using it.
+class Allocator {
+ public:
+  Allocator() {}
+  virtual ~Allocator() {}
+
+  virtual void *allocate(std::size_t size) = 0;
+  virtual void deallocate(void *ptr, std::size_t size) = 0;
+
+ private:
+  // Disallows copy and assignment.
+  Allocator(const Allocator &);
+  Allocator &operator=(const Allocator &);
+};
+
+// HugePageAllocator maps blocks of `min_size' bytes or more as anonymous
+// memory aligned to 2 MB and asks for transparent huge pages, so that large
+// arrays need fewer TLB entries. Smaller blocks come from the heap, as do
+// all blocks where huge pages are not available.
+class HugePageAllocator : public Allocator {
+ public:
+  enum {
+    HUGE_PAGE_SIZE    = 2 << 20,
+    DEFAULT_MIN_SIZE  = 1 << 20
+  };
+
+  explicit HugePageAllocator(std::size_t min_size = DEFAULT_MIN_SIZE)
+      : Allocator(), min_size_(min_size) {}
+
+  void *allocate(std::size_t size);
+  void deallocate(void *ptr, std::size_t size);
+
+  std::size_t min_size() const {
+    return min_size_;
+  }
+
+ private:
+  std::size_t min_size_;
+};
+
+// NumaAllocator maps blocks as anonymous memory bound to a NUMA node with
+// mbind(), which is called through syscall() so that libnuma is not needed.
+// If binding fails, the block is kept with the default policy and counted
+// by unbound_size(). Where mbind() is not available, blocks come from the
+// heap and are all counted.
+class NumaAllocator : public Allocator {
+ public:
+  explicit NumaAllocator(std::size_t node)
+      : Allocator(), node_(node), unbound_size_(0) {}
+
+  void *allocate(std::size_t size);
+  void deallocate(void *ptr, std::size_t size);
+
+  std::size_t node() const {
+    return node_;
+  }
+  // unbound_size() returns the number of bytes allocated without binding.
+  std::size_t unbound_size() const {
+    return unbound_size_;
+  }
+
+  // num_nodes() returns one more than the largest NUMA node online,
+  // has_memory() tells whether a node is online and has memory, and
+  // current_node() returns the node of the processor running the calling
+  // thread. Where NUMA is not available, there is one node, node 0.
+  static std::size_t num_nodes();
+  static bool has_memory(std::size_t node);
+  static std::size_t current_node();
+
+ private:
+  std::size_t node_;
+  std::size_t unbound_size_;
+};
+
+// ArenaAllocator carves blocks out of chunks of `chunk_size' bytes and
+// frees them all at once by clear() or on destruction. deallocate() does
+// nothing, so an arena suits scratch space that is thrown away together,
+// such as the temporary arrays of a build. It is not thread-safe.
+class ArenaAllocator : public Allocator {
+ public:
+  enum {
+    DEFAULT_CHUNK_SIZE  = 1 << 20
+  };
+
+  explicit ArenaAllocator(std::size_t chunk_size = DEFAULT_CHUNK_SIZE);
+  ~ArenaAllocator();
+
+  void *allocate(std::size_t size);
+  void deallocate(void *ptr, std::size_t size);
+
+  // total_size() returns the number of bytes of the chunks and used_size()
+  // returns the number of bytes given by allocate().
+  std::size_t total_size() const {
+    return total_size_;
+  }
+  std::size_t used_size() const {
+    return used_size_;
+  }
+  std::size_t num_chunks() const {
+    return num_chunks_;
+  }
+
+  void clear();
+  void swap(ArenaAllocator &rhs);
+
+ private:
+  struct Chunk {
+    char *ptr;
+    std::size_t size;
+  };
+
+  scoped_array<Chunk> chunks_;
+  std::size_t num_chunks_;
+  std::size_t capacity_;
+  std::size_t chunk_size_;
+  std::size_t chunk_pos_;
+  std::size_t total_size_;
+  std::size_t used_size_;
+};
+
+}  // namespace marisa
+
+#endif  // MARISA_ALLOCATOR_H_
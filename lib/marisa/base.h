@@ -148,14 +148,108 @@ typedef enum marisa_node_order_ {
   MARISA_DEFAULT_ORDER     = MARISA_WEIGHT_ORDER,
 } marisa_node_order;
 
+// The cache is arranged in one of the following layouts.
+typedef enum marisa_cache_layout_ {
+  // MARISA_DIRECT_CACHE keeps one transition per slot.
+  MARISA_DIRECT_CACHE      = 0x100000,
+
+  // MARISA_ASSOCIATIVE_CACHE groups transitions into sets of 4, each of
+  // which fits in a 64-byte cache line, and keeps the heaviest transitions
+  // of each set. It takes the same space as MARISA_DIRECT_CACHE but misses
+  // less often on skewed workloads. A dictionary with this layout cannot be
+  // loaded by older versions.
+  MARISA_ASSOCIATIVE_CACHE = 0x200000,
+
+  MARISA_DEFAULT_CACHE_LAYOUT = MARISA_DIRECT_CACHE
+} marisa_cache_layout;
+
+// A root table maps the first bytes of a query to the node where lookup()
+// and predictive_search() resume, so that the first steps from the root,
+// which has the largest number of children, are skipped. The table is saved
+// only in MARISA_FORMAT_V2, as a section which older versions ignore.
+typedef enum marisa_root_table_ {
+  MARISA_NO_ROOT_TABLE     = 0x400000,
+
+  // MARISA_ROOT_TABLE maps the first byte with 256 entries.
+  MARISA_ROOT_TABLE        = 0x800000,
+
+  // MARISA_DEEP_ROOT_TABLE also maps the first 2 bytes with 65536 entries,
+  // which take 256KB.
+  MARISA_DEEP_ROOT_TABLE   = 0xC00000,
+
+  MARISA_DEFAULT_ROOT_TABLE = MARISA_NO_ROOT_TABLE
+} marisa_root_table;
+
 typedef enum marisa_config_mask_ {
   MARISA_NUM_TRIES_MASK    = 0x0007F,
   MARISA_CACHE_LEVEL_MASK  = 0x00F80,
   MARISA_TAIL_MODE_MASK    = 0x0F000,
   MARISA_NODE_ORDER_MASK   = 0xF0000,
-  MARISA_CONFIG_MASK       = 0xFFFFF
+  MARISA_CACHE_LAYOUT_MASK = 0x300000,
+  MARISA_ROOT_TABLE_MASK   = 0xC00000,
+  MARISA_CONFIG_MASK       = 0xFFFFFF
 } marisa_config_mask;
 
+// When dictionaries are merged, the weights of a key that appears in more
+// than one dictionary are combined in one of the following ways.
+typedef enum marisa_merge_mode_ {
+  MARISA_SUM_WEIGHTS       = 0,
+  MARISA_MAX_WEIGHTS       = 1,
+  MARISA_DEFAULT_MERGE     = MARISA_SUM_WEIGHTS
+} marisa_merge_mode;
+
+// A ResultCache admits a new result in one of the following ways when it
+// has to evict another. MARISA_ADMIT_FREQUENT is TinyLFU: the new result is
+// admitted only if its key has been queried more often than the key of the
+// result to be evicted, which is estimated by a small counting sketch of
+// recent queries. MARISA_ADMIT_ALL always evicts the least recently used.
+typedef enum marisa_admission_policy_ {
+  MARISA_ADMIT_ALL         = 0,
+  MARISA_ADMIT_FREQUENT    = 1,
+  MARISA_DEFAULT_ADMISSION = MARISA_ADMIT_FREQUENT
+} marisa_admission_policy;
+
+// Dictionaries are saved in one of the following formats. MARISA_FORMAT_V2
+// starts with a directory of sections, each of which has a CRC-32C checksum
+// and is aligned to 64 bytes. A dictionary in either format can be loaded.
+typedef enum marisa_format_version_ {
+  MARISA_FORMAT_V1         = 1,
+  MARISA_FORMAT_V2         = 2,
+  MARISA_DEFAULT_FORMAT    = MARISA_FORMAT_V1
+} marisa_format_version;
+
+// Trie::mmap() accepts a combination of the following flags, which tune the
+// mapping for predictable latency right after loading. MARISA_MAP_POPULATE
+// prefaults the whole dictionary. MARISA_MAP_ADVISE marks the dictionary as
+// randomly accessed and starts reading the cache and the top level of a v2
+// dictionary in advance. MARISA_MAP_HUGE_PAGES asks for transparent huge
+// pages. MARISA_MAP_LOCK locks the dictionary in memory. The hints are
+// ignored where they are not supported, but a lock failure is an error.
+// MARISA_MAP_READ reads the whole file into one anonymous memory region with
+// large sequential reads and maps the dictionary in place, so that the pages
+// do not depend on the page cache and the file is not kept open.
+// MARISA_MAP_VERIFY checks each section of a v2 dictionary against its
+// checksum before the dictionary is used, which reads the whole file.
+typedef enum marisa_map_flags_ {
+  MARISA_MAP_POPULATE      = 0x01,
+  MARISA_MAP_ADVISE        = 0x02,
+  MARISA_MAP_HUGE_PAGES    = 0x04,
+  MARISA_MAP_LOCK          = 0x08,
+  MARISA_MAP_READ          = 0x10,
+  MARISA_MAP_VERIFY        = 0x20,
+  MARISA_DEFAULT_MAP       = 0x00
+} marisa_map_flags;
+
+// Trie::save() accepts a combination of the following flags for large
+// dictionaries. MARISA_SAVE_DIRECT bypasses the page cache with O_DIRECT
+// where it is supported. MARISA_SAVE_PREALLOCATE allocates the whole file in
+// advance, which avoids fragmentation.
+typedef enum marisa_save_flags_ {
+  MARISA_SAVE_DIRECT       = 0x01,
+  MARISA_SAVE_PREALLOCATE  = 0x02,
+  MARISA_DEFAULT_SAVE      = 0x00
+} marisa_save_flags;
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif  // __cplusplus
@@ -173,6 +267,11 @@ typedef ::marisa_error_code ErrorCode;
 typedef ::marisa_cache_level CacheLevel;
 typedef ::marisa_tail_mode TailMode;
 typedef ::marisa_node_order NodeOrder;
+typedef ::marisa_cache_layout CacheLayout;
+typedef ::marisa_root_table RootTable;
+typedef ::marisa_merge_mode MergeMode;
+typedef ::marisa_admission_policy AdmissionPolicy;
+typedef ::marisa_format_version FormatVersion;
 
 template <typename T>
 inline void swap(T &lhs, T &rhs) {
@@ -0,0 +1,183 @@
+#include <new>
+
+#include "marisa/description.h"
+
+namespace marisa {
+
+Description::Description() : levels_(), num_levels_(0), key_depths_() {}
+
+Description::~Description() {}
+
+std::size_t Description::get(std::size_t level, Item item) const {
+  MARISA_THROW_IF(level >= num_levels_, MARISA_BOUND_ERROR);
+  MARISA_THROW_IF((std::size_t)item >= NUM_ITEMS, MARISA_BOUND_ERROR);
+  return levels_[level].items[item];
+}
+
+std::size_t Description::fanout(std::size_t level,
+    std::size_t bucket) const {
+  MARISA_THROW_IF(level >= num_levels_, MARISA_BOUND_ERROR);
+  MARISA_THROW_IF(bucket >= NUM_FANOUT_BUCKETS, MARISA_BOUND_ERROR);
+  return levels_[level].fanouts[bucket];
+}
+
+std::size_t Description::key_depth(std::size_t bucket) const {
+  MARISA_THROW_IF(bucket >= NUM_DEPTH_BUCKETS, MARISA_BOUND_ERROR);
+  return key_depths_[bucket];
+}
+
+double Description::link_ratio(std::size_t level) const {
+  const std::size_t num_nodes = get(level, NUM_NODES);
+  return (num_nodes != 0) ?
+      ((double)get(level, NUM_LINKS) / num_nodes) : 0.0;
+}
+
+double Description::cache_fill_ratio(std::size_t level) const {
+  const std::size_t num_entries = get(level, NUM_CACHE_ENTRIES);
+  return (num_entries != 0) ?
+      ((double)get(level, NUM_FILLED_CACHE_ENTRIES) / num_entries) : 0.0;
+}
+
+double Description::sharing_ratio() const {
+  std::size_t tail_length = 0;
+  std::size_t suffix_length = 0;
+  for (std::size_t i = 0; i < num_levels_; ++i) {
+    tail_length += levels_[i].items[TAIL_LENGTH];
+    suffix_length += levels_[i].items[SUFFIX_LENGTH];
+  }
+  if ((suffix_length == 0) || (tail_length >= suffix_length)) {
+    return 0.0;
+  }
+  return 1.0 - ((double)tail_length / suffix_length);
+}
+
+std::size_t Description::size(std::size_t level) const {
+  const Item items[] = {
+    LOUDS_BITS_SIZE, LOUDS_RANK_SIZE, LOUDS_SELECT_SIZE,
+    TERMINAL_BITS_SIZE, TERMINAL_RANK_SIZE, TERMINAL_SELECT_SIZE,
+    LINK_BITS_SIZE, LINK_RANK_SIZE, LINK_SELECT_SIZE,
+    BASES_SIZE, EXTRAS_SIZE, CACHE_SIZE, ROOT_TABLE_SIZE, TAIL_SIZE
+  };
+  std::size_t total_size = 0;
+  for (std::size_t i = 0; i < (sizeof(items) / sizeof(items[0])); ++i) {
+    total_size += get(level, items[i]);
+  }
+  return total_size;
+}
+
+const char *Description::item_name(Item item) {
+  switch (item) {
+    case NUM_NODES: {
+      return "num_nodes";
+    }
+    case NUM_TERMINALS: {
+      return "num_terminals";
+    }
+    case NUM_LINKS: {
+      return "num_links";
+    }
+    case LOUDS_BITS_SIZE: {
+      return "louds_bits_size";
+    }
+    case LOUDS_RANK_SIZE: {
+      return "louds_rank_size";
+    }
+    case LOUDS_SELECT_SIZE: {
+      return "louds_select_size";
+    }
+    case TERMINAL_BITS_SIZE: {
+      return "terminal_bits_size";
+    }
+    case TERMINAL_RANK_SIZE: {
+      return "terminal_rank_size";
+    }
+    case TERMINAL_SELECT_SIZE: {
+      return "terminal_select_size";
+    }
+    case LINK_BITS_SIZE: {
+      return "link_bits_size";
+    }
+    case LINK_RANK_SIZE: {
+      return "link_rank_size";
+    }
+    case LINK_SELECT_SIZE: {
+      return "link_select_size";
+    }
+    case BASES_SIZE: {
+      return "bases_size";
+    }
+    case EXTRAS_SIZE: {
+      return "extras_size";
+    }
+    case CACHE_SIZE: {
+      return "cache_size";
+    }
+    case NUM_CACHE_ENTRIES: {
+      return "num_cache_entries";
+    }
+    case NUM_FILLED_CACHE_ENTRIES: {
+      return "num_filled_cache_entries";
+    }
+    case ROOT_TABLE_SIZE: {
+      return "root_table_size";
+    }
+    case TAIL_SIZE: {
+      return "tail_size";
+    }
+    case TAIL_LENGTH: {
+      return "tail_length";
+    }
+    case SUFFIX_LENGTH: {
+      return "suffix_length";
+    }
+    default: {
+      return "unknown";
+    }
+  }
+}
+
+void Description::resize(std::size_t num_levels) {
+  scoped_array<Level> new_levels(new (std::nothrow) Level[num_levels]());
+  MARISA_THROW_IF((new_levels.get() == NULL) && (num_levels != 0),
+      MARISA_MEMORY_ERROR);
+  for (std::size_t i = 0; (i < num_levels) && (i < num_levels_); ++i) {
+    new_levels[i] = levels_[i];
+  }
+  levels_.swap(new_levels);
+  num_levels_ = num_levels;
+}
+
+void Description::add(std::size_t level, Item item, std::size_t value) {
+  MARISA_THROW_IF(level >= num_levels_, MARISA_BOUND_ERROR);
+  MARISA_THROW_IF((std::size_t)item >= NUM_ITEMS, MARISA_BOUND_ERROR);
+  levels_[level].items[item] += value;
+}
+
+void Description::add_fanout(std::size_t level, std::size_t num_children) {
+  MARISA_THROW_IF(level >= num_levels_, MARISA_BOUND_ERROR);
+  std::size_t bucket = 0;
+  while ((num_children != 0) && (bucket < (NUM_FANOUT_BUCKETS - 1))) {
+    num_children >>= 1;
+    ++bucket;
+  }
+  ++levels_[level].fanouts[bucket];
+}
+
+void Description::add_key_depth(std::size_t depth) {
+  ++key_depths_[(depth < NUM_DEPTH_BUCKETS) ?
+      depth : (NUM_DEPTH_BUCKETS - 1)];
+}
+
+void Description::clear() {
+  Description().swap(*this);
+}
+
+void Description::swap(Description &rhs) {
+  levels_.swap(rhs.levels_);
+  marisa::swap(num_levels_, rhs.num_levels_);
+  for (std::size_t i = 0; i < NUM_DEPTH_BUCKETS; ++i) {
+    marisa::swap(key_depths_[i], rhs.key_depths_[i]);
+  }
+}
+
+}  // namespace marisa
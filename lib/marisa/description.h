@@ -0,0 +1,113 @@
+#ifndef MARISA_DESCRIPTION_H_
+#define MARISA_DESCRIPTION_H_
+
+#include "marisa/base.h"
+#include "marisa/scoped-array.h"
+
+namespace marisa {
+
+// Description reports the structure of a dictionary, which is filled by
+// Trie::describe(). A dictionary consists of levels, one for each trie,
+// where level 0 is the top trie and the last level has the TAIL if any.
+// The sizes are in bytes, and the sizes of all the levels add up to
+// Trie::total_size().
+class Description {
+ public:
+  enum {
+    // A fan-out histogram counts nodes with 0 children in bucket 0 and with
+    // [2^(i-1), 2^i) children in bucket i.
+    NUM_FANOUT_BUCKETS  = 10,
+    // A key depth histogram counts keys by the number of nodes of the top
+    // trie from the root, and the last bucket counts deeper keys as well.
+    NUM_DEPTH_BUCKETS   = 33
+  };
+
+  typedef enum Item_ {
+    NUM_NODES,
+    // NUM_TERMINALS is the number of keys in level 0. It is 0 in the other
+    // levels because the previous level refers to their nodes by IDs.
+    NUM_TERMINALS,
+    // NUM_LINKS is the number of nodes which refer to the next level or
+    // TAIL for the rest of their labels.
+    NUM_LINKS,
+    // Each bit vector is divided into the bits, the rank index and the
+    // select indexes.
+    LOUDS_BITS_SIZE,
+    LOUDS_RANK_SIZE,
+    LOUDS_SELECT_SIZE,
+    TERMINAL_BITS_SIZE,
+    TERMINAL_RANK_SIZE,
+    TERMINAL_SELECT_SIZE,
+    LINK_BITS_SIZE,
+    LINK_RANK_SIZE,
+    LINK_SELECT_SIZE,
+    // BASES_SIZE and EXTRAS_SIZE are for the labels and the upper bits of
+    // the links.
+    BASES_SIZE,
+    EXTRAS_SIZE,
+    CACHE_SIZE,
+    NUM_CACHE_ENTRIES,
+    NUM_FILLED_CACHE_ENTRIES,
+    ROOT_TABLE_SIZE,
+    // TAIL_SIZE includes the end flags of a binary TAIL. TAIL_LENGTH is the
+    // number of bytes of the suffixes stored in TAIL, and SUFFIX_LENGTH is
+    // the number of bytes they would take if no suffix were shared.
+    TAIL_SIZE,
+    TAIL_LENGTH,
+    SUFFIX_LENGTH,
+    NUM_ITEMS
+  } Item;
+
+  Description();
+  ~Description();
+
+  std::size_t num_levels() const {
+    return num_levels_;
+  }
+
+  std::size_t get(std::size_t level, Item item) const;
+  std::size_t fanout(std::size_t level, std::size_t bucket) const;
+  std::size_t key_depth(std::size_t bucket) const;
+
+  // The following functions give ratios in [0, 1]: link_ratio() is the
+  // ratio of NUM_LINKS to NUM_NODES, cache_fill_ratio() is that of
+  // NUM_FILLED_CACHE_ENTRIES to NUM_CACHE_ENTRIES, and sharing_ratio() is
+  // the ratio of SUFFIX_LENGTH saved by sharing suffixes in TAIL.
+  double link_ratio(std::size_t level) const;
+  double cache_fill_ratio(std::size_t level) const;
+  double sharing_ratio() const;
+
+  // size() returns the sum of the sizes of a level.
+  std::size_t size(std::size_t level) const;
+
+  // item_name() returns a lowercase name with underscores, which is usable
+  // as a JSON key.
+  static const char *item_name(Item item);
+
+  // The following functions are used by Trie::describe().
+  void resize(std::size_t num_levels);
+  void add(std::size_t level, Item item, std::size_t value);
+  void add_fanout(std::size_t level, std::size_t num_children);
+  void add_key_depth(std::size_t depth);
+
+  void clear();
+  void swap(Description &rhs);
+
+ private:
+  struct Level {
+    std::size_t items[NUM_ITEMS];
+    std::size_t fanouts[NUM_FANOUT_BUCKETS];
+  };
+
+  scoped_array<Level> levels_;
+  std::size_t num_levels_;
+  std::size_t key_depths_[NUM_DEPTH_BUCKETS];
+
+  // Disallows copy and assignment.
+  Description(const Description &);
+  Description &operator=(const Description &);
+};
+
+}  // namespace marisa
+
+#endif  // MARISA_DESCRIPTION_H_
@@ -112,4 +112,14 @@
  #endif  // MARISA_WORD_SIZE == 64
 #endif  // _MSC_VER
 
+// MARISA_PREFETCH() hints that the cache line at `ptr' is read soon.
+#if defined(__GNUC__)
+ #define MARISA_PREFETCH(ptr) __builtin_prefetch(ptr)
+#elif defined(_MSC_VER) && (defined(MARISA_X64) || defined(MARISA_X86))
+ #include <xmmintrin.h>
+ #define MARISA_PREFETCH(ptr) _mm_prefetch((const char *)(ptr), _MM_HINT_T0)
+#else  // defined(_MSC_VER) && (defined(MARISA_X64) || defined(MARISA_X86))
+ #define MARISA_PREFETCH(ptr) ((void)0)
+#endif  // defined(__GNUC__)
+
 #endif  // MARISA_GRIMOIRE_INTRIN_H_
@@ -1,14 +1,18 @@
 #ifndef MARISA_GRIMOIRE_IO_H_
 #define MARISA_GRIMOIRE_IO_H_
 
+#include "marisa/grimoire/io/crc32c.h"
 #include "marisa/grimoire/io/mapper.h"
+#include "marisa/grimoire/io/prefetcher.h"
 #include "marisa/grimoire/io/reader.h"
 #include "marisa/grimoire/io/writer.h"
 
 namespace marisa {
 namespace grimoire {
 
+using io::Crc32c;
 using io::Mapper;
+using io::Prefetcher;
 using io::Reader;
 using io::Writer;
 
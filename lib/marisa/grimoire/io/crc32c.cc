@@ -0,0 +1,79 @@
+#include <cstring>
+
+#include "marisa/grimoire/intrin.h"
+#include "marisa/grimoire/io/crc32c.h"
+
+#ifdef MARISA_USE_SSE4_2
+ #ifdef _MSC_VER
+  #include <intrin.h>
+ #else  // _MSC_VER
+  #include <nmmintrin.h>
+ #endif  // _MSC_VER
+#endif  // MARISA_USE_SSE4_2
+
+namespace marisa {
+namespace grimoire {
+namespace io {
+namespace {
+
+#ifndef MARISA_USE_SSE4_2
+class Table {
+ public:
+  Table() : table_() {
+    for (UInt32 i = 0; i < 256; ++i) {
+      UInt32 crc = i;
+      for (int j = 0; j < 8; ++j) {
+        crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78U : 0);
+      }
+      table_[i] = crc;
+    }
+  }
+
+  UInt32 operator[](std::size_t i) const {
+    return table_[i];
+  }
+
+ private:
+  UInt32 table_[256];
+};
+
+// The table is built before main() so that update() is thread-safe.
+const Table TABLE;
+#endif  // MARISA_USE_SSE4_2
+
+}  // namespace
+
+void Crc32c::update(const void *data, std::size_t size) {
+  MARISA_THROW_IF((data == NULL) && (size != 0), MARISA_NULL_ERROR);
+
+  const UInt8 *ptr = static_cast<const UInt8 *>(data);
+  UInt32 crc = crc_;
+#ifdef MARISA_USE_SSE4_2
+ #ifdef MARISA_X64
+  for ( ; size >= 8; ptr += 8, size -= 8) {
+    UInt64 unit;
+    std::memcpy(&unit, ptr, sizeof(unit));
+    crc = (UInt32)_mm_crc32_u64(crc, unit);
+  }
+ #else  // MARISA_X64
+  for ( ; size >= 4; ptr += 4, size -= 4) {
+    UInt32 unit;
+    std::memcpy(&unit, ptr, sizeof(unit));
+    crc = _mm_crc32_u32(crc, unit);
+  }
+ #endif  // MARISA_X64
+  for ( ; size != 0; ++ptr, --size) {
+    crc = _mm_crc32_u8(crc, *ptr);
+  }
+#else  // MARISA_USE_SSE4_2
+  for ( ; size != 0; ++ptr, --size) {
+    crc = TABLE[(crc ^ *ptr) & 0xFF] ^ (crc >> 8);
+  }
+#endif  // MARISA_USE_SSE4_2
+  crc_ = crc;
+  size_ += (UInt64)(ptr - static_cast<const UInt8 *>(data));
+}
+
+}  // namespace io
+}  // namespace grimoire
+}  // namespace marisa
@@ -0,0 +1,52 @@
+#ifndef MARISA_GRIMOIRE_IO_CRC32C_H_
+#define MARISA_GRIMOIRE_IO_CRC32C_H_
+
+#include "marisa/base.h"
+
+namespace marisa {
+namespace grimoire {
+namespace io {
+
+// Crc32c computes the CRC-32C (Castagnoli) checksum of a byte sequence given
+// in one or more pieces. It also counts the number of bytes.
+class Crc32c {
+ public:
+  Crc32c() : crc_(0xFFFFFFFFU), size_(0) {}
+
+  void update(const void *data, std::size_t size);
+
+  UInt32 value() const {
+    return crc_ ^ 0xFFFFFFFFU;
+  }
+  UInt64 size() const {
+    return size_;
+  }
+
+  void clear() {
+    Crc32c().swap(*this);
+  }
+  void swap(Crc32c &rhs) {
+    marisa::swap(crc_, rhs.crc_);
+    marisa::swap(size_, rhs.size_);
+  }
+
+  static UInt32 compute(const void *data, std::size_t size) {
+    Crc32c crc;
+    crc.update(data, size);
+    return crc.value();
+  }
+
+ private:
+  UInt32 crc_;
+  UInt64 size_;
+
+  // Disallows copy and assignment.
+  Crc32c(const Crc32c &);
+  Crc32c &operator=(const Crc32c &);
+};
+
+}  // namespace io
+}  // namespace grimoire
+}  // namespace marisa
+
+#endif  // MARISA_GRIMOIRE_IO_CRC32C_H_
@@ -15,6 +15,27 @@
 namespace marisa {
 namespace grimoire {
 namespace io {
+namespace {
+
+// read_() reads a file in chunks of READ_CHUNK_SIZE bytes, which is small
+// enough for a single read() on any platform.
+const std::size_t READ_CHUNK_SIZE = (std::size_t)1 << 30;
+
+#if !(defined _WIN32) && !(defined _WIN64)
+const std::size_t HUGE_PAGE_SIZE = (std::size_t)2 << 20;
+#endif  // !(defined _WIN32) && !(defined _WIN64)
+
+// touch_pages() reads a byte of each page so that the whole range is faulted
+// in before it is used.
+void touch_pages(const void *ptr, std::size_t size) {
+  const std::size_t page_size = Mapper::page_size();
+  const volatile char * const bytes = static_cast<const volatile char *>(ptr);
+  for (std::size_t i = 0; i < size; i += page_size) {
+    (void)bytes[i];
+  }
+}
+
+}  // namespace
 
 #if (defined _WIN32) || (defined _WIN64)
 Mapper::Mapper()
@@ -28,7 +49,12 @@ Mapper::Mapper()
 #if (defined _WIN32) || (defined _WIN64)
 Mapper::~Mapper() {
   if (origin_ != NULL) {
-    ::UnmapViewOfFile(origin_);
+    // A region without a file mapping has been read by read_().
+    if (map_ != NULL) {
+      ::UnmapViewOfFile(origin_);
+    } else {
+      ::VirtualFree(origin_, 0, MEM_RELEASE);
+    }
   }
 
   if (map_ != NULL) {
@@ -51,11 +77,22 @@ Mapper::~Mapper() {
 }
 #endif  // (defined _WIN32) || (defined _WIN64)
 
-void Mapper::open(const char *filename) {
+std::size_t Mapper::page_size() {
+#if (defined _WIN32) || (defined _WIN64)
+  SYSTEM_INFO info;
+  ::GetSystemInfo(&info);
+  return (std::size_t)info.dwPageSize;
+#else  // (defined _WIN32) || (defined _WIN64)
+  const long page_size = ::sysconf(_SC_PAGESIZE);
+  return (page_size > 0) ? (std::size_t)page_size : 4096;
+#endif  // (defined _WIN32) || (defined _WIN64)
+}
+
+void Mapper::open(const char *filename, int map_flags) {
   MARISA_THROW_IF(filename == NULL, MARISA_NULL_ERROR);
 
   Mapper temp;
-  temp.open_(filename);
+  temp.open_(filename, map_flags);
   swap(temp);
 }
 
@@ -67,6 +104,18 @@ void Mapper::open(const void *ptr, std::size_t size) {
   swap(temp);
 }
 
+void Mapper::open(const Mapper &mapper, std::size_t offset,
+    std::size_t size) {
+  MARISA_THROW_IF(!mapper.is_open(), MARISA_STATE_ERROR);
+  MARISA_THROW_IF(offset > mapper.avail_, MARISA_IO_ERROR);
+  MARISA_THROW_IF(size > (mapper.avail_ - offset), MARISA_IO_ERROR);
+
+  Mapper temp;
+  temp.open_(static_cast<const void *>(
+      static_cast<const char *>(mapper.ptr_) + offset), size);
+  swap(temp);
+}
+
 void Mapper::seek(std::size_t size) {
   MARISA_THROW_IF(!is_open(), MARISA_STATE_ERROR);
   MARISA_THROW_IF(size > avail_, MARISA_IO_ERROR);
@@ -74,6 +123,99 @@ void Mapper::seek(std::size_t size) {
   map_data(size);
 }
 
+#if (defined _WIN32) || (defined _WIN64)
+void Mapper::advise(std::size_t offset, std::size_t size,
+    Advice advice) const {
+  MARISA_THROW_IF(!is_open(), MARISA_STATE_ERROR);
+  MARISA_THROW_IF(offset > avail_, MARISA_IO_ERROR);
+  MARISA_THROW_IF(size > (avail_ - offset), MARISA_IO_ERROR);
+  MARISA_THROW_IF((advice != NORMAL_ADVICE) && (advice != RANDOM_ADVICE) &&
+      (advice != WILLNEED_ADVICE), MARISA_CODE_ERROR);
+}
+#else  // (defined _WIN32) || (defined _WIN64)
+void Mapper::advise(std::size_t offset, std::size_t size,
+    Advice advice) const {
+  MARISA_THROW_IF(!is_open(), MARISA_STATE_ERROR);
+  MARISA_THROW_IF(offset > avail_, MARISA_IO_ERROR);
+  MARISA_THROW_IF(size > (avail_ - offset), MARISA_IO_ERROR);
+
+  int native_advice = MADV_NORMAL;
+  switch (advice) {
+    case NORMAL_ADVICE: {
+      native_advice = MADV_NORMAL;
+      break;
+    }
+    case RANDOM_ADVICE: {
+      native_advice = MADV_RANDOM;
+      break;
+    }
+    case WILLNEED_ADVICE: {
+      native_advice = MADV_WILLNEED;
+      break;
+    }
+    default: {
+      MARISA_THROW(MARISA_CODE_ERROR, "undefined advice");
+    }
+  }
+  if ((origin_ == MAP_FAILED) || (size == 0)) {
+    return;
+  }
+
+  // madvise() requires a page-aligned address. A failure is ignored because
+  // the advice is only a hint.
+  const char * const ptr = static_cast<const char *>(ptr_) + offset;
+  const std::size_t gap = (std::size_t)(ptr - static_cast<char *>(origin_))
+      % Mapper::page_size();
+  ::madvise(const_cast<char *>(ptr - gap), size + gap, native_advice);
+}
+#endif  // (defined _WIN32) || (defined _WIN64)
+
+#if (defined _WIN32) || (defined _WIN64)
+std::size_t Mapper::mapped_size() const {
+  return (origin_ != NULL) ? size_ : 0;
+}
+
+std::size_t Mapper::resident_size() const {
+  return mapped_size();
+}
+#else  // (defined _WIN32) || (defined _WIN64)
+std::size_t Mapper::mapped_size() const {
+  return (origin_ != MAP_FAILED) ? size_ : 0;
+}
+
+std::size_t Mapper::resident_size() const {
+  if (mapped_size() == 0) {
+    return 0;
+  }
+
+ #ifdef __linux__
+  typedef unsigned char Flag;
+ #else  // __linux__
+  typedef char Flag;
+ #endif  // __linux__
+  static const std::size_t CHUNK_SIZE = 4096;
+  Flag flags[CHUNK_SIZE];
+
+  const std::size_t page_size = Mapper::page_size();
+  const std::size_t num_pages = (size_ + page_size - 1) / page_size;
+  std::size_t num_resident_pages = 0;
+  for (std::size_t i = 0; i < num_pages; i += CHUNK_SIZE) {
+    const std::size_t count = ((num_pages - i) < CHUNK_SIZE) ?
+        (num_pages - i) : CHUNK_SIZE;
+    const std::size_t offset = i * page_size;
+    const std::size_t length = ((size_ - offset) < (count * page_size)) ?
+        (size_ - offset) : (count * page_size);
+    MARISA_THROW_IF(::mincore(static_cast<char *>(origin_) + offset,
+        length, flags) != 0, MARISA_IO_ERROR);
+    for (std::size_t j = 0; j < count; ++j) {
+      num_resident_pages += flags[j] & 1;
+    }
+  }
+  const std::size_t resident_size = num_resident_pages * page_size;
+  return (resident_size < size_) ? resident_size : size_;
+}
+#endif  // (defined _WIN32) || (defined _WIN64)
+
 bool Mapper::is_open() const {
   return ptr_ != NULL;
 }
@@ -111,7 +253,9 @@ const void *Mapper::map_data(std::size_t size) {
    #define MARISA_HAS_STAT64
   #endif  // __MSVCRT_VERSION__ >= 0x0601
  #endif  // __MSVCRT_VERSION__
-void Mapper::open_(const char *filename) {
+std::size_t Mapper::file_size(const char *filename) {
+  MARISA_THROW_IF(filename == NULL, MARISA_NULL_ERROR);
+
  #ifdef MARISA_HAS_STAT64
   struct __stat64 st;
   MARISA_THROW_IF(::_stat64(filename, &st) != 0, MARISA_IO_ERROR);
@@ -120,7 +264,16 @@ void Mapper::open_(const char *filename) {
   MARISA_THROW_IF(::_stat(filename, &st) != 0, MARISA_IO_ERROR);
  #endif  // MARISA_HAS_STAT64
   MARISA_THROW_IF((UInt64)st.st_size > MARISA_SIZE_MAX, MARISA_SIZE_ERROR);
-  size_ = (std::size_t)st.st_size;
+  return (std::size_t)st.st_size;
+}
+
+void Mapper::open_(const char *filename, int map_flags) {
+  if ((map_flags & MARISA_MAP_READ) != 0) {
+    read_(filename, map_flags);
+    return;
+  }
+
+  size_ = file_size(filename);
 
   file_ = ::CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ,
       NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
@@ -132,22 +285,166 @@ void Mapper::open_(const char *filename) {
   origin_ = ::MapViewOfFile(map_, FILE_MAP_READ, 0, 0, 0);
   MARISA_THROW_IF(origin_ == NULL, MARISA_IO_ERROR);
 
+  if ((map_flags & MARISA_MAP_POPULATE) != 0) {
+    touch_pages(origin_, size_);
+  }
+  if ((map_flags & MARISA_MAP_LOCK) != 0) {
+    MARISA_THROW_IF(!::VirtualLock(origin_, size_), MARISA_IO_ERROR);
+  }
+
+  ptr_ = static_cast<const char *>(origin_);
+  avail_ = size_;
+}
+
+void Mapper::read_(const char *filename, int map_flags) {
+  file_ = ::CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ,
+      NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  MARISA_THROW_IF(file_ == INVALID_HANDLE_VALUE, MARISA_IO_ERROR);
+
+  LARGE_INTEGER file_size;
+  MARISA_THROW_IF(!::GetFileSizeEx(file_, &file_size), MARISA_IO_ERROR);
+  MARISA_THROW_IF((UInt64)file_size.QuadPart > MARISA_SIZE_MAX,
+      MARISA_SIZE_ERROR);
+  size_ = (std::size_t)file_size.QuadPart;
+  MARISA_THROW_IF(size_ == 0, MARISA_IO_ERROR);
+
+  origin_ = ::VirtualAlloc(NULL, size_, MEM_COMMIT | MEM_RESERVE,
+      PAGE_READWRITE);
+  MARISA_THROW_IF(origin_ == NULL, MARISA_MEMORY_ERROR);
+
+  char * const buf = static_cast<char *>(origin_);
+  for (std::size_t offset = 0; offset < size_; ) {
+    const std::size_t count = ((size_ - offset) < READ_CHUNK_SIZE) ?
+        (size_ - offset) : READ_CHUNK_SIZE;
+    DWORD size_read;
+    MARISA_THROW_IF(!::ReadFile(file_, buf + offset, (DWORD)count,
+        &size_read, NULL), MARISA_IO_ERROR);
+    MARISA_THROW_IF(size_read == 0, MARISA_IO_ERROR);
+    offset += size_read;
+  }
+  ::CloseHandle(file_);
+  file_ = NULL;
+
+  DWORD old_protect;
+  ::VirtualProtect(origin_, size_, PAGE_READONLY, &old_protect);
+  if ((map_flags & MARISA_MAP_LOCK) != 0) {
+    MARISA_THROW_IF(!::VirtualLock(origin_, size_), MARISA_IO_ERROR);
+  }
+
   ptr_ = static_cast<const char *>(origin_);
   avail_ = size_;
 }
 #else  // (defined _WIN32) || (defined _WIN64)
-void Mapper::open_(const char *filename) {
+std::size_t Mapper::file_size(const char *filename) {
+  MARISA_THROW_IF(filename == NULL, MARISA_NULL_ERROR);
+
   struct stat st;
   MARISA_THROW_IF(::stat(filename, &st) != 0, MARISA_IO_ERROR);
   MARISA_THROW_IF((UInt64)st.st_size > MARISA_SIZE_MAX, MARISA_SIZE_ERROR);
-  size_ = (std::size_t)st.st_size;
+  return (std::size_t)st.st_size;
+}
+
+void Mapper::open_(const char *filename, int map_flags) {
+  if ((map_flags & MARISA_MAP_READ) != 0) {
+    read_(filename, map_flags);
+    return;
+  }
+
+  size_ = file_size(filename);
 
   fd_ = ::open(filename, O_RDONLY);
   MARISA_THROW_IF(fd_ == -1, MARISA_IO_ERROR);
 
-  origin_ = ::mmap(NULL, size_, PROT_READ, MAP_SHARED, fd_, 0);
+  // MAP_POPULATE is not used with huge pages because the pages would be
+  // faulted in before the hint is given.
+  int mmap_flags = MAP_SHARED;
+  bool needs_populate = (map_flags & MARISA_MAP_POPULATE) != 0;
+ #ifdef MAP_POPULATE
+  if (needs_populate && ((map_flags & MARISA_MAP_HUGE_PAGES) == 0)) {
+    mmap_flags |= MAP_POPULATE;
+    needs_populate = false;
+  }
+ #endif  // MAP_POPULATE
+  origin_ = ::mmap(NULL, size_, PROT_READ, mmap_flags, fd_, 0);
   MARISA_THROW_IF(origin_ == MAP_FAILED, MARISA_IO_ERROR);
 
+ #ifdef MADV_HUGEPAGE
+  if ((map_flags & MARISA_MAP_HUGE_PAGES) != 0) {
+    ::madvise(origin_, size_, MADV_HUGEPAGE);
+  }
+ #endif  // MADV_HUGEPAGE
+  if (needs_populate) {
+    touch_pages(origin_, size_);
+  }
+  if ((map_flags & MARISA_MAP_LOCK) != 0) {
+    MARISA_THROW_IF(::mlock(origin_, size_) != 0, MARISA_IO_ERROR);
+  }
+
+  ptr_ = static_cast<const char *>(origin_);
+  avail_ = size_;
+}
+
+void Mapper::read_(const char *filename, int map_flags) {
+  fd_ = ::open(filename, O_RDONLY);
+  MARISA_THROW_IF(fd_ == -1, MARISA_IO_ERROR);
+
+  struct stat st;
+  MARISA_THROW_IF(::fstat(fd_, &st) != 0, MARISA_IO_ERROR);
+  MARISA_THROW_IF((UInt64)st.st_size > MARISA_SIZE_MAX, MARISA_SIZE_ERROR);
+  size_ = (std::size_t)st.st_size;
+  MARISA_THROW_IF(size_ == 0, MARISA_IO_ERROR);
+
+  // An anonymous mapping, unlike a file mapping, can be backed by
+  // transparent huge pages. For huge pages, the region is aligned to
+  // HUGE_PAGE_SIZE by trimming a larger mapping.
+  const bool uses_huge_pages = (map_flags & MARISA_MAP_HUGE_PAGES) != 0;
+  const std::size_t extra_size = uses_huge_pages ? HUGE_PAGE_SIZE : 0;
+  MARISA_THROW_IF(size_ > (MARISA_SIZE_MAX - extra_size), MARISA_SIZE_ERROR);
+  void * const region = ::mmap(NULL, size_ + extra_size,
+      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  MARISA_THROW_IF(region == MAP_FAILED, MARISA_MEMORY_ERROR);
+  if (uses_huge_pages) {
+    char * const begin = static_cast<char *>(region);
+    const std::size_t head_size =
+        (HUGE_PAGE_SIZE - ((std::size_t)begin % HUGE_PAGE_SIZE)) %
+        HUGE_PAGE_SIZE;
+    const std::size_t page_size = Mapper::page_size();
+    const std::size_t tail_offset = head_size +
+        (((size_ + page_size - 1) / page_size) * page_size);
+    if (head_size != 0) {
+      ::munmap(begin, head_size);
+    }
+    if (tail_offset < (size_ + extra_size)) {
+      ::munmap(begin + tail_offset, size_ + extra_size - tail_offset);
+    }
+    origin_ = begin + head_size;
+ #ifdef MADV_HUGEPAGE
+    ::madvise(origin_, size_, MADV_HUGEPAGE);
+ #endif  // MADV_HUGEPAGE
+  } else {
+    origin_ = region;
+  }
+ #ifdef POSIX_FADV_SEQUENTIAL
+  ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+ #endif  // POSIX_FADV_SEQUENTIAL
+
+  char * const buf = static_cast<char *>(origin_);
+  for (std::size_t offset = 0; offset < size_; ) {
+    const std::size_t count = ((size_ - offset) < READ_CHUNK_SIZE) ?
+        (size_ - offset) : READ_CHUNK_SIZE;
+    const ::ssize_t size_read = ::pread(fd_, buf + offset, count,
+        (::off_t)offset);
+    MARISA_THROW_IF(size_read <= 0, MARISA_IO_ERROR);
+    offset += (std::size_t)size_read;
+  }
+  ::close(fd_);
+  fd_ = -1;
+
+  ::mprotect(origin_, size_, PROT_READ);
+  if ((map_flags & MARISA_MAP_LOCK) != 0) {
+    MARISA_THROW_IF(::mlock(origin_, size_) != 0, MARISA_IO_ERROR);
+  }
+
   ptr_ = static_cast<const char *>(origin_);
   avail_ = size_;
 }
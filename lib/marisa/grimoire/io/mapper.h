@@ -11,11 +11,23 @@ namespace io {
 
 class Mapper {
  public:
+  enum Advice {
+    NORMAL_ADVICE    = 0,
+    RANDOM_ADVICE    = 1,
+    WILLNEED_ADVICE  = 2
+  };
+
   Mapper();
   ~Mapper();
 
-  void open(const char *filename);
+  // `map_flags' is a combination of marisa_map_flags, of which
+  // MARISA_MAP_ADVISE is left to the caller.
+  void open(const char *filename, int map_flags = MARISA_DEFAULT_MAP);
   void open(const void *ptr, std::size_t size);
+  // open() with a mapper opens a view of `size' bytes starting at `offset'
+  // bytes after the current position of `mapper'. The view does not own the
+  // mapping, so `mapper' must outlive it.
+  void open(const Mapper &mapper, std::size_t offset, std::size_t size);
 
   template <typename T>
   void map(T *obj) {
@@ -33,8 +45,29 @@ class Mapper {
 
   void seek(std::size_t size);
 
+  // advise() gives a hint about `size' bytes starting at `offset' bytes after
+  // the current position. It does nothing unless the mapper owns a mapping.
+  void advise(std::size_t offset, std::size_t size, Advice advice) const;
+
   bool is_open() const;
 
+  // avail() returns the number of bytes that have not been mapped yet.
+  std::size_t avail() const {
+    return avail_;
+  }
+
+  // mapped_size() returns the size of the mapping owned by the mapper and
+  // resident_size() returns how much of it is resident in memory. Both are 0
+  // if the mapper does not own a mapping. Where residency is not available,
+  // the whole mapping is counted as resident.
+  std::size_t mapped_size() const;
+  std::size_t resident_size() const;
+
+  static std::size_t page_size();
+  // file_size() returns the size of a file, which cannot be mapped if it is
+  // empty.
+  static std::size_t file_size(const char *filename);
+
   void clear();
   void swap(Mapper &rhs);
 
@@ -50,7 +83,8 @@ class Mapper {
   int fd_;
 #endif  // (defined _WIN32) || (defined _WIN64)
 
-  void open_(const char *filename);
+  void open_(const char *filename, int map_flags);
+  void read_(const char *filename, int map_flags);
   void open_(const void *ptr, std::size_t size);
 
   const void *map_data(std::size_t size);
@@ -0,0 +1,141 @@
+#if (defined _WIN32) || (defined _WIN64)
+ #include <windows.h>
+#else  // (defined _WIN32) || (defined _WIN64)
+ #include <sys/mman.h>
+#endif  // (defined _WIN32) || (defined _WIN64)
+
+#include <new>
+
+#include "marisa/grimoire/io/mapper.h"
+#include "marisa/grimoire/io/prefetcher.h"
+#include "marisa/grimoire/thread/atomic.h"
+
+namespace marisa {
+namespace grimoire {
+namespace io {
+
+Prefetcher::Prefetcher()
+    : regions_(), num_regions_(0), capacity_(0), total_size_(0), budget_(0),
+      stop_flag_(0), thread_() {}
+
+Prefetcher::~Prefetcher() {
+  stop();
+}
+
+void Prefetcher::add(const void *ptr, std::size_t size) {
+  MARISA_THROW_IF((ptr == NULL) && (size != 0), MARISA_NULL_ERROR);
+  MARISA_THROW_IF(is_running(), MARISA_STATE_ERROR);
+  if (size == 0) {
+    return;
+  }
+
+  if (num_regions_ == capacity_) {
+    const std::size_t new_capacity = (capacity_ != 0) ? (capacity_ * 2) : 16;
+    scoped_array<Region> new_regions(new (std::nothrow) Region[new_capacity]);
+    MARISA_THROW_IF(new_regions.get() == NULL, MARISA_MEMORY_ERROR);
+    for (std::size_t i = 0; i < num_regions_; ++i) {
+      new_regions[i] = regions_[i];
+    }
+    regions_.swap(new_regions);
+    capacity_ = new_capacity;
+  }
+  regions_[num_regions_].ptr = static_cast<const char *>(ptr);
+  regions_[num_regions_].size = size;
+  ++num_regions_;
+  total_size_ += size;
+}
+
+std::size_t Prefetcher::run(std::size_t budget) {
+  MARISA_THROW_IF(is_running(), MARISA_STATE_ERROR);
+  touch(budget);
+  return (budget < total_size_) ? budget : total_size_;
+}
+
+std::size_t Prefetcher::start(std::size_t budget) {
+  stop();
+  budget_ = budget;
+  stop_flag_ = 0;
+  thread_.start(run_thread, this);
+  return (budget < total_size_) ? budget : total_size_;
+}
+
+void Prefetcher::stop() {
+  if (is_running()) {
+    thread::atomic_add(&stop_flag_, 1);
+    thread_.join();
+  }
+}
+
+std::size_t Prefetcher::lock() const {
+  return lock_(true);
+}
+
+std::size_t Prefetcher::lock_size() const {
+  return lock_(false);
+}
+
+void Prefetcher::clear() {
+  Prefetcher().swap(*this);
+}
+
+void Prefetcher::swap(Prefetcher &rhs) {
+  MARISA_THROW_IF(is_running() || rhs.is_running(), MARISA_STATE_ERROR);
+  regions_.swap(rhs.regions_);
+  marisa::swap(num_regions_, rhs.num_regions_);
+  marisa::swap(capacity_, rhs.capacity_);
+  marisa::swap(total_size_, rhs.total_size_);
+  marisa::swap(budget_, rhs.budget_);
+}
+
+void Prefetcher::touch(std::size_t budget) {
+  // A byte is read from each page of a region. The first byte of a region is
+  // read even if the region does not start at a page boundary.
+  const std::size_t page_size = Mapper::page_size();
+  for (std::size_t i = 0; (i < num_regions_) && (budget != 0); ++i) {
+    const char * const ptr = regions_[i].ptr;
+    const std::size_t size = (regions_[i].size < budget) ?
+        regions_[i].size : budget;
+    const volatile char * const bytes = ptr;
+    (void)bytes[0];
+    const std::size_t gap =
+        (page_size - ((std::size_t)ptr % page_size)) % page_size;
+    for (std::size_t j = gap; j < size; j += page_size) {
+      if (thread::atomic_load(&stop_flag_) != 0) {
+        return;
+      }
+      (void)bytes[j];
+    }
+    budget -= size;
+  }
+}
+
+std::size_t Prefetcher::lock_(bool locks) const {
+  // Regions are extended to page boundaries. Adjacent regions may share a
+  // page, which is counted for each of them.
+  const std::size_t page_size = Mapper::page_size();
+  std::size_t num_bytes = 0;
+  for (std::size_t i = 0; i < num_regions_; ++i) {
+    const std::size_t gap = (std::size_t)regions_[i].ptr % page_size;
+    const std::size_t size =
+        ((regions_[i].size + gap + page_size - 1) / page_size) * page_size;
+    if (locks) {
+      char * const ptr = const_cast<char *>(regions_[i].ptr - gap);
+#if (defined _WIN32) || (defined _WIN64)
+      MARISA_THROW_IF(!::VirtualLock(ptr, size), MARISA_IO_ERROR);
+#else  // (defined _WIN32) || (defined _WIN64)
+      MARISA_THROW_IF(::mlock(ptr, size) != 0, MARISA_IO_ERROR);
+#endif  // (defined _WIN32) || (defined _WIN64)
+    }
+    num_bytes += size;
+  }
+  return num_bytes;
+}
+
+void Prefetcher::run_thread(void *arg) {
+  Prefetcher * const prefetcher = static_cast<Prefetcher *>(arg);
+  prefetcher->touch(prefetcher->budget_);
+}
+
+}  // namespace io
+}  // namespace grimoire
+}  // namespace marisa
@@ -0,0 +1,82 @@
+#ifndef MARISA_GRIMOIRE_IO_PREFETCHER_H_
+#define MARISA_GRIMOIRE_IO_PREFETCHER_H_
+
+#include "marisa/grimoire/thread/thread.h"
+
+namespace marisa {
+namespace grimoire {
+namespace io {
+
+// Prefetcher touches the pages of memory regions in the order they are
+// added, so that the regions are resident before they are used. Regions
+// are touched on the calling thread by run() or on a background thread by
+// start(), which is stopped by stop() or on destruction.
+class Prefetcher {
+ public:
+  Prefetcher();
+  ~Prefetcher();
+
+  void add(const void *ptr, std::size_t size);
+
+  template <typename T>
+  void add(const T &objs) {
+    add(objs.begin(), objs.total_size());
+  }
+
+  // run() and start() touch the first `budget' bytes of the regions and
+  // return the number of bytes to be touched.
+  std::size_t run(std::size_t budget);
+  std::size_t start(std::size_t budget);
+  void stop();
+
+  // lock() locks the pages of the regions in memory and returns the number
+  // of bytes locked, which is rounded to pages. The pages stay locked until
+  // they are unmapped, so the regions should be in a mapping of their own.
+  // lock() throws MARISA_IO_ERROR if a lock fails. lock_size() returns the
+  // number of bytes to be locked.
+  std::size_t lock() const;
+  std::size_t lock_size() const;
+
+  bool is_running() const {
+    return thread_.joinable();
+  }
+
+  std::size_t num_regions() const {
+    return num_regions_;
+  }
+  std::size_t total_size() const {
+    return total_size_;
+  }
+
+  void clear();
+  void swap(Prefetcher &rhs);
+
+ private:
+  struct Region {
+    const char *ptr;
+    std::size_t size;
+  };
+
+  scoped_array<Region> regions_;
+  std::size_t num_regions_;
+  std::size_t capacity_;
+  std::size_t total_size_;
+  std::size_t budget_;
+  volatile std::size_t stop_flag_;
+  thread::Thread thread_;
+
+  void touch(std::size_t budget);
+  std::size_t lock_(bool locks) const;
+
+  static void run_thread(void *arg);
+
+  // Disallows copy and assignment.
+  Prefetcher(const Prefetcher &);
+  Prefetcher &operator=(const Prefetcher &);
+};
+
+}  // namespace io
+}  // namespace grimoire
+}  // namespace marisa
+
+#endif  // MARISA_GRIMOIRE_IO_PREFETCHER_H_
@@ -15,7 +15,8 @@ namespace grimoire {
 namespace io {
 
 Reader::Reader()
-    : file_(NULL), fd_(-1), stream_(NULL), needs_fclose_(false) {}
+    : file_(NULL), fd_(-1), stream_(NULL), needs_fclose_(false),
+      checksum_(NULL), limit_(MARISA_SIZE_MAX) {}
 
 Reader::~Reader() {
   if (needs_fclose_) {
@@ -62,6 +63,8 @@ void Reader::swap(Reader &rhs) {
   marisa::swap(fd_, rhs.fd_);
   marisa::swap(stream_, rhs.stream_);
   marisa::swap(needs_fclose_, rhs.needs_fclose_);
+  marisa::swap(checksum_, rhs.checksum_);
+  marisa::swap(limit_, rhs.limit_);
 }
 
 void Reader::seek(std::size_t size) {
@@ -111,6 +114,10 @@ void Reader::open_(std::istream &stream) {
 
 void Reader::read_data(void *buf, std::size_t size) {
   MARISA_THROW_IF(!is_open(), MARISA_STATE_ERROR);
+  MARISA_THROW_IF(size > limit_, MARISA_FORMAT_ERROR);
+  limit_ -= size;
+  void * const begin = buf;
+  const std::size_t total_size = size;
   if (size == 0) {
     return;
   } else if (fd_ != -1) {
@@ -140,6 +147,9 @@ void Reader::read_data(void *buf, std::size_t size) {
       MARISA_THROW(MARISA_IO_ERROR, "std::ios_base::failure");
     }
   }
+  if (checksum_ != NULL) {
+    checksum_->update(begin, total_size);
+  }
 }
 
 }  // namespace io
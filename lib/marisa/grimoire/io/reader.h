@@ -4,7 +4,7 @@
 #include <cstdio>
 #include <iostream>
 
-#include "marisa/base.h"
+#include "marisa/grimoire/io/crc32c.h"
 
 namespace marisa {
 namespace grimoire {
@@ -36,6 +36,21 @@ class Reader {
 
   void seek(std::size_t size);
 
+  // While a Crc32c is attached by set_checksum(), the data read is also
+  // passed to the Crc32c.
+  void set_checksum(Crc32c *crc) {
+    checksum_ = crc;
+  }
+  // set_limit() allows `size' more bytes to be read, and reading beyond them
+  // throws MARISA_FORMAT_ERROR. avail() returns how many bytes are left. The
+  // limit is MARISA_SIZE_MAX by default.
+  void set_limit(std::size_t size) {
+    limit_ = size;
+  }
+  std::size_t avail() const {
+    return limit_;
+  }
+
   bool is_open() const;
 
   void clear();
@@ -46,6 +61,8 @@ class Reader {
   int fd_;
   std::istream *stream_;
   bool needs_fclose_;
+  Crc32c *checksum_;
+  std::size_t limit_;
 
   void open_(const char *filename);
   void open_(std::FILE *file);
@@ -1,33 +1,111 @@
 #include <stdio.h>
 
 #ifdef _WIN32
+ #include <fcntl.h>
  #include <io.h>
+ #include <share.h>
+ #include <sys/stat.h>
 #else  // _WIN32
+ #include <sys/types.h>
+ #include <sys/uio.h>
+ #include <fcntl.h>
  #include <unistd.h>
 #endif  // _WIN32
 
+#include <cstring>
 #include <limits>
+#include <new>
 
 #include "marisa/grimoire/io/writer.h"
 
 namespace marisa {
 namespace grimoire {
 namespace io {
+namespace {
+
+// Data goes through a buffer of BUFFER_SIZE bytes, which is aligned to
+// BLOCK_SIZE bytes for O_DIRECT. Writes of COPY_LIMIT bytes or more are not
+// copied but passed to writev() with the buffered data.
+const std::size_t BUFFER_SIZE = (std::size_t)1 << 20;
+const std::size_t BLOCK_SIZE = 4096;
+const std::size_t COPY_LIMIT = BUFFER_SIZE / 16;
+
+#ifdef _WIN32
+const std::size_t CHUNK_SIZE = std::numeric_limits<int>::max();
+
+void write_all(int fd, const void *data, std::size_t size) {
+  while (size != 0) {
+    const unsigned int count = (size < CHUNK_SIZE) ? size : CHUNK_SIZE;
+    const int size_written = ::_write(fd, data, count);
+    MARISA_THROW_IF(size_written <= 0, MARISA_IO_ERROR);
+    data = static_cast<const char *>(data) + size_written;
+    size -= size_written;
+  }
+}
+#else  // _WIN32
+const std::size_t CHUNK_SIZE = (std::size_t)1 << 30;
+
+void pwrite_all(int fd, const char *data, std::size_t size, UInt64 offset) {
+  while (size != 0) {
+    const ::size_t count = (size < CHUNK_SIZE) ? size : CHUNK_SIZE;
+    const ::ssize_t size_written = ::pwrite(fd, data, count, (::off_t)offset);
+    MARISA_THROW_IF(size_written <= 0, MARISA_IO_ERROR);
+    data += size_written;
+    size -= size_written;
+    offset += size_written;
+  }
+}
+
+void pread_all(int fd, char *buf, std::size_t size, UInt64 offset) {
+  while (size != 0) {
+    const ::size_t count = (size < CHUNK_SIZE) ? size : CHUNK_SIZE;
+    const ::ssize_t size_read = ::pread(fd, buf, count, (::off_t)offset);
+    MARISA_THROW_IF(size_read <= 0, MARISA_IO_ERROR);
+    buf += size_read;
+    size -= size_read;
+    offset += size_read;
+  }
+}
+#endif  // _WIN32
+
+char *align_block(char *ptr) {
+  return ptr + ((BLOCK_SIZE - ((std::size_t)ptr % BLOCK_SIZE)) % BLOCK_SIZE);
+}
+
+}  // namespace
 
 Writer::Writer()
-    : file_(NULL), fd_(-1), stream_(NULL), needs_fclose_(false) {}
+    : file_(NULL), fd_(-1), stream_(NULL), crc_(NULL), checksum_(NULL),
+      buf_(), buf_ptr_(NULL), buf_size_(0), position_(0), origin_(0),
+      flushed_(0), is_seekable_(false), is_direct_(false),
+      needs_fclose_(false), needs_close_(false) {}
 
 Writer::~Writer() {
+  if (fd_ != -1) {
+    try {
+      flush();
+    } catch (const Exception &) {
+    }
+  }
   if (needs_fclose_) {
     ::fclose(file_);
   }
+  if (needs_close_) {
+#ifdef _WIN32
+    ::_close(fd_);
+#else  // _WIN32
+    ::close(fd_);
+#endif  // _WIN32
+  }
 }
 
-void Writer::open(const char *filename) {
+void Writer::open(const char *filename, int save_flags) {
   MARISA_THROW_IF(filename == NULL, MARISA_NULL_ERROR);
+  MARISA_THROW_IF((save_flags & ~(MARISA_SAVE_DIRECT |
+      MARISA_SAVE_PREALLOCATE)) != 0, MARISA_CODE_ERROR);
 
   Writer temp;
-  temp.open_(filename);
+  temp.open_(filename, save_flags);
   swap(temp);
 }
 
@@ -53,6 +131,12 @@ void Writer::open(std::ostream &stream) {
   swap(temp);
 }
 
+void Writer::open(Crc32c &crc) {
+  Writer temp;
+  temp.open_(crc);
+  swap(temp);
+}
+
 void Writer::clear() {
   Writer().swap(*this);
 }
@@ -61,7 +145,18 @@ void Writer::swap(Writer &rhs) {
   marisa::swap(file_, rhs.file_);
   marisa::swap(fd_, rhs.fd_);
   marisa::swap(stream_, rhs.stream_);
+  marisa::swap(crc_, rhs.crc_);
+  marisa::swap(checksum_, rhs.checksum_);
+  buf_.swap(rhs.buf_);
+  marisa::swap(buf_ptr_, rhs.buf_ptr_);
+  marisa::swap(buf_size_, rhs.buf_size_);
+  marisa::swap(position_, rhs.position_);
+  marisa::swap(origin_, rhs.origin_);
+  marisa::swap(flushed_, rhs.flushed_);
+  marisa::swap(is_seekable_, rhs.is_seekable_);
+  marisa::swap(is_direct_, rhs.is_direct_);
   marisa::swap(needs_fclose_, rhs.needs_fclose_);
+  marisa::swap(needs_close_, rhs.needs_close_);
 }
 
 void Writer::seek(std::size_t size) {
@@ -81,20 +176,99 @@ void Writer::seek(std::size_t size) {
   }
 }
 
+void Writer::flush() {
+  MARISA_THROW_IF(!is_open(), MARISA_STATE_ERROR);
+  if (fd_ == -1) {
+    return;
+  } else if (is_direct_) {
+#ifndef _WIN32
+    // The last block is written with zeros, which are cut off. The rest of
+    // the block stays in the buffer and is written again with the next data.
+    write_direct(true);
+    MARISA_THROW_IF(::ftruncate(fd_, (::off_t)(origin_ + position_)) != 0,
+        MARISA_IO_ERROR);
+#endif  // _WIN32
+  } else if (buf_size_ != 0) {
+    write_fd(buf_ptr_, buf_size_, NULL, 0);
+    buf_size_ = 0;
+  }
+}
+
+void Writer::reserve(UInt64 size) {
+  MARISA_THROW_IF(!is_open(), MARISA_STATE_ERROR);
+#ifdef __linux__
+  if (is_seekable_ && (size != 0)) {
+    (void)::fallocate(fd_, FALLOC_FL_KEEP_SIZE,
+        (::off_t)(origin_ + position_), (::off_t)size);
+  }
+#else  // __linux__
+  (void)size;
+#endif  // __linux__
+}
+
+void Writer::rewrite(UInt64 offset, const void *data, std::size_t size) {
+  MARISA_THROW_IF(!is_seekable_, MARISA_STATE_ERROR);
+  MARISA_THROW_IF((data == NULL) && (size != 0), MARISA_NULL_ERROR);
+  MARISA_THROW_IF(offset > position_, MARISA_BOUND_ERROR);
+  MARISA_THROW_IF(size > (position_ - offset), MARISA_BOUND_ERROR);
+  if (size == 0) {
+    return;
+  } else if (is_direct_) {
+    rewrite_direct(offset, static_cast<const char *>(data), size);
+    return;
+  }
+
+  flush();
+#ifdef _WIN32
+  MARISA_THROW_IF(::_lseeki64(fd_, (__int64)(origin_ + offset),
+      SEEK_SET) == -1, MARISA_IO_ERROR);
+  write_all(fd_, data, size);
+  MARISA_THROW_IF(::_lseeki64(fd_, (__int64)(origin_ + position_),
+      SEEK_SET) == -1, MARISA_IO_ERROR);
+#else  // _WIN32
+  pwrite_all(fd_, static_cast<const char *>(data), size, origin_ + offset);
+#endif  // _WIN32
+}
+
 bool Writer::is_open() const {
-  return (file_ != NULL) || (fd_ != -1) || (stream_ != NULL);
+  return (file_ != NULL) || (fd_ != -1) || (stream_ != NULL) ||
+      (crc_ != NULL);
 }
 
-void Writer::open_(const char *filename) {
-  std::FILE *file = NULL;
-#ifdef _MSC_VER
-  MARISA_THROW_IF(::fopen_s(&file, filename, "wb") != 0, MARISA_IO_ERROR);
-#else  // _MSC_VER
-  file = ::fopen(filename, "wb");
-  MARISA_THROW_IF(file == NULL, MARISA_IO_ERROR);
-#endif  // _MSC_VER
-  file_ = file;
-  needs_fclose_ = true;
+void Writer::open_(const char *filename, int save_flags) {
+  init_buffer();
+
+  int fd = -1;
+#ifdef _WIN32
+ #ifdef _MSC_VER
+  MARISA_THROW_IF(::_sopen_s(&fd, filename,
+      _O_BINARY | _O_CREAT | _O_WRONLY | _O_TRUNC, _SH_DENYWR,
+      _S_IREAD | _S_IWRITE) != 0, MARISA_IO_ERROR);
+ #else  // _MSC_VER
+  fd = ::_open(filename, _O_BINARY | _O_CREAT | _O_WRONLY | _O_TRUNC,
+      _S_IREAD | _S_IWRITE);
+ #endif  // _MSC_VER
+  (void)save_flags;
+#else  // _WIN32
+ #ifdef O_DIRECT
+  // A file system without O_DIRECT support rejects it, and then the file is
+  // opened again without it. A direct writer may read blocks back when it
+  // rewrites them.
+  if ((save_flags & MARISA_SAVE_DIRECT) != 0) {
+    fd = ::open(filename, O_RDWR | O_CREAT | O_TRUNC | O_DIRECT, 0666);
+    is_direct_ = (fd != -1);
+  }
+ #else  // O_DIRECT
+  (void)save_flags;
+ #endif  // O_DIRECT
+  if (fd == -1) {
+    fd = ::open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  }
+#endif  // _WIN32
+  MARISA_THROW_IF(fd == -1, MARISA_IO_ERROR);
+  fd_ = fd;
+  needs_close_ = true;
+  is_seekable_ = true;
 }
 
 void Writer::open_(std::FILE *file) {
@@ -102,33 +276,70 @@ void Writer::open_(std::FILE *file) {
 }
 
 void Writer::open_(int fd) {
+  init_buffer();
   fd_ = fd;
+
+  // A descriptor is rewritten at offsets from its position when it was
+  // opened, which is impossible for a pipe or a file opened for appending.
+#ifdef _WIN32
+  const __int64 origin = ::_lseeki64(fd, 0, SEEK_CUR);
+  if (origin != -1) {
+    origin_ = (UInt64)origin;
+    is_seekable_ = true;
+  }
+#else  // _WIN32
+  const ::off_t origin = ::lseek(fd, 0, SEEK_CUR);
+  const int status_flags = ::fcntl(fd, F_GETFL);
+  if ((origin != -1) && (status_flags != -1) &&
+      ((status_flags & O_APPEND) == 0)) {
+    origin_ = (UInt64)origin;
+    is_seekable_ = true;
+  }
+#endif  // _WIN32
 }
 
 void Writer::open_(std::ostream &stream) {
   stream_ = &stream;
 }
 
+void Writer::open_(Crc32c &crc) {
+  crc_ = &crc;
+}
+
 void Writer::write_data(const void *data, std::size_t size) {
   MARISA_THROW_IF(!is_open(), MARISA_STATE_ERROR);
   if (size == 0) {
     return;
-  } else if (fd_ != -1) {
-    while (size != 0) {
-#ifdef _WIN32
-      static const std::size_t CHUNK_SIZE =
-          std::numeric_limits<int>::max();
-      const unsigned int count = (size < CHUNK_SIZE) ? size : CHUNK_SIZE;
-      const int size_written = ::_write(fd_, data, count);
-#else  // _WIN32
-      static const std::size_t CHUNK_SIZE =
-          std::numeric_limits< ::ssize_t>::max();
-      const ::size_t count = (size < CHUNK_SIZE) ? size : CHUNK_SIZE;
-      const ::ssize_t size_written = ::write(fd_, data, count);
-#endif  // _WIN32
-      MARISA_THROW_IF(size_written <= 0, MARISA_IO_ERROR);
-      data = static_cast<const char *>(data) + size_written;
-      size -= size_written;
+  }
+  if (checksum_ != NULL) {
+    checksum_->update(data, size);
+  }
+  position_ += size;
+
+  if (fd_ != -1) {
+    if (is_direct_) {
+      const char *ptr = static_cast<const char *>(data);
+      while (size != 0) {
+        const std::size_t avail = BUFFER_SIZE - buf_size_;
+        const std::size_t count = (size < avail) ? size : avail;
+        std::memcpy(buf_ptr_ + buf_size_, ptr, count);
+        buf_size_ += count;
+        ptr += count;
+        size -= count;
+        if (buf_size_ == BUFFER_SIZE) {
+          write_direct(false);
+        }
+      }
+    } else if (size < COPY_LIMIT) {
+      if (size > (BUFFER_SIZE - buf_size_)) {
+        write_fd(buf_ptr_, buf_size_, NULL, 0);
+        buf_size_ = 0;
+      }
+      std::memcpy(buf_ptr_ + buf_size_, data, size);
+      buf_size_ += size;
+    } else {
+      write_fd(buf_ptr_, buf_size_, data, size);
+      buf_size_ = 0;
     }
   } else if (file_ != NULL) {
     MARISA_THROW_IF(::fwrite(data, 1, size, file_) != size, MARISA_IO_ERROR);
@@ -140,9 +351,97 @@ void Writer::write_data(const void *data, std::size_t size) {
     } catch (const std::ios_base::failure &) {
       MARISA_THROW(MARISA_IO_ERROR, "std::ios_base::failure");
     }
+  } else if (crc_ != NULL) {
+    crc_->update(data, size);
   }
 }
 
+void Writer::init_buffer() {
+  buf_.reset(new (std::nothrow) char[BUFFER_SIZE + BLOCK_SIZE]);
+  MARISA_THROW_IF(buf_.get() == NULL, MARISA_MEMORY_ERROR);
+  buf_ptr_ = align_block(buf_.get());
+}
+
+void Writer::write_fd(const void *data, std::size_t size,
+    const void *extra_data, std::size_t extra_size) {
+#ifdef _WIN32
+  write_all(fd_, data, size);
+  write_all(fd_, extra_data, extra_size);
+#else  // _WIN32
+  struct ::iovec iov[2];
+  iov[0].iov_base = const_cast<void *>(data);
+  iov[0].iov_len = size;
+  iov[1].iov_base = const_cast<void *>(extra_data);
+  iov[1].iov_len = extra_size;
+  std::size_t i = (size != 0) ? 0 : 1;
+  while ((i < 2) && (iov[i].iov_len != 0)) {
+    const ::ssize_t size_written = ::writev(fd_, iov + i, (int)(2 - i));
+    MARISA_THROW_IF(size_written <= 0, MARISA_IO_ERROR);
+    std::size_t count = (std::size_t)size_written;
+    while ((i < 2) && (count >= iov[i].iov_len)) {
+      count -= iov[i].iov_len;
+      ++i;
+    }
+    if (i < 2) {
+      iov[i].iov_base = static_cast<char *>(iov[i].iov_base) + count;
+      iov[i].iov_len -= count;
+    }
+  }
+#endif  // _WIN32
+}
+
+void Writer::write_direct(bool pads) {
+#ifndef _WIN32
+  // Only whole blocks are written at block boundaries. If `pads' is true, the
+  // last block is filled with zeros and written too.
+  const std::size_t num_bytes = buf_size_ - (buf_size_ % BLOCK_SIZE);
+  std::size_t size = num_bytes;
+  if (pads && (buf_size_ != num_bytes)) {
+    std::memset(buf_ptr_ + buf_size_, 0, num_bytes + BLOCK_SIZE - buf_size_);
+    size += BLOCK_SIZE;
+  }
+  pwrite_all(fd_, buf_ptr_, size, origin_ + flushed_);
+  std::memmove(buf_ptr_, buf_ptr_ + num_bytes, buf_size_ - num_bytes);
+  buf_size_ -= num_bytes;
+  flushed_ += num_bytes;
+#else  // _WIN32
+  (void)pads;
+#endif  // _WIN32
+}
+
+void Writer::rewrite_direct(UInt64 offset, const char *data,
+    std::size_t size) {
+#ifndef _WIN32
+  // The bytes still in the buffer are overwritten in memory.
+  if ((offset + size) > flushed_) {
+    const UInt64 begin = (offset > flushed_) ? offset : flushed_;
+    std::memcpy(buf_ptr_ + (std::size_t)(begin - flushed_),
+        data + (std::size_t)(begin - offset),
+        (std::size_t)(offset + size - begin));
+    size = (std::size_t)(begin - offset);
+  }
+  if (size == 0) {
+    return;
+  }
+
+  // The blocks already written are read, modified and written again.
+  const UInt64 begin = offset - (offset % BLOCK_SIZE);
+  const UInt64 end = ((offset + size + BLOCK_SIZE - 1) / BLOCK_SIZE) *
+      BLOCK_SIZE;
+  const std::size_t length = (std::size_t)(end - begin);
+  scoped_array<char> temp(new (std::nothrow) char[length + BLOCK_SIZE]);
+  MARISA_THROW_IF(temp.get() == NULL, MARISA_MEMORY_ERROR);
+  char * const blocks = align_block(temp.get());
+  pread_all(fd_, blocks, length, origin_ + begin);
+  std::memcpy(blocks + (std::size_t)(offset - begin), data, size);
+  pwrite_all(fd_, blocks, length, origin_ + begin);
+#else  // _WIN32
+  (void)offset;
+  (void)data;
+  (void)size;
+#endif  // _WIN32
+}
+
 }  // namespace io
 }  // namespace grimoire
 }  // namespace marisa
@@ -4,21 +4,32 @@
 #include <cstdio>
 #include <iostream>
 
-#include "marisa/base.h"
+#include "marisa/grimoire/io/crc32c.h"
 
 namespace marisa {
 namespace grimoire {
 namespace io {
 
+// A writer opened with a filename or a file descriptor gathers small writes
+// in a buffer and passes them to the system together with the next large
+// write. The data must be flushed by flush(), which throws MARISA_IO_ERROR
+// if a write fails. The destructor flushes the rest but ignores errors, so
+// a writer destroyed without flush() may lose data silently. Also, a file
+// descriptor must not be closed before the writer is flushed.
 class Writer {
  public:
   Writer();
   ~Writer();
 
-  void open(const char *filename);
+  // `save_flags' is a combination of marisa_save_flags. MARISA_SAVE_DIRECT
+  // is ignored if the file system does not support it.
+  void open(const char *filename, int save_flags = MARISA_DEFAULT_SAVE);
   void open(std::FILE *file);
   void open(int fd);
   void open(std::ostream &stream);
+  // A writer opened with a Crc32c writes nothing but passes the data to the
+  // Crc32c, which gives its checksum and size.
+  void open(Crc32c &crc);
 
   template <typename T>
   void write(const T &obj) {
@@ -34,6 +45,28 @@ class Writer {
   }
 
   void seek(std::size_t size);
+  void flush();
+
+  // reserve() asks the file system to allocate `size' bytes following the
+  // current position in advance. It is only a hint.
+  void reserve(UInt64 size);
+
+  // While a Crc32c is attached by set_checksum(), the data written is also
+  // passed to it. NULL detaches it.
+  void set_checksum(Crc32c *crc) {
+    checksum_ = crc;
+  }
+
+  // position() returns the number of bytes written so far. If can_rewrite()
+  // is true, rewrite() overwrites `size' bytes which were written at
+  // `offset'.
+  UInt64 position() const {
+    return position_;
+  }
+  bool can_rewrite() const {
+    return is_seekable_;
+  }
+  void rewrite(UInt64 offset, const void *data, std::size_t size);
 
   bool is_open() const;
 
@@ -44,15 +77,33 @@ class Writer {
   std::FILE *file_;
   int fd_;
   std::ostream *stream_;
+  Crc32c *crc_;
+  Crc32c *checksum_;
+  scoped_array<char> buf_;
+  char *buf_ptr_;
+  std::size_t buf_size_;
+  UInt64 position_;
+  UInt64 origin_;
+  UInt64 flushed_;
+  bool is_seekable_;
+  bool is_direct_;
   bool needs_fclose_;
+  bool needs_close_;
 
-  void open_(const char *filename);
+  void open_(const char *filename, int save_flags);
   void open_(std::FILE *file);
   void open_(int fd);
   void open_(std::ostream &stream);
+  void open_(Crc32c &crc);
 
   void write_data(const void *data, std::size_t size);
 
+  void init_buffer();
+  void write_fd(const void *data, std::size_t size,
+      const void *extra_data, std::size_t extra_size);
+  void write_direct(bool pads);
+  void rewrite_direct(UInt64 offset, const char *data, std::size_t size);
+
   // Disallows copy and assignment.
   Writer(const Writer &);
   Writer &operator=(const Writer &);
@@ -0,0 +1,14 @@
+#ifndef MARISA_GRIMOIRE_THREAD_H_
+#define MARISA_GRIMOIRE_THREAD_H_
+
+#include "marisa/grimoire/thread/thread.h"
+
+namespace marisa {
+namespace grimoire {
+
+using thread::Thread;
+
+}  // namespace grimoire
+}  // namespace marisa
+
+#endif  // MARISA_GRIMOIRE_THREAD_H_
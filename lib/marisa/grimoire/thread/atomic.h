@@ -0,0 +1,70 @@
+#ifndef MARISA_GRIMOIRE_THREAD_ATOMIC_H_
+#define MARISA_GRIMOIRE_THREAD_ATOMIC_H_
+
+#ifdef _MSC_VER
+ #include <intrin.h>
+#endif  // _MSC_VER
+
+#include "marisa/base.h"
+
+namespace marisa {
+namespace grimoire {
+namespace thread {
+
+// atomic_add() and atomic_compare_and_swap() are full memory barriers.
+
+// atomic_add() adds `value' to `*ptr' and returns the new value.
+inline std::size_t atomic_add(volatile std::size_t *ptr, std::size_t value) {
+#ifdef _MSC_VER
+ #ifdef _WIN64
+  return (std::size_t)::_InterlockedExchangeAdd64(
+      reinterpret_cast<volatile __int64 *>(ptr), (__int64)value) + value;
+ #else  // _WIN64
+  return (std::size_t)::_InterlockedExchangeAdd(
+      reinterpret_cast<volatile long *>(ptr), (long)value) + value;
+ #endif  // _WIN64
+#else  // _MSC_VER
+  return __sync_add_and_fetch(ptr, value);
+#endif  // _MSC_VER
+}
+
+// atomic_compare_and_swap() replaces `*ptr' with `value' if `*ptr' equals
+// `expected' and returns whether `*ptr' has been replaced.
+inline bool atomic_compare_and_swap(volatile std::size_t *ptr,
+    std::size_t expected, std::size_t value) {
+#ifdef _MSC_VER
+ #ifdef _WIN64
+  return ::_InterlockedCompareExchange64(
+      reinterpret_cast<volatile __int64 *>(ptr), (__int64)value,
+      (__int64)expected) == (__int64)expected;
+ #else  // _WIN64
+  return ::_InterlockedCompareExchange(
+      reinterpret_cast<volatile long *>(ptr), (long)value,
+      (long)expected) == (long)expected;
+ #endif  // _WIN64
+#else  // _MSC_VER
+  return __sync_bool_compare_and_swap(ptr, expected, value);
+#endif  // _MSC_VER
+}
+
+// atomic_load() is a plain load with acquire semantics, that is later loads
+// and stores are not moved before it. It does not write to `*ptr'.
+inline std::size_t atomic_load(const volatile std::size_t *ptr) {
+#ifdef _MSC_VER
+  const std::size_t value = *ptr;
+  ::_ReadWriteBarrier();
+  return value;
+#elif defined(__ATOMIC_ACQUIRE)
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#else  // _MSC_VER
+  const std::size_t value = *ptr;
+  __sync_synchronize();
+  return value;
+#endif  // _MSC_VER
+}
+
+}  // namespace thread
+}  // namespace grimoire
+}  // namespace marisa
+
+#endif  // MARISA_GRIMOIRE_THREAD_ATOMIC_H_
@@ -0,0 +1,136 @@
+#include <new>
+
+#include "marisa/grimoire/thread/atomic.h"
+#include "marisa/grimoire/thread/epoch.h"
+
+namespace marisa {
+namespace grimoire {
+namespace thread {
+namespace {
+
+// Each thread starts at the slot it has reserved last, so that readers on
+// different threads rarely race for one without sharing a counter. A thread
+// takes its first slot from `thread_counter'. The hint is the slot ID plus
+// 1, and 0 means no hint.
+#ifdef _MSC_VER
+__declspec(thread) std::size_t slot_hint = 0;
+#else  // _MSC_VER
+__thread std::size_t slot_hint = 0;
+#endif  // _MSC_VER
+
+volatile std::size_t thread_counter = 0;
+
+}  // namespace
+
+Epoch::Epoch(std::size_t num_slots)
+    : slots_(), num_slots_(0), epoch_(1), retired_(),
+      num_retired_(0), capacity_(0) {
+  MARISA_THROW_IF(num_slots == 0, MARISA_SIZE_ERROR);
+  slots_.reset(new (std::nothrow) Slot[num_slots]);
+  MARISA_THROW_IF(slots_.get() == NULL, MARISA_MEMORY_ERROR);
+  for (std::size_t i = 0; i < num_slots; ++i) {
+    slots_[i].value = FREE_SLOT;
+  }
+  num_slots_ = num_slots;
+}
+
+Epoch::~Epoch() {
+  for (std::size_t i = 0; i < num_retired_; ++i) {
+    retired_[i].deleter(retired_[i].obj);
+  }
+}
+
+std::size_t Epoch::enter(volatile std::size_t *shared, std::size_t *value) {
+  MARISA_THROW_IF((shared == NULL) || (value == NULL), MARISA_NULL_ERROR);
+
+  if (slot_hint == 0) {
+    slot_hint = atomic_add(&thread_counter, 1);
+  }
+  const std::size_t first = (slot_hint - 1) % num_slots_;
+  for (std::size_t i = 0; i < num_slots_; ++i) {
+    const std::size_t slot_id = (first + i) % num_slots_;
+    volatile std::size_t * const slot = &slots_[slot_id].value;
+    if ((*slot != FREE_SLOT) ||
+        !atomic_compare_and_swap(slot, FREE_SLOT, BUSY_SLOT)) {
+      continue;
+    }
+    // The announced epoch is visible before `*shared' is loaded because
+    // both operations are full barriers. A writer that unpublishes the
+    // object afterwards retires it in a later epoch and waits for this slot.
+    atomic_compare_and_swap(slot, BUSY_SLOT,
+        (atomic_load(&epoch_) << 1) | 1);
+    *value = atomic_load(shared);
+    slot_hint = slot_id + 1;
+    return slot_id;
+  }
+  MARISA_THROW(MARISA_SIZE_ERROR, "too many readers");
+}
+
+void Epoch::leave(std::size_t slot_id) {
+  MARISA_THROW_IF(slot_id >= num_slots_, MARISA_BOUND_ERROR);
+  volatile std::size_t * const slot = &slots_[slot_id].value;
+  const std::size_t value = atomic_load(slot);
+  MARISA_THROW_IF(value == FREE_SLOT, MARISA_STATE_ERROR);
+  atomic_compare_and_swap(slot, value, FREE_SLOT);
+}
+
+void Epoch::reserve(std::size_t num_retired) {
+  if (num_retired <= capacity_) {
+    return;
+  }
+  std::size_t new_capacity = (capacity_ != 0) ? capacity_ : 4;
+  while (new_capacity < num_retired) {
+    new_capacity *= 2;
+  }
+  scoped_array<Retired> new_retired(new (std::nothrow) Retired[new_capacity]);
+  MARISA_THROW_IF(new_retired.get() == NULL, MARISA_MEMORY_ERROR);
+  for (std::size_t i = 0; i < num_retired_; ++i) {
+    new_retired[i] = retired_[i];
+  }
+  retired_.swap(new_retired);
+  capacity_ = new_capacity;
+}
+
+void Epoch::retire(void *obj, Deleter deleter) {
+  MARISA_THROW_IF((obj == NULL) || (deleter == NULL), MARISA_NULL_ERROR);
+
+  reserve(num_retired_ + 1);
+
+  // Readers that have announced the old epoch may still see `obj'.
+  retired_[num_retired_].obj = obj;
+  retired_[num_retired_].deleter = deleter;
+  retired_[num_retired_].epoch = atomic_add(&epoch_, 1) - 1;
+  ++num_retired_;
+}
+
+std::size_t Epoch::reclaim() {
+  if (num_retired_ == 0) {
+    return 0;
+  }
+
+  // An object is deleted if every active reader announced a later epoch.
+  // A slot being reserved has not loaded the shared value yet.
+  std::size_t min_epoch = atomic_load(&epoch_);
+  for (std::size_t i = 0; i < num_slots_; ++i) {
+    const std::size_t value = atomic_load(&slots_[i].value);
+    if ((value != FREE_SLOT) && (value != BUSY_SLOT) &&
+        ((value >> 1) < min_epoch)) {
+      min_epoch = value >> 1;
+    }
+  }
+
+  std::size_t num_kept = 0;
+  for (std::size_t i = 0; i < num_retired_; ++i) {
+    if (retired_[i].epoch < min_epoch) {
+      retired_[i].deleter(retired_[i].obj);
+    } else {
+      retired_[num_kept++] = retired_[i];
+    }
+  }
+  num_retired_ = num_kept;
+  return num_retired_;
+}
+
+}  // namespace thread
+}  // namespace grimoire
+}  // namespace marisa
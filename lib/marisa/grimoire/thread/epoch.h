@@ -0,0 +1,81 @@
+#ifndef MARISA_GRIMOIRE_THREAD_EPOCH_H_
+#define MARISA_GRIMOIRE_THREAD_EPOCH_H_
+
+#include "marisa/base.h"
+
+namespace marisa {
+namespace grimoire {
+namespace thread {
+
+// Epoch is an epoch-based reclamation scheme for objects that are replaced
+// under live readers. A reader announces the current epoch in a slot of its
+// own by enter() and clears it by leave(). An object retired by retire() is
+// deleted by reclaim() once no slot announces an epoch before the retirement.
+// enter() and leave() are lock-free and may be called from any thread, but
+// retire() and reclaim() must be serialized by the caller.
+class Epoch {
+ public:
+  typedef void (*Deleter)(void *);
+
+  explicit Epoch(std::size_t num_slots);
+  ~Epoch();
+
+  // enter() reserves a slot, announces the current epoch and then loads
+  // `*shared' into `*value'. An object published through `shared' before
+  // enter() is not deleted until the returned slot is left. enter() throws
+  // MARISA_SIZE_ERROR if all the slots are in use.
+  std::size_t enter(volatile std::size_t *shared, std::size_t *value);
+  void leave(std::size_t slot_id);
+
+  // retire() must be called after an object has been unpublished. It does
+  // not throw if reserve() has made room for the object.
+  void reserve(std::size_t num_retired);
+  void retire(void *obj, Deleter deleter);
+
+  // reclaim() deletes the objects that are no longer visible to readers and
+  // returns the number of objects still waiting.
+  std::size_t reclaim();
+
+  std::size_t num_slots() const {
+    return num_slots_;
+  }
+  std::size_t num_retired() const {
+    return num_retired_;
+  }
+
+ private:
+  enum {
+    FREE_SLOT  = 0,
+    BUSY_SLOT  = 1
+  };
+
+  // A slot has a cache line of its own, so that readers on different
+  // processors do not share lines.
+  struct Slot {
+    volatile std::size_t value;
+    char pad[64 - sizeof(std::size_t)];
+  };
+
+  struct Retired {
+    void *obj;
+    Deleter deleter;
+    std::size_t epoch;
+  };
+
+  scoped_array<Slot> slots_;
+  std::size_t num_slots_;
+  volatile std::size_t epoch_;
+  scoped_array<Retired> retired_;
+  std::size_t num_retired_;
+  std::size_t capacity_;
+
+  // Disallows copy and assignment.
+  Epoch(const Epoch &);
+  Epoch &operator=(const Epoch &);
+};
+
+}  // namespace thread
+}  // namespace grimoire
+}  // namespace marisa
+
+#endif  // MARISA_GRIMOIRE_THREAD_EPOCH_H_
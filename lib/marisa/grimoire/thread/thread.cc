@@ -0,0 +1,142 @@
+#if (defined _WIN32) || (defined _WIN64)
+ #include <windows.h>
+#else  // (defined _WIN32) || (defined _WIN64)
+ #include <sched.h>
+ #include <unistd.h>
+#endif  // (defined _WIN32) || (defined _WIN64)
+
+#include <new>
+
+#include "marisa/grimoire/thread/atomic.h"
+#include "marisa/grimoire/thread/thread.h"
+
+namespace marisa {
+namespace grimoire {
+namespace thread {
+namespace {
+
+struct Routine {
+  Thread::Function func;
+  void *arg;
+};
+
+#if (defined _WIN32) || (defined _WIN64)
+DWORD WINAPI run(LPVOID ptr) {
+  const Routine routine = *static_cast<Routine *>(ptr);
+  delete static_cast<Routine *>(ptr);
+  routine.func(routine.arg);
+  return 0;
+}
+#else  // (defined _WIN32) || (defined _WIN64)
+extern "C" void *run(void *ptr) {
+  const Routine routine = *static_cast<Routine *>(ptr);
+  delete static_cast<Routine *>(ptr);
+  routine.func(routine.arg);
+  return NULL;
+}
+#endif  // (defined _WIN32) || (defined _WIN64)
+
+// thread_index is the index of a thread plus 1, and 0 means no index.
+#ifdef _MSC_VER
+__declspec(thread) std::size_t thread_index = 0;
+#else  // _MSC_VER
+__thread std::size_t thread_index = 0;
+#endif  // _MSC_VER
+
+volatile std::size_t num_indexed_threads = 0;
+
+}  // namespace
+
+#if (defined _WIN32) || (defined _WIN64)
+Thread::Thread() : handle_(NULL), is_running_(false) {}
+#else  // (defined _WIN32) || (defined _WIN64)
+Thread::Thread() : handle_(), is_running_(false) {}
+#endif  // (defined _WIN32) || (defined _WIN64)
+
+Thread::~Thread() {
+  if (is_running_) {
+#if (defined _WIN32) || (defined _WIN64)
+    ::WaitForSingleObject(handle_, INFINITE);
+    ::CloseHandle(handle_);
+#else  // (defined _WIN32) || (defined _WIN64)
+    ::pthread_join(handle_, NULL);
+#endif  // (defined _WIN32) || (defined _WIN64)
+  }
+}
+
+void Thread::start(Function func, void *arg) {
+  MARISA_THROW_IF(is_running_, MARISA_STATE_ERROR);
+  MARISA_THROW_IF(func == NULL, MARISA_NULL_ERROR);
+
+  Routine * const routine = new (std::nothrow) Routine;
+  MARISA_THROW_IF(routine == NULL, MARISA_MEMORY_ERROR);
+  routine->func = func;
+  routine->arg = arg;
+
+#if (defined _WIN32) || (defined _WIN64)
+  handle_ = ::CreateThread(NULL, 0, run, routine, 0, NULL);
+  if (handle_ == NULL) {
+    delete routine;
+    MARISA_THROW(MARISA_STATE_ERROR, "failed to create a thread");
+  }
+#else  // (defined _WIN32) || (defined _WIN64)
+  if (::pthread_create(&handle_, NULL, run, routine) != 0) {
+    delete routine;
+    MARISA_THROW(MARISA_STATE_ERROR, "failed to create a thread");
+  }
+#endif  // (defined _WIN32) || (defined _WIN64)
+  is_running_ = true;
+}
+
+void Thread::join() {
+  MARISA_THROW_IF(!is_running_, MARISA_STATE_ERROR);
+
+#if (defined _WIN32) || (defined _WIN64)
+  ::WaitForSingleObject(handle_, INFINITE);
+  ::CloseHandle(handle_);
+  handle_ = NULL;
+#else  // (defined _WIN32) || (defined _WIN64)
+  ::pthread_join(handle_, NULL);
+#endif  // (defined _WIN32) || (defined _WIN64)
+  is_running_ = false;
+}
+
+std::size_t Thread::hardware_concurrency() {
+#if (defined _WIN32) || (defined _WIN64)
+  SYSTEM_INFO info;
+  ::GetSystemInfo(&info);
+  return (info.dwNumberOfProcessors != 0) ?
+      (std::size_t)info.dwNumberOfProcessors : 1;
+#else  // (defined _WIN32) || (defined _WIN64)
+  const long num_processors = ::sysconf(_SC_NPROCESSORS_ONLN);
+  return (num_processors > 0) ? (std::size_t)num_processors : 1;
+#endif  // (defined _WIN32) || (defined _WIN64)
+}
+
+void Thread::yield() {
+#if (defined _WIN32) || (defined _WIN64)
+  ::SwitchToThread();
+#else  // (defined _WIN32) || (defined _WIN64)
+  ::sched_yield();
+#endif  // (defined _WIN32) || (defined _WIN64)
+}
+
+std::size_t Thread::index() {
+  if (thread_index == 0) {
+    thread_index = atomic_add(&num_indexed_threads, 1);
+  }
+  return thread_index - 1;
+}
+
+void Thread::clear() {
+  Thread().swap(*this);
+}
+
+void Thread::swap(Thread &rhs) {
+  marisa::swap(handle_, rhs.handle_);
+  marisa::swap(is_running_, rhs.is_running_);
+}
+
+}  // namespace thread
+}  // namespace grimoire
+}  // namespace marisa
@@ -0,0 +1,61 @@
+#ifndef MARISA_GRIMOIRE_THREAD_THREAD_H_
+#define MARISA_GRIMOIRE_THREAD_THREAD_H_
+
+#if !(defined _WIN32) && !(defined _WIN64)
+ #include <pthread.h>
+#endif  // !(defined _WIN32) && !(defined _WIN64)
+
+#include "marisa/base.h"
+
+namespace marisa {
+namespace grimoire {
+namespace thread {
+
+// Thread is a thin wrapper of a native thread. A function given to start()
+// must not throw an exception. A running thread is joined on destruction.
+class Thread {
+ public:
+  typedef void (*Function)(void *);
+
+  Thread();
+  ~Thread();
+
+  void start(Function func, void *arg);
+  void join();
+
+  bool joinable() const {
+    return is_running_;
+  }
+
+  // hardware_concurrency() returns the number of online processors, or 1 if
+  // it is not available.
+  static std::size_t hardware_concurrency();
+
+  // yield() gives up the rest of the time slice of the calling thread.
+  static void yield();
+
+  // index() returns a number which identifies the calling thread. Threads
+  // are numbered from 0 in the order of their first calls.
+  static std::size_t index();
+
+  void clear();
+  void swap(Thread &rhs);
+
+ private:
+#if (defined _WIN32) || (defined _WIN64)
+  void *handle_;
+#else  // (defined _WIN32) || (defined _WIN64)
+  pthread_t handle_;
+#endif  // (defined _WIN32) || (defined _WIN64)
+  bool is_running_;
+
+  // Disallows copy and assignment.
+  Thread(const Thread &);
+  Thread &operator=(const Thread &);
+};
+
+}  // namespace thread
+}  // namespace grimoire
+}  // namespace marisa
+
+#endif  // MARISA_GRIMOIRE_THREAD_THREAD_H_
@@ -0,0 +1,49 @@
+#ifndef MARISA_GRIMOIRE_TIMER_H_
+#define MARISA_GRIMOIRE_TIMER_H_
+
+#if (defined _WIN32) || (defined _WIN64)
+ #include <windows.h>
+#else  // (defined _WIN32) || (defined _WIN64)
+ #include <sys/time.h>
+#endif  // (defined _WIN32) || (defined _WIN64)
+
+#include "marisa/base.h"
+
+namespace marisa {
+namespace grimoire {
+
+// Timer measures elapsed wall-clock time in seconds. Unlike std::clock(), it
+// is not affected by the CPU time of other threads.
+class Timer {
+ public:
+  Timer() : start_(now()) {}
+
+  void reset() {
+    start_ = now();
+  }
+
+  double elapsed() const {
+    return now() - start_;
+  }
+
+  static double now() {
+#if (defined _WIN32) || (defined _WIN64)
+    LARGE_INTEGER count, frequency;
+    ::QueryPerformanceCounter(&count);
+    ::QueryPerformanceFrequency(&frequency);
+    return (double)count.QuadPart / (double)frequency.QuadPart;
+#else  // (defined _WIN32) || (defined _WIN64)
+    struct timeval tv;
+    ::gettimeofday(&tv, NULL);
+    return tv.tv_sec + (tv.tv_usec * 0.000001);
+#endif  // (defined _WIN32) || (defined _WIN64)
+  }
+
+ private:
+  double start_;
+};
+
+}  // namespace grimoire
+}  // namespace marisa
+
+#endif  // MARISA_GRIMOIRE_TIMER_H_
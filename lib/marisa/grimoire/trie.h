@@ -3,6 +3,7 @@
 
 #include "marisa/grimoire/trie/state.h"
 #include "marisa/grimoire/trie/louds-trie.h"
+#include "marisa/grimoire/trie/cursor.h"
 
 namespace marisa {
 namespace grimoire {
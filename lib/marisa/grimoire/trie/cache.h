@@ -74,6 +74,98 @@ class Cache {
   } union_;
 };
 
+// CacheSet packs NUM_WAYS entries of a set-associative cache into 64 bytes,
+// so that a set is probed with one cache line if the sets are aligned to
+// ALIGNMENT bytes. An entry of the first trie is found by its parent and
+// label, and an entry of the other tries by its child.
+class CacheSet {
+ public:
+  enum {
+    NUM_WAYS   = 4,
+    ALIGNMENT  = 64
+  };
+
+  CacheSet() {
+    for (std::size_t i = 0; i < NUM_WAYS; ++i) {
+      labels_[i] = 0;
+    }
+    for (std::size_t i = 0; i < sizeof(reserved_); ++i) {
+      reserved_[i] = 0;
+    }
+  }
+
+  Cache &operator[](std::size_t i) {
+    MARISA_DEBUG_IF(i >= NUM_WAYS, MARISA_BOUND_ERROR);
+    return ways_[i];
+  }
+  const Cache &operator[](std::size_t i) const {
+    MARISA_DEBUG_IF(i >= NUM_WAYS, MARISA_BOUND_ERROR);
+    return ways_[i];
+  }
+
+  void set_label(std::size_t i, char label) {
+    MARISA_DEBUG_IF(i >= NUM_WAYS, MARISA_BOUND_ERROR);
+    labels_[i] = (UInt8)label;
+  }
+  char label(std::size_t i) const {
+    MARISA_DEBUG_IF(i >= NUM_WAYS, MARISA_BOUND_ERROR);
+    return (char)labels_[i];
+  }
+
+  // insert() replaces the lightest entry if `weight' is heavier.
+  void insert(std::size_t parent, std::size_t child, float weight,
+      char label) {
+    std::size_t min_id = 0;
+    for (std::size_t i = 1; i < NUM_WAYS; ++i) {
+      if (ways_[i].weight() < ways_[min_id].weight()) {
+        min_id = i;
+      }
+    }
+    if (weight > ways_[min_id].weight()) {
+      ways_[min_id].set_parent(parent);
+      ways_[min_id].set_child(child);
+      ways_[min_id].set_weight(weight);
+      labels_[min_id] = (UInt8)label;
+    }
+  }
+
+  // sort() arranges the entries in descending order of weight, so that a
+  // heavier entry is found first. It must be called before the weights are
+  // replaced with links.
+  void sort() {
+    for (std::size_t i = 1; i < NUM_WAYS; ++i) {
+      for (std::size_t j = i;
+          (j != 0) && (ways_[j - 1].weight() < ways_[j].weight()); --j) {
+        marisa::swap(ways_[j - 1], ways_[j]);
+        marisa::swap(labels_[j - 1], labels_[j]);
+      }
+    }
+  }
+
+  // find() returns NULL if there is no matching entry.
+  const Cache *find(std::size_t parent, char label) const {
+    for (std::size_t i = 0; i < NUM_WAYS; ++i) {
+      if ((ways_[i].parent() == parent) && (labels_[i] == (UInt8)label)) {
+        return &ways_[i];
+      }
+    }
+    return NULL;
+  }
+  const Cache *find(std::size_t child) const {
+    for (std::size_t i = 0; i < NUM_WAYS; ++i) {
+      if (ways_[i].child() == child) {
+        return &ways_[i];
+      }
+    }
+    return NULL;
+  }
+
+ private:
+  Cache ways_[NUM_WAYS];
+  UInt8 labels_[NUM_WAYS];
+  UInt8 reserved_[ALIGNMENT - ((sizeof(Cache) + 1) * NUM_WAYS)];
+};
+
 }  // namespace trie
 }  // namespace grimoire
 }  // namespace marisa
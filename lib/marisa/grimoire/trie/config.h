@@ -13,7 +13,10 @@ class Config {
       : num_tries_(MARISA_DEFAULT_NUM_TRIES),
         cache_level_(MARISA_DEFAULT_CACHE),
         tail_mode_(MARISA_DEFAULT_TAIL),
-        node_order_(MARISA_DEFAULT_ORDER) {}
+        node_order_(MARISA_DEFAULT_ORDER),
+        cache_layout_(MARISA_DEFAULT_CACHE_LAYOUT),
+        root_table_(MARISA_DEFAULT_ROOT_TABLE), cache_levels_(NULL),
+        num_cache_levels_(0) {}
 
   void parse(int config_flags) {
     Config temp;
@@ -21,8 +24,12 @@ class Config {
     swap(temp);
   }
 
+  // The default cache layout is left out, so that the flags can be parsed
+  // by older versions. The root table is also left out because it is saved
+  // in a section of its own.
   int flags() const {
-    return (int)num_tries_ | tail_mode_ | node_order_;
+    return (int)num_tries_ | cache_level_ | tail_mode_ | node_order_ |
+        ((cache_layout_ != MARISA_DEFAULT_CACHE_LAYOUT) ? cache_layout_ : 0);
   }
 
   std::size_t num_tries() const {
@@ -31,12 +38,39 @@ class Config {
   CacheLevel cache_level() const {
     return cache_level_;
   }
+  // cache_level(level) returns the cache level of a trie, where the first
+  // trie is level 0. A trie which is not given by set_cache_levels() uses
+  // cache_level().
+  CacheLevel cache_level(std::size_t level) const {
+    return (level < num_cache_levels_) ? cache_levels_[level] : cache_level_;
+  }
   TailMode tail_mode() const {
     return tail_mode_;
   }
   NodeOrder node_order() const {
     return node_order_;
   }
+  CacheLayout cache_layout() const {
+    return cache_layout_;
+  }
+  RootTable root_table() const {
+    return root_table_;
+  }
+
+  // set_cache_levels() keeps `cache_levels', which must outlive the
+  // config. parse() discards it.
+  void set_cache_levels(const CacheLevel *cache_levels,
+      std::size_t num_cache_levels) {
+    MARISA_THROW_IF((cache_levels == NULL) && (num_cache_levels != 0),
+        MARISA_NULL_ERROR);
+    for (std::size_t i = 0; i < num_cache_levels; ++i) {
+      MARISA_THROW_IF(((cache_levels[i] & ~MARISA_CACHE_LEVEL_MASK) != 0) ||
+          (cache_levels[i] == 0), MARISA_CODE_ERROR);
+      Config().parse_cache_level(cache_levels[i]);
+    }
+    cache_levels_ = cache_levels;
+    num_cache_levels_ = num_cache_levels;
+  }
 
   void clear() {
     Config().swap(*this);
@@ -46,6 +80,10 @@ class Config {
     marisa::swap(cache_level_, rhs.cache_level_);
     marisa::swap(tail_mode_, rhs.tail_mode_);
     marisa::swap(node_order_, rhs.node_order_);
+    marisa::swap(cache_layout_, rhs.cache_layout_);
+    marisa::swap(root_table_, rhs.root_table_);
+    marisa::swap(cache_levels_, rhs.cache_levels_);
+    marisa::swap(num_cache_levels_, rhs.num_cache_levels_);
   }
 
  private:
@@ -53,6 +91,10 @@ class Config {
   CacheLevel cache_level_;
   TailMode tail_mode_;
   NodeOrder node_order_;
+  CacheLayout cache_layout_;
+  RootTable root_table_;
+  const CacheLevel *cache_levels_;
+  std::size_t num_cache_levels_;
 
   void parse_(int config_flags) {
     MARISA_THROW_IF((config_flags & ~MARISA_CONFIG_MASK) != 0,
@@ -62,6 +104,8 @@ class Config {
     parse_cache_level(config_flags);
     parse_tail_mode(config_flags);
     parse_node_order(config_flags);
+    parse_cache_layout(config_flags);
+    parse_root_table(config_flags);
   }
 
   void parse_num_tries(int config_flags) {
@@ -143,6 +187,50 @@ class Config {
     }
   }
 
+  void parse_cache_layout(int config_flags) {
+    switch (config_flags & MARISA_CACHE_LAYOUT_MASK) {
+      case 0: {
+        cache_layout_ = MARISA_DEFAULT_CACHE_LAYOUT;
+        break;
+      }
+      case MARISA_DIRECT_CACHE: {
+        cache_layout_ = MARISA_DIRECT_CACHE;
+        break;
+      }
+      case MARISA_ASSOCIATIVE_CACHE: {
+        cache_layout_ = MARISA_ASSOCIATIVE_CACHE;
+        break;
+      }
+      default: {
+        MARISA_THROW(MARISA_CODE_ERROR, "undefined cache layout");
+      }
+    }
+  }
+
+  void parse_root_table(int config_flags) {
+    switch (config_flags & MARISA_ROOT_TABLE_MASK) {
+      case 0: {
+        root_table_ = MARISA_DEFAULT_ROOT_TABLE;
+        break;
+      }
+      case MARISA_NO_ROOT_TABLE: {
+        root_table_ = MARISA_NO_ROOT_TABLE;
+        break;
+      }
+      case MARISA_ROOT_TABLE: {
+        root_table_ = MARISA_ROOT_TABLE;
+        break;
+      }
+      case MARISA_DEEP_ROOT_TABLE: {
+        root_table_ = MARISA_DEEP_ROOT_TABLE;
+        break;
+      }
+      default: {
+        MARISA_THROW(MARISA_CODE_ERROR, "undefined root table");
+      }
+    }
+  }
+
   // Disallows copy and assignment.
   Config(const Config &);
   Config &operator=(const Config &);
@@ -0,0 +1,118 @@
+#ifndef MARISA_GRIMOIRE_TRIE_CURSOR_H_
+#define MARISA_GRIMOIRE_TRIE_CURSOR_H_
+
+#include "marisa/grimoire/trie/louds-trie.h"
+
+namespace marisa {
+namespace grimoire {
+namespace trie {
+
+// Cursor enumerates the keys of a trie in label order by depth-first search.
+// Unlike predictive_search(), the order does not depend on the node order,
+// so cursors over different tries can be merged.
+class Cursor {
+ public:
+  Cursor()
+      : trie_(NULL), agent_(), children_(), frames_(), key_id_(0),
+        is_root_ready_(false) {}
+
+  void open(const LoudsTrie &trie) {
+    Cursor temp;
+    temp.open_(trie);
+    swap(temp);
+  }
+
+  // next() moves to the next key and returns false at the end.
+  bool next() {
+    MARISA_DEBUG_IF(trie_ == NULL, MARISA_STATE_ERROR);
+
+    if (is_root_ready_) {
+      is_root_ready_ = false;
+      key_id_ = trie_->get_key_id(0);
+      return true;
+    }
+
+    Vector<char> &key_buf = agent_.state().key_buf();
+    while (!frames_.empty()) {
+      Frame &frame = frames_.back();
+      if (frame.pos == frame.end) {
+        children_.resize(frame.begin);
+        frames_.pop_back();
+        continue;
+      }
+      const std::size_t node_id = children_[frame.pos++];
+      key_buf.resize(frame.key_pos);
+      trie_->restore_label(agent_, node_id);
+      push_frame(node_id);
+      if (trie_->is_terminal(node_id)) {
+        key_id_ = trie_->get_key_id(node_id);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  const char *key_ptr() const {
+    return agent_.state().key_buf().begin();
+  }
+  std::size_t key_length() const {
+    return agent_.state().key_buf().size();
+  }
+  std::size_t key_id() const {
+    return key_id_;
+  }
+
+  void clear() {
+    Cursor().swap(*this);
+  }
+  void swap(Cursor &rhs) {
+    marisa::swap(trie_, rhs.trie_);
+    agent_.swap(rhs.agent_);
+    children_.swap(rhs.children_);
+    frames_.swap(rhs.frames_);
+    marisa::swap(key_id_, rhs.key_id_);
+    marisa::swap(is_root_ready_, rhs.is_root_ready_);
+  }
+
+ private:
+  struct Frame {
+    std::size_t begin;
+    std::size_t pos;
+    std::size_t end;
+    std::size_t key_pos;
+  };
+
+  const LoudsTrie *trie_;
+  Agent agent_;
+  Vector<UInt32> children_;
+  Vector<Frame> frames_;
+  std::size_t key_id_;
+  bool is_root_ready_;
+
+  void open_(const LoudsTrie &trie) {
+    trie_ = &trie;
+    agent_.init_state();
+    push_frame(0);
+    is_root_ready_ = trie.is_terminal(0);
+  }
+
+  void push_frame(std::size_t node_id) {
+    Frame frame;
+    frame.begin = children_.size();
+    trie_->sorted_children(node_id, &children_);
+    frame.pos = frame.begin;
+    frame.end = children_.size();
+    frame.key_pos = agent_.state().key_buf().size();
+    frames_.push_back(frame);
+  }
+
+  // Disallows copy and assignment.
+  Cursor(const Cursor &);
+  Cursor &operator=(const Cursor &);
+};
+
+}  // namespace trie
+}  // namespace grimoire
+}  // namespace marisa
+
+#endif  // MARISA_GRIMOIRE_TRIE_CURSOR_H_
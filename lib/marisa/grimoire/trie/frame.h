@@ -0,0 +1,42 @@
+#ifndef MARISA_GRIMOIRE_TRIE_FRAME_H_
+#define MARISA_GRIMOIRE_TRIE_FRAME_H_
+
+#include "marisa/base.h"
+
+namespace marisa {
+namespace grimoire {
+namespace trie {
+
+class LoudsTrie;
+
+// A Frame keeps the rest of a path in a nested trie, from `node_id' to the
+// root, while a link on the path is followed into the next trie.
+class Frame {
+ public:
+  Frame() : trie_(NULL), node_id_(0) {}
+
+  void set_trie(const LoudsTrie *trie) {
+    trie_ = trie;
+  }
+  void set_node_id(std::size_t node_id) {
+    MARISA_DEBUG_IF(node_id > MARISA_UINT32_MAX, MARISA_SIZE_ERROR);
+    node_id_ = (UInt32)node_id;
+  }
+
+  const LoudsTrie *trie() const {
+    return trie_;
+  }
+  std::size_t node_id() const {
+    return node_id_;
+  }
+
+ private:
+  const LoudsTrie *trie_;
+  UInt32 node_id_;
+};
+
+}  // namespace trie
+}  // namespace grimoire
+}  // namespace marisa
+
+#endif  // MARISA_GRIMOIRE_TRIE_FRAME_H_
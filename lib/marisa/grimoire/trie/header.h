@@ -7,26 +7,33 @@ namespace marisa {
 namespace grimoire {
 namespace trie {
 
+// Header is the magic string at the beginning of a dictionary. map() and
+// read() accept any known format and version() tells which one was found.
 class Header {
  public:
   enum {
     HEADER_SIZE = 16
   };
 
-  Header() {}
+  Header() : version_(MARISA_FORMAT_V1) {}
+  explicit Header(FormatVersion version) : version_(version) {}
 
   void map(Mapper &mapper) {
     const char *ptr;
     mapper.map(&ptr, HEADER_SIZE);
-    MARISA_THROW_IF(!test_header(ptr), MARISA_FORMAT_ERROR);
+    version_ = test_header(ptr);
   }
   void read(Reader &reader) {
     char buf[HEADER_SIZE];
     reader.read(buf, HEADER_SIZE);
-    MARISA_THROW_IF(!test_header(buf), MARISA_FORMAT_ERROR);
+    version_ = test_header(buf);
   }
   void write(Writer &writer) const {
-    writer.write(get_header(), HEADER_SIZE);
+    writer.write(get_header(version_), HEADER_SIZE);
+  }
+
+  FormatVersion version() const {
+    return version_;
   }
 
   std::size_t io_size() const {
@@ -34,15 +41,37 @@ class Header {
   }
 
  private:
+  FormatVersion version_;
 
-  static const char *get_header() {
-    static const char buf[HEADER_SIZE] = "We love Marisa.";
-    return buf;
+  static const char *get_header(FormatVersion version) {
+    static const char v1_buf[HEADER_SIZE] = "We love Marisa.";
+    static const char v2_buf[HEADER_SIZE] = "We love Marisa2";
+    switch (version) {
+      case MARISA_FORMAT_V1: {
+        return v1_buf;
+      }
+      case MARISA_FORMAT_V2: {
+        return v2_buf;
+      }
+      default: {
+        MARISA_THROW(MARISA_CODE_ERROR, "undefined format version");
+      }
+    }
+  }
+
+  static FormatVersion test_header(const char *ptr) {
+    if (test_header(ptr, MARISA_FORMAT_V1)) {
+      return MARISA_FORMAT_V1;
+    } else if (test_header(ptr, MARISA_FORMAT_V2)) {
+      return MARISA_FORMAT_V2;
+    }
+    MARISA_THROW(MARISA_FORMAT_ERROR, "unknown header");
   }
 
-  static bool test_header(const char *ptr) {
+  static bool test_header(const char *ptr, FormatVersion version) {
+    const char * const header = get_header(version);
     for (std::size_t i = 0; i < HEADER_SIZE; ++i) {
-      if (ptr[i] != get_header()[i]) {
+      if (ptr[i] != header[i]) {
         return false;
       }
     }
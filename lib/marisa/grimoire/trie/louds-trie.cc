@@ -1,8 +1,13 @@
 #include <algorithm>
 #include <queue>
+#include <sstream>
 
 #include "marisa/grimoire/algorithm.h"
+#include "marisa/grimoire/intrin.h"
+#include "marisa/grimoire/thread/atomic.h"
+#include "marisa/grimoire/thread/thread.h"
 #include "marisa/grimoire/trie/header.h"
+#include "marisa/grimoire/trie/monitor.h"
 #include "marisa/grimoire/trie/range.h"
 #include "marisa/grimoire/trie/state.h"
 #include "marisa/grimoire/trie/louds-trie.h"
@@ -10,55 +15,244 @@
 namespace marisa {
 namespace grimoire {
 namespace trie {
+namespace {
+
+// Regions of a dictionary are warmed up in the following order. The cache
+// is used first by every lookup, the rank/select indexes are used at every
+// step, and the top levels are shared by most keys.
+enum {
+  CACHE_PREFETCH_PHASE  = 0,
+  INDEX_PREFETCH_PHASE  = 1,
+  TOP_PREFETCH_PHASE    = 2,
+  REST_PREFETCH_PHASE   = 3,
+  NUM_PREFETCH_PHASES   = 4
+};
+
+// In MARISA_ASSOCIATIVE_CACHE, the cache sets follow the flags in META. The
+// padding places their elements at a 64-byte boundary in a v2 dictionary.
+enum {
+  CACHE_SET_PADDING     = 56
+};
+
+// A root table has an entry for each first byte, which is followed by an
+// entry for each pair of first bytes in MARISA_DEEP_ROOT_TABLE.
+enum {
+  ROOT_TABLE_SIZE       = 256,
+  DEEP_ROOT_TABLE_SIZE  = 256 + 65536
+};
+
+// The stamps of dictionaries are taken from this counter, which starts at 1
+// so that 0 is never a stamp.
+volatile std::size_t stamp_counter = 0;
+
+// SectionScope limits a reader to a section and passes the bytes read to a
+// checksum until the section has been read.
+class SectionScope {
+ public:
+  SectionScope(Reader &reader, std::size_t size, Crc32c *crc)
+      : reader_(reader) {
+    reader_.set_limit(size);
+    reader_.set_checksum(crc);
+  }
+  ~SectionScope() {
+    reader_.set_checksum(NULL);
+    reader_.set_limit(MARISA_SIZE_MAX);
+  }
+
+ private:
+  Reader &reader_;
+
+  // Disallows copy and assignment.
+  SectionScope(const SectionScope &);
+  SectionScope &operator=(const SectionScope &);
+};
+
+}  // namespace
 
 LoudsTrie::LoudsTrie()
     : louds_(), terminal_flags_(), link_flags_(), bases_(), extras_(),
-      tail_(), next_trie_(), cache_(), cache_mask_(0), num_l1_nodes_(0),
-      config_(), mapper_() {}
+      tail_(), next_trie_(), cache_(), cache_mask_(0), cache_sets_(),
+      root_table_(), profile_(),
+      num_l1_nodes_(0), link_mode_(TEXT_TAIL_LINK),
+      tail_link_mode_(TEXT_TAIL_LINK), cache_mode_(SLOT_CACHE),
+      stamp_(thread::atomic_add(&stamp_counter, 1)),
+#ifdef MARISA_ENABLE_STATS
+      stats_(),
+#endif  // MARISA_ENABLE_STATS
+      config_(), allocator_(NULL), scratch_allocator_(NULL),
+      mapper_(), prefetcher_() {
+  cache_sets_.set_alignment(CacheSet::ALIGNMENT);
+#ifdef MARISA_ENABLE_STATS
+  stats_.set_alignment(STATS_STRIPE_ALIGNMENT);
+  stats_.resize(NUM_STATS_STRIPES * STATS_STRIPE_SIZE, 0);
+#endif  // MARISA_ENABLE_STATS
+}
 
 LoudsTrie::~LoudsTrie() {}
 
-void LoudsTrie::build(Keyset &keyset, int flags) {
+void LoudsTrie::build(Keyset &keyset, int flags, BuildObserver *observer,
+    const CacheLevel *cache_levels, std::size_t num_cache_levels) {
   Config config;
   config.parse(flags);
+  config.set_cache_levels(cache_levels, num_cache_levels);
 
+  Monitor monitor(observer);
   LoudsTrie temp;
-  temp.build_(keyset, config);
+  temp.set_allocator(allocator_, scratch_allocator_);
+  temp.build_(keyset, config, monitor);
   swap(temp);
 }
 
-void LoudsTrie::map(Mapper &mapper) {
-  Header().map(mapper);
+void LoudsTrie::map(Mapper &mapper, int map_flags) {
+  Header header;
+  header.map(mapper);
 
   LoudsTrie temp;
-  temp.map_(mapper);
+  temp.set_allocator(allocator_, scratch_allocator_);
+  if (header.version() == MARISA_FORMAT_V2) {
+    Directory directory;
+    directory.map(mapper);
+    MARISA_THROW_IF(directory.file_size() > MARISA_SIZE_MAX,
+        MARISA_SIZE_ERROR);
+    const std::size_t position = header.io_size() + directory.io_size();
+    if ((map_flags & MARISA_MAP_VERIFY) != 0) {
+      verify_sections_(mapper, directory, position);
+    }
+    temp.map_sections_(mapper, directory, 0, position);
+    if ((map_flags & MARISA_MAP_ADVISE) != 0) {
+      advise_sections_(mapper, directory, position);
+    }
+    mapper.seek((std::size_t)directory.file_size() - position);
+  } else {
+    // A v1 dictionary has no section directory, so it is advised as a whole.
+    if ((map_flags & MARISA_MAP_ADVISE) != 0) {
+      mapper.advise(0, mapper.avail(), Mapper::RANDOM_ADVICE);
+    }
+    temp.map_(mapper);
+  }
   temp.mapper_.swap(mapper);
   swap(temp);
 }
 
 void LoudsTrie::read(Reader &reader) {
-  Header().read(reader);
+  Header header;
+  header.read(reader);
 
   LoudsTrie temp;
-  temp.read_(reader);
+  temp.set_allocator(allocator_, scratch_allocator_);
+  if (header.version() == MARISA_FORMAT_V2) {
+    Directory directory;
+    directory.read(reader);
+    MARISA_THROW_IF(directory.file_size() > MARISA_SIZE_MAX,
+        MARISA_SIZE_ERROR);
+    UInt64 position = header.io_size() + directory.io_size();
+    temp.read_sections_(reader, directory, 0, &position);
+    reader.seek((std::size_t)(directory.file_size() - position));
+  } else {
+    temp.read_(reader);
+  }
   swap(temp);
 }
 
-void LoudsTrie::write(Writer &writer) const {
-  Header().write(writer);
-
-  write_(writer);
+void LoudsTrie::write(Writer &writer, FormatVersion format) const {
+  MARISA_THROW_IF((format != MARISA_FORMAT_V1) &&
+      (format != MARISA_FORMAT_V2), MARISA_CODE_ERROR);
+
+  Header header(format);
+  header.write(writer);
+
+  if (format == MARISA_FORMAT_V2) {
+    // If the writer can rewrite its output, the checksums are computed while
+    // the sections are written and the directory is written again at the
+    // end. Otherwise, the sections are encoded twice.
+    const UInt64 origin = writer.position() - header.io_size();
+    const bool computes_checksums = writer.can_rewrite();
+    Directory directory;
+    make_directory_(&directory, 0, !computes_checksums);
+    directory.layout();
+    directory.write(writer);
+    UInt64 position = header.io_size() + directory.io_size();
+    write_sections_(writer, &directory, 0, &position, computes_checksums);
+    writer.seek((std::size_t)(directory.file_size() - position));
+    if (computes_checksums) {
+      directory.layout();
+      std::ostringstream stream;
+      Writer directory_writer;
+      directory_writer.open(stream);
+      directory.write(directory_writer);
+      const std::string bytes = stream.str();
+      writer.rewrite(origin + header.io_size(), bytes.data(), bytes.size());
+    }
+  } else {
+    write_(writer);
+  }
 }
 
 bool LoudsTrie::lookup(Agent &agent) const {
   MARISA_DEBUG_IF(!agent.has_state(), MARISA_STATE_ERROR);
 
+  switch (link_mode_) {
+    case NEXT_TRIE_LINK: {
+      return (cache_mode_ == SLOT_CACHE) ?
+          lookup_<NEXT_TRIE_LINK, SLOT_CACHE>(agent) :
+          lookup_<NEXT_TRIE_LINK, SET_CACHE>(agent);
+    }
+    case BINARY_TAIL_LINK: {
+      return (cache_mode_ == SLOT_CACHE) ?
+          lookup_<BINARY_TAIL_LINK, SLOT_CACHE>(agent) :
+          lookup_<BINARY_TAIL_LINK, SET_CACHE>(agent);
+    }
+    default: {
+      return (cache_mode_ == SLOT_CACHE) ?
+          lookup_<TEXT_TAIL_LINK, SLOT_CACHE>(agent) :
+          lookup_<TEXT_TAIL_LINK, SET_CACHE>(agent);
+    }
+  }
+}
+
+template <LoudsTrie::LinkMode L, LoudsTrie::CacheMode C>
+bool LoudsTrie::lookup_(Agent &agent) const {
   State &state = agent.state();
   state.lookup_init();
+  jump_from_root(agent);
   while (state.query_pos() < agent.query().length()) {
+    if (!find_child<L, C>(agent)) {
+      return false;
+    }
+  }
+  if (!terminal_flags_[state.node_id()]) {
+    return false;
+  }
+  MARISA_STATS_COUNT(agent, RANK1_CALLS);
+  agent.set_key(agent.query().ptr(), agent.query().length());
+  agent.set_key(terminal_flags_.rank1(state.node_id()));
+  return true;
+}
+
+bool LoudsTrie::profile(Agent &agent) {
+  MARISA_DEBUG_IF(!agent.has_state(), MARISA_STATE_ERROR);
+
+  const std::size_t num_slots =
+      cache_sets_.empty() ? cache_.size() : cache_sets_.size();
+  if (profile_.num_slots() != num_slots) {
+    profile_.resize(num_slots);
+  }
+
+  State &state = agent.state();
+  state.lookup_init();
+  while (state.query_pos() < agent.query().length()) {
+    const std::size_t parent = state.node_id();
+    const char label = agent.query()[state.query_pos()];
+    const std::size_t slot = cache_sets_.empty() ?
+        get_cache_id(parent, label) : get_set_id(parent, label);
+    profile_.count_probe(find_cache(parent, label) != NULL);
     if (!find_child(agent)) {
       return false;
     }
+    profile_.count(slot, parent, state.node_id());
+    if (link_flags_[state.node_id()] && (next_trie_.get() != NULL)) {
+      next_trie_->profile_link_(get_link(state.node_id()));
+    }
   }
   if (!terminal_flags_[state.node_id()]) {
     return false;
@@ -68,13 +262,140 @@ bool LoudsTrie::lookup(Agent &agent) const {
   return true;
 }
 
+void LoudsTrie::rebuild_cache() {
+  // The new cache is built aside, so that the old one may be mapped.
+  if (!cache_sets_.empty()) {
+    if (profile_.num_slots() != cache_sets_.size()) {
+      return;
+    }
+    Vector<CacheSet> temp;
+    temp.set_allocator(allocator_);
+    temp.set_alignment(CacheSet::ALIGNMENT);
+    rebuild_cache_sets_(&temp);
+    cache_sets_.swap(temp);
+    return;
+  }
+
+  if (profile_.num_slots() != cache_.size()) {
+    return;
+  }
+  Vector<Cache> temp;
+  temp.set_allocator(allocator_);
+  rebuild_cache_(&temp);
+  cache_.swap(temp);
+}
+
+RootTable LoudsTrie::root_table() const {
+  if (root_table_.empty()) {
+    return MARISA_NO_ROOT_TABLE;
+  }
+  return (root_table_.size() == ROOT_TABLE_SIZE) ?
+      MARISA_ROOT_TABLE : MARISA_DEEP_ROOT_TABLE;
+}
+
+std::size_t LoudsTrie::cache_size(std::size_t level) const {
+  const LoudsTrie &trie = get_level_(level);
+  return trie.cache_sets_.empty() ? trie.cache_.size() :
+      (trie.cache_sets_.size() * CacheSet::NUM_WAYS);
+}
+
+std::size_t LoudsTrie::cache_hits(std::size_t level) const {
+  return get_level_(level).profile_.num_hits();
+}
+
+std::size_t LoudsTrie::cache_misses(std::size_t level) const {
+  return get_level_(level).profile_.num_misses();
+}
+
+void LoudsTrie::describe(Description *description) const {
+  MARISA_THROW_IF(description == NULL, MARISA_NULL_ERROR);
+  std::size_t num_levels = 1;
+  for (const LoudsTrie *trie = next_trie_.get(); trie != NULL;
+      trie = trie->next_trie_.get()) {
+    ++num_levels;
+  }
+  Description temp;
+  temp.resize(num_levels);
+  describe_(&temp, 0);
+  description->swap(temp);
+}
+
+#ifdef MARISA_ENABLE_STATS
+void LoudsTrie::add_stats(const Stats &stats, const Stats &base) const {
+  std::size_t * const stripe = &stats_[
+      (thread::Thread::index() % NUM_STATS_STRIPES) * STATS_STRIPE_SIZE];
+  for (std::size_t i = 0; i < Stats::NUM_COUNTERS; ++i) {
+    const Stats::Counter counter = (Stats::Counter)i;
+    if (stats[counter] != base[counter]) {
+      thread::atomic_add(&stripe[i], stats[counter] - base[counter]);
+    }
+  }
+}
+
+Stats LoudsTrie::stats() const {
+  Stats stats;
+  for (std::size_t i = 0; i < NUM_STATS_STRIPES; ++i) {
+    const std::size_t * const stripe = &stats_[i * STATS_STRIPE_SIZE];
+    for (std::size_t j = 0; j < Stats::NUM_COUNTERS; ++j) {
+      stats.add((Stats::Counter)j, thread::atomic_load(&stripe[j]));
+    }
+  }
+  return stats;
+}
+
+void LoudsTrie::clear_stats() {
+  for (std::size_t i = 0; i < stats_.size(); ++i) {
+    stats_[i] = 0;
+  }
+}
+#else  // MARISA_ENABLE_STATS
+void LoudsTrie::add_stats(const Stats &, const Stats &) const {}
+
+Stats LoudsTrie::stats() const {
+  return Stats();
+}
+
+void LoudsTrie::clear_stats() {}
+#endif  // MARISA_ENABLE_STATS
+
 void LoudsTrie::reverse_lookup(Agent &agent) const {
   MARISA_DEBUG_IF(!agent.has_state(), MARISA_STATE_ERROR);
   MARISA_THROW_IF(agent.query().id() >= size(), MARISA_BOUND_ERROR);
 
+  switch (link_mode_) {
+    case NEXT_TRIE_LINK: {
+      if (cache_mode_ == SLOT_CACHE) {
+        reverse_lookup_<NEXT_TRIE_LINK, SLOT_CACHE>(agent);
+      } else {
+        reverse_lookup_<NEXT_TRIE_LINK, SET_CACHE>(agent);
+      }
+      return;
+    }
+    case BINARY_TAIL_LINK: {
+      if (cache_mode_ == SLOT_CACHE) {
+        reverse_lookup_<BINARY_TAIL_LINK, SLOT_CACHE>(agent);
+      } else {
+        reverse_lookup_<BINARY_TAIL_LINK, SET_CACHE>(agent);
+      }
+      return;
+    }
+    default: {
+      if (cache_mode_ == SLOT_CACHE) {
+        reverse_lookup_<TEXT_TAIL_LINK, SLOT_CACHE>(agent);
+      } else {
+        reverse_lookup_<TEXT_TAIL_LINK, SET_CACHE>(agent);
+      }
+      return;
+    }
+  }
+}
+
+template <LoudsTrie::LinkMode L, LoudsTrie::CacheMode C>
+void LoudsTrie::reverse_lookup_(Agent &agent) const {
   State &state = agent.state();
   state.reverse_lookup_init();
 
+  MARISA_STATS_COUNT(agent, SELECT1_CALLS);
   state.set_node_id(terminal_flags_.select1(agent.query().id()));
   if (state.node_id() == 0) {
     agent.set_key(state.key_buf().begin(), state.key_buf().size());
@@ -82,9 +403,11 @@ void LoudsTrie::reverse_lookup(Agent &agent) const {
     return;
   }
   for ( ; ; ) {
+    MARISA_STATS_COUNT(agent, NODES_VISITED);
     if (link_flags_[state.node_id()]) {
+      MARISA_STATS_COUNT(agent, RANK1_CALLS);
       const std::size_t prev_key_pos = state.key_buf().size();
-      restore(agent, get_link(state.node_id()));
+      restore<L, C>(agent, get_link(state.node_id()));
       std::reverse(state.key_buf().begin() + prev_key_pos,
           state.key_buf().end());
     } else {
@@ -97,6 +420,7 @@ void LoudsTrie::reverse_lookup(Agent &agent) const {
       agent.set_key(agent.query().id());
       return;
     }
+    MARISA_STATS_COUNT(agent, SELECT1_CALLS);
     state.set_node_id(louds_.select1(state.node_id()) - state.node_id() - 1);
   }
 }
@@ -104,6 +428,27 @@ void LoudsTrie::reverse_lookup(Agent &agent) const {
 bool LoudsTrie::common_prefix_search(Agent &agent) const {
   MARISA_DEBUG_IF(!agent.has_state(), MARISA_STATE_ERROR);
 
+  switch (link_mode_) {
+    case NEXT_TRIE_LINK: {
+      return (cache_mode_ == SLOT_CACHE) ?
+          common_prefix_search_<NEXT_TRIE_LINK, SLOT_CACHE>(agent) :
+          common_prefix_search_<NEXT_TRIE_LINK, SET_CACHE>(agent);
+    }
+    case BINARY_TAIL_LINK: {
+      return (cache_mode_ == SLOT_CACHE) ?
+          common_prefix_search_<BINARY_TAIL_LINK, SLOT_CACHE>(agent) :
+          common_prefix_search_<BINARY_TAIL_LINK, SET_CACHE>(agent);
+    }
+    default: {
+      return (cache_mode_ == SLOT_CACHE) ?
+          common_prefix_search_<TEXT_TAIL_LINK, SLOT_CACHE>(agent) :
+          common_prefix_search_<TEXT_TAIL_LINK, SET_CACHE>(agent);
+    }
+  }
+}
+
+template <LoudsTrie::LinkMode L, LoudsTrie::CacheMode C>
+bool LoudsTrie::common_prefix_search_(Agent &agent) const {
   State &state = agent.state();
   if (state.status_code() == MARISA_END_OF_COMMON_PREFIX_SEARCH) {
     return false;
@@ -112,6 +457,7 @@ bool LoudsTrie::common_prefix_search(Agent &agent) const {
   if (state.status_code() != MARISA_READY_TO_COMMON_PREFIX_SEARCH) {
     state.common_prefix_search_init();
     if (terminal_flags_[state.node_id()]) {
+      MARISA_STATS_COUNT(agent, RANK1_CALLS);
       agent.set_key(agent.query().ptr(), state.query_pos());
       agent.set_key(terminal_flags_.rank1(state.node_id()));
       return true;
@@ -119,10 +465,11 @@ bool LoudsTrie::common_prefix_search(Agent &agent) const {
   }
 
   while (state.query_pos() < agent.query().length()) {
-    if (!find_child(agent)) {
+    if (!find_child<L, C>(agent)) {
       state.set_status_code(MARISA_END_OF_COMMON_PREFIX_SEARCH);
       return false;
     } else if (terminal_flags_[state.node_id()]) {
+      MARISA_STATS_COUNT(agent, RANK1_CALLS);
       agent.set_key(agent.query().ptr(), state.query_pos());
       agent.set_key(terminal_flags_.rank1(state.node_id()));
       return true;
@@ -135,6 +482,27 @@ bool LoudsTrie::common_prefix_search(Agent &agent) const {
 bool LoudsTrie::predictive_search(Agent &agent) const {
   MARISA_DEBUG_IF(!agent.has_state(), MARISA_STATE_ERROR);
 
+  switch (link_mode_) {
+    case NEXT_TRIE_LINK: {
+      return (cache_mode_ == SLOT_CACHE) ?
+          predictive_search_<NEXT_TRIE_LINK, SLOT_CACHE>(agent) :
+          predictive_search_<NEXT_TRIE_LINK, SET_CACHE>(agent);
+    }
+    case BINARY_TAIL_LINK: {
+      return (cache_mode_ == SLOT_CACHE) ?
+          predictive_search_<BINARY_TAIL_LINK, SLOT_CACHE>(agent) :
+          predictive_search_<BINARY_TAIL_LINK, SET_CACHE>(agent);
+    }
+    default: {
+      return (cache_mode_ == SLOT_CACHE) ?
+          predictive_search_<TEXT_TAIL_LINK, SLOT_CACHE>(agent) :
+          predictive_search_<TEXT_TAIL_LINK, SET_CACHE>(agent);
+    }
+  }
+}
+
+template <LoudsTrie::LinkMode L, LoudsTrie::CacheMode C>
+bool LoudsTrie::predictive_search_(Agent &agent) const {
   State &state = agent.state();
   if (state.status_code() == MARISA_END_OF_PREDICTIVE_SEARCH) {
     return false;
@@ -142,8 +510,12 @@ bool LoudsTrie::predictive_search(Agent &agent) const {
 
   if (state.status_code() != MARISA_READY_TO_PREDICTIVE_SEARCH) {
     state.predictive_search_init();
+    jump_from_root(agent);
+    for (std::size_t i = 0; i < state.query_pos(); ++i) {
+      state.key_buf().push_back(agent.query()[i]);
+    }
     while (state.query_pos() < agent.query().length()) {
-      if (!predictive_find_child(agent)) {
+      if (!predictive_find_child<L, C>(agent)) {
         state.set_status_code(MARISA_END_OF_PREDICTIVE_SEARCH);
         return false;
       }
@@ -156,6 +528,7 @@ bool LoudsTrie::predictive_search(Agent &agent) const {
     state.set_history_pos(1);
 
     if (terminal_flags_[state.node_id()]) {
+      MARISA_STATS_COUNT(agent, RANK1_CALLS);
       agent.set_key(state.key_buf().begin(), state.key_buf().size());
       agent.set_key(terminal_flags_.rank1(state.node_id()));
       return true;
@@ -166,6 +539,7 @@ bool LoudsTrie::predictive_search(Agent &agent) const {
     if (state.history_pos() == state.history().size()) {
       const History &current = state.history().back();
       History next;
+      MARISA_STATS_COUNT(agent, SELECT0_CALLS);
       next.set_louds_pos(louds_.select0(current.node_id()) + 1);
       next.set_node_id(next.louds_pos() - current.node_id() - 1);
       state.history().push_back(next);
@@ -175,10 +549,13 @@ bool LoudsTrie::predictive_search(Agent &agent) const {
     const bool link_flag = louds_[next.louds_pos()];
     next.set_louds_pos(next.louds_pos() + 1);
     if (link_flag) {
+      MARISA_STATS_COUNT(agent, NODES_VISITED);
       state.set_history_pos(state.history_pos() + 1);
       if (link_flags_[next.node_id()]) {
+        MARISA_STATS_COUNT_IF(agent,
+            next.link_id() == MARISA_INVALID_LINK_ID, RANK1_CALLS);
         next.set_link_id(update_link_id(next.link_id(), next.node_id()));
-        restore(agent, get_link(next.node_id(), next.link_id()));
+        restore<L, C>(agent, get_link(next.node_id(), next.link_id()));
       } else {
         state.key_buf().push_back((char)bases_[next.node_id()]);
       }
@@ -186,6 +563,7 @@ bool LoudsTrie::predictive_search(Agent &agent) const {
 
       if (terminal_flags_[next.node_id()]) {
         if (next.key_id() == MARISA_INVALID_KEY_ID) {
+          MARISA_STATS_COUNT(agent, RANK1_CALLS);
           next.set_key_id(terminal_flags_.rank1(next.node_id()));
         } else {
           next.set_key_id(next.key_id() + 1);
@@ -213,20 +591,137 @@ std::size_t LoudsTrie::total_size() const {
       + link_flags_.total_size() + bases_.total_size()
       + extras_.total_size() + tail_.total_size()
       + ((next_trie_.get() != NULL) ? next_trie_->total_size() : 0)
-      + cache_.total_size();
+      + cache_.total_size() + cache_sets_.total_size()
+      + root_table_.total_size();
 }
 
-std::size_t LoudsTrie::io_size() const {
+std::size_t LoudsTrie::io_size(FormatVersion format) const {
+  if (format == MARISA_FORMAT_V2) {
+    Directory directory;
+    make_directory_(&directory, 0, false);
+    directory.layout();
+    return (std::size_t)directory.file_size();
+  }
   return Header().io_size() + louds_.io_size()
       + terminal_flags_.io_size() + link_flags_.io_size()
       + bases_.io_size() + extras_.io_size() + tail_.io_size()
       + ((next_trie_.get() != NULL) ?
           (next_trie_->io_size() - Header().io_size()) : 0)
-      + cache_.io_size() + (sizeof(UInt32) * 2);
+      + cache_.io_size() + section_io_size_(Section::META_SECTION);
+}
+
+std::size_t LoudsTrie::warm_up(std::size_t budget, bool in_background) {
+  scoped_ptr<Prefetcher> prefetcher(new (std::nothrow) Prefetcher);
+  MARISA_THROW_IF(prefetcher.get() == NULL, MARISA_MEMORY_ERROR);
+  for (int phase = 0; phase < NUM_PREFETCH_PHASES; ++phase) {
+    prefetch_(prefetcher.get(), phase, true);
+  }
+
+  prefetcher_.reset();
+  if (!in_background) {
+    return prefetcher->run(budget);
+  }
+  const std::size_t size = prefetcher->start(budget);
+  prefetcher_.swap(prefetcher);
+  return size;
+}
+
+std::size_t LoudsTrie::pin(std::size_t budget, std::size_t *num_levels) {
+  MARISA_THROW_IF(mapper_.mapped_size() == 0, MARISA_STATE_ERROR);
+
+  // Levels are added while the regions fit in the budget. A level adds no
+  // nodes once the deepest level is reached.
+  Prefetcher prefetcher;
+  pin_(&prefetcher, 0);
+  if (prefetcher.lock_size() > budget) {
+    if (num_levels != NULL) {
+      *num_levels = 0;
+    }
+    return 0;
+  }
+  std::size_t level = 0;
+  for (std::size_t num_top_nodes = 0; num_top_nodes < num_nodes(); ) {
+    Prefetcher next_prefetcher;
+    pin_(&next_prefetcher, level + 1);
+    if (next_prefetcher.lock_size() > budget) {
+      break;
+    }
+    prefetcher.swap(next_prefetcher);
+    num_top_nodes = num_top_nodes_(++level);
+  }
+
+  const std::size_t num_locked_bytes = prefetcher.lock();
+  if (num_levels != NULL) {
+    *num_levels = level;
+  }
+  return num_locked_bytes;
+}
+
+std::size_t LoudsTrie::resident_size() const {
+  // A dictionary which is not mapped from a file is on the heap.
+  if (mapper_.mapped_size() == 0) {
+    return total_size();
+  }
+  return mapper_.resident_size();
+}
+
+void LoudsTrie::sorted_children(std::size_t node_id,
+    Vector<UInt32> *children) const {
+  MARISA_DEBUG_IF(children == NULL, MARISA_NULL_ERROR);
+
+  UInt32 ids[256];
+  UInt8 labels[256];
+  std::size_t num_children = 0;
+  std::size_t louds_pos = louds_.select0(node_id) + 1;
+  for (std::size_t child_id = louds_pos - node_id - 1; louds_[louds_pos];
+      ++child_id, ++louds_pos) {
+    MARISA_DEBUG_IF(num_children == 256, MARISA_RANGE_ERROR);
+    const UInt8 label = first_label_(child_id);
+    std::size_t i = num_children++;
+    for ( ; (i != 0) && (labels[i - 1] > label); --i) {
+      ids[i] = ids[i - 1];
+      labels[i] = labels[i - 1];
+    }
+    ids[i] = (UInt32)child_id;
+    labels[i] = label;
+  }
+  for (std::size_t i = 0; i < num_children; ++i) {
+    children->push_back(ids[i]);
+  }
+}
+
+void LoudsTrie::restore_label(Agent &agent, std::size_t node_id) const {
+  MARISA_DEBUG_IF(!agent.has_state(), MARISA_STATE_ERROR);
+  MARISA_DEBUG_IF(node_id == 0, MARISA_RANGE_ERROR);
+
+  if (!link_flags_[node_id]) {
+    agent.state().key_buf().push_back((char)bases_[node_id]);
+  } else if (next_trie_.get() != NULL) {
+    next_trie_->restore_(agent, get_link(node_id));
+  } else {
+    tail_.restore(agent, get_link(node_id));
+  }
+}
+
+void LoudsTrie::set_allocator(Allocator *allocator,
+    Allocator *scratch_allocator) {
+  louds_.set_allocator(allocator);
+  terminal_flags_.set_allocator(allocator);
+  link_flags_.set_allocator(allocator);
+  bases_.set_allocator(allocator);
+  extras_.set_allocator(allocator);
+  tail_.set_allocator(allocator);
+  cache_.set_allocator(allocator);
+  cache_sets_.set_allocator(allocator);
+  root_table_.set_allocator(allocator);
+  allocator_ = allocator;
+  scratch_allocator_ = scratch_allocator;
 }
 
 void LoudsTrie::clear() {
-  LoudsTrie().swap(*this);
+  LoudsTrie temp;
+  temp.set_allocator(allocator_, scratch_allocator_);
+  swap(temp);
 }
 
 void LoudsTrie::swap(LoudsTrie &rhs) {
@@ -239,13 +734,28 @@ void LoudsTrie::swap(LoudsTrie &rhs) {
   next_trie_.swap(rhs.next_trie_);
   cache_.swap(rhs.cache_);
   marisa::swap(cache_mask_, rhs.cache_mask_);
+  cache_sets_.swap(rhs.cache_sets_);
+  root_table_.swap(rhs.root_table_);
+  profile_.swap(rhs.profile_);
   marisa::swap(num_l1_nodes_, rhs.num_l1_nodes_);
+  marisa::swap(link_mode_, rhs.link_mode_);
+  marisa::swap(tail_link_mode_, rhs.tail_link_mode_);
+  marisa::swap(cache_mode_, rhs.cache_mode_);
+  marisa::swap(stamp_, rhs.stamp_);
+#ifdef MARISA_ENABLE_STATS
+  stats_.swap(rhs.stats_);
+#endif  // MARISA_ENABLE_STATS
   config_.swap(rhs.config_);
+  marisa::swap(allocator_, rhs.allocator_);
+  marisa::swap(scratch_allocator_, rhs.scratch_allocator_);
   mapper_.swap(rhs.mapper_);
+  prefetcher_.swap(rhs.prefetcher_);
 }
 
-void LoudsTrie::build_(Keyset &keyset, const Config &config) {
+void LoudsTrie::build_(Keyset &keyset, const Config &config,
+    Monitor &monitor) {
   Vector<Key> keys;
+  keys.set_allocator(scratch_allocator_);
   keys.resize(keyset.size());
   for (std::size_t i = 0; i < keyset.size(); ++i) {
     keys[i].set_str(keyset[i].ptr(), keyset[i].length());
@@ -253,11 +763,14 @@ void LoudsTrie::build_(Keyset &keyset, const Config &config) {
   }
 
   Vector<UInt32> terminals;
-  build_trie(keys, &terminals, config, 1);
+  terminals.set_allocator(scratch_allocator_);
+  build_trie(keys, &terminals, config, 1, monitor);
 
+  monitor.begin(BuildObserver::BUILD_TERMINALS, 1, keyset.size());
   typedef std::pair<UInt32, UInt32> TerminalIdPair;
 
   Vector<TerminalIdPair> pairs;
+  pairs.set_allocator(scratch_allocator_);
   pairs.resize(terminals.size());
   for (std::size_t i = 0; i < pairs.size(); ++i) {
     pairs[i].first = terminals[i];
@@ -287,25 +800,71 @@ void LoudsTrie::build_(Keyset &keyset, const Config &config) {
   for (std::size_t i = 0; i < keyset.size(); ++i) {
     keyset[pairs[i].second].set_id(terminal_flags_.rank1(pairs[i].first));
   }
+  monitor.end(bases_.size());
+
+  if (config.root_table() != MARISA_NO_ROOT_TABLE) {
+    build_root_table_(config.root_table());
+  }
+}
+
+void LoudsTrie::build_root_table_(RootTable root_table) {
+  // An entry keeps the state after the steps from the root which are done
+  // within its bytes. A step through a link which is longer than the rest of
+  // the bytes is left to the search, and so is a node which does not fit in
+  // an entry.
+  Vector<UInt32> table;
+  table.set_allocator(allocator_);
+  table.resize((root_table == MARISA_ROOT_TABLE) ?
+      ROOT_TABLE_SIZE : DEEP_ROOT_TABLE_SIZE);
+
+  Agent agent;
+  agent.init_state();
+  State &state = agent.state();
+  char bytes[2];
+  for (std::size_t i = 0; i < table.size(); ++i) {
+    if (i < ROOT_TABLE_SIZE) {
+      bytes[0] = (char)i;
+      agent.set_query(bytes, 1);
+    } else {
+      bytes[0] = (char)((i - ROOT_TABLE_SIZE) >> 8);
+      bytes[1] = (char)(i - ROOT_TABLE_SIZE);
+      agent.set_query(bytes, 2);
+    }
+    state.lookup_init();
+    std::size_t node_id = 0;
+    std::size_t query_pos = 0;
+    while ((state.query_pos() < agent.query().length()) &&
+        find_child(agent)) {
+      node_id = state.node_id();
+      query_pos = state.query_pos();
+    }
+    table[i] = (node_id <= (MARISA_UINT32_MAX >> 2)) ?
+        (UInt32)((node_id << 2) | query_pos) : 0;
+  }
+  root_table_.swap(table);
 }
 
 template <typename T>
-void LoudsTrie::build_trie(Vector<T> &keys,
-    Vector<UInt32> *terminals, const Config &config, std::size_t trie_id) {
-  build_current_trie(keys, terminals, config, trie_id);
+void LoudsTrie::build_trie(Vector<T> &keys, Vector<UInt32> *terminals,
+    const Config &config, std::size_t trie_id, Monitor &monitor) {
+  build_current_trie(keys, terminals, config, trie_id, monitor);
 
   Vector<UInt32> next_terminals;
+  next_terminals.set_allocator(scratch_allocator_);
   if (!keys.empty()) {
-    build_next_trie(keys, &next_terminals, config, trie_id);
+    build_next_trie(keys, &next_terminals, config, trie_id, monitor);
   }
 
+  monitor.begin(BuildObserver::BUILD_LINKS, trie_id, next_terminals.size());
   if (next_trie_.get() != NULL) {
-    config_.parse((next_trie_->num_tries() + 1) |
-        next_trie_->tail_mode() | next_trie_->node_order());
+    config_.parse((next_trie_->num_tries() + 1) | next_trie_->cache_level() |
+        next_trie_->tail_mode() | next_trie_->node_order() |
+        next_trie_->cache_layout());
   } else {
     config_.parse(1 | tail_.mode() | config.node_order() |
-        config.cache_level());
+        config.cache_level() | config.cache_layout());
   }
+  select_modes_();
 
   link_flags_.build(false, false);
   std::size_t node_id = 0;
@@ -319,16 +878,20 @@ void LoudsTrie::build_trie(Vector<T> &keys,
   }
   extras_.build(next_terminals);
   fill_cache();
+  monitor.end(bases_.size());
 }
 
 template <typename T>
-void LoudsTrie::build_current_trie(Vector<T> &keys,
-    Vector<UInt32> *terminals, const Config &config,
-    std::size_t trie_id) try {
+void LoudsTrie::build_current_trie(Vector<T> &keys, Vector<UInt32> *terminals,
+    const Config &config, std::size_t trie_id, Monitor &monitor) try {
+  monitor.begin(BuildObserver::SORT_KEYS, trie_id, keys.size());
   for (std::size_t i = 0; i < keys.size(); ++i) {
     keys[i].set_id(i);
   }
   const std::size_t num_keys = Algorithm().sort(keys.begin(), keys.end());
+  monitor.end(0);
+
+  monitor.begin(BuildObserver::BUILD_LEVELS, trie_id, num_keys);
   reserve_cache(config, trie_id, num_keys);
 
   louds_.push_back(true);
@@ -337,8 +900,10 @@ void LoudsTrie::build_current_trie(Vector<T> &keys,
   link_flags_.push_back(false);
 
   Vector<T> next_keys;
+  next_keys.set_allocator(scratch_allocator_);
   std::queue<Range> queue;
   Vector<WeightedRange> w_ranges;
+  w_ranges.set_allocator(scratch_allocator_);
 
   queue.push(make_range(0, keys.size(), 0));
   while (!queue.empty()) {
@@ -417,30 +982,37 @@ void LoudsTrie::build_current_trie(Vector<T> &keys,
     }
     louds_.push_back(false);
   }
+  monitor.end(bases_.size());
 
+  monitor.begin(BuildObserver::BUILD_INDEX, trie_id, num_keys);
   louds_.push_back(false);
   louds_.build(trie_id == 1, true);
   bases_.shrink();
 
   build_terminals(keys, terminals);
   keys.swap(next_keys);
+  monitor.end(bases_.size());
 } catch (const std::bad_alloc &) {
   MARISA_THROW(MARISA_MEMORY_ERROR, "std::bad_alloc");
 }
 
 template <>
-void LoudsTrie::build_next_trie(Vector<Key> &keys,
-    Vector<UInt32> *terminals, const Config &config, std::size_t trie_id) {
+void LoudsTrie::build_next_trie(Vector<Key> &keys, Vector<UInt32> *terminals,
+    const Config &config, std::size_t trie_id, Monitor &monitor) {
   if (trie_id == config.num_tries()) {
+    monitor.begin(BuildObserver::BUILD_TAIL, trie_id, keys.size());
     Vector<Entry> entries;
+    entries.set_allocator(scratch_allocator_);
     entries.resize(keys.size());
     for (std::size_t i = 0; i < keys.size(); ++i) {
       entries[i].set_str(keys[i].ptr(), keys[i].length());
     }
     tail_.build(entries, terminals, config.tail_mode());
+    monitor.end(0);
     return;
   }
   Vector<ReverseKey> reverse_keys;
+  reverse_keys.set_allocator(scratch_allocator_);
   reverse_keys.resize(keys.size());
   for (std::size_t i = 0; i < keys.size(); ++i) {
     reverse_keys[i].set_str(keys[i].ptr(), keys[i].length());
@@ -449,30 +1021,37 @@ void LoudsTrie::build_next_trie(Vector<Key> &keys,
   keys.clear();
   next_trie_.reset(new (std::nothrow) LoudsTrie);
   MARISA_THROW_IF(next_trie_.get() == NULL, MARISA_MEMORY_ERROR);
-  next_trie_->build_trie(reverse_keys, terminals, config, trie_id + 1);
+  next_trie_->set_allocator(allocator_, scratch_allocator_);
+  next_trie_->build_trie(reverse_keys, terminals, config, trie_id + 1,
+      monitor);
 }
 
 template <>
-void LoudsTrie::build_next_trie(Vector<ReverseKey> &keys,
-    Vector<UInt32> *terminals, const Config &config, std::size_t trie_id) {
+void LoudsTrie::build_next_trie(Vector<ReverseKey> &keys, Vector<UInt32> *terminals,
+    const Config &config, std::size_t trie_id, Monitor &monitor) {
   if (trie_id == config.num_tries()) {
+    monitor.begin(BuildObserver::BUILD_TAIL, trie_id, keys.size());
     Vector<Entry> entries;
+    entries.set_allocator(scratch_allocator_);
     entries.resize(keys.size());
     for (std::size_t i = 0; i < keys.size(); ++i) {
       entries[i].set_str(keys[i].ptr(), keys[i].length());
     }
     tail_.build(entries, terminals, config.tail_mode());
+    monitor.end(0);
     return;
   }
   next_trie_.reset(new (std::nothrow) LoudsTrie);
   MARISA_THROW_IF(next_trie_.get() == NULL, MARISA_MEMORY_ERROR);
-  next_trie_->build_trie(keys, terminals, config, trie_id + 1);
+  next_trie_->set_allocator(allocator_, scratch_allocator_);
+  next_trie_->build_trie(keys, terminals, config, trie_id + 1, monitor);
 }
 
 template <typename T>
 void LoudsTrie::build_terminals(const Vector<T> &keys,
     Vector<UInt32> *terminals) const {
   Vector<UInt32> temp;
+  temp.set_allocator(terminals->allocator());
   temp.resize(keys.size());
   for (std::size_t i = 0; i < keys.size(); ++i) {
     temp[keys[i].id()] = (UInt32)keys[i].terminal();
@@ -485,6 +1064,11 @@ void LoudsTrie::cache<Key>(std::size_t parent, std::size_t child,
     float weight, char label) {
   MARISA_DEBUG_IF(parent >= child, MARISA_RANGE_ERROR);
 
+  if (!cache_sets_.empty()) {
+    cache_sets_[get_set_id(parent, label)].insert(parent, child, weight,
+        label);
+    return;
+  }
   const std::size_t cache_id = get_cache_id(parent, label);
   if (weight > cache_[cache_id].weight()) {
     cache_[cache_id].set_parent(parent);
@@ -496,9 +1080,16 @@ void LoudsTrie::cache<Key>(std::size_t parent, std::size_t child,
 void LoudsTrie::reserve_cache(const Config &config, std::size_t trie_id,
     std::size_t num_keys) {
   std::size_t cache_size = (trie_id == 1) ? 256 : 1;
-  while (cache_size < (num_keys / config.cache_level())) {
+  while (cache_size < (num_keys / config.cache_level(trie_id - 1))) {
     cache_size *= 2;
   }
+  if (config.cache_layout() == MARISA_ASSOCIATIVE_CACHE) {
+    // The sets take as much space as the slots of MARISA_DIRECT_CACHE.
+    const std::size_t num_sets =
+        (cache_size * sizeof(Cache)) / sizeof(CacheSet);
+    cache_sets_.resize((num_sets != 0) ? num_sets : 1);
+    return;
+  }
   cache_.resize(cache_size);
   cache_mask_ = cache_size - 1;
 }
@@ -508,6 +1099,10 @@ void LoudsTrie::cache<ReverseKey>(std::size_t parent, std::size_t child,
     float weight, char) {
   MARISA_DEBUG_IF(parent >= child, MARISA_RANGE_ERROR);
 
+  if (!cache_sets_.empty()) {
+    cache_sets_[get_set_id(child)].insert(parent, child, weight, '\0');
+    return;
+  }
   const std::size_t cache_id = get_cache_id(child);
   if (weight > cache_[cache_id].weight()) {
     cache_[cache_id].set_parent(parent);
@@ -516,20 +1111,125 @@ void LoudsTrie::cache<ReverseKey>(std::size_t parent, std::size_t child,
   }
 }
 
+void LoudsTrie::rebuild_cache_(Vector<Cache> *cache) const {
+  cache->resize(cache_.size());
+  for (std::size_t i = 0; i < cache_.size(); ++i) {
+    (*cache)[i] = cache_[i];
+    const Profile::Edge &edge = profile_.top(i);
+    if (edge.count() != 0) {
+      (*cache)[i].set_parent(edge.parent());
+      (*cache)[i].set_child(edge.child());
+      fill_cache_(&(*cache)[i]);
+    }
+  }
+}
+
+void LoudsTrie::rebuild_cache_sets_(Vector<CacheSet> *cache_sets) const {
+  cache_sets->resize(cache_sets_.size());
+  for (std::size_t i = 0; i < cache_sets_.size(); ++i) {
+    const CacheSet &old_set = cache_sets_[i];
+    CacheSet &set = (*cache_sets)[i];
+    for (std::size_t j = 0; j < CacheSet::NUM_WAYS; ++j) {
+      set[j].set_parent(MARISA_UINT32_MAX);
+      set[j].set_child(MARISA_UINT32_MAX);
+    }
+
+    std::size_t num_ways = 0;
+    bool is_used[Profile::NUM_CANDIDATES] = { false };
+    while (num_ways < CacheSet::NUM_WAYS) {
+      std::size_t max_id = Profile::NUM_CANDIDATES;
+      for (std::size_t j = 0; j < Profile::NUM_CANDIDATES; ++j) {
+        const UInt32 count = profile_.candidate(i, j).count();
+        if (!is_used[j] && (count != 0) &&
+            ((max_id == Profile::NUM_CANDIDATES) ||
+             (count > profile_.candidate(i, max_id).count()))) {
+          max_id = j;
+        }
+      }
+      if (max_id == Profile::NUM_CANDIDATES) {
+        break;
+      }
+      is_used[max_id] = true;
+      const Profile::Edge &edge = profile_.candidate(i, max_id);
+      set[num_ways].set_parent(edge.parent());
+      set[num_ways].set_child(edge.child());
+      set.set_label(num_ways, (char)first_label_(edge.child()));
+      fill_cache_(&set[num_ways]);
+      ++num_ways;
+    }
+    for (std::size_t j = 0;
+        (j < CacheSet::NUM_WAYS) && (num_ways < CacheSet::NUM_WAYS); ++j) {
+      if ((old_set[j].child() != MARISA_UINT32_MAX) &&
+          (set.find(old_set[j].parent(), old_set.label(j)) == NULL)) {
+        set[num_ways] = old_set[j];
+        set.set_label(num_ways, old_set.label(j));
+        ++num_ways;
+      }
+    }
+  }
+}
+
+// profile_link_() follows the probes of restore_(), which are the same as
+// those of a successful match_().
+void LoudsTrie::profile_link_(std::size_t node_id) {
+  for ( ; ; ) {
+    const Cache * const cache = find_cache(node_id);
+    profile_.count_probe(cache != NULL);
+    if (cache != NULL) {
+      if ((cache->extra() != MARISA_INVALID_EXTRA) &&
+          (next_trie_.get() != NULL)) {
+        next_trie_->profile_link_(cache->link());
+      }
+      node_id = cache->parent();
+      if (node_id == 0) {
+        return;
+      }
+      continue;
+    }
+
+    if (link_flags_[node_id] && (next_trie_.get() != NULL)) {
+      next_trie_->profile_link_(get_link(node_id));
+    }
+    if (node_id <= num_l1_nodes_) {
+      return;
+    }
+    node_id = louds_.select1(node_id) - node_id - 1;
+  }
+}
+
+const LoudsTrie &LoudsTrie::get_level_(std::size_t level) const {
+  const LoudsTrie *trie = this;
+  for (std::size_t i = 0; i < level; ++i) {
+    trie = trie->next_trie_.get();
+    MARISA_THROW_IF(trie == NULL, MARISA_BOUND_ERROR);
+  }
+  return *trie;
+}
+
 void LoudsTrie::fill_cache() {
   for (std::size_t i = 0; i < cache_.size(); ++i) {
-    const std::size_t node_id = cache_[i].child();
-    if (node_id != 0) {
-      cache_[i].set_base(bases_[node_id]);
-      cache_[i].set_extra(!link_flags_[node_id] ?
-          MARISA_INVALID_EXTRA : extras_[link_flags_.rank1(node_id)]);
-    } else {
-      cache_[i].set_parent(MARISA_UINT32_MAX);
-      cache_[i].set_child(MARISA_UINT32_MAX);
+    fill_cache_(&cache_[i]);
+  }
+  for (std::size_t i = 0; i < cache_sets_.size(); ++i) {
+    cache_sets_[i].sort();
+    for (std::size_t j = 0; j < CacheSet::NUM_WAYS; ++j) {
+      fill_cache_(&cache_sets_[i][j]);
     }
   }
 }
 
+void LoudsTrie::fill_cache_(Cache *cache) const {
+  const std::size_t node_id = cache->child();
+  if (node_id != 0) {
+    cache->set_base(bases_[node_id]);
+    cache->set_extra(!link_flags_[node_id] ?
+        MARISA_INVALID_EXTRA : extras_[link_flags_.rank1(node_id)]);
+  } else {
+    cache->set_parent(MARISA_UINT32_MAX);
+    cache->set_child(MARISA_UINT32_MAX);
+  }
+}
+
 void LoudsTrie::map_(Mapper &mapper) {
   louds_.map(mapper);
   terminal_flags_.map(mapper);
@@ -537,23 +1237,16 @@ void LoudsTrie::map_(Mapper &mapper) {
   bases_.map(mapper);
   extras_.map(mapper);
   tail_.map(mapper);
-  if ((link_flags_.num_1s() != 0) && tail_.empty()) {
+  if (has_next_trie_()) {
     next_trie_.reset(new (std::nothrow) LoudsTrie);
     MARISA_THROW_IF(next_trie_.get() == NULL, MARISA_MEMORY_ERROR);
+    next_trie_->set_allocator(allocator_, scratch_allocator_);
     next_trie_->map_(mapper);
   }
   cache_.map(mapper);
   cache_mask_ = cache_.size() - 1;
-  {
-    UInt32 temp_num_l1_nodes;
-    mapper.map(&temp_num_l1_nodes);
-    num_l1_nodes_ = temp_num_l1_nodes;
-  }
-  {
-    UInt32 temp_config_flags;
-    mapper.map(&temp_config_flags);
-    config_.parse((int)temp_config_flags);
-  }
+  map_section_(mapper, Section::META_SECTION);
+  select_modes_();
 }
 
 void LoudsTrie::read_(Reader &reader) {
@@ -563,23 +1256,16 @@ void LoudsTrie::read_(Reader &reader) {
   bases_.read(reader);
   extras_.read(reader);
   tail_.read(reader);
-  if ((link_flags_.num_1s() != 0) && tail_.empty()) {
+  if (has_next_trie_()) {
     next_trie_.reset(new (std::nothrow) LoudsTrie);
     MARISA_THROW_IF(next_trie_.get() == NULL, MARISA_MEMORY_ERROR);
+    next_trie_->set_allocator(allocator_, scratch_allocator_);
     next_trie_->read_(reader);
   }
   cache_.read(reader);
   cache_mask_ = cache_.size() - 1;
-  {
-    UInt32 temp_num_l1_nodes;
-    reader.read(&temp_num_l1_nodes);
-    num_l1_nodes_ = temp_num_l1_nodes;
-  }
-  {
-    UInt32 temp_config_flags;
-    reader.read(&temp_config_flags);
-    config_.parse((int)temp_config_flags);
-  }
+  read_section_(reader, Section::META_SECTION);
+  select_modes_();
 }
 
 void LoudsTrie::write_(Writer &writer) const {
@@ -593,29 +1279,618 @@ void LoudsTrie::write_(Writer &writer) const {
     next_trie_->write_(writer);
   }
   cache_.write(writer);
-  writer.write((UInt32)num_l1_nodes_);
-  writer.write((UInt32)config_.flags());
+  write_section_(writer, Section::META_SECTION);
+}
+
+void LoudsTrie::prefetch_(Prefetcher *prefetcher, int phase,
+    bool is_top) const {
+  // In weight order, the nodes of a level are arranged in descending order
+  // of weight, so the rest is also touched from heavier nodes.
+  const std::size_t num_top_nodes = is_top ? num_top_nodes_() : 0;
+  const std::size_t num_top_bits = (num_top_nodes != 0) ?
+      (louds_.select0(num_top_nodes) + 1) : 0;
+  switch (phase) {
+    case CACHE_PREFETCH_PHASE: {
+      prefetcher->add(root_table_);
+      prefetcher->add(cache_);
+      prefetcher->add(cache_sets_);
+      break;
+    }
+    case INDEX_PREFETCH_PHASE: {
+      louds_.prefetch_index(prefetcher);
+      terminal_flags_.prefetch_index(prefetcher);
+      link_flags_.prefetch_index(prefetcher);
+      break;
+    }
+    case TOP_PREFETCH_PHASE: {
+      if (is_top) {
+        louds_.prefetch_bits(prefetcher, 0, num_top_bits);
+        prefetcher->add(bases_.begin(), num_top_nodes);
+        terminal_flags_.prefetch_bits(prefetcher, 0, num_top_nodes);
+        link_flags_.prefetch_bits(prefetcher, 0, num_top_nodes);
+      }
+      return;
+    }
+    case REST_PREFETCH_PHASE: {
+      louds_.prefetch_bits(prefetcher, num_top_bits, louds_.size());
+      prefetcher->add(bases_.begin() + num_top_nodes,
+          bases_.size() - num_top_nodes);
+      terminal_flags_.prefetch_bits(prefetcher, num_top_nodes,
+          terminal_flags_.size());
+      link_flags_.prefetch_bits(prefetcher, num_top_nodes,
+          link_flags_.size());
+      extras_.prefetch(prefetcher);
+      tail_.prefetch(prefetcher);
+      break;
+    }
+    default: {
+      MARISA_THROW(MARISA_CODE_ERROR, "undefined phase");
+    }
+  }
+  if (next_trie_.get() != NULL) {
+    next_trie_->prefetch_(prefetcher, phase, false);
+  }
+}
+
+void LoudsTrie::pin_(Prefetcher *prefetcher, std::size_t num_levels) const {
+  prefetcher->add(root_table_);
+  prefetcher->add(cache_);
+  prefetcher->add(cache_sets_);
+  louds_.prefetch_index(prefetcher);
+  terminal_flags_.prefetch_index(prefetcher);
+  link_flags_.prefetch_index(prefetcher);
+  if (num_levels != 0) {
+    const std::size_t num_top_nodes = num_top_nodes_(num_levels);
+    louds_.prefetch_bits(prefetcher, 0, louds_.select0(num_top_nodes) + 1);
+    prefetcher->add(bases_.begin(), num_top_nodes);
+    terminal_flags_.prefetch_bits(prefetcher, 0, num_top_nodes);
+    link_flags_.prefetch_bits(prefetcher, 0, num_top_nodes);
+  }
+}
+
+void LoudsTrie::describe_(Description *description,
+    std::size_t level) const {
+  description->add(level, Description::NUM_NODES, num_nodes());
+  description->add(level, Description::NUM_TERMINALS,
+      terminal_flags_.num_1s());
+  description->add(level, Description::NUM_LINKS, link_flags_.num_1s());
+
+  const BitVector * const bit_vectors[] = {
+    &louds_, &terminal_flags_, &link_flags_
+  };
+  const Description::Item bit_vector_items[] = {
+    Description::LOUDS_BITS_SIZE,
+    Description::TERMINAL_BITS_SIZE,
+    Description::LINK_BITS_SIZE
+  };
+  for (std::size_t i = 0; i < 3; ++i) {
+    // The bits, the rank index and the select indexes are consecutive items.
+    const Description::Item item = bit_vector_items[i];
+    description->add(level, item, bit_vectors[i]->bits_size());
+    description->add(level, (Description::Item)(item + 1),
+        bit_vectors[i]->rank_index_size());
+    description->add(level, (Description::Item)(item + 2),
+        bit_vectors[i]->select_index_size());
+  }
+  description->add(level, Description::BASES_SIZE, bases_.total_size());
+  description->add(level, Description::EXTRAS_SIZE, extras_.total_size());
+
+  std::size_t num_filled_entries = 0;
+  if (cache_sets_.empty()) {
+    description->add(level, Description::NUM_CACHE_ENTRIES, cache_.size());
+    for (std::size_t i = 0; i < cache_.size(); ++i) {
+      if (cache_[i].child() != MARISA_UINT32_MAX) {
+        ++num_filled_entries;
+      }
+    }
+  } else {
+    description->add(level, Description::NUM_CACHE_ENTRIES,
+        cache_sets_.size() * CacheSet::NUM_WAYS);
+    for (std::size_t i = 0; i < cache_sets_.size(); ++i) {
+      for (std::size_t j = 0; j < CacheSet::NUM_WAYS; ++j) {
+        if (cache_sets_[i][j].child() != MARISA_UINT32_MAX) {
+          ++num_filled_entries;
+        }
+      }
+    }
+  }
+  description->add(level, Description::NUM_FILLED_CACHE_ENTRIES,
+      num_filled_entries);
+  description->add(level, Description::CACHE_SIZE,
+      cache_.total_size() + cache_sets_.total_size());
+  description->add(level, Description::ROOT_TABLE_SIZE,
+      root_table_.total_size());
+
+  description->add(level, Description::TAIL_SIZE, tail_.total_size());
+  description->add(level, Description::TAIL_LENGTH, tail_.size());
+  if (!tail_.empty()) {
+    std::size_t link_id = 0;
+    for (std::size_t i = 0; i < num_nodes(); ++i) {
+      if (link_flags_[i]) {
+        description->add(level, Description::SUFFIX_LENGTH,
+            tail_.suffix_size(get_link(i, link_id++)));
+      }
+    }
+  }
+
+  // LOUDS is scanned in level order. The children of a node are given by
+  // 1s followed by a 0, after "10" for the root, and a 0 is appended to the
+  // end.
+  std::size_t parent = 0;
+  std::size_t depth = 0;
+  std::size_t level_end = 1;
+  std::size_t num_children = 0;
+  std::size_t next_child = 1;
+  for (std::size_t i = 2; parent < num_nodes(); ++i) {
+    if (louds_[i]) {
+      ++num_children;
+      continue;
+    }
+    description->add_fanout(level, num_children);
+    if ((level == 0) && terminal_flags_[parent]) {
+      description->add_key_depth(depth);
+    }
+    next_child += num_children;
+    num_children = 0;
+    if (++parent == level_end) {
+      ++depth;
+      level_end = next_child;
+    }
+  }
+
+  if (next_trie_.get() != NULL) {
+    next_trie_->describe_(description, level + 1);
+  }
+}
+
+std::size_t LoudsTrie::num_top_nodes_(std::size_t num_levels) const {
+  // The top levels are the root and its descendants in the following
+  // `num_levels' - 1 levels. Nodes are arranged in level order, so the
+  // first child of the first node of a level follows the last node of the
+  // next level.
+  if (num_levels == 0) {
+    return 0;
+  }
+  std::size_t node_id = 1;
+  for (std::size_t level = 1; level < num_levels; ++level) {
+    if (node_id >= num_nodes()) {
+      return num_nodes();
+    }
+    node_id = louds_.select0(node_id) - node_id;
+  }
+  return (node_id < num_nodes()) ? node_id : num_nodes();
+}
+
+void LoudsTrie::map_sections_(const Mapper &mapper,
+    const Directory &directory, std::size_t level, std::size_t position) {
+  for (int i = 0; i < Section::NUM_SECTION_KINDS; ++i) {
+    const Section::Kind kind = (Section::Kind)i;
+    const UInt32 id = Section::make_id(level, kind);
+    if (Section::is_optional(kind) && !directory.contains(id)) {
+      continue;
+    }
+    const Section &section = directory.find(id);
+    MARISA_THROW_IF(section.offset() < position, MARISA_FORMAT_ERROR);
+
+    Mapper section_mapper;
+    section_mapper.open(mapper, (std::size_t)section.offset() - position,
+        (std::size_t)section.size());
+    map_section_(section_mapper, kind);
+    MARISA_THROW_IF(section_mapper.avail() != 0, MARISA_FORMAT_ERROR);
+  }
+  if (has_next_trie_()) {
+    next_trie_.reset(new (std::nothrow) LoudsTrie);
+    MARISA_THROW_IF(next_trie_.get() == NULL, MARISA_MEMORY_ERROR);
+    next_trie_->set_allocator(allocator_, scratch_allocator_);
+    next_trie_->map_sections_(mapper, directory, level + 1, position);
+  }
+  select_modes_();
+}
+
+void LoudsTrie::read_sections_(Reader &reader, const Directory &directory,
+    std::size_t level, UInt64 *position) {
+  for (int i = 0; i < Section::NUM_SECTION_KINDS; ++i) {
+    const Section::Kind kind = (Section::Kind)i;
+    const UInt32 id = Section::make_id(level, kind);
+    if (Section::is_optional(kind) && !directory.contains(id)) {
+      continue;
+    }
+    const Section &section = directory.find(id);
+    MARISA_THROW_IF(section.offset() < *position, MARISA_FORMAT_ERROR);
+    reader.seek((std::size_t)(section.offset() - *position));
+
+    // The reader is limited to the section, so that a broken size is not
+    // allocated, and the checksum is computed over the bytes read.
+    Crc32c crc;
+    {
+      SectionScope scope(reader, (std::size_t)section.size(), &crc);
+      read_section_(reader, kind);
+      MARISA_THROW_IF(reader.avail() != 0, MARISA_FORMAT_ERROR);
+    }
+    MARISA_THROW_IF(crc.value() != section.crc(), MARISA_FORMAT_ERROR);
+    *position = section.offset() + section.size();
+  }
+  if (has_next_trie_()) {
+    next_trie_.reset(new (std::nothrow) LoudsTrie);
+    MARISA_THROW_IF(next_trie_.get() == NULL, MARISA_MEMORY_ERROR);
+    next_trie_->set_allocator(allocator_, scratch_allocator_);
+    next_trie_->read_sections_(reader, directory, level + 1, position);
+  }
+  select_modes_();
+}
+
+void LoudsTrie::write_sections_(Writer &writer, Directory *directory,
+    std::size_t level, UInt64 *position, bool computes_checksums) const {
+  for (int i = 0; i < Section::NUM_SECTION_KINDS; ++i) {
+    const Section::Kind kind = (Section::Kind)i;
+    if (!has_section_(kind)) {
+      continue;
+    }
+    const UInt32 id = Section::make_id(level, kind);
+    const Section &section = directory->find(id);
+    writer.seek((std::size_t)(section.offset() - *position));
+    if (computes_checksums) {
+      Crc32c crc;
+      writer.set_checksum(&crc);
+      write_section_(writer, kind);
+      writer.set_checksum(NULL);
+      MARISA_THROW_IF(crc.size() != section.size(), MARISA_CODE_ERROR);
+      directory->set_crc(id, crc.value());
+    } else {
+      write_section_(writer, kind);
+    }
+    *position = section.offset() + section.size();
+  }
+  if (next_trie_.get() != NULL) {
+    next_trie_->write_sections_(writer, directory, level + 1, position,
+        computes_checksums);
+  }
+}
+
+void LoudsTrie::make_directory_(Directory *directory, std::size_t level,
+    bool with_checksums) const {
+  for (int i = 0; i < Section::NUM_SECTION_KINDS; ++i) {
+    const Section::Kind kind = (Section::Kind)i;
+    if (!has_section_(kind)) {
+      continue;
+    }
+    if (with_checksums) {
+      Crc32c crc;
+      Writer writer;
+      writer.open(crc);
+      write_section_(writer, kind);
+      directory->push_back(Section::make_id(level, kind), crc.size(),
+          crc.value());
+    } else {
+      directory->push_back(Section::make_id(level, kind),
+          section_io_size_(kind), 0);
+    }
+  }
+  if (next_trie_.get() != NULL) {
+    next_trie_->make_directory_(directory, level + 1, with_checksums);
+  }
+}
+
+void LoudsTrie::advise_sections_(const Mapper &mapper,
+    const Directory &directory, std::size_t position) {
+  // Lookups touch the root table, the cache, which is in META in
+  // MARISA_ASSOCIATIVE_CACHE, and the LOUDS of the first trie at every step,
+  // so they are read in advance. The others, especially TAIL, are accessed
+  // at random. Advice on overlapping pages is applied in this order so that
+  // the read-ahead is not cancelled.
+  const std::size_t end = (std::size_t)directory.file_size();
+  mapper.advise(0, end - position, Mapper::RANDOM_ADVICE);
+  for (std::size_t i = 0; i < directory.num_sections(); ++i) {
+    const Section &section = directory[i];
+    const std::size_t level = section.id() >> 8;
+    const std::size_t kind = section.id() & 0xFF;
+    if ((kind == Section::CACHE_SECTION) ||
+        (kind == Section::META_SECTION) ||
+        (kind == Section::ROOT_TABLE_SECTION) ||
+        ((level == 0) && (kind == Section::LOUDS_SECTION))) {
+      mapper.advise((std::size_t)section.offset() - position,
+          (std::size_t)section.size(), Mapper::WILLNEED_ADVICE);
+    }
+  }
+}
+
+void LoudsTrie::verify_sections_(const Mapper &mapper,
+    const Directory &directory, std::size_t position) {
+  for (std::size_t i = 0; i < directory.num_sections(); ++i) {
+    const Section &section = directory[i];
+    const std::size_t size = (std::size_t)section.size();
+    Mapper section_mapper;
+    section_mapper.open(mapper, (std::size_t)section.offset() - position,
+        size);
+    const char *bytes;
+    section_mapper.map(&bytes, size);
+    MARISA_THROW_IF(Crc32c::compute(bytes, size) != section.crc(),
+        MARISA_FORMAT_ERROR);
+  }
+}
+
+void LoudsTrie::map_section_(Mapper &mapper, Section::Kind kind) {
+  switch (kind) {
+    case Section::LOUDS_SECTION: {
+      louds_.map(mapper);
+      break;
+    }
+    case Section::TERMINAL_FLAGS_SECTION: {
+      terminal_flags_.map(mapper);
+      break;
+    }
+    case Section::LINK_FLAGS_SECTION: {
+      link_flags_.map(mapper);
+      break;
+    }
+    case Section::BASES_SECTION: {
+      bases_.map(mapper);
+      break;
+    }
+    case Section::EXTRAS_SECTION: {
+      extras_.map(mapper);
+      break;
+    }
+    case Section::TAIL_SECTION: {
+      tail_.map(mapper);
+      break;
+    }
+    case Section::CACHE_SECTION: {
+      cache_.map(mapper);
+      cache_mask_ = cache_.size() - 1;
+      break;
+    }
+    case Section::META_SECTION: {
+      UInt32 temp_num_l1_nodes;
+      mapper.map(&temp_num_l1_nodes);
+      num_l1_nodes_ = temp_num_l1_nodes;
+      UInt32 temp_config_flags;
+      mapper.map(&temp_config_flags);
+      config_.parse((int)temp_config_flags);
+      if (config_.cache_layout() == MARISA_ASSOCIATIVE_CACHE) {
+        mapper.seek(CACHE_SET_PADDING);
+        cache_sets_.map(mapper);
+        MARISA_THROW_IF(cache_sets_.empty(), MARISA_FORMAT_ERROR);
+      }
+      break;
+    }
+    case Section::ROOT_TABLE_SECTION: {
+      root_table_.map(mapper);
+      MARISA_THROW_IF((root_table_.size() != ROOT_TABLE_SIZE) &&
+          (root_table_.size() != DEEP_ROOT_TABLE_SIZE), MARISA_FORMAT_ERROR);
+      break;
+    }
+    default: {
+      MARISA_THROW(MARISA_CODE_ERROR, "undefined section");
+    }
+  }
+}
+
+void LoudsTrie::read_section_(Reader &reader, Section::Kind kind) {
+  switch (kind) {
+    case Section::LOUDS_SECTION: {
+      louds_.read(reader);
+      break;
+    }
+    case Section::TERMINAL_FLAGS_SECTION: {
+      terminal_flags_.read(reader);
+      break;
+    }
+    case Section::LINK_FLAGS_SECTION: {
+      link_flags_.read(reader);
+      break;
+    }
+    case Section::BASES_SECTION: {
+      bases_.read(reader);
+      break;
+    }
+    case Section::EXTRAS_SECTION: {
+      extras_.read(reader);
+      break;
+    }
+    case Section::TAIL_SECTION: {
+      tail_.read(reader);
+      break;
+    }
+    case Section::CACHE_SECTION: {
+      cache_.read(reader);
+      cache_mask_ = cache_.size() - 1;
+      break;
+    }
+    case Section::META_SECTION: {
+      UInt32 temp_num_l1_nodes;
+      reader.read(&temp_num_l1_nodes);
+      num_l1_nodes_ = temp_num_l1_nodes;
+      UInt32 temp_config_flags;
+      reader.read(&temp_config_flags);
+      config_.parse((int)temp_config_flags);
+      if (config_.cache_layout() == MARISA_ASSOCIATIVE_CACHE) {
+        reader.seek(CACHE_SET_PADDING);
+        cache_sets_.read(reader);
+        MARISA_THROW_IF(cache_sets_.empty(), MARISA_FORMAT_ERROR);
+      }
+      break;
+    }
+    case Section::ROOT_TABLE_SECTION: {
+      root_table_.read(reader);
+      MARISA_THROW_IF((root_table_.size() != ROOT_TABLE_SIZE) &&
+          (root_table_.size() != DEEP_ROOT_TABLE_SIZE), MARISA_FORMAT_ERROR);
+      break;
+    }
+    default: {
+      MARISA_THROW(MARISA_CODE_ERROR, "undefined section");
+    }
+  }
+}
+
+void LoudsTrie::write_section_(Writer &writer, Section::Kind kind) const {
+  switch (kind) {
+    case Section::LOUDS_SECTION: {
+      louds_.write(writer);
+      break;
+    }
+    case Section::TERMINAL_FLAGS_SECTION: {
+      terminal_flags_.write(writer);
+      break;
+    }
+    case Section::LINK_FLAGS_SECTION: {
+      link_flags_.write(writer);
+      break;
+    }
+    case Section::BASES_SECTION: {
+      bases_.write(writer);
+      break;
+    }
+    case Section::EXTRAS_SECTION: {
+      extras_.write(writer);
+      break;
+    }
+    case Section::TAIL_SECTION: {
+      tail_.write(writer);
+      break;
+    }
+    case Section::CACHE_SECTION: {
+      cache_.write(writer);
+      break;
+    }
+    case Section::META_SECTION: {
+      writer.write((UInt32)num_l1_nodes_);
+      writer.write((UInt32)config_.flags());
+      if (config_.cache_layout() == MARISA_ASSOCIATIVE_CACHE) {
+        writer.seek(CACHE_SET_PADDING);
+        cache_sets_.write(writer);
+      }
+      break;
+    }
+    case Section::ROOT_TABLE_SECTION: {
+      root_table_.write(writer);
+      break;
+    }
+    default: {
+      MARISA_THROW(MARISA_CODE_ERROR, "undefined section");
+    }
+  }
+}
+
+std::size_t LoudsTrie::section_io_size_(Section::Kind kind) const {
+  switch (kind) {
+    case Section::LOUDS_SECTION: {
+      return louds_.io_size();
+    }
+    case Section::TERMINAL_FLAGS_SECTION: {
+      return terminal_flags_.io_size();
+    }
+    case Section::LINK_FLAGS_SECTION: {
+      return link_flags_.io_size();
+    }
+    case Section::BASES_SECTION: {
+      return bases_.io_size();
+    }
+    case Section::EXTRAS_SECTION: {
+      return extras_.io_size();
+    }
+    case Section::TAIL_SECTION: {
+      return tail_.io_size();
+    }
+    case Section::CACHE_SECTION: {
+      return cache_.io_size();
+    }
+    case Section::META_SECTION: {
+      return (sizeof(UInt32) * 2) +
+          ((config_.cache_layout() == MARISA_ASSOCIATIVE_CACHE) ?
+              (CACHE_SET_PADDING + cache_sets_.io_size()) : 0);
+    }
+    case Section::ROOT_TABLE_SECTION: {
+      return root_table_.io_size();
+    }
+    default: {
+      MARISA_THROW(MARISA_CODE_ERROR, "undefined section");
+    }
+  }
+}
+
+bool LoudsTrie::has_section_(Section::Kind kind) const {
+  return !Section::is_optional(kind) || !root_table_.empty();
+}
+
+bool LoudsTrie::has_next_trie_() const {
+  return (link_flags_.num_1s() != 0) && tail_.empty();
+}
+
+void LoudsTrie::select_modes_() {
+  if (next_trie_.get() != NULL) {
+    link_mode_ = NEXT_TRIE_LINK;
+  } else if (tail_.mode() == MARISA_BINARY_TAIL) {
+    link_mode_ = BINARY_TAIL_LINK;
+  } else {
+    link_mode_ = TEXT_TAIL_LINK;
+  }
+  tail_link_mode_ = (next_trie_.get() != NULL) ?
+      next_trie_->tail_link_mode_ : link_mode_;
+
+  // A path through several tries is walked by the kernels of one layout.
+  cache_mode_ = cache_sets_.empty() ? SLOT_CACHE : SET_CACHE;
+  MARISA_THROW_IF((next_trie_.get() != NULL) &&
+      (next_trie_->cache_mode_ != cache_mode_), MARISA_FORMAT_ERROR);
+}
+
+void LoudsTrie::jump_from_root(Agent &agent) const {
+  if (root_table_.empty() || agent.query().length() == 0) {
+    return;
+  }
+  std::size_t id = (UInt8)agent.query()[0];
+  if ((root_table_.size() == DEEP_ROOT_TABLE_SIZE) &&
+      (agent.query().length() >= 2)) {
+    id = ROOT_TABLE_SIZE + ((id << 8) | (UInt8)agent.query()[1]);
+  }
+  const UInt32 entry = root_table_[id];
+  agent.state().set_node_id(entry >> 2);
+  agent.state().set_query_pos(entry & 3);
 }
 
+bool LoudsTrie::find_child(Agent &agent) const {
+  switch (link_mode_) {
+    case NEXT_TRIE_LINK: {
+      return (cache_mode_ == SLOT_CACHE) ?
+          find_child<NEXT_TRIE_LINK, SLOT_CACHE>(agent) :
+          find_child<NEXT_TRIE_LINK, SET_CACHE>(agent);
+    }
+    case BINARY_TAIL_LINK: {
+      return (cache_mode_ == SLOT_CACHE) ?
+          find_child<BINARY_TAIL_LINK, SLOT_CACHE>(agent) :
+          find_child<BINARY_TAIL_LINK, SET_CACHE>(agent);
+    }
+    default: {
+      return (cache_mode_ == SLOT_CACHE) ?
+          find_child<TEXT_TAIL_LINK, SLOT_CACHE>(agent) :
+          find_child<TEXT_TAIL_LINK, SET_CACHE>(agent);
+    }
+  }
+}
+
+template <LoudsTrie::LinkMode L, LoudsTrie::CacheMode C>
 bool LoudsTrie::find_child(Agent &agent) const {
   MARISA_DEBUG_IF(agent.state().query_pos() >= agent.query().length(),
       MARISA_BOUND_ERROR);
 
   State &state = agent.state();
-  const std::size_t cache_id = get_cache_id(state.node_id(),
+  const Cache * const cache = find_cache<C>(state.node_id(),
       agent.query()[state.query_pos()]);
-  if (state.node_id() == cache_[cache_id].parent()) {
-    if (cache_[cache_id].extra() != MARISA_INVALID_EXTRA) {
-      if (!match(agent, cache_[cache_id].link())) {
+  MARISA_STATS_COUNT_CACHE(agent, cache);
+  if (cache != NULL) {
+    MARISA_STATS_COUNT(agent, NODES_VISITED);
+    if (cache->extra() != MARISA_INVALID_EXTRA) {
+      if (!match<L, C>(agent, cache->link())) {
         return false;
       }
     } else {
       state.set_query_pos(state.query_pos() + 1);
     }
-    state.set_node_id(cache_[cache_id].child());
+    state.set_node_id(cache->child());
     return true;
   }
 
+  MARISA_STATS_COUNT(agent, SELECT0_CALLS);
   std::size_t louds_pos = louds_.select0(state.node_id()) + 1;
   if (!louds_[louds_pos]) {
     return false;
@@ -623,10 +1898,13 @@ bool LoudsTrie::find_child(Agent &agent) const {
   state.set_node_id(louds_pos - state.node_id() - 1);
   std::size_t link_id = MARISA_INVALID_LINK_ID;
   do {
+    MARISA_STATS_COUNT(agent, NODES_VISITED);
     if (link_flags_[state.node_id()]) {
+      MARISA_STATS_COUNT_IF(agent, link_id == MARISA_INVALID_LINK_ID,
+          RANK1_CALLS);
       link_id = update_link_id(link_id, state.node_id());
       const std::size_t prev_query_pos = state.query_pos();
-      if (match(agent, get_link(state.node_id(), link_id))) {
+      if (match<L, C>(agent, get_link(state.node_id(), link_id))) {
         return true;
       } else if (state.query_pos() != prev_query_pos) {
         return false;
@@ -642,26 +1920,30 @@ bool LoudsTrie::find_child(Agent &agent) const {
   return false;
 }
 
+template <LoudsTrie::LinkMode L, LoudsTrie::CacheMode C>
 bool LoudsTrie::predictive_find_child(Agent &agent) const {
   MARISA_DEBUG_IF(agent.state().query_pos() >= agent.query().length(),
       MARISA_BOUND_ERROR);
 
   State &state = agent.state();
-  const std::size_t cache_id = get_cache_id(state.node_id(),
+  const Cache * const cache = find_cache<C>(state.node_id(),
       agent.query()[state.query_pos()]);
-  if (state.node_id() == cache_[cache_id].parent()) {
-    if (cache_[cache_id].extra() != MARISA_INVALID_EXTRA) {
-      if (!prefix_match(agent, cache_[cache_id].link())) {
+  MARISA_STATS_COUNT_CACHE(agent, cache);
+  if (cache != NULL) {
+    MARISA_STATS_COUNT(agent, NODES_VISITED);
+    if (cache->extra() != MARISA_INVALID_EXTRA) {
+      if (!prefix_match<L, C>(agent, cache->link())) {
         return false;
       }
     } else {
-      state.key_buf().push_back(cache_[cache_id].label());
+      state.key_buf().push_back(cache->label());
       state.set_query_pos(state.query_pos() + 1);
     }
-    state.set_node_id(cache_[cache_id].child());
+    state.set_node_id(cache->child());
     return true;
   }
 
+  MARISA_STATS_COUNT(agent, SELECT0_CALLS);
   std::size_t louds_pos = louds_.select0(state.node_id()) + 1;
   if (!louds_[louds_pos]) {
     return false;
@@ -669,10 +1951,13 @@ bool LoudsTrie::predictive_find_child(Agent &agent) const {
   state.set_node_id(louds_pos - state.node_id() - 1);
   std::size_t link_id = MARISA_INVALID_LINK_ID;
   do {
+    MARISA_STATS_COUNT(agent, NODES_VISITED);
     if (link_flags_[state.node_id()]) {
+      MARISA_STATS_COUNT_IF(agent, link_id == MARISA_INVALID_LINK_ID,
+          RANK1_CALLS);
       link_id = update_link_id(link_id, state.node_id());
       const std::size_t prev_query_pos = state.query_pos();
-      if (prefix_match(agent, get_link(state.node_id(), link_id))) {
+      if (prefix_match<L, C>(agent, get_link(state.node_id(), link_id))) {
         return true;
       } else if (state.query_pos() != prev_query_pos) {
         return false;
@@ -689,160 +1974,280 @@ bool LoudsTrie::predictive_find_child(Agent &agent) const {
   return false;
 }
 
+template <LoudsTrie::LinkMode L, LoudsTrie::CacheMode C>
 void LoudsTrie::restore(Agent &agent, std::size_t link) const {
-  if (next_trie_.get() != NULL) {
-    next_trie_->restore_(agent,  link);
+  if (L == NEXT_TRIE_LINK) {
+    MARISA_STATS_COUNT(agent, TRIE_DESCENTS);
+    next_trie_->restore_(agent, link);
+  } else if (L == BINARY_TAIL_LINK) {
+    tail_.restore<MARISA_BINARY_TAIL>(agent, link);
   } else {
-    tail_.restore(agent, link);
+    tail_.restore<MARISA_TEXT_TAIL>(agent, link);
   }
 }
 
+template <LoudsTrie::LinkMode L, LoudsTrie::CacheMode C>
 bool LoudsTrie::match(Agent &agent, std::size_t link) const {
-  if (next_trie_.get() != NULL) {
+  if (L == NEXT_TRIE_LINK) {
+    MARISA_STATS_COUNT(agent, TRIE_DESCENTS);
     return next_trie_->match_(agent, link);
+  } else if (L == BINARY_TAIL_LINK) {
+    return tail_.match<MARISA_BINARY_TAIL>(agent, link);
   } else {
-    return tail_.match(agent, link);
+    return tail_.match<MARISA_TEXT_TAIL>(agent, link);
   }
 }
 
+template <LoudsTrie::LinkMode L, LoudsTrie::CacheMode C>
 bool LoudsTrie::prefix_match(Agent &agent, std::size_t link) const {
-  if (next_trie_.get() != NULL) {
+  if (L == NEXT_TRIE_LINK) {
+    MARISA_STATS_COUNT(agent, TRIE_DESCENTS);
     return next_trie_->prefix_match_(agent, link);
+  } else if (L == BINARY_TAIL_LINK) {
+    return tail_.prefix_match<MARISA_BINARY_TAIL>(agent, link);
   } else {
-    return tail_.prefix_match(agent, link);
+    return tail_.prefix_match<MARISA_TEXT_TAIL>(agent, link);
   }
 }
 
 void LoudsTrie::restore_(Agent &agent, std::size_t node_id) const {
+  agent.state().frames().resize(0);
+  switch (tail_link_mode_) {
+    case BINARY_TAIL_LINK: {
+      if (cache_mode_ == SLOT_CACHE) {
+        restore_path_<BINARY_TAIL_LINK, SLOT_CACHE>(agent, this, node_id);
+      } else {
+        restore_path_<BINARY_TAIL_LINK, SET_CACHE>(agent, this, node_id);
+      }
+      return;
+    }
+    default: {
+      if (cache_mode_ == SLOT_CACHE) {
+        restore_path_<TEXT_TAIL_LINK, SLOT_CACHE>(agent, this, node_id);
+      } else {
+        restore_path_<TEXT_TAIL_LINK, SET_CACHE>(agent, this, node_id);
+      }
+      return;
+    }
+  }
+}
+
+bool LoudsTrie::match_(Agent &agent, std::size_t node_id) const {
+  switch (tail_link_mode_) {
+    case BINARY_TAIL_LINK: {
+      return (cache_mode_ == SLOT_CACHE) ?
+          match_<BINARY_TAIL_LINK, SLOT_CACHE>(agent, node_id) :
+          match_<BINARY_TAIL_LINK, SET_CACHE>(agent, node_id);
+    }
+    default: {
+      return (cache_mode_ == SLOT_CACHE) ?
+          match_<TEXT_TAIL_LINK, SLOT_CACHE>(agent, node_id) :
+          match_<TEXT_TAIL_LINK, SET_CACHE>(agent, node_id);
+    }
+  }
+}
+
+bool LoudsTrie::prefix_match_(Agent &agent, std::size_t node_id) const {
+  switch (tail_link_mode_) {
+    case BINARY_TAIL_LINK: {
+      return (cache_mode_ == SLOT_CACHE) ?
+          prefix_match_<BINARY_TAIL_LINK, SLOT_CACHE>(agent, node_id) :
+          prefix_match_<BINARY_TAIL_LINK, SET_CACHE>(agent, node_id);
+    }
+    default: {
+      return (cache_mode_ == SLOT_CACHE) ?
+          prefix_match_<TEXT_TAIL_LINK, SLOT_CACHE>(agent, node_id) :
+          prefix_match_<TEXT_TAIL_LINK, SET_CACHE>(agent, node_id);
+    }
+  }
+}
+
+// The following walkers resolve the links of the last trie into the TAIL
+// in the mode given by `L'. A link of another trie is followed after the
+// rest of the path is pushed to State::frames(), and the rest is popped
+// when the path in the next trie reaches its root.
+template <LoudsTrie::LinkMode L, LoudsTrie::CacheMode C>
+void LoudsTrie::restore_path_(Agent &agent, const LoudsTrie *trie,
+    std::size_t node_id) {
   MARISA_DEBUG_IF(node_id == 0, MARISA_RANGE_ERROR);
 
   State &state = agent.state();
   for ( ; ; ) {
-    const std::size_t cache_id = get_cache_id(node_id);
-    if (node_id == cache_[cache_id].child()) {
-      if (cache_[cache_id].extra() != MARISA_INVALID_EXTRA) {
-        restore(agent,  cache_[cache_id].link());
+    MARISA_STATS_COUNT(agent, NODES_VISITED);
+    bool has_link = false;
+    std::size_t link = 0;
+    std::size_t parent = 0;
+    const Cache * const cache = trie->find_cache<C>(node_id);
+    MARISA_STATS_COUNT_CACHE(agent, cache);
+    if (cache != NULL) {
+      if (cache->extra() != MARISA_INVALID_EXTRA) {
+        has_link = true;
+        link = cache->link();
       } else {
-        state.key_buf().push_back(cache_[cache_id].label());
+        state.key_buf().push_back(cache->label());
       }
-
-      node_id = cache_[cache_id].parent();
-      if (node_id == 0) {
-        return;
+      parent = cache->parent();
+    } else {
+      if (trie->link_flags_[node_id]) {
+        MARISA_STATS_COUNT(agent, RANK1_CALLS);
+        has_link = true;
+        link = trie->get_link(node_id);
+        trie->prefetch_link_(link);
+      } else {
+        state.key_buf().push_back((char)trie->bases_[node_id]);
+      }
+      if (node_id > trie->num_l1_nodes_) {
+        MARISA_STATS_COUNT(agent, SELECT1_CALLS);
+        parent = trie->louds_.select1(node_id) - node_id - 1;
       }
-      continue;
     }
 
-    if (link_flags_[node_id]) {
-      restore(agent, get_link(node_id));
-    } else {
-      state.key_buf().push_back((char)bases_[node_id]);
+    if (has_link && (trie->next_trie_.get() == NULL)) {
+      if (L == BINARY_TAIL_LINK) {
+        trie->tail_.restore<MARISA_BINARY_TAIL>(agent, link);
+      } else {
+        trie->tail_.restore<MARISA_TEXT_TAIL>(agent, link);
+      }
+      has_link = false;
     }
-
-    if (node_id <= num_l1_nodes_) {
+    if (!next_node_(agent, &trie, &node_id, has_link, link, parent)) {
       return;
     }
-    node_id = louds_.select1(node_id) - node_id - 1;
   }
 }
 
+UInt8 LoudsTrie::first_label_(std::size_t node_id) const {
+  if (!link_flags_[node_id]) {
+    return bases_[node_id];
+  } else if (next_trie_.get() != NULL) {
+    return next_trie_->first_label_(get_link(node_id));
+  } else {
+    return (UInt8)tail_[get_link(node_id)];
+  }
+}
+
+template <LoudsTrie::LinkMode L, LoudsTrie::CacheMode C>
 bool LoudsTrie::match_(Agent &agent, std::size_t node_id) const {
   MARISA_DEBUG_IF(agent.state().query_pos() >= agent.query().length(),
       MARISA_BOUND_ERROR);
   MARISA_DEBUG_IF(node_id == 0, MARISA_RANGE_ERROR);
 
   State &state = agent.state();
+  state.frames().resize(0);
+  const LoudsTrie *trie = this;
   for ( ; ; ) {
-    const std::size_t cache_id = get_cache_id(node_id);
-    if (node_id == cache_[cache_id].child()) {
-      if (cache_[cache_id].extra() != MARISA_INVALID_EXTRA) {
-        if (!match(agent, cache_[cache_id].link())) {
-          return false;
-        }
-      } else if (cache_[cache_id].label() ==
-          agent.query()[state.query_pos()]) {
+    MARISA_STATS_COUNT(agent, NODES_VISITED);
+    bool has_link = false;
+    std::size_t link = 0;
+    std::size_t parent = 0;
+    const Cache * const cache = trie->find_cache<C>(node_id);
+    MARISA_STATS_COUNT_CACHE(agent, cache);
+    if (cache != NULL) {
+      if (cache->extra() != MARISA_INVALID_EXTRA) {
+        has_link = true;
+        link = cache->link();
+      } else if (cache->label() == agent.query()[state.query_pos()]) {
         state.set_query_pos(state.query_pos() + 1);
       } else {
         return false;
       }
-
-      node_id = cache_[cache_id].parent();
-      if (node_id == 0) {
-        return true;
-      } else if (state.query_pos() >= agent.query().length()) {
+      parent = cache->parent();
+    } else {
+      if (trie->link_flags_[node_id]) {
+        MARISA_STATS_COUNT(agent, RANK1_CALLS);
+        has_link = true;
+        link = trie->get_link(node_id);
+        trie->prefetch_link_(link);
+      } else if (trie->bases_[node_id] ==
+          (UInt8)agent.query()[state.query_pos()]) {
+        state.set_query_pos(state.query_pos() + 1);
+      } else {
         return false;
       }
-      continue;
+      if (node_id > trie->num_l1_nodes_) {
+        MARISA_STATS_COUNT(agent, SELECT1_CALLS);
+        parent = trie->louds_.select1(node_id) - node_id - 1;
+      }
     }
 
-    if (link_flags_[node_id]) {
-      if (next_trie_.get() != NULL) {
-        if (!match(agent, get_link(node_id))) {
+    if (has_link && (trie->next_trie_.get() == NULL)) {
+      if (L == BINARY_TAIL_LINK) {
+        if (!trie->tail_.match<MARISA_BINARY_TAIL>(agent, link)) {
           return false;
         }
-      } else if (!tail_.match(agent, get_link(node_id))) {
+      } else if (!trie->tail_.match<MARISA_TEXT_TAIL>(agent, link)) {
         return false;
       }
-    } else if (bases_[node_id] == (UInt8)agent.query()[state.query_pos()]) {
-      state.set_query_pos(state.query_pos() + 1);
-    } else {
-      return false;
+      has_link = false;
     }
-
-    if (node_id <= num_l1_nodes_) {
+    if (!next_node_(agent, &trie, &node_id, has_link, link, parent)) {
       return true;
     } else if (state.query_pos() >= agent.query().length()) {
       return false;
     }
-    node_id = louds_.select1(node_id) - node_id - 1;
   }
 }
 
+template <LoudsTrie::LinkMode L, LoudsTrie::CacheMode C>
 bool LoudsTrie::prefix_match_(Agent &agent, std::size_t node_id) const {
   MARISA_DEBUG_IF(agent.state().query_pos() >= agent.query().length(),
       MARISA_BOUND_ERROR);
   MARISA_DEBUG_IF(node_id == 0, MARISA_RANGE_ERROR);
 
   State &state = agent.state();
+  state.frames().resize(0);
+  const LoudsTrie *trie = this;
   for ( ; ; ) {
-    const std::size_t cache_id = get_cache_id(node_id);
-    if (node_id == cache_[cache_id].child()) {
-      if (cache_[cache_id].extra() != MARISA_INVALID_EXTRA) {
-        if (!prefix_match(agent, cache_[cache_id].link())) {
-          return false;
-        }
-      } else if (cache_[cache_id].label() ==
-          agent.query()[state.query_pos()]) {
-        state.key_buf().push_back(cache_[cache_id].label());
+    MARISA_STATS_COUNT(agent, NODES_VISITED);
+    bool has_link = false;
+    std::size_t link = 0;
+    std::size_t parent = 0;
+    const Cache * const cache = trie->find_cache<C>(node_id);
+    MARISA_STATS_COUNT_CACHE(agent, cache);
+    if (cache != NULL) {
+      if (cache->extra() != MARISA_INVALID_EXTRA) {
+        has_link = true;
+        link = cache->link();
+      } else if (cache->label() == agent.query()[state.query_pos()]) {
+        state.key_buf().push_back(cache->label());
         state.set_query_pos(state.query_pos() + 1);
       } else {
         return false;
       }
-
-      node_id = cache_[cache_id].parent();
-      if (node_id == 0) {
-        return true;
-      }
+      parent = cache->parent();
     } else {
-      if (link_flags_[node_id]) {
-        if (!prefix_match(agent, get_link(node_id))) {
-          return false;
-        }
-      } else if (bases_[node_id] == (UInt8)agent.query()[state.query_pos()]) {
-        state.key_buf().push_back((char)bases_[node_id]);
+      if (trie->link_flags_[node_id]) {
+        MARISA_STATS_COUNT(agent, RANK1_CALLS);
+        has_link = true;
+        link = trie->get_link(node_id);
+        trie->prefetch_link_(link);
+      } else if (trie->bases_[node_id] ==
+          (UInt8)agent.query()[state.query_pos()]) {
+        state.key_buf().push_back((char)trie->bases_[node_id]);
         state.set_query_pos(state.query_pos() + 1);
       } else {
         return false;
       }
-
-      if (node_id <= num_l1_nodes_) {
-        return true;
+      if (node_id > trie->num_l1_nodes_) {
+        MARISA_STATS_COUNT(agent, SELECT1_CALLS);
+        parent = trie->louds_.select1(node_id) - node_id - 1;
       }
-      node_id = louds_.select1(node_id) - node_id - 1;
     }
 
-    if (state.query_pos() >= agent.query().length()) {
-      restore_(agent, node_id);
+    if (has_link && (trie->next_trie_.get() == NULL)) {
+      if (L == BINARY_TAIL_LINK) {
+        if (!trie->tail_.prefix_match<MARISA_BINARY_TAIL>(agent, link)) {
+          return false;
+        }
+      } else if (!trie->tail_.prefix_match<MARISA_TEXT_TAIL>(agent, link)) {
+        return false;
+      }
+      has_link = false;
+    }
+    if (!next_node_(agent, &trie, &node_id, has_link, link, parent)) {
+      return true;
+    } else if (state.query_pos() >= agent.query().length()) {
+      restore_path_<L, C>(agent, trie, node_id);
       return true;
     }
   }
@@ -856,6 +2261,48 @@ std::size_t LoudsTrie::get_cache_id(std::size_t node_id) const {
   return node_id & cache_mask_;
 }
 
+// The number of sets is not a power of 2, so a hash value is scaled to the
+// number of sets by multiplication.
+std::size_t LoudsTrie::get_set_id(std::size_t node_id, char label) const {
+  const UInt32 hash =
+      (UInt32)(node_id ^ (node_id << 5) ^ (UInt8)label) * 0x9E3779B9U;
+  return (std::size_t)(((UInt64)hash * cache_sets_.size()) >> 32);
+}
+
+std::size_t LoudsTrie::get_set_id(std::size_t node_id) const {
+  const UInt32 hash = (UInt32)node_id * 0x9E3779B9U;
+  return (std::size_t)(((UInt64)hash * cache_sets_.size()) >> 32);
+}
+
+const Cache *LoudsTrie::find_cache(std::size_t node_id, char label) const {
+  return (cache_mode_ == SLOT_CACHE) ?
+      find_cache<SLOT_CACHE>(node_id, label) :
+      find_cache<SET_CACHE>(node_id, label);
+}
+
+const Cache *LoudsTrie::find_cache(std::size_t node_id) const {
+  return (cache_mode_ == SLOT_CACHE) ? find_cache<SLOT_CACHE>(node_id) :
+      find_cache<SET_CACHE>(node_id);
+}
+
+template <LoudsTrie::CacheMode C>
+const Cache *LoudsTrie::find_cache(std::size_t node_id, char label) const {
+  if (C == SLOT_CACHE) {
+    const Cache &cache = cache_[get_cache_id(node_id, label)];
+    return (node_id == cache.parent()) ? &cache : NULL;
+  }
+  return cache_sets_[get_set_id(node_id, label)].find(node_id, label);
+}
+
+template <LoudsTrie::CacheMode C>
+const Cache *LoudsTrie::find_cache(std::size_t node_id) const {
+  if (C == SLOT_CACHE) {
+    const Cache &cache = cache_[get_cache_id(node_id)];
+    return (node_id == cache.child()) ? &cache : NULL;
+  }
+  return cache_sets_[get_set_id(node_id)].find(node_id);
+}
+
 std::size_t LoudsTrie::get_link(std::size_t node_id) const {
   return  bases_[node_id] | (extras_[link_flags_.rank1(node_id)] * 256);
 }
@@ -865,6 +2312,47 @@ std::size_t LoudsTrie::get_link(std::size_t node_id,
   return  bases_[node_id] | (extras_[link_id] * 256);
 }
 
+bool LoudsTrie::next_node_(Agent &agent, const LoudsTrie **trie,
+    std::size_t *node_id, bool has_link, std::size_t link,
+    std::size_t parent) {
+  Vector<Frame> &frames = agent.state().frames();
+  if (has_link) {
+    if (parent != 0) {
+      frames.push_back(Frame());
+      frames.back().set_trie(*trie);
+      frames.back().set_node_id(parent);
+    }
+    MARISA_STATS_COUNT(agent, TRIE_DESCENTS);
+    *trie = (*trie)->next_trie_.get();
+    *node_id = link;
+  } else if (parent != 0) {
+    *node_id = parent;
+  } else if (!frames.empty()) {
+    *trie = frames.back().trie();
+    *node_id = frames.back().node_id();
+    frames.pop_back();
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// The cache entry and the label of the next node are read first, and the
+// suffix is read from its beginning.
+void LoudsTrie::prefetch_link_(std::size_t link) const {
+  const LoudsTrie * const next = next_trie_.get();
+  if (next != NULL) {
+    if (next->cache_sets_.empty()) {
+      MARISA_PREFETCH(&next->cache_[next->get_cache_id(link)]);
+    } else {
+      MARISA_PREFETCH(&next->cache_sets_[next->get_set_id(link)]);
+    }
+    MARISA_PREFETCH(&next->bases_[link]);
+  } else {
+    MARISA_PREFETCH(&tail_[link]);
+  }
+}
+
 std::size_t LoudsTrie::update_link_id(std::size_t link_id,
     std::size_t node_id) const {
   return (link_id == MARISA_INVALID_LINK_ID) ?
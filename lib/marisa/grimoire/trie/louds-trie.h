@@ -3,26 +3,40 @@
 
 #include "marisa/keyset.h"
 #include "marisa/agent.h"
+#include "marisa/observer.h"
+#include "marisa/description.h"
 #include "marisa/grimoire/vector.h"
 #include "marisa/grimoire/trie/config.h"
 #include "marisa/grimoire/trie/key.h"
 #include "marisa/grimoire/trie/tail.h"
 #include "marisa/grimoire/trie/cache.h"
+#include "marisa/grimoire/trie/profile.h"
+#include "marisa/grimoire/trie/section.h"
 
 namespace marisa {
 namespace grimoire {
 namespace trie {
 
+class Monitor;
+
 class LoudsTrie  {
  public:
   LoudsTrie();
   ~LoudsTrie();
 
-  void build(Keyset &keyset, int flags);
+  // If `cache_levels' is not NULL, the first `num_cache_levels' tries use
+  // the cache levels given by it instead of the one in `flags'.
+  void build(Keyset &keyset, int flags, BuildObserver *observer = NULL,
+      const CacheLevel *cache_levels = NULL,
+      std::size_t num_cache_levels = 0);
 
-  void map(Mapper &mapper);
+  // If `map_flags' has MARISA_MAP_ADVISE, map() gives access pattern hints
+  // to `mapper'. If it has MARISA_MAP_VERIFY, map() checks the sections of a
+  // v2 dictionary against their checksums before they are used.
+  void map(Mapper &mapper, int map_flags = MARISA_DEFAULT_MAP);
   void read(Reader &reader);
-  void write(Writer &writer) const;
+  void write(Writer &writer,
+      FormatVersion format = MARISA_DEFAULT_FORMAT) const;
 
   bool lookup(Agent &agent) const;
   void reverse_lookup(Agent &agent) const;
@@ -48,6 +62,62 @@ class LoudsTrie  {
   NodeOrder node_order() const {
     return config_.node_order();
   }
+  CacheLayout cache_layout() const {
+    return config_.cache_layout();
+  }
+  RootTable root_table() const;
+
+  // warm_up() touches up to `budget' bytes of the dictionary in the order of
+  // importance for lookups, on a background thread if `in_background' is
+  // true, and returns the number of bytes to be touched. resident_size()
+  // returns the number of bytes in memory.
+  std::size_t warm_up(std::size_t budget, bool in_background);
+  std::size_t resident_size() const;
+  // pin() locks the cache, the rank/select indexes and the first levels of
+  // a mapped dictionary in memory, as many levels as fit in `budget' bytes,
+  // and returns the number of bytes locked. The nested tries and the TAIL
+  // are left to demand paging.
+  std::size_t pin(std::size_t budget, std::size_t *num_levels);
+
+  // profile() looks up a key like lookup() and counts the edges of the top
+  // trie which are traversed. rebuild_cache() fills each slot of the cache
+  // of the top trie with the edge counted most often in the slot, and keeps
+  // the slots where no edge has been counted. In the associative layout, a
+  // set is filled with the counted edges in descending order of count and
+  // the rest of the old entries.
+  // profile() also counts the cache hits and misses of each trie along the
+  // path of the key.
+  bool profile(Agent &agent);
+  void rebuild_cache();
+  void clear_profile() {
+    profile_.clear();
+    if (next_trie_.get() != NULL) {
+      next_trie_->clear_profile();
+    }
+  }
+
+  // cache_size() returns the number of cache entries of a trie, where the
+  // first trie is level 0. cache_hits() and cache_misses() return the counts
+  // of profile().
+  std::size_t cache_size(std::size_t level) const;
+  std::size_t cache_hits(std::size_t level) const;
+  std::size_t cache_misses(std::size_t level) const;
+  // cache_sets() returns the cache of the first trie in
+  // MARISA_ASSOCIATIVE_CACHE, which is empty otherwise.
+  const Vector<CacheSet> &cache_sets() const {
+    return cache_sets_;
+  }
+
+  // describe() fills `description' with the structure of each trie.
+  void describe(Description *description) const;
+
+  // add_stats() adds the counts of a query, which are the differences
+  // between `stats' and `base', to the stripe of the calling thread, and
+  // stats() sums the stripes. Queries on other threads may add theirs at the
+  // same time.
+  void add_stats(const Stats &stats, const Stats &base) const;
+  Stats stats() const;
+  void clear_stats();
 
   bool empty() const {
     return size() == 0;
@@ -56,12 +126,64 @@ class LoudsTrie  {
     return terminal_flags_.num_1s();
   }
   std::size_t total_size() const;
-  std::size_t io_size() const;
+  std::size_t io_size(FormatVersion format = MARISA_DEFAULT_FORMAT) const;
+
+  // stamp() tells a dictionary from the others in the process. A LoudsTrie
+  // gets a new stamp on construction, and swap() exchanges the stamps.
+  std::size_t stamp() const {
+    return stamp_;
+  }
+
+  // The following functions are used to enumerate keys in label order, which
+  // differs from the order of predictive_search() in MARISA_WEIGHT_ORDER.
+  // sorted_children() appends the children of a node in label order, and
+  // restore_label() appends the label of a node to the key buffer.
+  void sorted_children(std::size_t node_id, Vector<UInt32> *children) const;
+  void restore_label(Agent &agent, std::size_t node_id) const;
+
+  bool is_terminal(std::size_t node_id) const {
+    return terminal_flags_[node_id];
+  }
+  std::size_t get_key_id(std::size_t node_id) const {
+    return terminal_flags_.rank1(node_id);
+  }
+
+  // set_allocator() selects the allocator of the arrays built or read
+  // afterwards, and `scratch_allocator' for the temporary arrays of a build.
+  // NULL selects new[].
+  void set_allocator(Allocator *allocator, Allocator *scratch_allocator);
 
   void clear();
   void swap(LoudsTrie &rhs);
 
  private:
+  // A trie follows its links into the TAIL in either mode or into the next
+  // trie. The mode is selected when the trie is built, mapped or read, and
+  // each query dispatches on it once to the kernels instantiated for it.
+  enum LinkMode {
+    TEXT_TAIL_LINK,
+    BINARY_TAIL_LINK,
+    NEXT_TRIE_LINK
+  };
+
+  // The kernels are also instantiated for each cache layout: SLOT_CACHE
+  // probes cache_ and SET_CACHE probes cache_sets_. All the tries of a
+  // dictionary have the same layout.
+  enum CacheMode {
+    SLOT_CACHE,
+    SET_CACHE
+  };
+
+  // A stats stripe is a cache line of counters, which is shared only by the
+  // threads whose indexes are congruent modulo NUM_STATS_STRIPES.
+  enum {
+    NUM_STATS_STRIPES = 16,
+    STATS_STRIPE_ALIGNMENT = 64,
+    STATS_STRIPE_SIZE = (Stats::NUM_COUNTERS * sizeof(std::size_t) +
+        STATS_STRIPE_ALIGNMENT - 1) / STATS_STRIPE_ALIGNMENT *
+        STATS_STRIPE_ALIGNMENT / sizeof(std::size_t)
+  };
+
   BitVector louds_;
   BitVector terminal_flags_;
   BitVector link_flags_;
@@ -71,21 +193,44 @@ class LoudsTrie  {
   scoped_ptr<LoudsTrie> next_trie_;
   Vector<Cache> cache_;
   std::size_t cache_mask_;
+  // cache_sets_ is used instead of cache_ in MARISA_ASSOCIATIVE_CACHE.
+  Vector<CacheSet> cache_sets_;
+  // root_table_ is empty unless the first trie has a root table. An entry
+  // is a node ID shifted left by 2 bits and the number of bytes consumed.
+  Vector<UInt32> root_table_;
+  Profile profile_;
   std::size_t num_l1_nodes_;
+  LinkMode link_mode_;
+  // tail_link_mode_ is the link mode of the last trie.
+  LinkMode tail_link_mode_;
+  CacheMode cache_mode_;
+  std::size_t stamp_;
+#ifdef MARISA_ENABLE_STATS
+  mutable Vector<std::size_t> stats_;
+#endif  // MARISA_ENABLE_STATS
   Config config_;
+  Allocator *allocator_;
+  Allocator *scratch_allocator_;
   Mapper mapper_;
+  // prefetcher_ is declared last so that a background warm-up is stopped
+  // before the dictionary is destroyed.
+  scoped_ptr<Prefetcher> prefetcher_;
+
+  void build_(Keyset &keyset, const Config &config, Monitor &monitor);
+  void build_root_table_(RootTable root_table);
 
-  void build_(Keyset &keyset, const Config &config);
+  void describe_(Description *description, std::size_t level) const;
+  void select_modes_();
 
   template <typename T>
-  void build_trie(Vector<T> &keys,
-      Vector<UInt32> *terminals, const Config &config, std::size_t trie_id);
+  void build_trie(Vector<T> &keys, Vector<UInt32> *terminals,
+      const Config &config, std::size_t trie_id, Monitor &monitor);
   template <typename T>
-  void build_current_trie(Vector<T> &keys,
-      Vector<UInt32> *terminals, const Config &config, std::size_t trie_id);
+  void build_current_trie(Vector<T> &keys, Vector<UInt32> *terminals,
+      const Config &config, std::size_t trie_id, Monitor &monitor);
   template <typename T>
-  void build_next_trie(Vector<T> &keys,
-      Vector<UInt32> *terminals, const Config &config, std::size_t trie_id);
+  void build_next_trie(Vector<T> &keys, Vector<UInt32> *terminals,
+      const Config &config, std::size_t trie_id, Monitor &monitor);
   template <typename T>
   void build_terminals(const Vector<T> &keys,
       Vector<UInt32> *terminals) const;
@@ -96,24 +241,107 @@ class LoudsTrie  {
   void cache(std::size_t parent, std::size_t child,
       float weight, char label);
   void fill_cache();
+  void fill_cache_(Cache *cache) const;
+  void rebuild_cache_(Vector<Cache> *cache) const;
+  void rebuild_cache_sets_(Vector<CacheSet> *cache_sets) const;
+  void profile_link_(std::size_t node_id);
+  const LoudsTrie &get_level_(std::size_t level) const;
 
   void map_(Mapper &mapper);
   void read_(Reader &reader);
   void write_(Writer &writer) const;
 
+  // The following functions handle the sections of a v2 dictionary. A level
+  // is stored as NUM_SECTION_KINDS sections except for the optional ones
+  // which it does not have, followed by the sections of the next level.
+  // `position' is the number of bytes from the beginning of the dictionary.
+  void map_sections_(const Mapper &mapper, const Directory &directory,
+      std::size_t level, std::size_t position);
+  void read_sections_(Reader &reader, const Directory &directory,
+      std::size_t level, UInt64 *position);
+  void write_sections_(Writer &writer, Directory *directory,
+      std::size_t level, UInt64 *position, bool computes_checksums) const;
+  void make_directory_(Directory *directory, std::size_t level,
+      bool with_checksums) const;
+  static void advise_sections_(const Mapper &mapper,
+      const Directory &directory, std::size_t position);
+  static void verify_sections_(const Mapper &mapper,
+      const Directory &directory, std::size_t position);
+
+  void prefetch_(Prefetcher *prefetcher, int phase, bool is_top) const;
+  void pin_(Prefetcher *prefetcher, std::size_t num_levels) const;
+  std::size_t num_top_nodes_(std::size_t num_levels = 3) const;
+
+  void map_section_(Mapper &mapper, Section::Kind kind);
+  void read_section_(Reader &reader, Section::Kind kind);
+  void write_section_(Writer &writer, Section::Kind kind) const;
+  std::size_t section_io_size_(Section::Kind kind) const;
+  bool has_section_(Section::Kind kind) const;
+  bool has_next_trie_() const;
+
+  template <LinkMode L, CacheMode C>
+  bool lookup_(Agent &agent) const;
+  template <LinkMode L, CacheMode C>
+  void reverse_lookup_(Agent &agent) const;
+  template <LinkMode L, CacheMode C>
+  bool common_prefix_search_(Agent &agent) const;
+  template <LinkMode L, CacheMode C>
+  bool predictive_search_(Agent &agent) const;
+
+  inline void jump_from_root(Agent &agent) const;
+  bool find_child(Agent &agent) const;
+  template <LinkMode L, CacheMode C>
   inline bool find_child(Agent &agent) const;
+  template <LinkMode L, CacheMode C>
   inline bool predictive_find_child(Agent &agent) const;
 
-  inline void restore(Agent &agent, std::size_t node_id) const;
-  inline bool match(Agent &agent, std::size_t node_id) const;
-  inline bool prefix_match(Agent &agent, std::size_t node_id) const;
+  // restore(), match() and prefix_match() follow a link of this trie, and
+  // restore_(), match_() and prefix_match_() follow the path from a node of
+  // this trie to the root, including the paths in the next tries. The
+  // latter without a template argument dispatch on tail_link_mode_, which a
+  // parent trie calls. They do not recurse into the next tries but keep the
+  // rest of each path in State::frames().
+  template <LinkMode L, CacheMode C>
+  inline void restore(Agent &agent, std::size_t link) const;
+  template <LinkMode L, CacheMode C>
+  inline bool match(Agent &agent, std::size_t link) const;
+  template <LinkMode L, CacheMode C>
+  inline bool prefix_match(Agent &agent, std::size_t link) const;
 
   void restore_(Agent &agent, std::size_t node_id) const;
   bool match_(Agent &agent, std::size_t node_id) const;
   bool prefix_match_(Agent &agent, std::size_t node_id) const;
+  template <LinkMode L, CacheMode C>
+  static void restore_path_(Agent &agent, const LoudsTrie *trie,
+      std::size_t node_id);
+  template <LinkMode L, CacheMode C>
+  bool match_(Agent &agent, std::size_t node_id) const;
+  template <LinkMode L, CacheMode C>
+  bool prefix_match_(Agent &agent, std::size_t node_id) const;
+  UInt8 first_label_(std::size_t node_id) const;
+
+  // next_node_() moves `trie' and `node_id' to the next node of a path, into
+  // the next trie if the node has a link, and returns false at the end.
+  static inline bool next_node_(Agent &agent, const LoudsTrie **trie,
+      std::size_t *node_id, bool has_link, std::size_t link,
+      std::size_t parent);
+  // prefetch_link_() hints that the node or the suffix at `link' is read.
+  inline void prefetch_link_(std::size_t link) const;
 
   inline std::size_t get_cache_id(std::size_t node_id, char label) const;
   inline std::size_t get_cache_id(std::size_t node_id) const;
+  inline std::size_t get_set_id(std::size_t node_id, char label) const;
+  inline std::size_t get_set_id(std::size_t node_id) const;
+
+  // find_cache() returns the cache entry of the edge labeled `label' from
+  // `node_id' in the first trie, or of the edge to `node_id' in the other
+  // tries, and NULL if the edge is not cached.
+  inline const Cache *find_cache(std::size_t node_id, char label) const;
+  inline const Cache *find_cache(std::size_t node_id) const;
+  template <CacheMode C>
+  inline const Cache *find_cache(std::size_t node_id, char label) const;
+  template <CacheMode C>
+  inline const Cache *find_cache(std::size_t node_id) const;
 
   inline std::size_t get_link(std::size_t node_id) const;
   inline std::size_t get_link(std::size_t node_id,
@@ -0,0 +1,79 @@
+#ifndef MARISA_GRIMOIRE_TRIE_MONITOR_H_
+#define MARISA_GRIMOIRE_TRIE_MONITOR_H_
+
+#include "marisa/observer.h"
+#include "marisa/grimoire/timer.h"
+#include "marisa/grimoire/vector/allocation.h"
+
+namespace marisa {
+namespace grimoire {
+namespace trie {
+
+// Monitor measures the phases of a build and reports them to an observer.
+// It does nothing if the observer is NULL. Otherwise, it enables counting
+// of the memory allocated by vectors while it lives.
+class Monitor {
+ public:
+  explicit Monitor(BuildObserver *observer)
+      : observer_(observer), timer_(), phase_timer_(), event_(),
+        num_allocated_bytes_(0), base_bytes_(0) {
+    if (observer_ != NULL) {
+      vector::Allocation::enable();
+      base_bytes_ = vector::Allocation::current();
+    }
+  }
+  ~Monitor() {
+    if (observer_ != NULL) {
+      vector::Allocation::disable();
+    }
+  }
+
+  void begin(BuildObserver::Phase phase, std::size_t trie_id,
+      std::size_t num_keys) {
+    if (observer_ == NULL) {
+      return;
+    }
+    event_ = BuildObserver::Event();
+    event_.set_phase(phase);
+    event_.set_trie_id(trie_id);
+    event_.set_num_keys(num_keys);
+    event_.set_total_time(timer_.elapsed());
+    observer_->begin(event_);
+
+    num_allocated_bytes_ = vector::Allocation::total();
+    vector::Allocation::reset_peak();
+    phase_timer_.reset();
+  }
+
+  void end(std::size_t num_nodes) {
+    if (observer_ == NULL) {
+      return;
+    }
+    event_.set_num_nodes(num_nodes);
+    event_.set_time(phase_timer_.elapsed());
+    event_.set_total_time(timer_.elapsed());
+    event_.set_num_allocated_bytes(
+        vector::Allocation::total() - num_allocated_bytes_);
+    event_.set_peak_bytes(vector::Allocation::peak() - base_bytes_);
+    observer_->end(event_);
+  }
+
+ private:
+  BuildObserver *observer_;
+  Timer timer_;
+  Timer phase_timer_;
+  BuildObserver::Event event_;
+  std::size_t num_allocated_bytes_;
+  // base_bytes_ is current() when counting has started.
+  std::size_t base_bytes_;
+
+  // Disallows copy and assignment.
+  Monitor(const Monitor &);
+  Monitor &operator=(const Monitor &);
+};
+
+}  // namespace trie
+}  // namespace grimoire
+}  // namespace marisa
+
+#endif  // MARISA_GRIMOIRE_TRIE_MONITOR_H_
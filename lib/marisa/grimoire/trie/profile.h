@@ -0,0 +1,148 @@
+#ifndef MARISA_GRIMOIRE_TRIE_PROFILE_H_
+#define MARISA_GRIMOIRE_TRIE_PROFILE_H_
+
+#include "marisa/grimoire/vector.h"
+
+namespace marisa {
+namespace grimoire {
+namespace trie {
+
+// Profile counts traversals of the edges of a trie. Edges are grouped by the
+// cache slot they would occupy, and each slot keeps NUM_CANDIDATES edges as
+// in the Space-Saving algorithm: an edge which is not kept replaces the least
+// frequent one and takes over its count. An edge which takes more than
+// 1 / NUM_CANDIDATES of the traversals of its slot is never lost. Profile
+// also counts the hits and misses of the cache of a trie.
+class Profile {
+ public:
+  enum {
+    NUM_CANDIDATES  = 4
+  };
+
+  class Edge {
+   public:
+    Edge() : parent_(0), child_(0), count_(0) {}
+
+    void set(std::size_t parent, std::size_t child, UInt32 count) {
+      MARISA_DEBUG_IF(parent > MARISA_UINT32_MAX, MARISA_SIZE_ERROR);
+      MARISA_DEBUG_IF(child > MARISA_UINT32_MAX, MARISA_SIZE_ERROR);
+      parent_ = (UInt32)parent;
+      child_ = (UInt32)child;
+      count_ = count;
+    }
+    void increment() {
+      if (count_ != MARISA_UINT32_MAX) {
+        ++count_;
+      }
+    }
+
+    std::size_t parent() const {
+      return parent_;
+    }
+    std::size_t child() const {
+      return child_;
+    }
+    UInt32 count() const {
+      return count_;
+    }
+
+   private:
+    UInt32 parent_;
+    UInt32 child_;
+    UInt32 count_;
+  };
+
+  Profile() : edges_(), num_slots_(0), num_hits_(0), num_misses_(0) {}
+
+  // resize() discards the counts.
+  void resize(std::size_t num_slots) {
+    MARISA_THROW_IF(num_slots > (MARISA_SIZE_MAX / NUM_CANDIDATES),
+        MARISA_SIZE_ERROR);
+    Profile temp;
+    temp.edges_.resize(num_slots * NUM_CANDIDATES);
+    temp.num_slots_ = num_slots;
+    swap(temp);
+  }
+
+  void count(std::size_t slot, std::size_t parent, std::size_t child) {
+    MARISA_DEBUG_IF(slot >= num_slots_, MARISA_BOUND_ERROR);
+    Edge * const edges = &edges_[slot * NUM_CANDIDATES];
+    std::size_t min_id = 0;
+    for (std::size_t i = 0; i < NUM_CANDIDATES; ++i) {
+      if ((edges[i].count() != 0) && (edges[i].child() == child)) {
+        edges[i].increment();
+        return;
+      } else if (edges[i].count() < edges[min_id].count()) {
+        min_id = i;
+      }
+    }
+    const UInt32 count = edges[min_id].count();
+    edges[min_id].set(parent, child,
+        (count != MARISA_UINT32_MAX) ? (count + 1) : count);
+  }
+
+  // top() returns the most frequent edge of a slot, whose count is 0 if no
+  // edge has been counted in the slot.
+  const Edge &top(std::size_t slot) const {
+    MARISA_DEBUG_IF(slot >= num_slots_, MARISA_BOUND_ERROR);
+    const Edge * const edges = &edges_[slot * NUM_CANDIDATES];
+    std::size_t max_id = 0;
+    for (std::size_t i = 1; i < NUM_CANDIDATES; ++i) {
+      if (edges[i].count() > edges[max_id].count()) {
+        max_id = i;
+      }
+    }
+    return edges[max_id];
+  }
+  // candidate() returns the `i'-th edge kept in a slot in no particular
+  // order.
+  const Edge &candidate(std::size_t slot, std::size_t i) const {
+    MARISA_DEBUG_IF(slot >= num_slots_, MARISA_BOUND_ERROR);
+    MARISA_DEBUG_IF(i >= NUM_CANDIDATES, MARISA_BOUND_ERROR);
+    return edges_[(slot * NUM_CANDIDATES) + i];
+  }
+
+  void count_probe(bool is_hit) {
+    if (is_hit) {
+      ++num_hits_;
+    } else {
+      ++num_misses_;
+    }
+  }
+
+  std::size_t num_slots() const {
+    return num_slots_;
+  }
+  std::size_t num_hits() const {
+    return num_hits_;
+  }
+  std::size_t num_misses() const {
+    return num_misses_;
+  }
+
+  void clear() {
+    Profile().swap(*this);
+  }
+  void swap(Profile &rhs) {
+    edges_.swap(rhs.edges_);
+    marisa::swap(num_slots_, rhs.num_slots_);
+    marisa::swap(num_hits_, rhs.num_hits_);
+    marisa::swap(num_misses_, rhs.num_misses_);
+  }
+
+ private:
+  Vector<Edge> edges_;
+  std::size_t num_slots_;
+  std::size_t num_hits_;
+  std::size_t num_misses_;
+
+  // Disallows copy and assignment.
+  Profile(const Profile &);
+  Profile &operator=(const Profile &);
+};
+
+}  // namespace trie
+}  // namespace grimoire
+}  // namespace marisa
+
+#endif  // MARISA_GRIMOIRE_TRIE_PROFILE_H_
@@ -0,0 +1,255 @@
+#ifndef MARISA_GRIMOIRE_TRIE_SECTION_H_
+#define MARISA_GRIMOIRE_TRIE_SECTION_H_
+
+#include "marisa/grimoire/vector.h"
+#include "marisa/grimoire/trie/header.h"
+
+namespace marisa {
+namespace grimoire {
+namespace trie {
+
+// A section is a component of one level of a v2 dictionary. Its offset is
+// counted from the beginning of the dictionary and lies PAYLOAD_OFFSET bytes
+// before a multiple of ALIGNMENT, so that the elements which follow the size
+// of its first vector are aligned. A section in RAW_ENCODING holds the v1
+// encoding of the component. An optional section may be missing, and older
+// versions ignore it.
+class Section {
+ public:
+  enum Kind {
+    LOUDS_SECTION           = 0,
+    TERMINAL_FLAGS_SECTION  = 1,
+    LINK_FLAGS_SECTION      = 2,
+    BASES_SECTION           = 3,
+    EXTRAS_SECTION          = 4,
+    TAIL_SECTION            = 5,
+    CACHE_SECTION           = 6,
+    META_SECTION            = 7,
+    ROOT_TABLE_SECTION      = 8,
+    NUM_SECTION_KINDS       = 9
+  };
+
+  enum Encoding {
+    RAW_ENCODING  = 0
+  };
+
+  enum {
+    ALIGNMENT       = 64,
+    PAYLOAD_OFFSET  = 8
+  };
+
+  Section()
+      : id_(0), encoding_(RAW_ENCODING), offset_(0), size_(0), crc_(0),
+        reserved_(0) {}
+
+  static UInt32 make_id(std::size_t level, Kind kind) {
+    return (UInt32)((level << 8) | kind);
+  }
+  static bool is_optional(Kind kind) {
+    return kind == ROOT_TABLE_SECTION;
+  }
+  // align() returns the first section offset at or after `offset', and
+  // pad() rounds `offset' up to a multiple of ALIGNMENT.
+  static UInt64 align(UInt64 offset) {
+    return pad(offset + PAYLOAD_OFFSET) - PAYLOAD_OFFSET;
+  }
+  static UInt64 pad(UInt64 offset) {
+    return (offset + (ALIGNMENT - 1)) & ~(UInt64)(ALIGNMENT - 1);
+  }
+  static bool is_aligned(UInt64 offset) {
+    return ((offset + PAYLOAD_OFFSET) % ALIGNMENT) == 0;
+  }
+
+  void set_id(UInt32 id) {
+    id_ = id;
+  }
+  void set_encoding(Encoding encoding) {
+    encoding_ = encoding;
+  }
+  void set_offset(UInt64 offset) {
+    offset_ = offset;
+  }
+  void set_size(UInt64 size) {
+    size_ = size;
+  }
+  void set_crc(UInt32 crc) {
+    crc_ = crc;
+  }
+
+  UInt32 id() const {
+    return id_;
+  }
+  Encoding encoding() const {
+    return (Encoding)encoding_;
+  }
+  UInt64 offset() const {
+    return offset_;
+  }
+  UInt64 size() const {
+    return size_;
+  }
+  UInt32 crc() const {
+    return crc_;
+  }
+
+ private:
+  UInt32 id_;
+  UInt32 encoding_;
+  UInt64 offset_;
+  UInt64 size_;
+  UInt32 crc_;
+  UInt32 reserved_;
+};
+
+// Directory is the table of sections which follows the header of a v2
+// dictionary. It is protected by its own checksum and gives the size of the
+// whole dictionary.
+class Directory {
+ public:
+  Directory() : sections_(), file_size_(0), crc_(0) {}
+
+  void map(Mapper &mapper) {
+    Directory temp;
+    temp.map_(mapper);
+    swap(temp);
+  }
+  void read(Reader &reader) {
+    Directory temp;
+    temp.read_(reader);
+    swap(temp);
+  }
+  void write(Writer &writer) const {
+    write_(writer);
+  }
+
+  void push_back(UInt32 id, UInt64 size, UInt32 crc) {
+    Section section;
+    section.set_id(id);
+    section.set_size(size);
+    section.set_crc(crc);
+    sections_.push_back(section);
+  }
+
+  // set_crc() gives the checksum of a section after push_back(), and then
+  // layout() must be called again.
+  void set_crc(UInt32 id, UInt32 crc) {
+    for (std::size_t i = 0; i < sections_.size(); ++i) {
+      if (sections_[i].id() == id) {
+        sections_[i].set_crc(crc);
+        return;
+      }
+    }
+    MARISA_THROW(MARISA_CODE_ERROR, "undefined section");
+  }
+
+  // layout() assigns offsets to the sections in order and fixes the
+  // directory.
+  void layout() {
+    UInt64 offset = Section::align(Header().io_size() + io_size());
+    for (std::size_t i = 0; i < sections_.size(); ++i) {
+      sections_[i].set_offset(offset);
+      offset += sections_[i].size();
+      if ((i + 1) < sections_.size()) {
+        offset = Section::align(offset);
+      }
+    }
+    file_size_ = Section::pad(offset);
+    crc_ = Crc32c::compute(sections_.begin(), sections_.total_size());
+  }
+
+  bool contains(UInt32 id) const {
+    for (std::size_t i = 0; i < sections_.size(); ++i) {
+      if (sections_[i].id() == id) {
+        return true;
+      }
+    }
+    return false;
+  }
+  // find() throws MARISA_FORMAT_ERROR if there is no such section.
+  const Section &find(UInt32 id) const {
+    for (std::size_t i = 0; i < sections_.size(); ++i) {
+      if (sections_[i].id() == id) {
+        return sections_[i];
+      }
+    }
+    MARISA_THROW(MARISA_FORMAT_ERROR, "missing section");
+  }
+
+  const Section &operator[](std::size_t i) const {
+    return sections_[i];
+  }
+  std::size_t num_sections() const {
+    return sections_.size();
+  }
+  UInt64 file_size() const {
+    return file_size_;
+  }
+
+  std::size_t io_size() const {
+    return sizeof(UInt64) + (sizeof(UInt32) * 2) + sections_.io_size();
+  }
+
+  void clear() {
+    Directory().swap(*this);
+  }
+  void swap(Directory &rhs) {
+    sections_.swap(rhs.sections_);
+    marisa::swap(file_size_, rhs.file_size_);
+    marisa::swap(crc_, rhs.crc_);
+  }
+
+ private:
+  Vector<Section> sections_;
+  UInt64 file_size_;
+  UInt32 crc_;
+
+  void map_(Mapper &mapper) {
+    mapper.map(&file_size_);
+    mapper.map(&crc_);
+    mapper.seek(sizeof(UInt32));
+    sections_.map(mapper);
+    validate();
+  }
+  void read_(Reader &reader) {
+    reader.read(&file_size_);
+    reader.read(&crc_);
+    reader.seek(sizeof(UInt32));
+    sections_.read(reader);
+    validate();
+  }
+  void write_(Writer &writer) const {
+    writer.write(file_size_);
+    writer.write(crc_);
+    writer.write((UInt32)0);
+    sections_.write(writer);
+  }
+
+  void validate() const {
+    MARISA_THROW_IF(Crc32c::compute(sections_.begin(),
+        sections_.total_size()) != crc_, MARISA_FORMAT_ERROR);
+    UInt64 offset = Header().io_size() + io_size();
+    for (std::size_t i = 0; i < sections_.size(); ++i) {
+      const Section &section = sections_[i];
+      MARISA_THROW_IF(section.encoding() != Section::RAW_ENCODING,
+          MARISA_FORMAT_ERROR);
+      MARISA_THROW_IF(!Section::is_aligned(section.offset()),
+          MARISA_FORMAT_ERROR);
+      MARISA_THROW_IF(section.offset() < offset, MARISA_FORMAT_ERROR);
+      MARISA_THROW_IF(section.offset() > file_size_, MARISA_FORMAT_ERROR);
+      MARISA_THROW_IF(section.size() > (file_size_ - section.offset()),
+          MARISA_FORMAT_ERROR);
+      offset = section.offset() + section.size();
+    }
+    MARISA_THROW_IF(offset > file_size_, MARISA_FORMAT_ERROR);
+  }
+
+  // Disallows copy and assignment.
+  Directory(const Directory &);
+  Directory &operator=(const Directory &);
+};
+
+}  // namespace trie
+}  // namespace grimoire
+}  // namespace marisa
+
+#endif  // MARISA_GRIMOIRE_TRIE_SECTION_H_
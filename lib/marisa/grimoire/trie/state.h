@@ -3,6 +3,28 @@
 
 #include "marisa/grimoire/vector.h"
 #include "marisa/grimoire/trie/history.h"
+#include "marisa/grimoire/trie/frame.h"
+
+// The following macros count the work of a query in the stats of `agent' if
+// the library is built with MARISA_ENABLE_STATS, and do nothing otherwise.
+// MARISA_STATS_COUNT_CACHE() counts a cache probe which has found `cache',
+// and MARISA_STATS_ADD() counts `count' at once.
+#ifdef MARISA_ENABLE_STATS
+ #define MARISA_STATS_COUNT(agent, counter) \
+     ((agent).stats().add(::marisa::Stats::counter))
+ #define MARISA_STATS_ADD(agent, counter, count) \
+     ((agent).stats().add(::marisa::Stats::counter, (count)))
+ #define MARISA_STATS_COUNT_IF(agent, condition, counter) \
+     ((condition) ? MARISA_STATS_COUNT(agent, counter) : (void)0)
+ #define MARISA_STATS_COUNT_CACHE(agent, cache) \
+     (((cache) != NULL) ? MARISA_STATS_COUNT(agent, CACHE_HITS) : \
+         MARISA_STATS_COUNT(agent, CACHE_MISSES))
+#else  // MARISA_ENABLE_STATS
+ #define MARISA_STATS_COUNT(agent, counter) ((void)0)
+ #define MARISA_STATS_ADD(agent, counter, count) ((void)0)
+ #define MARISA_STATS_COUNT_IF(agent, condition, counter) ((void)0)
+ #define MARISA_STATS_COUNT_CACHE(agent, cache) ((void)0)
+#endif  // MARISA_ENABLE_STATS
 
 namespace marisa {
 namespace grimoire {
@@ -21,7 +43,7 @@ typedef enum StatusCode {
 class State {
  public:
   State()
-      : key_buf_(), history_(), node_id_(0), query_pos_(0),
+      : key_buf_(), history_(), frames_(), node_id_(0), query_pos_(0),
         history_pos_(0), status_code_(MARISA_READY_TO_ALL) {}
 
   void set_node_id(std::size_t node_id) {
@@ -59,6 +81,9 @@ class State {
   const Vector<History> &history() const {
     return history_;
   }
+  const Vector<Frame> &frames() const {
+    return frames_;
+  }
 
   Vector<char> &key_buf() {
     return key_buf_;
@@ -66,6 +91,11 @@ class State {
   Vector<History> &history() {
     return history_;
   }
+  // frames() is the stack of the paths which remain to be followed in the
+  // nested tries. It is used within a step of a query.
+  Vector<Frame> &frames() {
+    return frames_;
+  }
 
   void reset() {
     status_code_ = MARISA_READY_TO_ALL;
@@ -100,6 +130,7 @@ class State {
  private:
   Vector<char> key_buf_;
   Vector<History> history_;
+  Vector<Frame> frames_;
   UInt32 node_id_;
   UInt32 query_pos_;
   UInt32 history_pos_;
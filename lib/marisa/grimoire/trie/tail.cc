@@ -1,5 +1,4 @@
 #include "marisa/grimoire/algorithm.h"
-#include "marisa/grimoire/trie/state.h"
 #include "marisa/grimoire/trie/tail.h"
 
 namespace marisa {
@@ -38,18 +37,21 @@ void Tail::build(Vector<Entry> &entries, Vector<UInt32> *offsets,
   }
 
   Tail temp;
+  temp.set_allocator(allocator());
   temp.build_(entries, offsets, mode);
   swap(temp);
 }
 
 void Tail::map(Mapper &mapper) {
   Tail temp;
+  temp.set_allocator(allocator());
   temp.map_(mapper);
   swap(temp);
 }
 
 void Tail::read(Reader &reader) {
   Tail temp;
+  temp.set_allocator(allocator());
   temp.read_(reader);
   swap(temp);
 }
@@ -59,93 +61,32 @@ void Tail::write(Writer &writer) const {
 }
 
 void Tail::restore(Agent &agent, std::size_t offset) const {
-  MARISA_DEBUG_IF(buf_.empty(), MARISA_STATE_ERROR);
-
-  State &state = agent.state();
   if (end_flags_.empty()) {
-    for (const char *ptr = &buf_[offset]; *ptr != '\0'; ++ptr) {
-      state.key_buf().push_back(*ptr);
-    }
+    restore<MARISA_TEXT_TAIL>(agent, offset);
   } else {
-    do {
-      state.key_buf().push_back(buf_[offset]);
-    } while (!end_flags_[offset++]);
+    restore<MARISA_BINARY_TAIL>(agent, offset);
   }
 }
 
 bool Tail::match(Agent &agent, std::size_t offset) const {
-  MARISA_DEBUG_IF(buf_.empty(), MARISA_STATE_ERROR);
-  MARISA_DEBUG_IF(agent.state().query_pos() >= agent.query().length(),
-      MARISA_BOUND_ERROR);
-
-  State &state = agent.state();
-  if (end_flags_.empty()) {
-    const char * const ptr = &buf_[offset] - state.query_pos();
-    do {
-      if (ptr[state.query_pos()] != agent.query()[state.query_pos()]) {
-        return false;
-      }
-      state.set_query_pos(state.query_pos() + 1);
-      if (ptr[state.query_pos()] == '\0') {
-        return true;
-      }
-    } while (state.query_pos() < agent.query().length());
-    return false;
-  } else {
-    do {
-      if (buf_[offset] != agent.query()[state.query_pos()]) {
-        return false;
-      }
-      state.set_query_pos(state.query_pos() + 1);
-      if (end_flags_[offset++]) {
-        return true;
-      }
-    } while (state.query_pos() < agent.query().length());
-    return false;
-  }
+  return end_flags_.empty() ? match<MARISA_TEXT_TAIL>(agent, offset) :
+      match<MARISA_BINARY_TAIL>(agent, offset);
 }
 
 bool Tail::prefix_match(Agent &agent, std::size_t offset) const {
-  MARISA_DEBUG_IF(buf_.empty(), MARISA_STATE_ERROR);
+  return end_flags_.empty() ? prefix_match<MARISA_TEXT_TAIL>(agent, offset) :
+      prefix_match<MARISA_BINARY_TAIL>(agent, offset);
+}
 
-  State &state = agent.state();
-  if (end_flags_.empty()) {
-    const char *ptr = &buf_[offset] - state.query_pos();
-    do {
-      if (ptr[state.query_pos()] != agent.query()[state.query_pos()]) {
-        return false;
-      }
-      state.key_buf().push_back(ptr[state.query_pos()]);
-      state.set_query_pos(state.query_pos() + 1);
-      if (ptr[state.query_pos()] == '\0') {
-        return true;
-      }
-    } while (state.query_pos() < agent.query().length());
-    ptr += state.query_pos();
-    do {
-      state.key_buf().push_back(*ptr);
-    } while (*++ptr != '\0');
-    return true;
-  } else {
-    do {
-      if (buf_[offset] != agent.query()[state.query_pos()]) {
-        return false;
-      }
-      state.key_buf().push_back(buf_[offset]);
-      state.set_query_pos(state.query_pos() + 1);
-      if (end_flags_[offset++]) {
-        return true;
-      }
-    } while (state.query_pos() < agent.query().length());
-    do {
-      state.key_buf().push_back(buf_[offset]);
-    } while (!end_flags_[offset++]);
-    return true;
-  }
+std::size_t Tail::suffix_size(std::size_t offset) const {
+  return end_flags_.empty() ? (suffix_length_<MARISA_TEXT_TAIL>(offset) + 1) :
+      suffix_length_<MARISA_BINARY_TAIL>(offset);
 }
 
 void Tail::clear() {
-  Tail().swap(*this);
+  Tail temp;
+  temp.set_allocator(allocator());
+  swap(temp);
 }
 
 void Tail::swap(Tail &rhs) {
@@ -161,6 +102,7 @@ void Tail::build_(Vector<Entry> &entries, Vector<UInt32> *offsets,
   Algorithm().sort(entries.begin(), entries.end());
 
   Vector<UInt32> temp_offsets;
+  temp_offsets.set_allocator(offsets->allocator());
   temp_offsets.resize(entries.size(), 0);
 
   const Entry dummy;
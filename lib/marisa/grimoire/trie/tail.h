@@ -1,9 +1,12 @@
 #ifndef MARISA_GRIMOIRE_TRIE_TAIL_H_
 #define MARISA_GRIMOIRE_TRIE_TAIL_H_
 
+#include <cstring>
+
 #include "marisa/agent.h"
 #include "marisa/grimoire/vector.h"
 #include "marisa/grimoire/trie/entry.h"
+#include "marisa/grimoire/trie/state.h"
 
 namespace marisa {
 namespace grimoire {
@@ -13,6 +16,15 @@ class Tail {
  public:
   Tail();
 
+  // set_allocator() must be called before the TAIL is built or read.
+  void set_allocator(Allocator *allocator) {
+    buf_.set_allocator(allocator);
+    end_flags_.set_allocator(allocator);
+  }
+  Allocator *allocator() const {
+    return buf_.allocator();
+  }
+
   void build(Vector<Entry> &entries, Vector<UInt32> *offsets,
       TailMode mode);
 
@@ -24,6 +36,19 @@ class Tail {
   bool match(Agent &agent, std::size_t offset) const;
   bool prefix_match(Agent &agent, std::size_t offset) const;
 
+  // The following templates are the kernels of the above functions for each
+  // mode. A caller which knows the mode in advance uses them directly, so
+  // that the mode is not tested for each suffix. They find the end of a
+  // suffix first and then copy or compare it at once. If match() or
+  // prefix_match() fails after the first byte matches, the query position
+  // is moved forward, so that the caller does not try the siblings.
+  template <TailMode T>
+  inline void restore(Agent &agent, std::size_t offset) const;
+  template <TailMode T>
+  inline bool match(Agent &agent, std::size_t offset) const;
+  template <TailMode T>
+  inline bool prefix_match(Agent &agent, std::size_t offset) const;
+
   const char &operator[](std::size_t offset) const {
     MARISA_DEBUG_IF(offset >= buf_.size(), MARISA_BOUND_ERROR);
     return buf_[offset];
@@ -45,6 +70,15 @@ class Tail {
   std::size_t io_size() const {
     return buf_.io_size() + end_flags_.io_size();
   }
+  // suffix_size() returns the number of bytes of the suffix at `offset',
+  // including the terminator in MARISA_TEXT_TAIL.
+  std::size_t suffix_size(std::size_t offset) const;
+
+  void prefetch(Prefetcher *prefetcher) const {
+    prefetcher->add(buf_);
+    end_flags_.prefetch_bits(prefetcher, 0, end_flags_.size());
+    end_flags_.prefetch_index(prefetcher);
+  }
 
   void clear();
   void swap(Tail &rhs);
@@ -53,6 +87,11 @@ class Tail {
   Vector<char> buf_;
   BitVector end_flags_;
 
+  // suffix_length_() returns the number of bytes of the suffix at
+  // `offset', excluding the terminator in MARISA_TEXT_TAIL.
+  template <TailMode T>
+  inline std::size_t suffix_length_(std::size_t offset) const;
+
   void build_(Vector<Entry> &entries, Vector<UInt32> *offsets,
       TailMode mode);
 
@@ -65,6 +104,87 @@ class Tail {
   Tail &operator=(const Tail &);
 };
 
+template <TailMode T>
+std::size_t Tail::suffix_length_(std::size_t offset) const {
+  MARISA_DEBUG_IF(offset >= buf_.size(), MARISA_BOUND_ERROR);
+  if (T == MARISA_TEXT_TAIL) {
+    const char * const ptr = &buf_[offset];
+    const void * const end = std::memchr(ptr, '\0', buf_.size() - offset);
+    return (end != NULL) ? (std::size_t)((const char *)end - ptr) :
+        (buf_.size() - offset);
+  } else {
+    return end_flags_.next1(offset) + 1 - offset;
+  }
+}
+
+template <TailMode T>
+void Tail::restore(Agent &agent, std::size_t offset) const {
+  MARISA_DEBUG_IF(buf_.empty(), MARISA_STATE_ERROR);
+
+  agent.state().key_buf().append(&buf_[offset], suffix_length_<T>(offset));
+}
+
+template <TailMode T>
+bool Tail::match(Agent &agent, std::size_t offset) const {
+  MARISA_DEBUG_IF(buf_.empty(), MARISA_STATE_ERROR);
+  MARISA_DEBUG_IF(agent.state().query_pos() >= agent.query().length(),
+      MARISA_BOUND_ERROR);
+
+  State &state = agent.state();
+  const char * const ptr = &buf_[offset];
+  const char * const query = agent.query().ptr() + state.query_pos();
+  MARISA_STATS_COUNT(agent, TAIL_BYTES_COMPARED);
+  if (*ptr != *query) {
+    return false;
+  }
+
+  const std::size_t length = suffix_length_<T>(offset);
+  if ((length == 0) ||
+      (length > (agent.query().length() - state.query_pos()))) {
+    state.set_query_pos(state.query_pos() + 1);
+    return false;
+  }
+  if (std::memcmp(ptr + 1, query + 1, length - 1) != 0) {
+    state.set_query_pos(state.query_pos() + 1);
+    return false;
+  }
+  MARISA_STATS_ADD(agent, TAIL_BYTES_COMPARED, length - 1);
+  state.set_query_pos(state.query_pos() + length);
+  return true;
+}
+
+template <TailMode T>
+bool Tail::prefix_match(Agent &agent, std::size_t offset) const {
+  MARISA_DEBUG_IF(buf_.empty(), MARISA_STATE_ERROR);
+  MARISA_DEBUG_IF(agent.state().query_pos() >= agent.query().length(),
+      MARISA_BOUND_ERROR);
+
+  State &state = agent.state();
+  const char * const ptr = &buf_[offset];
+  const char * const query = agent.query().ptr() + state.query_pos();
+  MARISA_STATS_COUNT(agent, TAIL_BYTES_COMPARED);
+  if (*ptr != *query) {
+    return false;
+  }
+
+  // The whole suffix is restored even if the rest of the query is shorter.
+  const std::size_t length = suffix_length_<T>(offset);
+  const std::size_t avail = agent.query().length() - state.query_pos();
+  const std::size_t num_compared = (length < avail) ? length : avail;
+  if (num_compared == 0) {
+    state.set_query_pos(state.query_pos() + 1);
+    return false;
+  }
+  if (std::memcmp(ptr + 1, query + 1, num_compared - 1) != 0) {
+    state.set_query_pos(state.query_pos() + 1);
+    return false;
+  }
+  MARISA_STATS_ADD(agent, TAIL_BYTES_COMPARED, num_compared - 1);
+  state.key_buf().append(ptr, length);
+  state.set_query_pos(state.query_pos() + num_compared);
+  return true;
+}
+
 }  // namespace trie
 }  // namespace grimoire
 }  // namespace marisa
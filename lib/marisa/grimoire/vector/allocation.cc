@@ -0,0 +1,70 @@
+#include "marisa/grimoire/thread/atomic.h"
+#include "marisa/grimoire/vector/allocation.h"
+
+namespace marisa {
+namespace grimoire {
+namespace vector {
+namespace {
+
+volatile std::size_t total_bytes = 0;
+volatile std::size_t current_bytes = 0;
+volatile std::size_t peak_bytes = 0;
+
+// The counters wrap around, so they are compared by their difference.
+void update_peak(std::size_t bytes) {
+  for ( ; ; ) {
+    const std::size_t peak = thread::atomic_load(&peak_bytes);
+    if (((std::ptrdiff_t)(bytes - peak) <= 0) ||
+        thread::atomic_compare_and_swap(&peak_bytes, peak, bytes)) {
+      return;
+    }
+  }
+}
+
+}  // namespace
+
+volatile std::size_t Allocation::num_users_ = 0;
+
+void Allocation::enable() {
+  thread::atomic_add(&num_users_, 1);
+}
+
+void Allocation::disable() {
+  MARISA_DEBUG_IF(thread::atomic_load(&num_users_) == 0,
+      MARISA_STATE_ERROR);
+  thread::atomic_add(&num_users_, ~(std::size_t)0);
+}
+
+void Allocation::add_(std::size_t size) {
+  thread::atomic_add(&total_bytes, size);
+  update_peak(thread::atomic_add(&current_bytes, size));
+}
+
+void Allocation::remove_(std::size_t size) {
+  thread::atomic_add(&current_bytes, ~size + 1);
+}
+
+std::size_t Allocation::total() {
+  return thread::atomic_load(&total_bytes);
+}
+
+std::size_t Allocation::current() {
+  return thread::atomic_load(&current_bytes);
+}
+
+std::size_t Allocation::peak() {
+  return thread::atomic_load(&peak_bytes);
+}
+
+void Allocation::reset_peak() {
+  for ( ; ; ) {
+    const std::size_t peak = thread::atomic_load(&peak_bytes);
+    if (thread::atomic_compare_and_swap(&peak_bytes, peak, current())) {
+      return;
+    }
+  }
+}
+
+}  // namespace vector
+}  // namespace grimoire
+}  // namespace marisa
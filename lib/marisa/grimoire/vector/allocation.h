@@ -0,0 +1,60 @@
+#ifndef MARISA_GRIMOIRE_VECTOR_ALLOCATION_H_
+#define MARISA_GRIMOIRE_VECTOR_ALLOCATION_H_
+
+#include "marisa/base.h"
+
+namespace marisa {
+namespace grimoire {
+namespace vector {
+
+// Allocation counts the memory allocated by vectors, so that a build can
+// report how much memory each phase uses. The counters are shared by all
+// threads and all objects, and they are updated only while counting is
+// enabled, so that vectors do not touch them otherwise.
+class Allocation {
+ public:
+  static void add(std::size_t size) {
+    if (num_users_ != 0) {
+      add_(size);
+    }
+  }
+  static void remove(std::size_t size) {
+    if (num_users_ != 0) {
+      remove_(size);
+    }
+  }
+
+  // enable() starts counting and disable() stops it. Calls may be nested,
+  // and counting continues until each enable() is followed by disable().
+  static void enable();
+  static void disable();
+  static bool enabled() {
+    return num_users_ != 0;
+  }
+
+  // total() returns the number of bytes allocated so far, current() returns
+  // the number of bytes in use and peak() returns the maximum of current()
+  // since the last reset_peak(). current() also goes down when a vector
+  // allocated before counting is freed, and it wraps around below 0, so
+  // differences of current() and peak() are meaningful but not the values.
+  static std::size_t total();
+  static std::size_t current();
+  static std::size_t peak();
+
+  static void reset_peak();
+
+ private:
+  static volatile std::size_t num_users_;
+
+  static void add_(std::size_t size);
+  static void remove_(std::size_t size);
+
+  // Disallows instantiation.
+  Allocation();
+};
+
+}  // namespace vector
+}  // namespace grimoire
+}  // namespace marisa
+
+#endif  // MARISA_GRIMOIRE_VECTOR_ALLOCATION_H_
@@ -720,6 +720,36 @@ std::size_t BitVector::select1(std::size_t i) const {
 
 #endif  // MARISA_WORD_SIZE == 64
 
+std::size_t BitVector::next1(std::size_t i) const {
+  MARISA_DEBUG_IF(i >= size_, MARISA_BOUND_ERROR);
+
+  std::size_t unit_id = i / MARISA_WORD_SIZE;
+  Unit unit = units_[unit_id] & (~(Unit)0 << (i % MARISA_WORD_SIZE));
+  while (unit == 0) {
+    if (++unit_id >= units_.size()) {
+      return size_;
+    }
+    unit = units_[unit_id];
+  }
+
+#ifdef _MSC_VER
+  unsigned long skip;
+ #if MARISA_WORD_SIZE == 64
+  ::_BitScanForward64(&skip, unit);
+ #else  // MARISA_WORD_SIZE == 64
+  ::_BitScanForward(&skip, unit);
+ #endif  // MARISA_WORD_SIZE == 64
+#else  // _MSC_VER
+ #if MARISA_WORD_SIZE == 64
+  const int skip = ::__builtin_ctzll(unit);
+ #else  // MARISA_WORD_SIZE == 64
+  const int skip = ::__builtin_ctz(unit);
+ #endif  // MARISA_WORD_SIZE == 64
+#endif  // _MSC_VER
+  const std::size_t pos = (unit_id * MARISA_WORD_SIZE) + skip;
+  return (pos < size_) ? pos : size_;
+}
+
 void BitVector::build_index(const BitVector &bv,
     bool enables_select0, bool enables_select1) {
   ranks_.resize((bv.size() / 512) + (((bv.size() % 512) != 0) ? 1 : 0) + 1);
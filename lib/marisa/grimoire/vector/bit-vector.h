@@ -19,8 +19,21 @@ class BitVector {
   BitVector()
       : units_(), size_(0), num_1s_(0), ranks_(), select0s_(), select1s_() {}
 
+  // set_allocator() selects the allocator of the bits and the index. It must
+  // be called before the bit vector is filled.
+  void set_allocator(Allocator *allocator) {
+    units_.set_allocator(allocator);
+    ranks_.set_allocator(allocator);
+    select0s_.set_allocator(allocator);
+    select1s_.set_allocator(allocator);
+  }
+  Allocator *allocator() const {
+    return units_.allocator();
+  }
+
   void build(bool enables_select0, bool enables_select1) {
     BitVector temp;
+    temp.set_allocator(allocator());
     temp.build_index(*this, enables_select0, enables_select1);
     units_.shrink();
     temp.units_.swap(units_);
@@ -29,11 +42,13 @@ class BitVector {
 
   void map(Mapper &mapper) {
     BitVector temp;
+    temp.set_allocator(allocator());
     temp.map_(mapper);
     swap(temp);
   }
   void read(Reader &reader) {
     BitVector temp;
+    temp.set_allocator(allocator());
     temp.read_(reader);
     swap(temp);
   }
@@ -77,6 +92,11 @@ class BitVector {
   std::size_t select0(std::size_t i) const;
   std::size_t select1(std::size_t i) const;
 
+  // next1() returns the position of the first 1 at or after `i', or size()
+  // if there is none. It scans the bits a word at a time and does not use
+  // the index.
+  std::size_t next1(std::size_t i) const;
+
   std::size_t num_0s() const {
     return size_ - num_1s_;
   }
@@ -94,13 +114,45 @@ class BitVector {
     return units_.total_size() + ranks_.total_size()
         + select0s_.total_size() + select1s_.total_size();
   }
+  // bits_size(), rank_index_size() and select_index_size() divide
+  // total_size().
+  std::size_t bits_size() const {
+    return units_.total_size();
+  }
+  std::size_t rank_index_size() const {
+    return ranks_.total_size();
+  }
+  std::size_t select_index_size() const {
+    return select0s_.total_size() + select1s_.total_size();
+  }
   std::size_t io_size() const {
     return units_.io_size() + (sizeof(UInt32) * 2) + ranks_.io_size()
         + select0s_.io_size() + select1s_.io_size();
   }
 
+  // prefetch_index() adds the rank/select index to `prefetcher' and
+  // prefetch_bits() adds the units which hold the bits in [begin, end).
+  void prefetch_index(Prefetcher *prefetcher) const {
+    prefetcher->add(ranks_);
+    prefetcher->add(select0s_);
+    prefetcher->add(select1s_);
+  }
+  void prefetch_bits(Prefetcher *prefetcher, std::size_t begin,
+      std::size_t end) const {
+    end = (end < size_) ? end : size_;
+    if (begin < end) {
+      const std::size_t unit_begin = begin / MARISA_WORD_SIZE;
+      const std::size_t unit_end =
+          (end + MARISA_WORD_SIZE - 1) / MARISA_WORD_SIZE;
+      prefetcher->add(units_.begin() + unit_begin,
+          sizeof(Unit) * (unit_end - unit_begin));
+    }
+  }
+
   void clear() {
-    BitVector().swap(*this);
+    BitVector temp;
+    temp.set_allocator(allocator());
+    swap(temp);
   }
   void swap(BitVector &rhs) {
     units_.swap(rhs.units_);
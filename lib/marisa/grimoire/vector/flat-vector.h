@@ -17,19 +17,30 @@ class FlatVector {
 
   FlatVector() : units_(), value_size_(0), mask_(0), size_(0) {}
 
+  // set_allocator() must be called before the vector is built.
+  void set_allocator(Allocator *allocator) {
+    units_.set_allocator(allocator);
+  }
+  Allocator *allocator() const {
+    return units_.allocator();
+  }
+
   void build(const Vector<UInt32> &values) {
     FlatVector temp;
+    temp.set_allocator(allocator());
     temp.build_(values);
     swap(temp);
   }
 
   void map(Mapper &mapper) {
     FlatVector temp;
+    temp.set_allocator(allocator());
     temp.map_(mapper);
     swap(temp);
   }
   void read(Reader &reader) {
     FlatVector temp;
+    temp.set_allocator(allocator());
     temp.read_(reader);
     swap(temp);
   }
@@ -72,8 +83,14 @@ class FlatVector {
     return units_.io_size() + (sizeof(UInt32) * 2) + sizeof(UInt64);
   }
 
+  void prefetch(Prefetcher *prefetcher) const {
+    prefetcher->add(units_);
+  }
+
   void clear() {
-    FlatVector().swap(*this);
+    FlatVector temp;
+    temp.set_allocator(allocator());
+    swap(temp);
   }
   void swap(FlatVector &rhs) {
     units_.swap(rhs.units_);
@@ -3,7 +3,9 @@
 
 #include <new>
 
+#include "marisa/allocator.h"
 #include "marisa/grimoire/io.h"
+#include "marisa/grimoire/vector/allocation.h"
 
 namespace marisa {
 namespace grimoire {
@@ -13,24 +15,55 @@ template <typename T>
 class Vector {
  public:
   Vector()
-      : buf_(), objs_(NULL), const_objs_(NULL),
-        size_(0), capacity_(0), fixed_(false) {}
+      : buf_(NULL), objs_(NULL), const_objs_(NULL),
+        size_(0), capacity_(0), fixed_(false), alignment_(0),
+        allocator_(NULL) {}
   ~Vector() {
     if (objs_ != NULL) {
       for (std::size_t i = 0; i < size_; ++i) {
         objs_[i].~T();
       }
     }
+    if (buf_ != NULL) {
+      deallocate(buf_, buf_size(capacity_));
+      Allocation::remove(sizeof(T) * capacity_);
+    }
+  }
+
+  // set_allocator() selects the allocator of the buffer and must be called
+  // before the buffer is allocated. NULL selects new[]. The allocator is
+  // kept by map(), read() and clear().
+  void set_allocator(Allocator *allocator) {
+    MARISA_THROW_IF(buf_ != NULL, MARISA_STATE_ERROR);
+    allocator_ = allocator;
+  }
+  Allocator *allocator() const {
+    return allocator_;
+  }
+
+  // set_alignment() aligns the elements to `alignment' bytes, a power of 2
+  // up to 4096, by allocating `alignment' - 1 bytes more. It must be called
+  // before the buffer is allocated and is kept like the allocator. A mapped
+  // vector is aligned as it is in the mapping.
+  void set_alignment(std::size_t alignment) {
+    MARISA_THROW_IF(buf_ != NULL, MARISA_STATE_ERROR);
+    MARISA_THROW_IF((alignment == 0) || (alignment > 4096) ||
+        ((alignment & (alignment - 1)) != 0), MARISA_CODE_ERROR);
+    alignment_ = (UInt32)((alignment > 1) ? alignment : 0);
   }
 
   void map(Mapper &mapper) {
     Vector temp;
+    temp.alignment_ = alignment_;
+    temp.allocator_ = allocator_;
     temp.map_(mapper);
     swap(temp);
   }
 
   void read(Reader &reader) {
     Vector temp;
+    temp.alignment_ = alignment_;
+    temp.allocator_ = allocator_;
     temp.read_(reader);
     swap(temp);
   }
@@ -47,6 +80,18 @@ class Vector {
     ++size_;
   }
 
+  // append() assumes that T's copy constructor does not throw an exception.
+  // `objs' must not point into the vector.
+  void append(const T *objs, std::size_t num_objs) {
+    MARISA_DEBUG_IF(fixed_, MARISA_STATE_ERROR);
+    MARISA_DEBUG_IF(num_objs > (max_size() - size_), MARISA_SIZE_ERROR);
+    reserve(size_ + num_objs);
+    for (std::size_t i = 0; i < num_objs; ++i) {
+      new (&objs_[size_ + i]) T(objs[i]);
+    }
+    size_ += num_objs;
+  }
+
   void pop_back() {
     MARISA_DEBUG_IF(fixed_, MARISA_STATE_ERROR);
     MARISA_DEBUG_IF(size_ == 0, MARISA_STATE_ERROR);
@@ -172,15 +217,20 @@ class Vector {
   }
 
   void clear() {
-    Vector().swap(*this);
+    Vector temp;
+    temp.alignment_ = alignment_;
+    temp.allocator_ = allocator_;
+    swap(temp);
   }
   void swap(Vector &rhs) {
-    buf_.swap(rhs.buf_);
+    marisa::swap(buf_, rhs.buf_);
     marisa::swap(objs_, rhs.objs_);
     marisa::swap(const_objs_, rhs.const_objs_);
     marisa::swap(size_, rhs.size_);
     marisa::swap(capacity_, rhs.capacity_);
     marisa::swap(fixed_, rhs.fixed_);
+    marisa::swap(alignment_, rhs.alignment_);
+    marisa::swap(allocator_, rhs.allocator_);
   }
 
   static std::size_t max_size() {
@@ -188,12 +238,14 @@ class Vector {
   }
 
  private:
-  scoped_array<char> buf_;
+  char *buf_;
   T *objs_;
   const T *const_objs_;
   std::size_t size_;
   std::size_t capacity_;
   bool fixed_;
+  UInt32 alignment_;
+  Allocator *allocator_;
 
   void map_(Mapper &mapper) {
     UInt64 total_size;
@@ -211,6 +263,7 @@ class Vector {
     reader.read(&total_size);
     MARISA_THROW_IF(total_size > MARISA_SIZE_MAX, MARISA_SIZE_ERROR);
     MARISA_THROW_IF((total_size % sizeof(T)) != 0, MARISA_FORMAT_ERROR);
+    MARISA_THROW_IF(total_size > reader.avail(), MARISA_FORMAT_ERROR);
     const std::size_t size = (std::size_t)(total_size / sizeof(T));
     resize(size);
     reader.read(objs_, size);
@@ -226,10 +279,14 @@ class Vector {
   void realloc(std::size_t new_capacity) {
     MARISA_DEBUG_IF(new_capacity > max_size(), MARISA_SIZE_ERROR);
 
-    scoped_array<char> new_buf(
-        new (std::nothrow) char[sizeof(T) * new_capacity]);
-    MARISA_DEBUG_IF(new_buf.get() == NULL, MARISA_MEMORY_ERROR);
-    T *new_objs = reinterpret_cast<T *>(new_buf.get());
+    MARISA_THROW_IF(new_capacity > ((MARISA_SIZE_MAX - alignment_) /
+        sizeof(T)), MARISA_SIZE_ERROR);
+    char * const new_buf = allocate(buf_size(new_capacity));
+    MARISA_THROW_IF(new_buf == NULL, MARISA_MEMORY_ERROR);
+    T *new_objs = reinterpret_cast<T *>((alignment_ == 0) ? new_buf :
+        (new_buf + ((alignment_ - ((std::size_t)new_buf % alignment_)) %
+            alignment_)));
+    Allocation::add(sizeof(T) * new_capacity);
 
     for (std::size_t i = 0; i < size_; ++i) {
       new (&new_objs[i]) T(objs_[i]);
@@ -238,12 +295,34 @@ class Vector {
       objs_[i].~T();
     }
 
-    buf_.swap(new_buf);
+    if (buf_ != NULL) {
+      deallocate(buf_, buf_size(capacity_));
+      Allocation::remove(sizeof(T) * capacity_);
+    }
+    buf_ = new_buf;
     objs_ = new_objs;
     const_objs_ = new_objs;
     capacity_ = new_capacity;
   }
 
+  // buf_size() returns the size of a buffer for `capacity' elements.
+  std::size_t buf_size(std::size_t capacity) const {
+    return (sizeof(T) * capacity) + ((alignment_ != 0) ? (alignment_ - 1) : 0);
+  }
+  char *allocate(std::size_t size) const {
+    if (allocator_ != NULL) {
+      return static_cast<char *>(allocator_->allocate(size));
+    }
+    return new (std::nothrow) char[size];
+  }
+  void deallocate(char *buf, std::size_t size) const {
+    if (allocator_ != NULL) {
+      allocator_->deallocate(buf, size);
+    } else {
+      delete [] buf;
+    }
+  }
+
   // Disallows copy and assignment.
   Vector(const Vector &);
   Vector &operator=(const Vector &);
@@ -3,12 +3,15 @@
 
 #include <iosfwd>
 
+#include "marisa/base.h"
+
 namespace marisa {
 
 class Trie;
 
 std::istream &read(std::istream &stream, Trie *trie);
-std::ostream &write(std::ostream &stream, const Trie &trie);
+std::ostream &write(std::ostream &stream, const Trie &trie,
+    FormatVersion format = MARISA_DEFAULT_FORMAT);
 
 std::istream &operator>>(std::istream &stream, Trie &trie);
 std::ostream &operator<<(std::ostream &stream, const Trie &trie);
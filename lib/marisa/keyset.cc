@@ -1,15 +1,181 @@
+#include <cstdlib>
+#include <cstring>
 #include <new>
+#include <string>
 
+#include "marisa/grimoire/io.h"
+#include "marisa/grimoire/thread.h"
+#include "marisa/grimoire/vector.h"
 #include "marisa/keyset.h"
 
 namespace marisa {
+namespace {
+
+// parse_weight() parses [begin, end) as a number without copying it. Simple
+// decimals whose significand and exponent are small enough are converted
+// exactly, so the result is the same as std::strtod(). The other forms are
+// passed to std::strtod() through a buffer. Like marisa-build, the value of
+// the longest valid prefix is stored even if the parse fails.
+bool parse_weight(const char *begin, const char *end, float *weight) {
+  static const double POWERS[] = {
+    1E0, 1E1, 1E2, 1E3, 1E4, 1E5, 1E6, 1E7, 1E8, 1E9, 1E10, 1E11,
+    1E12, 1E13, 1E14, 1E15, 1E16, 1E17, 1E18, 1E19, 1E20, 1E21, 1E22
+  };
+
+  const char *ptr = begin;
+  const bool is_negative = (ptr != end) && (*ptr == '-');
+  if ((ptr != end) && ((*ptr == '-') || (*ptr == '+'))) {
+    ++ptr;
+  }
+  UInt64 significand = 0;
+  std::size_t num_digits = 0;
+  int exponent = 0;
+  bool has_digits = false;
+  for ( ; (ptr != end) && (*ptr >= '0') && (*ptr <= '9'); ++ptr) {
+    if ((significand != 0) || (*ptr != '0')) {
+      significand = (significand * 10) + (UInt64)(*ptr - '0');
+      ++num_digits;
+    }
+    has_digits = true;
+  }
+  if ((ptr != end) && (*ptr == '.')) {
+    for (++ptr; (ptr != end) && (*ptr >= '0') && (*ptr <= '9'); ++ptr) {
+      if ((significand != 0) || (*ptr != '0')) {
+        significand = (significand * 10) + (UInt64)(*ptr - '0');
+        ++num_digits;
+      }
+      --exponent;
+      has_digits = true;
+    }
+  }
+  if (has_digits && (ptr != end) && ((*ptr == 'e') || (*ptr == 'E'))) {
+    const char *exp_ptr = ptr + 1;
+    const bool is_negative_exp = (exp_ptr != end) && (*exp_ptr == '-');
+    if ((exp_ptr != end) && ((*exp_ptr == '-') || (*exp_ptr == '+'))) {
+      ++exp_ptr;
+    }
+    int exp_value = 0;
+    const char * const exp_begin = exp_ptr;
+    for ( ; (exp_ptr != end) && (*exp_ptr >= '0') && (*exp_ptr <= '9');
+        ++exp_ptr) {
+      if (exp_value < 10000) {
+        exp_value = (exp_value * 10) + (*exp_ptr - '0');
+      }
+    }
+    if (exp_ptr != exp_begin) {
+      exponent += is_negative_exp ? -exp_value : exp_value;
+      ptr = exp_ptr;
+    }
+  }
+  if (has_digits && (ptr == end) && (num_digits <= 15) &&
+      (exponent >= -22) && (exponent <= 22)) {
+    double value = (double)significand;
+    if (exponent < 0) {
+      value /= POWERS[-exponent];
+    } else {
+      value *= POWERS[exponent];
+    }
+    *weight = (float)(is_negative ? -value : value);
+    return true;
+  }
+
+  const std::string buf(begin, end);
+  char *end_of_value;
+  *weight = (float)std::strtod(buf.c_str(), &end_of_value);
+  return *end_of_value == '\0';
+}
+
+void append_key(Keyset *keyset, const char *ptr, std::size_t length,
+    float weight) {
+  keyset->push_back_ref(ptr, length, weight);
+}
+
+void append_key(grimoire::Vector<Key> *keys, const char *ptr,
+    std::size_t length, float weight) {
+  MARISA_THROW_IF(length > MARISA_UINT32_MAX, MARISA_SIZE_ERROR);
+  Key key;
+  key.set_str(ptr, length);
+  key.set_weight(weight);
+  keys->push_back(key);
+}
+
+// parse_lines() appends the lines in [ptr, end) to `keys'.
+template <typename T>
+void parse_lines(const char *ptr, const char *end, char delimiter,
+    bool with_weights, T *keys) {
+  while (ptr != end) {
+    const char *line_end = static_cast<const char *>(
+        std::memchr(ptr, delimiter, (std::size_t)(end - ptr)));
+    if (line_end == NULL) {
+      line_end = end;
+    }
+
+    const char *key_end = line_end;
+    float weight = 1.0F;
+    if (with_weights) {
+      const char *delim_ptr = line_end;
+      while ((delim_ptr != ptr) && (delim_ptr[-1] != '\t')) {
+        --delim_ptr;
+      }
+      if ((delim_ptr != ptr) && parse_weight(delim_ptr, line_end, &weight)) {
+        key_end = delim_ptr - 1;
+      }
+    }
+    append_key(keys, ptr, (std::size_t)(key_end - ptr), weight);
+
+    ptr = (line_end != end) ? (line_end + 1) : end;
+  }
+}
+
+// A ParseTask is a chunk of lines parsed by a worker thread. An exception is
+// kept in the task and rethrown by the calling thread, and std::bad_alloc is
+// kept as MARISA_MEMORY_ERROR because nothing may escape a worker thread.
+struct ParseTask {
+  ParseTask()
+      : begin(NULL), end(NULL), delimiter('\n'), with_weights(true),
+        keys(), has_error(false), error(NULL, 0, MARISA_OK, NULL) {}
+
+  const char *begin;
+  const char *end;
+  char delimiter;
+  bool with_weights;
+  grimoire::Vector<Key> keys;
+  bool has_error;
+  Exception error;
+
+  static void run(void *arg) {
+    ParseTask &task = *static_cast<ParseTask *>(arg);
+    try {
+      parse_lines(task.begin, task.end, task.delimiter, task.with_weights,
+          &task.keys);
+    } catch (const Exception &ex) {
+      task.has_error = true;
+      task.error = ex;
+    } catch (const std::bad_alloc &) {
+      task.has_error = true;
+      task.error = Exception(__FILE__, __LINE__, MARISA_MEMORY_ERROR,
+          __FILE__ ":" MARISA_LINE_STR ": MARISA_MEMORY_ERROR: "
+          "std::bad_alloc");
+    }
+  }
+
+ private:
+  // Disallows copy and assignment.
+  ParseTask(const ParseTask &);
+  ParseTask &operator=(const ParseTask &);
+};
+
+}  // namespace
 
 Keyset::Keyset()
     : base_blocks_(), base_blocks_size_(0), base_blocks_capacity_(0),
       extra_blocks_(), extra_blocks_size_(0), extra_blocks_capacity_(0),
       key_blocks_(), key_blocks_size_(0), key_blocks_capacity_(0),
+      mappers_(), mappers_size_(0), mappers_capacity_(0),
       ptr_(NULL), avail_(0), size_(0), total_length_(0) {}
 
+Keyset::~Keyset() {}
+
 void Keyset::push_back(const Key &key) {
   MARISA_DEBUG_IF(size_ == MARISA_SIZE_MAX, MARISA_SIZE_ERROR);
 
@@ -73,9 +239,119 @@ void Keyset::push_back(const char *ptr, std::size_t length, float weight) {
   total_length_ += length;
 }
 
+void Keyset::push_back_ref(const char *ptr, std::size_t length,
+    float weight) {
+  MARISA_DEBUG_IF(size_ == MARISA_SIZE_MAX, MARISA_SIZE_ERROR);
+  MARISA_THROW_IF((ptr == NULL) && (length != 0), MARISA_NULL_ERROR);
+  MARISA_THROW_IF(length > MARISA_UINT32_MAX, MARISA_SIZE_ERROR);
+
+  if ((size_ / KEY_BLOCK_SIZE) == key_blocks_size_) {
+    append_key_block();
+  }
+
+  Key &key = key_blocks_[size_ / KEY_BLOCK_SIZE][size_ % KEY_BLOCK_SIZE];
+  key.set_str(ptr, length);
+  key.set_weight(weight);
+  ++size_;
+  total_length_ += length;
+}
+
+void Keyset::push_back_ref(const char *data, const UInt32 *offsets,
+    std::size_t num_keys, const float *weights) {
+  push_back_refs(data, offsets, num_keys, weights);
+}
+
+void Keyset::push_back_ref(const char *data, const UInt64 *offsets,
+    std::size_t num_keys, const float *weights) {
+  push_back_refs(data, offsets, num_keys, weights);
+}
+
+void Keyset::mmap(const char *filename, char delimiter, bool with_weights,
+    std::size_t num_threads) {
+  MARISA_THROW_IF(filename == NULL, MARISA_NULL_ERROR);
+
+  // An empty file has no keys and cannot be mapped.
+  if (grimoire::Mapper::file_size(filename) == 0) {
+    return;
+  }
+
+  grimoire::Mapper &mapper = append_mapper();
+  mapper.open(filename);
+
+  const std::size_t size = mapper.avail();
+  const char *ptr;
+  mapper.map(&ptr, size);
+
+  if (num_threads == 0) {
+    num_threads = grimoire::Thread::hardware_concurrency();
+  }
+  if (num_threads > (size / MIN_CHUNK_SIZE)) {
+    num_threads = size / MIN_CHUNK_SIZE;
+  }
+  if (num_threads <= 1) {
+    parse_lines(ptr, ptr + size, delimiter, with_weights, this);
+    return;
+  }
+
+  // The input is split at line boundaries. The last chunk is parsed by the
+  // calling thread.
+  scoped_array<ParseTask> tasks(new (std::nothrow) ParseTask[num_threads]);
+  MARISA_THROW_IF(tasks.get() == NULL, MARISA_MEMORY_ERROR);
+  std::size_t offset = 0;
+  for (std::size_t i = 0; i < num_threads; ++i) {
+    std::size_t next_offset = size;
+    if (i != (num_threads - 1)) {
+      next_offset = (std::size_t)((UInt64)size * (i + 1) / num_threads);
+      if (next_offset <= offset) {
+        next_offset = offset;
+      } else if (ptr[next_offset - 1] != delimiter) {
+        const char * const line_end = static_cast<const char *>(
+            std::memchr(ptr + next_offset, delimiter, size - next_offset));
+        next_offset = (line_end != NULL) ?
+            (std::size_t)(line_end + 1 - ptr) : size;
+      }
+    }
+    tasks[i].begin = ptr + offset;
+    tasks[i].end = ptr + next_offset;
+    tasks[i].delimiter = delimiter;
+    tasks[i].with_weights = with_weights;
+    offset = next_offset;
+  }
+
+  {
+    scoped_array<grimoire::Thread> threads(
+        new (std::nothrow) grimoire::Thread[num_threads - 1]);
+    MARISA_THROW_IF(threads.get() == NULL, MARISA_MEMORY_ERROR);
+    for (std::size_t i = 0; i < (num_threads - 1); ++i) {
+      threads[i].start(ParseTask::run, &tasks[i]);
+    }
+    ParseTask::run(&tasks[num_threads - 1]);
+    for (std::size_t i = 0; i < (num_threads - 1); ++i) {
+      threads[i].join();
+    }
+  }
+
+  for (std::size_t i = 0; i < num_threads; ++i) {
+    if (tasks[i].has_error) {
+      throw tasks[i].error;
+    }
+  }
+  for (std::size_t i = 0; i < num_threads; ++i) {
+    const grimoire::Vector<Key> &keys = tasks[i].keys;
+    for (std::size_t j = 0; j < keys.size(); ++j) {
+      push_back_ref(keys[j].ptr(), keys[j].length(), keys[j].weight());
+    }
+    tasks[i].keys.clear();
+  }
+}
+
 void Keyset::reset() {
   base_blocks_size_ = 0;
   extra_blocks_size_ = 0;
+  for (std::size_t i = 0; i < mappers_size_; ++i) {
+    mappers_[i].clear();
+  }
+  mappers_size_ = 0;
   ptr_ = NULL;
   avail_ = 0;
   size_ = 0;
@@ -96,6 +372,9 @@ void Keyset::swap(Keyset &rhs) {
   key_blocks_.swap(rhs.key_blocks_);
   marisa::swap(key_blocks_size_, rhs.key_blocks_size_);
   marisa::swap(key_blocks_capacity_, rhs.key_blocks_capacity_);
+  mappers_.swap(rhs.mappers_);
+  marisa::swap(mappers_size_, rhs.mappers_size_);
+  marisa::swap(mappers_capacity_, rhs.mappers_capacity_);
   marisa::swap(ptr_, rhs.ptr_);
   marisa::swap(avail_, rhs.avail_);
   marisa::swap(size_, rhs.size_);
@@ -120,6 +399,23 @@ char *Keyset::reserve(std::size_t size) {
   }
 }
 
+template <typename T>
+void Keyset::push_back_refs(const char *data, const T *offsets,
+    std::size_t num_keys, const float *weights) {
+  MARISA_THROW_IF((offsets == NULL) && (num_keys != 0), MARISA_NULL_ERROR);
+  MARISA_THROW_IF(num_keys > (MARISA_SIZE_MAX - size_), MARISA_SIZE_ERROR);
+  for (std::size_t i = 0; i < num_keys; ++i) {
+    MARISA_THROW_IF(offsets[i + 1] < offsets[i], MARISA_RANGE_ERROR);
+  }
+  MARISA_THROW_IF((data == NULL) && (num_keys != 0) &&
+      (offsets[num_keys] != offsets[0]), MARISA_NULL_ERROR);
+
+  for (std::size_t i = 0; i < num_keys; ++i) {
+    push_back_ref(data + offsets[i], (std::size_t)(offsets[i + 1] - offsets[i]),
+        (weights != NULL) ? weights[i] : 1.0F);
+  }
+}
+
 void Keyset::append_base_block() {
   if (base_blocks_size_ == base_blocks_capacity_) {
     const std::size_t new_capacity =
@@ -178,4 +474,24 @@ void Keyset::append_key_block() {
   key_blocks_[key_blocks_size_++].swap(new_block);
 }
 
+grimoire::io::Mapper &Keyset::append_mapper() {
+  if (mappers_size_ == mappers_capacity_) {
+    const std::size_t new_capacity =
+        (mappers_size_ != 0) ? (mappers_size_ * 2) : 1;
+    scoped_array<scoped_ptr<grimoire::io::Mapper> > new_mappers(
+        new (std::nothrow) scoped_ptr<grimoire::io::Mapper>[new_capacity]);
+    MARISA_THROW_IF(new_mappers.get() == NULL, MARISA_MEMORY_ERROR);
+    for (std::size_t i = 0; i < mappers_size_; ++i) {
+      mappers_[i].swap(new_mappers[i]);
+    }
+    mappers_.swap(new_mappers);
+    mappers_capacity_ = new_capacity;
+  }
+  scoped_ptr<grimoire::io::Mapper> new_mapper(
+      new (std::nothrow) grimoire::io::Mapper);
+  MARISA_THROW_IF(new_mapper.get() == NULL, MARISA_MEMORY_ERROR);
+  mappers_[mappers_size_].swap(new_mapper);
+  return *mappers_[mappers_size_++];
+}
+
 }  // namespace marisa
@@ -4,16 +4,25 @@
 #include "marisa/key.h"
 
 namespace marisa {
+namespace grimoire {
+namespace io {
+
+class Mapper;
+
+}  // namespace io
+}  // namespace grimoire
 
 class Keyset {
  public:
   enum {
     BASE_BLOCK_SIZE  = 4096,
     EXTRA_BLOCK_SIZE = 1024,
-    KEY_BLOCK_SIZE   = 256
+    KEY_BLOCK_SIZE   = 256,
+    MIN_CHUNK_SIZE   = 1 << 20
   };
 
   Keyset();
+  ~Keyset();
 
   void push_back(const Key &key);
   void push_back(const Key &key, char end_marker);
@@ -21,6 +30,29 @@ class Keyset {
   void push_back(const char *str);
   void push_back(const char *ptr, std::size_t length, float weight = 1.0);
 
+  // push_back_ref() adds keys without copying them, so the given strings must
+  // be kept available until the keyset is cleared. The bulk versions take
+  // Arrow-style arrays: the i-th key is data[offsets[i], offsets[i + 1]) and
+  // `weights', if not NULL, gives num_keys weights.
+  void push_back_ref(const char *ptr, std::size_t length,
+      float weight = 1.0);
+  void push_back_ref(const char *data, const UInt32 *offsets,
+      std::size_t num_keys, const float *weights = NULL);
+  void push_back_ref(const char *data, const UInt64 *offsets,
+      std::size_t num_keys, const float *weights = NULL);
+
+  // mmap() maps a file of keys separated by `delimiter' and adds the keys
+  // without copying them. If `with_weights' is true, a line that ends with
+  // a tab and a number is split into a key and its weight, in the same way
+  // as marisa-build. The mapping is kept until the keyset is reset.
+  //
+  // If `num_threads' is not 1, the file is split at line boundaries into
+  // chunks of at least MIN_CHUNK_SIZE bytes and the chunks are parsed in
+  // parallel. 0 means the number of processors. Keys are added in the same
+  // order as the single-threaded parser.
+  void mmap(const char *filename, char delimiter = '\n',
+      bool with_weights = true, std::size_t num_threads = 1);
+
   const Key &operator[](std::size_t i) const {
     MARISA_DEBUG_IF(i >= size_, MARISA_BOUND_ERROR);
     return key_blocks_[i / KEY_BLOCK_SIZE][i % KEY_BLOCK_SIZE];
@@ -59,6 +91,9 @@ class Keyset {
   scoped_array<scoped_array<Key> > key_blocks_;
   std::size_t key_blocks_size_;
   std::size_t key_blocks_capacity_;
+  scoped_array<scoped_ptr<grimoire::io::Mapper> > mappers_;
+  std::size_t mappers_size_;
+  std::size_t mappers_capacity_;
   char *ptr_;
   std::size_t avail_;
   std::size_t size_;
@@ -66,9 +101,14 @@ class Keyset {
 
   char *reserve(std::size_t size);
 
+  template <typename T>
+  void push_back_refs(const char *data, const T *offsets,
+      std::size_t num_keys, const float *weights);
+
   void append_base_block();
   void append_extra_block(std::size_t size);
   void append_key_block();
+  grimoire::io::Mapper &append_mapper();
 
   // Disallows copy and assignment.
   Keyset(const Keyset &);
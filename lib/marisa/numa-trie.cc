@@ -0,0 +1,137 @@
+#include <new>
+#include <sstream>
+
+#include "marisa/iostream.h"
+#include "marisa/numa-trie.h"
+
+namespace marisa {
+
+NumaTrie::NumaTrie()
+    : allocators_(), replicas_(), num_replicas_(0), node_replicas_(),
+      num_nodes_(0) {}
+
+NumaTrie::~NumaTrie() {}
+
+void NumaTrie::load(const char *filename, std::size_t num_replicas) {
+  MARISA_THROW_IF(filename == NULL, MARISA_NULL_ERROR);
+
+  NumaTrie temp;
+  temp.create_replicas_(num_replicas);
+  for (std::size_t i = 0; i < temp.num_replicas_; ++i) {
+    temp.replicas_[i].load(filename);
+  }
+  swap(temp);
+}
+
+void NumaTrie::replicate(const Trie &trie, std::size_t num_replicas) {
+  std::stringstream stream;
+  write(stream, trie);
+
+  NumaTrie temp;
+  temp.create_replicas_(num_replicas);
+  for (std::size_t i = 0; i < temp.num_replicas_; ++i) {
+    stream.clear();
+    stream.seekg(0);
+    read(stream, &temp.replicas_[i]);
+  }
+  swap(temp);
+}
+
+const Trie &NumaTrie::local() const {
+  MARISA_THROW_IF(num_replicas_ == 0, MARISA_STATE_ERROR);
+  if (num_replicas_ == 1) {
+    return replicas_[0];
+  }
+  const std::size_t node = NumaAllocator::current_node();
+  return replicas_[(node < num_nodes_) ? node_replicas_[node] : 0];
+}
+
+const Trie &NumaTrie::replica(std::size_t i) const {
+  MARISA_THROW_IF(num_replicas_ == 0, MARISA_STATE_ERROR);
+  MARISA_THROW_IF(i >= num_replicas_, MARISA_BOUND_ERROR);
+  return replicas_[i];
+}
+
+std::size_t NumaTrie::replica_node(std::size_t i) const {
+  replica(i);
+  return allocators_[i]->node();
+}
+
+std::size_t NumaTrie::replica_size(std::size_t i) const {
+  return replica(i).total_size();
+}
+
+std::size_t NumaTrie::unbound_size(std::size_t i) const {
+  replica(i);
+  return allocators_[i]->unbound_size();
+}
+
+bool NumaTrie::empty() const {
+  return replica(0).empty();
+}
+
+std::size_t NumaTrie::num_keys() const {
+  return replica(0).num_keys();
+}
+
+std::size_t NumaTrie::total_size() const {
+  std::size_t total_size = 0;
+  for (std::size_t i = 0; i < num_replicas_; ++i) {
+    total_size += replica_size(i);
+  }
+  return total_size;
+}
+
+void NumaTrie::clear() {
+  NumaTrie().swap(*this);
+}
+
+void NumaTrie::swap(NumaTrie &rhs) {
+  allocators_.swap(rhs.allocators_);
+  replicas_.swap(rhs.replicas_);
+  marisa::swap(num_replicas_, rhs.num_replicas_);
+  node_replicas_.swap(rhs.node_replicas_);
+  marisa::swap(num_nodes_, rhs.num_nodes_);
+}
+
+void NumaTrie::create_replicas_(std::size_t num_replicas) {
+  const std::size_t num_nodes = NumaAllocator::num_nodes();
+  node_replicas_.reset(new (std::nothrow) std::size_t[num_nodes]);
+  MARISA_THROW_IF(node_replicas_.get() == NULL, MARISA_MEMORY_ERROR);
+  num_nodes_ = num_nodes;
+
+  // Nodes without memory get no replica of their own.
+  const bool skips_nodes = (num_replicas == 0);
+  if (skips_nodes) {
+    for (std::size_t node = 0; node < num_nodes; ++node) {
+      num_replicas += NumaAllocator::has_memory(node) ? 1 : 0;
+    }
+    num_replicas = (num_replicas != 0) ? num_replicas : 1;
+  }
+
+  allocators_.reset(
+      new (std::nothrow) scoped_ptr<NumaAllocator>[num_replicas]);
+  MARISA_THROW_IF(allocators_.get() == NULL, MARISA_MEMORY_ERROR);
+  replicas_.reset(new (std::nothrow) Trie[num_replicas]);
+  MARISA_THROW_IF(replicas_.get() == NULL, MARISA_MEMORY_ERROR);
+  num_replicas_ = num_replicas;
+
+  for (std::size_t node = 0; node < num_nodes; ++node) {
+    node_replicas_[node] = 0;
+  }
+  std::size_t node = 0;
+  for (std::size_t i = 0; i < num_replicas; ++i, ++node) {
+    while (skips_nodes && (node < num_nodes) &&
+        !NumaAllocator::has_memory(node)) {
+      ++node;
+    }
+    if (node < num_nodes) {
+      node_replicas_[node] = i;
+    }
+    allocators_[i].reset(new (std::nothrow) NumaAllocator(node));
+    MARISA_THROW_IF(allocators_[i].get() == NULL, MARISA_MEMORY_ERROR);
+    replicas_[i].set_allocator(allocators_[i].get());
+  }
+}
+
+}  // namespace marisa
@@ -0,0 +1,78 @@
+#ifndef MARISA_NUMA_TRIE_H_
+#define MARISA_NUMA_TRIE_H_
+
+#include "marisa/trie.h"
+
+namespace marisa {
+
+// NumaTrie keeps a replica of a dictionary on each NUMA node, so that
+// lookups do not cross the interconnect. The replicas are read into memory
+// bound to their nodes by NumaAllocator, and a query is given to the replica
+// of the node running the calling thread. The replicas are identical, so an
+// agent may move between nodes during a search.
+class NumaTrie {
+ public:
+  NumaTrie();
+  ~NumaTrie();
+
+  // load() and replicate() create `num_replicas' replicas, one per node
+  // starting at node 0. 0 means one replica per NUMA node which is online
+  // and has memory.
+  void load(const char *filename, std::size_t num_replicas = 0);
+  void replicate(const Trie &trie, std::size_t num_replicas = 0);
+
+  bool lookup(Agent &agent) const {
+    return local().lookup(agent);
+  }
+  void reverse_lookup(Agent &agent) const {
+    local().reverse_lookup(agent);
+  }
+  bool common_prefix_search(Agent &agent) const {
+    return local().common_prefix_search(agent);
+  }
+  bool predictive_search(Agent &agent) const {
+    return local().predictive_search(agent);
+  }
+
+  // local() returns the replica for the calling thread. A thread on a node
+  // without a replica uses the first replica. replica() returns the `i'-th
+  // replica and replica_node() returns its node.
+  const Trie &local() const;
+  const Trie &replica(std::size_t i) const;
+  std::size_t replica_node(std::size_t i) const;
+
+  std::size_t num_replicas() const {
+    return num_replicas_;
+  }
+  // replica_size() returns total_size() of the `i'-th replica. Its memory is
+  // bound to its node, except for the bytes counted by unbound_size().
+  std::size_t replica_size(std::size_t i) const;
+  std::size_t unbound_size(std::size_t i) const;
+
+  bool empty() const;
+  std::size_t num_keys() const;
+  std::size_t total_size() const;
+
+  void clear();
+  void swap(NumaTrie &rhs);
+
+ private:
+  // allocators_ is declared before replicas_ so that the replicas are
+  // destroyed first.
+  scoped_array<scoped_ptr<NumaAllocator> > allocators_;
+  scoped_array<Trie> replicas_;
+  std::size_t num_replicas_;
+  // node_replicas_ maps a node to its replica.
+  scoped_array<std::size_t> node_replicas_;
+  std::size_t num_nodes_;
+
+  void create_replicas_(std::size_t num_replicas);
+
+  // Disallows copy and assignment.
+  NumaTrie(const NumaTrie &);
+  NumaTrie &operator=(const NumaTrie &);
+};
+
+}  // namespace marisa
+
+#endif  // MARISA_NUMA_TRIE_H_
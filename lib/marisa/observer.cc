@@ -0,0 +1,31 @@
+#include "marisa/observer.h"
+
+namespace marisa {
+
+const char *BuildObserver::phase_name(Phase phase) {
+  switch (phase) {
+    case SORT_KEYS: {
+      return "sort keys";
+    }
+    case BUILD_LEVELS: {
+      return "build levels";
+    }
+    case BUILD_INDEX: {
+      return "build index";
+    }
+    case BUILD_TAIL: {
+      return "build TAIL";
+    }
+    case BUILD_LINKS: {
+      return "build links";
+    }
+    case BUILD_TERMINALS: {
+      return "build terminals";
+    }
+    default: {
+      return "unknown";
+    }
+  }
+}
+
+}  // namespace marisa
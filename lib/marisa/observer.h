@@ -0,0 +1,126 @@
+#ifndef MARISA_OBSERVER_H_
+#define MARISA_OBSERVER_H_
+
+#include "marisa/base.h"
+
+namespace marisa {
+
+// BuildObserver receives the progress of Trie::build(). A build consists of
+// the following phases, and the phases of a nested trie are reported with
+// its trie ID, which starts with 1 for the top-level trie. Phases do not
+// overlap, so their times and allocations can be summed up.
+class BuildObserver {
+ public:
+  typedef enum Phase_ {
+    // SORT_KEYS sorts the keys of a trie.
+    SORT_KEYS,
+    // BUILD_LEVELS arranges the nodes of a trie in level order.
+    BUILD_LEVELS,
+    // BUILD_INDEX builds the rank/select index of LOUDS.
+    BUILD_INDEX,
+    // BUILD_TAIL builds the TAIL, which stores the labels of the last trie.
+    BUILD_TAIL,
+    // BUILD_LINKS connects a trie to the next trie or TAIL and fills its
+    // cache.
+    BUILD_LINKS,
+    // BUILD_TERMINALS assigns key IDs.
+    BUILD_TERMINALS,
+    NUM_PHASES
+  } Phase;
+
+  class Event {
+   public:
+    Event()
+        : phase_(SORT_KEYS), trie_id_(0), num_keys_(0), num_nodes_(0),
+          time_(0.0), total_time_(0.0), num_allocated_bytes_(0),
+          peak_bytes_(0) {}
+
+    void set_phase(Phase phase) {
+      phase_ = phase;
+    }
+    void set_trie_id(std::size_t trie_id) {
+      trie_id_ = trie_id;
+    }
+    void set_num_keys(std::size_t num_keys) {
+      num_keys_ = num_keys;
+    }
+    void set_num_nodes(std::size_t num_nodes) {
+      num_nodes_ = num_nodes;
+    }
+    void set_time(double time) {
+      time_ = time;
+    }
+    void set_total_time(double total_time) {
+      total_time_ = total_time;
+    }
+    void set_num_allocated_bytes(std::size_t num_allocated_bytes) {
+      num_allocated_bytes_ = num_allocated_bytes;
+    }
+    void set_peak_bytes(std::size_t peak_bytes) {
+      peak_bytes_ = peak_bytes;
+    }
+
+    Phase phase() const {
+      return phase_;
+    }
+    std::size_t trie_id() const {
+      return trie_id_;
+    }
+    // num_keys() is the number of keys given to the phase.
+    std::size_t num_keys() const {
+      return num_keys_;
+    }
+    // num_nodes() is the number of nodes of the trie at the end of the phase.
+    std::size_t num_nodes() const {
+      return num_nodes_;
+    }
+    // time() is the wall time of the phase in seconds, and total_time() is
+    // the wall time from the beginning of the build.
+    double time() const {
+      return time_;
+    }
+    double total_time() const {
+      return total_time_;
+    }
+    // num_allocated_bytes() is the number of bytes allocated in the phase,
+    // and peak_bytes() is the peak of memory in use in the phase by the
+    // vectors allocated since the build has started. They count internal
+    // vectors of all threads, but only while a build with an observer is in
+    // progress.
+    std::size_t num_allocated_bytes() const {
+      return num_allocated_bytes_;
+    }
+    std::size_t peak_bytes() const {
+      return peak_bytes_;
+    }
+
+   private:
+    Phase phase_;
+    std::size_t trie_id_;
+    std::size_t num_keys_;
+    std::size_t num_nodes_;
+    double time_;
+    double total_time_;
+    std::size_t num_allocated_bytes_;
+    std::size_t peak_bytes_;
+  };
+
+  BuildObserver() {}
+  virtual ~BuildObserver() {}
+
+  // begin() and end() are called at the beginning and the end of a phase.
+  // The statistics of the phase are available in end().
+  virtual void begin(const Event &) {}
+  virtual void end(const Event &) {}
+
+  static const char *phase_name(Phase phase);
+
+ private:
+  // Disallows copy and assignment.
+  BuildObserver(const BuildObserver &);
+  BuildObserver &operator=(const BuildObserver &);
+};
+
+}  // namespace marisa
+
+#endif  // MARISA_OBSERVER_H_
@@ -0,0 +1,314 @@
+#include <cstring>
+#include <new>
+
+#include "marisa/result-cache.h"
+#include "marisa/grimoire/trie.h"
+
+namespace marisa {
+namespace {
+
+// A counter of the sketch saturates at MAX_SKETCH_COUNT, and the counters
+// are halved after SKETCH_PERIOD queries per entry of the cache so that the
+// estimates follow recent queries.
+enum {
+  MIN_SKETCH_WIDTH  = 16,
+  MAX_SKETCH_WIDTH  = 1 << 30,
+  MAX_SKETCH_COUNT  = 15,
+  SKETCH_PERIOD     = 10
+};
+
+const UInt32 SKETCH_SEEDS[] = {
+  0x9E3779B9U, 0x85EBCA6BU, 0xC2B2AE35U, 0x27D4EB2FU
+};
+
+UInt32 mix(UInt32 x) {
+  x ^= x >> 16;
+  x *= 0x85EBCA6BU;
+  x ^= x >> 13;
+  x *= 0xC2B2AE35U;
+  x ^= x >> 16;
+  return x;
+}
+
+UInt32 hash_key(const char *ptr, std::size_t length) {
+  UInt32 hash = 2166136261U;
+  for (std::size_t i = 0; i < length; ++i) {
+    hash ^= (UInt8)ptr[i];
+    hash *= 16777619U;
+  }
+  return mix(hash) & ~1U;
+}
+
+UInt32 hash_id(std::size_t key_id) {
+  return mix((UInt32)key_id) | 1U;
+}
+
+}  // namespace
+
+ResultCache::ResultCache(std::size_t capacity,
+    AdmissionPolicy admission_policy, std::size_t max_key_length)
+    : entries_(), keys_(), sketch_(), num_sets_(0), sketch_shift_(0),
+      num_samples_(0), max_key_length_(max_key_length),
+      admission_policy_(admission_policy), stamp_(0), clock_(0), size_(0),
+      num_hits_(0), num_misses_(0), num_rejections_(0) {
+  MARISA_THROW_IF((admission_policy != MARISA_ADMIT_ALL) &&
+      (admission_policy != MARISA_ADMIT_FREQUENT), MARISA_CODE_ERROR);
+  MARISA_THROW_IF(max_key_length > MARISA_UINT32_MAX, MARISA_SIZE_ERROR);
+  MARISA_THROW_IF(capacity > (MARISA_UINT32_MAX - NUM_WAYS + 1),
+      MARISA_SIZE_ERROR);
+
+  const std::size_t num_sets = (capacity + NUM_WAYS - 1) / NUM_WAYS;
+  const std::size_t num_entries = num_sets * NUM_WAYS;
+  if (num_entries == 0) {
+    return;
+  }
+  MARISA_THROW_IF((max_key_length != 0) &&
+      (num_entries > (MARISA_SIZE_MAX / max_key_length)), MARISA_SIZE_ERROR);
+
+  entries_.reset(new (std::nothrow) Entry[num_entries]);
+  MARISA_THROW_IF(entries_.get() == NULL, MARISA_MEMORY_ERROR);
+  keys_.reset(new (std::nothrow) char[num_entries * max_key_length]);
+  MARISA_THROW_IF(keys_.get() == NULL, MARISA_MEMORY_ERROR);
+  num_sets_ = num_sets;
+
+  if (admission_policy == MARISA_ADMIT_FREQUENT) {
+    std::size_t width = MIN_SKETCH_WIDTH;
+    sketch_shift_ = 32 - 4;
+    while ((width < num_entries) && (width < MAX_SKETCH_WIDTH)) {
+      width *= 2;
+      --sketch_shift_;
+    }
+    sketch_.reset(new (std::nothrow) UInt8[NUM_SKETCH_ROWS * width]);
+    MARISA_THROW_IF(sketch_.get() == NULL, MARISA_MEMORY_ERROR);
+    std::memset(sketch_.get(), 0, NUM_SKETCH_ROWS * width);
+  }
+  invalidate();
+}
+
+ResultCache::~ResultCache() {}
+
+bool ResultCache::lookup(const Trie &trie, Agent &agent) {
+  MARISA_THROW_IF(trie.trie_.get() == NULL, MARISA_STATE_ERROR);
+  bind(trie);
+
+  const char * const ptr = agent.query().ptr();
+  const std::size_t length = agent.query().length();
+  if (length > max_key_length_) {
+    ++num_misses_;
+    return trie.lookup(agent);
+  }
+
+  const UInt32 hash = hash_key(ptr, length);
+  count(hash);
+  Entry * const entry = find(hash, ptr, length);
+  if (entry == NULL) {
+    ++num_misses_;
+    const bool found = trie.lookup(agent);
+    insert(hash, ptr, length,
+        found ? agent.key().id() : (std::size_t)MARISA_INVALID_KEY_ID);
+    return found;
+  }
+
+  ++num_hits_;
+  touch(entry);
+  if (!agent.has_state()) {
+    agent.init_state();
+  }
+  agent.state().lookup_init();
+  if (entry->key_id == MARISA_INVALID_KEY_ID) {
+    return false;
+  }
+  agent.set_key(ptr, length);
+  agent.set_key(entry->key_id);
+  return true;
+}
+
+void ResultCache::reverse_lookup(const Trie &trie, Agent &agent) {
+  MARISA_THROW_IF(trie.trie_.get() == NULL, MARISA_STATE_ERROR);
+  bind(trie);
+
+  const std::size_t key_id = agent.query().id();
+  const UInt32 hash = hash_id(key_id);
+  count(hash);
+  Entry * const entry = find(hash, key_id);
+  if (entry == NULL) {
+    ++num_misses_;
+    trie.reverse_lookup(agent);
+    insert(hash, agent.key().ptr(), agent.key().length(), key_id);
+    return;
+  }
+
+  ++num_hits_;
+  touch(entry);
+  if (!agent.has_state()) {
+    agent.init_state();
+  }
+  grimoire::State &state = agent.state();
+  state.reverse_lookup_init();
+  state.key_buf().resize(entry->length);
+  if (entry->length != 0) {
+    std::memcpy(state.key_buf().begin(), get_key(entry), entry->length);
+  }
+  agent.set_key(state.key_buf().begin(), state.key_buf().size());
+  agent.set_key(key_id);
+}
+
+void ResultCache::invalidate() {
+  for (std::size_t i = 0; i < capacity(); ++i) {
+    entries_[i].last_use = 0;
+  }
+  clock_ = 0;
+  size_ = 0;
+}
+
+double ResultCache::hit_rate() const {
+  const std::size_t num_queries = num_hits_ + num_misses_;
+  return (num_queries != 0) ? ((double)num_hits_ / num_queries) : 0.0;
+}
+
+void ResultCache::clear_counts() {
+  num_hits_ = 0;
+  num_misses_ = 0;
+  num_rejections_ = 0;
+}
+
+void ResultCache::swap(ResultCache &rhs) {
+  entries_.swap(rhs.entries_);
+  keys_.swap(rhs.keys_);
+  sketch_.swap(rhs.sketch_);
+  marisa::swap(num_sets_, rhs.num_sets_);
+  marisa::swap(sketch_shift_, rhs.sketch_shift_);
+  marisa::swap(num_samples_, rhs.num_samples_);
+  marisa::swap(max_key_length_, rhs.max_key_length_);
+  marisa::swap(admission_policy_, rhs.admission_policy_);
+  marisa::swap(stamp_, rhs.stamp_);
+  marisa::swap(clock_, rhs.clock_);
+  marisa::swap(size_, rhs.size_);
+  marisa::swap(num_hits_, rhs.num_hits_);
+  marisa::swap(num_misses_, rhs.num_misses_);
+  marisa::swap(num_rejections_, rhs.num_rejections_);
+}
+
+void ResultCache::bind(const Trie &trie) {
+  const std::size_t stamp = trie.trie_->stamp();
+  if (stamp != stamp_) {
+    invalidate();
+    stamp_ = stamp;
+  }
+}
+
+ResultCache::Entry *ResultCache::find(UInt32 hash, const char *ptr,
+    std::size_t length) {
+  if (num_sets_ == 0) {
+    return NULL;
+  }
+  Entry * const set = &entries_[get_set_id(hash) * NUM_WAYS];
+  for (std::size_t i = 0; i < NUM_WAYS; ++i) {
+    const Entry &entry = set[i];
+    if ((entry.last_use != 0) && (entry.hash == hash) &&
+        (entry.length == length) &&
+        ((length == 0) || (std::memcmp(get_key(&entry), ptr, length) == 0))) {
+      return &set[i];
+    }
+  }
+  return NULL;
+}
+
+ResultCache::Entry *ResultCache::find(UInt32 hash, std::size_t key_id) {
+  if (num_sets_ == 0) {
+    return NULL;
+  }
+  Entry * const set = &entries_[get_set_id(hash) * NUM_WAYS];
+  for (std::size_t i = 0; i < NUM_WAYS; ++i) {
+    const Entry &entry = set[i];
+    if ((entry.last_use != 0) && (entry.hash == hash) &&
+        (entry.key_id == key_id)) {
+      return &set[i];
+    }
+  }
+  return NULL;
+}
+
+void ResultCache::insert(UInt32 hash, const char *ptr, std::size_t length,
+    std::size_t key_id) {
+  if ((num_sets_ == 0) || (length > max_key_length_)) {
+    return;
+  }
+
+  // An empty entry is taken first, and the least recently used one is
+  // evicted otherwise.
+  Entry * const set = &entries_[get_set_id(hash) * NUM_WAYS];
+  Entry *victim = &set[0];
+  for (std::size_t i = 0; i < NUM_WAYS; ++i) {
+    if (set[i].last_use == 0) {
+      victim = &set[i];
+      break;
+    } else if (set[i].last_use < victim->last_use) {
+      victim = &set[i];
+    }
+  }
+  if (victim->last_use == 0) {
+    ++size_;
+  } else if ((admission_policy_ == MARISA_ADMIT_FREQUENT) &&
+      (estimate(hash) <= estimate(victim->hash))) {
+    ++num_rejections_;
+    return;
+  }
+
+  victim->hash = hash;
+  victim->key_id = (UInt32)key_id;
+  victim->length = (UInt32)length;
+  if (length != 0) {
+    std::memcpy(&keys_[(victim - entries_.get()) * max_key_length_],
+        ptr, length);
+  }
+  touch(victim);
+}
+
+void ResultCache::touch(Entry *entry) {
+  if (clock_ == MARISA_UINT32_MAX) {
+    // The order of use is forgotten when the clock wraps around.
+    for (std::size_t i = 0; i < capacity(); ++i) {
+      if (entries_[i].last_use != 0) {
+        entries_[i].last_use = 1;
+      }
+    }
+    clock_ = 1;
+  }
+  entry->last_use = ++clock_;
+}
+
+void ResultCache::count(UInt32 hash) {
+  if (sketch_.get() == NULL) {
+    return;
+  }
+  const std::size_t width = (std::size_t)1 << (32 - sketch_shift_);
+  for (std::size_t i = 0; i < NUM_SKETCH_ROWS; ++i) {
+    UInt8 &counter = sketch_[(i * width) +
+        ((UInt32)(hash * SKETCH_SEEDS[i]) >> sketch_shift_)];
+    if (counter < MAX_SKETCH_COUNT) {
+      ++counter;
+    }
+  }
+  if (++num_samples_ >= (capacity() * SKETCH_PERIOD)) {
+    for (std::size_t i = 0; i < (NUM_SKETCH_ROWS * width); ++i) {
+      sketch_[i] = (UInt8)(sketch_[i] >> 1);
+    }
+    num_samples_ /= 2;
+  }
+}
+
+std::size_t ResultCache::estimate(UInt32 hash) const {
+  const std::size_t width = (std::size_t)1 << (32 - sketch_shift_);
+  std::size_t min_count = MAX_SKETCH_COUNT;
+  for (std::size_t i = 0; i < NUM_SKETCH_ROWS; ++i) {
+    const std::size_t counter = sketch_[(i * width) +
+        ((UInt32)(hash * SKETCH_SEEDS[i]) >> sketch_shift_)];
+    if (counter < min_count) {
+      min_count = counter;
+    }
+  }
+  return min_count;
+}
+
+}  // namespace marisa
@@ -0,0 +1,122 @@
+#ifndef MARISA_RESULT_CACHE_H_
+#define MARISA_RESULT_CACHE_H_
+
+#include "marisa/trie.h"
+
+namespace marisa {
+
+// ResultCache keeps the results of lookup() and reverse_lookup() for keys
+// which are queried again and again, so that they are given without
+// traversing the dictionary. The results are bound to the dictionary which
+// gave them and are discarded when the cache is used with another one,
+// including a Trie which has been rebuilt, reloaded or swapped since.
+// A cache has no locks and must not be shared by threads: like an Agent,
+// each thread has its own.
+class ResultCache {
+ public:
+  enum {
+    DEFAULT_CAPACITY        = 4096,
+    DEFAULT_MAX_KEY_LENGTH  = 48
+  };
+
+  // `capacity' is the number of results kept, which is rounded up to a
+  // multiple of 4. Keys longer than `max_key_length' bytes are not kept.
+  explicit ResultCache(std::size_t capacity = DEFAULT_CAPACITY,
+      AdmissionPolicy admission_policy = MARISA_DEFAULT_ADMISSION,
+      std::size_t max_key_length = DEFAULT_MAX_KEY_LENGTH);
+  ~ResultCache();
+
+  // lookup() and reverse_lookup() give the same results as those of `trie'.
+  bool lookup(const Trie &trie, Agent &agent);
+  void reverse_lookup(const Trie &trie, Agent &agent);
+
+  // invalidate() discards the results but keeps the counts.
+  void invalidate();
+
+  // num_hits() and num_misses() count the queries given with and without
+  // a kept result. num_rejections() counts the results which have not been
+  // admitted. clear_counts() resets them.
+  std::size_t num_hits() const {
+    return num_hits_;
+  }
+  std::size_t num_misses() const {
+    return num_misses_;
+  }
+  std::size_t num_rejections() const {
+    return num_rejections_;
+  }
+  double hit_rate() const;
+  void clear_counts();
+
+  std::size_t capacity() const {
+    return num_sets_ * NUM_WAYS;
+  }
+  AdmissionPolicy admission_policy() const {
+    return admission_policy_;
+  }
+  std::size_t max_key_length() const {
+    return max_key_length_;
+  }
+  // size() returns the number of results kept.
+  std::size_t size() const {
+    return size_;
+  }
+
+  void swap(ResultCache &rhs);
+
+ private:
+  enum {
+    NUM_WAYS          = 4,
+    NUM_SKETCH_ROWS   = 4
+  };
+
+  // The lowest bit of `hash' tells a result of reverse_lookup() from that of
+  // lookup(). An entry is empty if `last_use' is 0.
+  struct Entry {
+    UInt32 hash;
+    UInt32 key_id;
+    UInt32 length;
+    UInt32 last_use;
+  };
+
+  scoped_array<Entry> entries_;
+  scoped_array<char> keys_;
+  scoped_array<UInt8> sketch_;
+  std::size_t num_sets_;
+  std::size_t sketch_shift_;
+  std::size_t num_samples_;
+  std::size_t max_key_length_;
+  AdmissionPolicy admission_policy_;
+  std::size_t stamp_;
+  UInt32 clock_;
+  std::size_t size_;
+  std::size_t num_hits_;
+  std::size_t num_misses_;
+  std::size_t num_rejections_;
+
+  void bind(const Trie &trie);
+
+  Entry *find(UInt32 hash, const char *ptr, std::size_t length);
+  Entry *find(UInt32 hash, std::size_t key_id);
+  void insert(UInt32 hash, const char *ptr, std::size_t length,
+      std::size_t key_id);
+  void touch(Entry *entry);
+
+  void count(UInt32 hash);
+  std::size_t estimate(UInt32 hash) const;
+
+  std::size_t get_set_id(UInt32 hash) const {
+    return (std::size_t)(((UInt64)hash * num_sets_) >> 32);
+  }
+  const char *get_key(const Entry *entry) const {
+    return &keys_[(entry - entries_.get()) * max_key_length_];
+  }
+
+  // Disallows copy and assignment.
+  ResultCache(const ResultCache &);
+  ResultCache &operator=(const ResultCache &);
+};
+
+}  // namespace marisa
+
+#endif  // MARISA_RESULT_CACHE_H_
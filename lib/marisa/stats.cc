@@ -0,0 +1,45 @@
+#include "marisa/stats.h"
+
+namespace marisa {
+
+const char *Stats::counter_name(Counter counter) {
+  switch (counter) {
+    case CACHE_HITS: {
+      return "cache hits";
+    }
+    case CACHE_MISSES: {
+      return "cache misses";
+    }
+    case SELECT0_CALLS: {
+      return "select0 calls";
+    }
+    case SELECT1_CALLS: {
+      return "select1 calls";
+    }
+    case RANK1_CALLS: {
+      return "rank1 calls";
+    }
+    case NODES_VISITED: {
+      return "nodes visited";
+    }
+    case TRIE_DESCENTS: {
+      return "trie descents";
+    }
+    case TAIL_BYTES_COMPARED: {
+      return "TAIL bytes compared";
+    }
+    default: {
+      return "unknown";
+    }
+  }
+}
+
+bool Stats::is_enabled() {
+#ifdef MARISA_ENABLE_STATS
+  return true;
+#else  // MARISA_ENABLE_STATS
+  return false;
+#endif  // MARISA_ENABLE_STATS
+}
+
+}  // namespace marisa
@@ -0,0 +1,69 @@
+#ifndef MARISA_STATS_H_
+#define MARISA_STATS_H_
+
+#include "marisa/base.h"
+
+namespace marisa {
+
+// Stats counts the work done by queries. The counters are updated only if
+// the library is built with MARISA_ENABLE_STATS (configure --enable-stats)
+// and stay 0 otherwise, so that queries do not pay for them by default.
+class Stats {
+ public:
+  typedef enum Counter_ {
+    // CACHE_HITS and CACHE_MISSES count the probes of the caches of all the
+    // tries.
+    CACHE_HITS,
+    CACHE_MISSES,
+    // SELECT0_CALLS, SELECT1_CALLS and RANK1_CALLS count the rank/select
+    // operations on the bit vectors.
+    SELECT0_CALLS,
+    SELECT1_CALLS,
+    RANK1_CALLS,
+    // NODES_VISITED counts the nodes whose labels or links are examined.
+    NODES_VISITED,
+    // TRIE_DESCENTS counts the links followed into a nested trie.
+    TRIE_DESCENTS,
+    // TAIL_BYTES_COMPARED counts the first byte of each suffix in TAIL
+    // compared with a query and the rest of the suffix only if it matches.
+    TAIL_BYTES_COMPARED,
+    NUM_COUNTERS
+  } Counter;
+
+  Stats() {
+    clear();
+  }
+
+  std::size_t operator[](Counter counter) const {
+    MARISA_DEBUG_IF((std::size_t)counter >= NUM_COUNTERS, MARISA_BOUND_ERROR);
+    return counts_[counter];
+  }
+
+  void add(Counter counter, std::size_t count = 1) {
+    MARISA_DEBUG_IF((std::size_t)counter >= NUM_COUNTERS, MARISA_BOUND_ERROR);
+    counts_[counter] += count;
+  }
+  void add(const Stats &stats) {
+    for (std::size_t i = 0; i < NUM_COUNTERS; ++i) {
+      counts_[i] += stats.counts_[i];
+    }
+  }
+
+  void clear() {
+    for (std::size_t i = 0; i < NUM_COUNTERS; ++i) {
+      counts_[i] = 0;
+    }
+  }
+
+  static const char *counter_name(Counter counter);
+
+  // is_enabled() returns whether the library counts.
+  static bool is_enabled();
+
+ private:
+  std::size_t counts_[NUM_COUNTERS];
+};
+
+}  // namespace marisa
+
+#endif  // MARISA_STATS_H_
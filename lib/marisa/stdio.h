@@ -3,12 +3,15 @@
 
 #include <cstdio>
 
+#include "marisa/base.h"
+
 namespace marisa {
 
 class Trie;
 
 void fread(std::FILE *file, Trie *trie);
-void fwrite(std::FILE *file, const Trie &trie);
+void fwrite(std::FILE *file, const Trie &trie,
+    FormatVersion format = MARISA_DEFAULT_FORMAT);
 
 }  // namespace marisa
 
@@ -0,0 +1,123 @@
+#include <new>
+
+#include "marisa/trie-handle.h"
+#include "marisa/grimoire/thread.h"
+#include "marisa/grimoire/thread/atomic.h"
+#include "marisa/grimoire/thread/epoch.h"
+
+namespace marisa {
+namespace {
+
+void delete_trie(void *trie) {
+  delete static_cast<Trie *>(trie);
+}
+
+}  // namespace
+
+void TrieHandle::Snapshot::release() {
+  if (epoch_ != NULL) {
+    epoch_->leave(slot_id_);
+    epoch_ = NULL;
+    trie_ = NULL;
+    slot_id_ = 0;
+  }
+}
+
+TrieHandle::TrieHandle(std::size_t max_readers)
+    : epoch_(), current_(0), lock_(0) {
+  epoch_.reset(new (std::nothrow) grimoire::thread::Epoch(max_readers));
+  MARISA_THROW_IF(epoch_.get() == NULL, MARISA_MEMORY_ERROR);
+}
+
+TrieHandle::~TrieHandle() {
+  // Snapshots must have been released before the handle is destroyed.
+  delete reinterpret_cast<Trie *>(current_);
+}
+
+void TrieHandle::mmap(const char *filename, int map_flags) {
+  Trie trie;
+  trie.mmap(filename, map_flags);
+  publish(trie);
+}
+
+void TrieHandle::load(const char *filename) {
+  Trie trie;
+  trie.load(filename);
+  publish(trie);
+}
+
+void TrieHandle::publish(Trie &trie) {
+  MARISA_THROW_IF(trie.trie_.get() == NULL, MARISA_STATE_ERROR);
+
+  Trie * const new_trie = new (std::nothrow) Trie;
+  MARISA_THROW_IF(new_trie == NULL, MARISA_MEMORY_ERROR);
+  new_trie->swap(trie);
+
+  lock();
+  try {
+    epoch_->reserve(epoch_->num_retired() + 1);
+  } catch (...) {
+    unlock();
+    trie.swap(*new_trie);
+    delete new_trie;
+    throw;
+  }
+
+  // Nothing throws after the new version is published.
+  const std::size_t old_value = grimoire::thread::atomic_load(&current_);
+  grimoire::thread::atomic_compare_and_swap(&current_, old_value,
+      reinterpret_cast<std::size_t>(new_trie));
+  if (old_value != 0) {
+    epoch_->retire(reinterpret_cast<Trie *>(old_value), delete_trie);
+    epoch_->reclaim();
+  }
+  unlock();
+}
+
+void TrieHandle::acquire(Snapshot *snapshot) const {
+  MARISA_THROW_IF(snapshot == NULL, MARISA_NULL_ERROR);
+
+  snapshot->release();
+  std::size_t value;
+  const std::size_t slot_id = epoch_->enter(&current_, &value);
+  if (value == 0) {
+    epoch_->leave(slot_id);
+    return;
+  }
+  snapshot->epoch_ = epoch_.get();
+  snapshot->trie_ = reinterpret_cast<const Trie *>(value);
+  snapshot->slot_id_ = slot_id;
+}
+
+std::size_t TrieHandle::reclaim() {
+  lock();
+  const std::size_t num_retired = epoch_->reclaim();
+  unlock();
+  return num_retired;
+}
+
+void TrieHandle::synchronize() {
+  while (reclaim() != 0) {
+    grimoire::Thread::yield();
+  }
+}
+
+bool TrieHandle::empty() const {
+  return grimoire::thread::atomic_load(&current_) == 0;
+}
+
+std::size_t TrieHandle::max_readers() const {
+  return epoch_->num_slots();
+}
+
+void TrieHandle::lock() {
+  while (!grimoire::thread::atomic_compare_and_swap(&lock_, 0, 1)) {
+    grimoire::Thread::yield();
+  }
+}
+
+void TrieHandle::unlock() {
+  grimoire::thread::atomic_compare_and_swap(&lock_, 1, 0);
+}
+
+}  // namespace marisa
@@ -0,0 +1,113 @@
+#ifndef MARISA_TRIE_HANDLE_H_
+#define MARISA_TRIE_HANDLE_H_
+
+#include "marisa/trie.h"
+
+namespace marisa {
+namespace grimoire {
+namespace thread {
+
+class Epoch;
+
+}  // namespace thread
+}  // namespace grimoire
+
+// TrieHandle holds the current version of a dictionary which is replaced
+// under live readers. A reader takes a snapshot by acquire() without locks
+// and uses it as a read-only Trie. A writer publishes a new version by
+// publish(), mmap() or load(), and the old version is deleted, and unmapped,
+// once every snapshot of it has been released. Agents used with a snapshot
+// must not be used after the snapshot is released.
+class TrieHandle {
+ public:
+  enum {
+    DEFAULT_MAX_READERS = 256
+  };
+
+  class Snapshot {
+    friend class TrieHandle;
+
+   public:
+    Snapshot() : epoch_(NULL), trie_(NULL), slot_id_(0) {}
+    ~Snapshot() {
+      release();
+    }
+
+    const Trie &trie() const {
+      MARISA_THROW_IF(trie_ == NULL, MARISA_STATE_ERROR);
+      return *trie_;
+    }
+    const Trie *operator->() const {
+      return &trie();
+    }
+
+    bool empty() const {
+      return trie_ == NULL;
+    }
+
+    // release() lets the version be deleted. A snapshot is also released
+    // on destruction or by the next acquire().
+    void release();
+
+    void clear() {
+      release();
+    }
+    void swap(Snapshot &rhs) {
+      marisa::swap(epoch_, rhs.epoch_);
+      marisa::swap(trie_, rhs.trie_);
+      marisa::swap(slot_id_, rhs.slot_id_);
+    }
+
+   private:
+    grimoire::thread::Epoch *epoch_;
+    const Trie *trie_;
+    std::size_t slot_id_;
+
+    // Disallows copy and assignment.
+    Snapshot(const Snapshot &);
+    Snapshot &operator=(const Snapshot &);
+  };
+
+  // At most `max_readers' snapshots can be held at once.
+  explicit TrieHandle(std::size_t max_readers = DEFAULT_MAX_READERS);
+  ~TrieHandle();
+
+  // mmap() and load() open a dictionary and publish it. If opening fails,
+  // the current version is kept.
+  void mmap(const char *filename, int map_flags = MARISA_DEFAULT_MAP);
+  void load(const char *filename);
+
+  // publish() takes the dictionary of `trie' as the new version and leaves
+  // `trie' empty. Writers are serialized by a spin lock.
+  void publish(Trie &trie);
+
+  // acquire() makes `snapshot' refer to the current version. The snapshot is
+  // empty if nothing has been published. acquire() throws MARISA_SIZE_ERROR
+  // if `max_readers' snapshots are already held.
+  void acquire(Snapshot *snapshot) const;
+
+  // reclaim() deletes the old versions which are no longer used and returns
+  // the number of old versions still in use. synchronize() waits until all
+  // the old versions are deleted.
+  std::size_t reclaim();
+  void synchronize();
+
+  bool empty() const;
+  std::size_t max_readers() const;
+
+ private:
+  scoped_ptr<grimoire::thread::Epoch> epoch_;
+  mutable volatile std::size_t current_;
+  volatile std::size_t lock_;
+
+  void lock();
+  void unlock();
+
+  // Disallows copy and assignment.
+  TrieHandle(const TrieHandle &);
+  TrieHandle &operator=(const TrieHandle &);
+};
+
+}  // namespace marisa
+
+#endif  // MARISA_TRIE_HANDLE_H_
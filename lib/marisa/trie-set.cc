@@ -0,0 +1,231 @@
+#include <new>
+
+#include "marisa/trie-set.h"
+#include "marisa/grimoire/io.h"
+#include "marisa/grimoire/thread/atomic.h"
+#include "marisa/grimoire/trie.h"
+
+namespace marisa {
+namespace {
+
+// A set file starts with the following header, which is followed by a pair
+// of an offset and a size for each dictionary in the order of name IDs, the
+// dictionary of names and the dictionaries. Offsets are counted from the
+// beginning of the file and the dictionaries are aligned to ALIGNMENT bytes.
+// The checksum covers the table of offsets and sizes.
+const char MAGIC[16] = "Marisa trie set";
+
+enum {
+  HEADER_SIZE  = 48,
+  ALIGNMENT    = 64
+};
+
+UInt64 align(UInt64 offset) {
+  return (offset + (ALIGNMENT - 1)) & ~(UInt64)(ALIGNMENT - 1);
+}
+
+}  // namespace
+
+TrieSet::TrieSet()
+    : mapper_(), origin_(NULL), entries_(NULL), num_tries_(0), names_(),
+      tries_() {}
+
+TrieSet::~TrieSet() {
+  if (tries_.get() != NULL) {
+    for (std::size_t i = 0; i < num_tries_; ++i) {
+      delete reinterpret_cast<Trie *>(tries_[i]);
+    }
+  }
+}
+
+void TrieSet::save(const char *filename, const char * const *names,
+    const Trie * const *tries, std::size_t num_tries, FormatVersion format,
+    int save_flags) {
+  MARISA_THROW_IF(filename == NULL, MARISA_NULL_ERROR);
+  MARISA_THROW_IF(((names == NULL) || (tries == NULL)) && (num_tries != 0),
+      MARISA_NULL_ERROR);
+  MARISA_THROW_IF((format != MARISA_FORMAT_V1) &&
+      (format != MARISA_FORMAT_V2), MARISA_CODE_ERROR);
+  MARISA_THROW_IF((save_flags & ~(MARISA_SAVE_DIRECT |
+      MARISA_SAVE_PREALLOCATE)) != 0, MARISA_CODE_ERROR);
+
+  Keyset keyset;
+  for (std::size_t i = 0; i < num_tries; ++i) {
+    MARISA_THROW_IF((names[i] == NULL) || (tries[i] == NULL),
+        MARISA_NULL_ERROR);
+    MARISA_THROW_IF(tries[i]->trie_.get() == NULL, MARISA_STATE_ERROR);
+    keyset.push_back(names[i]);
+  }
+  Trie name_trie;
+  name_trie.build(keyset);
+  MARISA_THROW_IF(name_trie.num_keys() != num_tries, MARISA_CODE_ERROR);
+
+  scoped_array<std::size_t> order(new (std::nothrow) std::size_t[num_tries]);
+  MARISA_THROW_IF((order.get() == NULL) && (num_tries != 0),
+      MARISA_MEMORY_ERROR);
+  for (std::size_t i = 0; i < num_tries; ++i) {
+    order[keyset[i].id()] = i;
+  }
+
+  grimoire::Vector<UInt64> entries;
+  entries.resize(num_tries * 2);
+  UInt64 offset = align(HEADER_SIZE + entries.total_size() +
+      name_trie.io_size());
+  for (std::size_t i = 0; i < num_tries; ++i) {
+    entries[i * 2] = offset;
+    entries[(i * 2) + 1] = tries[order[i]]->io_size(format);
+    offset = align(offset + entries[(i * 2) + 1]);
+  }
+
+  grimoire::Writer writer;
+  writer.open(filename, save_flags);
+  if ((save_flags & MARISA_SAVE_PREALLOCATE) != 0) {
+    writer.reserve(offset);
+  }
+  writer.write(MAGIC, sizeof(MAGIC));
+  writer.write(offset);
+  writer.write((UInt64)num_tries);
+  writer.write((UInt64)name_trie.io_size());
+  writer.write(grimoire::Crc32c::compute(entries.begin(),
+      entries.total_size()));
+  writer.write((UInt32)0);
+  writer.write(entries.begin(), entries.size());
+  name_trie.trie_->write(writer);
+
+  UInt64 position = HEADER_SIZE + entries.total_size() + name_trie.io_size();
+  for (std::size_t i = 0; i < num_tries; ++i) {
+    writer.seek((std::size_t)(entries[i * 2] - position));
+    tries[order[i]]->trie_->write(writer, format);
+    position = entries[i * 2] + entries[(i * 2) + 1];
+  }
+  writer.seek((std::size_t)(offset - position));
+  writer.flush();
+}
+
+void TrieSet::mmap(const char *filename, int map_flags) {
+  MARISA_THROW_IF(filename == NULL, MARISA_NULL_ERROR);
+
+  TrieSet temp;
+  temp.mapper_.reset(new (std::nothrow) grimoire::Mapper);
+  MARISA_THROW_IF(temp.mapper_.get() == NULL, MARISA_MEMORY_ERROR);
+  grimoire::Mapper &mapper = *temp.mapper_;
+  mapper.open(filename, map_flags);
+  const std::size_t file_size = mapper.avail();
+
+  const char *magic;
+  mapper.map(&magic, sizeof(MAGIC));
+  for (std::size_t i = 0; i < sizeof(MAGIC); ++i) {
+    MARISA_THROW_IF(magic[i] != MAGIC[i], MARISA_FORMAT_ERROR);
+  }
+  temp.origin_ = magic;
+
+  UInt64 total_size, num_tries, names_size;
+  UInt32 crc, reserved;
+  mapper.map(&total_size);
+  mapper.map(&num_tries);
+  mapper.map(&names_size);
+  mapper.map(&crc);
+  mapper.map(&reserved);
+  MARISA_THROW_IF(total_size > file_size, MARISA_FORMAT_ERROR);
+  MARISA_THROW_IF(num_tries > (mapper.avail() / (sizeof(UInt64) * 2)),
+      MARISA_FORMAT_ERROR);
+  temp.num_tries_ = (std::size_t)num_tries;
+
+  mapper.map(&temp.entries_, temp.num_tries_ * 2);
+  MARISA_THROW_IF(grimoire::Crc32c::compute(temp.entries_,
+      sizeof(UInt64) * 2 * temp.num_tries_) != crc, MARISA_FORMAT_ERROR);
+  for (std::size_t i = 0; i < temp.num_tries_; ++i) {
+    const UInt64 offset = temp.entries_[i * 2];
+    const UInt64 size = temp.entries_[(i * 2) + 1];
+    MARISA_THROW_IF((offset % ALIGNMENT) != 0, MARISA_FORMAT_ERROR);
+    MARISA_THROW_IF((offset > total_size) || (size > (total_size - offset)),
+        MARISA_FORMAT_ERROR);
+  }
+
+  MARISA_THROW_IF(names_size > mapper.avail(), MARISA_FORMAT_ERROR);
+  const char *names;
+  mapper.map(&names, (std::size_t)names_size);
+  temp.names_.map(names, (std::size_t)names_size);
+  MARISA_THROW_IF(temp.names_.num_keys() != temp.num_tries_,
+      MARISA_FORMAT_ERROR);
+
+  temp.tries_.reset(new (std::nothrow) volatile std::size_t[temp.num_tries_]);
+  MARISA_THROW_IF((temp.tries_.get() == NULL) && (temp.num_tries_ != 0),
+      MARISA_MEMORY_ERROR);
+  for (std::size_t i = 0; i < temp.num_tries_; ++i) {
+    temp.tries_[i] = 0;
+  }
+  swap(temp);
+}
+
+const Trie *TrieSet::get(const char *name) const {
+  MARISA_THROW_IF(name == NULL, MARISA_NULL_ERROR);
+  Agent agent;
+  agent.set_query(name);
+  if (!names_.lookup(agent)) {
+    return NULL;
+  }
+  return &get(agent.key().id());
+}
+
+const Trie *TrieSet::get(const char *name, std::size_t length) const {
+  MARISA_THROW_IF((name == NULL) && (length != 0), MARISA_NULL_ERROR);
+  Agent agent;
+  agent.set_query(name, length);
+  if (!names_.lookup(agent)) {
+    return NULL;
+  }
+  return &get(agent.key().id());
+}
+
+const Trie &TrieSet::get(std::size_t id) const {
+  MARISA_THROW_IF(id >= num_tries_, MARISA_BOUND_ERROR);
+
+  const std::size_t value = grimoire::thread::atomic_load(&tries_[id]);
+  if (value != 0) {
+    return *reinterpret_cast<const Trie *>(value);
+  }
+
+  // Threads may race to open a dictionary, and the losers delete theirs.
+  Trie * const trie = new (std::nothrow) Trie;
+  MARISA_THROW_IF(trie == NULL, MARISA_MEMORY_ERROR);
+  try {
+    trie->map(origin_ + entries_[id * 2],
+        (std::size_t)entries_[(id * 2) + 1]);
+  } catch (...) {
+    delete trie;
+    throw;
+  }
+  if (grimoire::thread::atomic_compare_and_swap(&tries_[id], 0,
+      reinterpret_cast<std::size_t>(trie))) {
+    return *trie;
+  }
+  delete trie;
+  return *reinterpret_cast<const Trie *>(
+      grimoire::thread::atomic_load(&tries_[id]));
+}
+
+std::size_t TrieSet::num_opened() const {
+  std::size_t num_opened = 0;
+  for (std::size_t i = 0; i < num_tries_; ++i) {
+    if (grimoire::thread::atomic_load(&tries_[i]) != 0) {
+      ++num_opened;
+    }
+  }
+  return num_opened;
+}
+
+void TrieSet::clear() {
+  TrieSet().swap(*this);
+}
+
+void TrieSet::swap(TrieSet &rhs) {
+  mapper_.swap(rhs.mapper_);
+  marisa::swap(origin_, rhs.origin_);
+  marisa::swap(entries_, rhs.entries_);
+  marisa::swap(num_tries_, rhs.num_tries_);
+  names_.swap(rhs.names_);
+  tries_.swap(rhs.tries_);
+}
+
+}  // namespace marisa
@@ -0,0 +1,68 @@
+#ifndef MARISA_TRIE_SET_H_
+#define MARISA_TRIE_SET_H_
+
+#include "marisa/trie.h"
+
+namespace marisa {
+namespace grimoire {
+namespace io {
+
+class Mapper;
+
+}  // namespace io
+}  // namespace grimoire
+
+// TrieSet packs named dictionaries into one file, which is mapped once and
+// shares a file descriptor and a mapping among the dictionaries. The names
+// are indexed by a dictionary of their own, and a dictionary is opened on
+// the first get(), which may be called from multiple threads.
+class TrieSet {
+ public:
+  TrieSet();
+  ~TrieSet();
+
+  // save() writes `tries' in `format', where `names[i]' is the name of
+  // `tries[i]'. The names must be unique. `save_flags' is a combination of
+  // marisa_save_flags.
+  static void save(const char *filename, const char * const *names,
+      const Trie * const *tries, std::size_t num_tries,
+      FormatVersion format = MARISA_DEFAULT_FORMAT,
+      int save_flags = MARISA_DEFAULT_SAVE);
+
+  void mmap(const char *filename, int map_flags = MARISA_DEFAULT_MAP);
+
+  // get() returns NULL if there is no dictionary named `name'.
+  const Trie *get(const char *name) const;
+  const Trie *get(const char *name, std::size_t length) const;
+  // get() with an ID returns the dictionary whose name has the ID in
+  // names().
+  const Trie &get(std::size_t id) const;
+
+  const Trie &names() const {
+    return names_;
+  }
+  std::size_t size() const {
+    return num_tries_;
+  }
+  // num_opened() returns the number of dictionaries opened by get().
+  std::size_t num_opened() const;
+
+  void clear();
+  void swap(TrieSet &rhs);
+
+ private:
+  scoped_ptr<grimoire::io::Mapper> mapper_;
+  const char *origin_;
+  const UInt64 *entries_;
+  std::size_t num_tries_;
+  Trie names_;
+  scoped_array<volatile std::size_t> tries_;
+
+  // Disallows copy and assignment.
+  TrieSet(const TrieSet &);
+  TrieSet &operator=(const TrieSet &);
+};
+
+}  // namespace marisa
+
+#endif  // MARISA_TRIE_SET_H_
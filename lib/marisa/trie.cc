@@ -4,28 +4,160 @@
 #include "marisa/grimoire/trie.h"
 
 namespace marisa {
+namespace {
+
+int compare_keys(const grimoire::trie::Cursor &lhs,
+    const grimoire::trie::Cursor &rhs) {
+  const std::size_t min_length = (lhs.key_length() < rhs.key_length()) ?
+      lhs.key_length() : rhs.key_length();
+  for (std::size_t i = 0; i < min_length; ++i) {
+    if (lhs.key_ptr()[i] != rhs.key_ptr()[i]) {
+      return ((UInt8)lhs.key_ptr()[i] < (UInt8)rhs.key_ptr()[i]) ? -1 : 1;
+    }
+  }
+  if (lhs.key_length() != rhs.key_length()) {
+    return (lhs.key_length() < rhs.key_length()) ? -1 : 1;
+  }
+  return 0;
+}
+
+// StatsScope adds the counts of a query to the stats of a dictionary when
+// the query ends. It does nothing unless MARISA_ENABLE_STATS is defined.
+class StatsScope {
+ public:
+#ifdef MARISA_ENABLE_STATS
+  StatsScope(const grimoire::LoudsTrie &trie, const Agent &agent)
+      : trie_(trie), agent_(agent), base_(agent.stats()) {}
+  ~StatsScope() {
+    trie_.add_stats(agent_.stats(), base_);
+  }
+
+ private:
+  const grimoire::LoudsTrie &trie_;
+  const Agent &agent_;
+  const Stats base_;
+#else  // MARISA_ENABLE_STATS
+  StatsScope(const grimoire::LoudsTrie &, const Agent &) {}
+
+ private:
+#endif  // MARISA_ENABLE_STATS
+
+  // Disallows copy and assignment.
+  StatsScope(const StatsScope &);
+  StatsScope &operator=(const StatsScope &);
+};
 
-Trie::Trie() : trie_() {}
+}  // namespace
+
+Trie::Trie() : trie_(), allocator_(NULL), scratch_allocator_(NULL) {}
 
 Trie::~Trie() {}
 
-void Trie::build(Keyset &keyset, int config_flags) {
+void Trie::build(Keyset &keyset, int config_flags,
+    BuildObserver *observer) {
+  build(keyset, config_flags, NULL, 0, observer);
+}
+
+void Trie::build(Keyset &keyset, int config_flags,
+    const CacheLevel *cache_levels, std::size_t num_cache_levels,
+    BuildObserver *observer) {
   scoped_ptr<grimoire::LoudsTrie> temp(new (std::nothrow) grimoire::LoudsTrie);
   MARISA_THROW_IF(temp.get() == NULL, MARISA_MEMORY_ERROR);
+  temp->set_allocator(allocator_, scratch_allocator_);
+
+  temp->build(keyset, config_flags, observer, cache_levels,
+      num_cache_levels);
+  trie_.swap(temp);
+}
+
+void Trie::merge(const Trie * const *tries, std::size_t num_tries,
+    int config_flags, const float *weights, MergeMode merge_mode) {
+  MARISA_THROW_IF((tries == NULL) && (num_tries != 0), MARISA_NULL_ERROR);
+  MARISA_THROW_IF((merge_mode != MARISA_SUM_WEIGHTS) &&
+      (merge_mode != MARISA_MAX_WEIGHTS), MARISA_CODE_ERROR);
+  for (std::size_t i = 0; i < num_tries; ++i) {
+    MARISA_THROW_IF(tries[i] == NULL, MARISA_NULL_ERROR);
+    MARISA_THROW_IF(tries[i]->trie_.get() == NULL, MARISA_STATE_ERROR);
+  }
+
+  scoped_array<grimoire::trie::Cursor> cursors(
+      new (std::nothrow) grimoire::trie::Cursor[num_tries]);
+  MARISA_THROW_IF((cursors.get() == NULL) && (num_tries != 0),
+      MARISA_MEMORY_ERROR);
+  scoped_array<bool> flags(new (std::nothrow) bool[num_tries * 2]);
+  MARISA_THROW_IF((flags.get() == NULL) && (num_tries != 0),
+      MARISA_MEMORY_ERROR);
+  bool * const is_active = flags.get();
+  bool * const is_matched = flags.get() + num_tries;
+  for (std::size_t i = 0; i < num_tries; ++i) {
+    cursors[i].open(*tries[i]->trie_);
+    is_active[i] = cursors[i].next();
+    is_matched[i] = false;
+  }
+
+  // The cursors are merged by a linear scan because the number of sources
+  // is expected to be small.
+  Keyset keyset;
+  for ( ; ; ) {
+    std::size_t min_id = num_tries;
+    for (std::size_t i = 0; i < num_tries; ++i) {
+      if (is_active[i] && ((min_id == num_tries) ||
+          (compare_keys(cursors[i], cursors[min_id]) < 0))) {
+        min_id = i;
+      }
+    }
+    if (min_id == num_tries) {
+      break;
+    }
+
+    float weight = 0.0F;
+    bool is_first = true;
+    for (std::size_t i = min_id; i < num_tries; ++i) {
+      if (is_active[i] && (compare_keys(cursors[i], cursors[min_id]) == 0)) {
+        const float source_weight = (weights != NULL) ? weights[i] : 1.0F;
+        if (is_first) {
+          weight = source_weight;
+          is_first = false;
+        } else if (merge_mode == MARISA_SUM_WEIGHTS) {
+          weight += source_weight;
+        } else if (source_weight > weight) {
+          weight = source_weight;
+        }
+        is_matched[i] = true;
+      }
+    }
+    keyset.push_back(cursors[min_id].key_ptr(), cursors[min_id].key_length(),
+        weight);
+
+    for (std::size_t i = min_id; i < num_tries; ++i) {
+      if (is_matched[i]) {
+        is_active[i] = cursors[i].next();
+        is_matched[i] = false;
+      }
+    }
+  }
+
+  scoped_ptr<grimoire::LoudsTrie> temp(new (std::nothrow) grimoire::LoudsTrie);
+  MARISA_THROW_IF(temp.get() == NULL, MARISA_MEMORY_ERROR);
+  temp->set_allocator(allocator_, scratch_allocator_);
 
   temp->build(keyset, config_flags);
   trie_.swap(temp);
 }
 
-void Trie::mmap(const char *filename) {
+void Trie::mmap(const char *filename, int map_flags) {
   MARISA_THROW_IF(filename == NULL, MARISA_NULL_ERROR);
+  MARISA_THROW_IF((map_flags & ~(MARISA_MAP_POPULATE | MARISA_MAP_ADVISE |
+      MARISA_MAP_HUGE_PAGES | MARISA_MAP_LOCK | MARISA_MAP_READ |
+      MARISA_MAP_VERIFY)) != 0, MARISA_CODE_ERROR);
 
   scoped_ptr<grimoire::LoudsTrie> temp(new (std::nothrow) grimoire::LoudsTrie);
   MARISA_THROW_IF(temp.get() == NULL, MARISA_MEMORY_ERROR);
+  temp->set_allocator(allocator_, scratch_allocator_);
 
   grimoire::Mapper mapper;
-  mapper.open(filename);
-  temp->map(mapper);
+  mapper.open(filename, map_flags);
+  temp->map(mapper, map_flags);
   trie_.swap(temp);
 }
 
@@ -34,6 +166,7 @@ void Trie::map(const void *ptr, std::size_t size) {
 
   scoped_ptr<grimoire::LoudsTrie> temp(new (std::nothrow) grimoire::LoudsTrie);
   MARISA_THROW_IF(temp.get() == NULL, MARISA_MEMORY_ERROR);
+  temp->set_allocator(allocator_, scratch_allocator_);
 
   grimoire::Mapper mapper;
   mapper.open(ptr, size);
@@ -46,6 +179,7 @@ void Trie::load(const char *filename) {
 
   scoped_ptr<grimoire::LoudsTrie> temp(new (std::nothrow) grimoire::LoudsTrie);
   MARISA_THROW_IF(temp.get() == NULL, MARISA_MEMORY_ERROR);
+  temp->set_allocator(allocator_, scratch_allocator_);
 
   grimoire::Reader reader;
   reader.open(filename);
@@ -58,6 +192,7 @@ void Trie::read(int fd) {
 
   scoped_ptr<grimoire::LoudsTrie> temp(new (std::nothrow) grimoire::LoudsTrie);
   MARISA_THROW_IF(temp.get() == NULL, MARISA_MEMORY_ERROR);
+  temp->set_allocator(allocator_, scratch_allocator_);
 
   grimoire::Reader reader;
   reader.open(fd);
@@ -65,22 +200,45 @@ void Trie::read(int fd) {
   trie_.swap(temp);
 }
 
-void Trie::save(const char *filename) const {
+void Trie::save(const char *filename, FormatVersion format,
+    int save_flags) const {
   MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
   MARISA_THROW_IF(filename == NULL, MARISA_NULL_ERROR);
+  MARISA_THROW_IF((save_flags & ~(MARISA_SAVE_DIRECT |
+      MARISA_SAVE_PREALLOCATE)) != 0, MARISA_CODE_ERROR);
 
   grimoire::Writer writer;
-  writer.open(filename);
-  trie_->write(writer);
+  writer.open(filename, save_flags);
+  if ((save_flags & MARISA_SAVE_PREALLOCATE) != 0) {
+    writer.reserve(trie_->io_size(format));
+  }
+  trie_->write(writer, format);
+  writer.flush();
 }
 
-void Trie::write(int fd) const {
+void Trie::write(int fd, FormatVersion format) const {
   MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
   MARISA_THROW_IF(fd == -1, MARISA_CODE_ERROR);
 
   grimoire::Writer writer;
   writer.open(fd);
-  trie_->write(writer);
+  trie_->write(writer, format);
+  writer.flush();
+}
+
+std::size_t Trie::warm_up(std::size_t budget, bool in_background) {
+  MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
+  return trie_->warm_up(budget, in_background);
+}
+
+std::size_t Trie::pin(std::size_t budget, std::size_t *num_levels) {
+  MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
+  return trie_->pin(budget, num_levels);
+}
+
+std::size_t Trie::resident_size() const {
+  MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
+  return trie_->resident_size();
 }
 
 bool Trie::lookup(Agent &agent) const {
@@ -88,14 +246,49 @@ bool Trie::lookup(Agent &agent) const {
   if (!agent.has_state()) {
     agent.init_state();
   }
+  StatsScope scope(*trie_, agent);
   return trie_->lookup(agent);
 }
 
+bool Trie::profile(Agent &agent) {
+  MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
+  if (!agent.has_state()) {
+    agent.init_state();
+  }
+  return trie_->profile(agent);
+}
+
+void Trie::rebuild_cache() {
+  MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
+  trie_->rebuild_cache();
+}
+
+void Trie::clear_profile() {
+  MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
+  trie_->clear_profile();
+}
+
+std::size_t Trie::cache_size(std::size_t level) const {
+  MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
+  return trie_->cache_size(level);
+}
+
+std::size_t Trie::cache_hits(std::size_t level) const {
+  MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
+  return trie_->cache_hits(level);
+}
+
+std::size_t Trie::cache_misses(std::size_t level) const {
+  MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
+  return trie_->cache_misses(level);
+}
+
 void Trie::reverse_lookup(Agent &agent) const {
   MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
   if (!agent.has_state()) {
     agent.init_state();
   }
+  StatsScope scope(*trie_, agent);
   trie_->reverse_lookup(agent);
 }
 
@@ -104,6 +297,7 @@ bool Trie::common_prefix_search(Agent &agent) const {
   if (!agent.has_state()) {
     agent.init_state();
   }
+  StatsScope scope(*trie_, agent);
   return trie_->common_prefix_search(agent);
 }
 
@@ -112,9 +306,26 @@ bool Trie::predictive_search(Agent &agent) const {
   if (!agent.has_state()) {
     agent.init_state();
   }
+  StatsScope scope(*trie_, agent);
   return trie_->predictive_search(agent);
 }
 
+void Trie::describe(Description *description) const {
+  MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
+  MARISA_THROW_IF(description == NULL, MARISA_NULL_ERROR);
+  trie_->describe(description);
+}
+
+Stats Trie::stats() const {
+  MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
+  return trie_->stats();
+}
+
+void Trie::clear_stats() {
+  MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
+  trie_->clear_stats();
+}
+
 std::size_t Trie::num_tries() const {
   MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
   return trie_->num_tries();
@@ -130,6 +341,11 @@ std::size_t Trie::num_nodes() const {
   return trie_->num_nodes();
 }
 
+CacheLevel Trie::cache_level() const {
+  MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
+  return trie_->cache_level();
+}
+
 TailMode Trie::tail_mode() const {
   MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
   return trie_->tail_mode();
@@ -140,6 +356,16 @@ NodeOrder Trie::node_order() const {
   return trie_->node_order();
 }
 
+CacheLayout Trie::cache_layout() const {
+  MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
+  return trie_->cache_layout();
+}
+
+RootTable Trie::root_table() const {
+  MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
+  return trie_->root_table();
+}
+
 bool Trie::empty() const {
   MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
   return trie_->empty();
@@ -155,17 +381,25 @@ std::size_t Trie::total_size() const {
   return trie_->total_size();
 }
 
-std::size_t Trie::io_size() const {
+std::size_t Trie::io_size(FormatVersion format) const {
   MARISA_THROW_IF(trie_.get() == NULL, MARISA_STATE_ERROR);
-  return trie_->io_size();
+  return trie_->io_size(format);
 }
 
 void Trie::clear() {
   Trie().swap(*this);
 }
 
+void Trie::set_allocator(Allocator *allocator,
+    Allocator *scratch_allocator) {
+  allocator_ = allocator;
+  scratch_allocator_ = scratch_allocator;
+}
+
 void Trie::swap(Trie &rhs) {
   trie_.swap(rhs.trie_);
+  marisa::swap(allocator_, rhs.allocator_);
+  marisa::swap(scratch_allocator_, rhs.scratch_allocator_);
 }
 
 }  // namespace marisa
@@ -182,18 +416,20 @@ class TrieIO {
     scoped_ptr<grimoire::LoudsTrie> temp(
         new (std::nothrow) grimoire::LoudsTrie);
     MARISA_THROW_IF(temp.get() == NULL, MARISA_MEMORY_ERROR);
+    temp->set_allocator(trie->allocator_, trie->scratch_allocator_);
 
     grimoire::Reader reader;
     reader.open(file);
     temp->read(reader);
     trie->trie_.swap(temp);
   }
-  static void fwrite(std::FILE *file, const Trie &trie) {
+  static void fwrite(std::FILE *file, const Trie &trie,
+      FormatVersion format) {
     MARISA_THROW_IF(file == NULL, MARISA_NULL_ERROR);
     MARISA_THROW_IF(trie.trie_.get() == NULL, MARISA_STATE_ERROR);
     grimoire::Writer writer;
     writer.open(file);
-    trie.trie_->write(writer);
+    trie.trie_->write(writer, format);
   }
 
   static std::istream &read(std::istream &stream, Trie *trie) {
@@ -202,6 +438,7 @@ class TrieIO {
     scoped_ptr<grimoire::LoudsTrie> temp(
         new (std::nothrow) grimoire::LoudsTrie);
     MARISA_THROW_IF(temp.get() == NULL, MARISA_MEMORY_ERROR);
+    temp->set_allocator(trie->allocator_, trie->scratch_allocator_);
 
     grimoire::Reader reader;
     reader.open(stream);
@@ -209,11 +446,12 @@ class TrieIO {
     trie->trie_.swap(temp);
     return stream;
   }
-  static std::ostream &write(std::ostream &stream, const Trie &trie) {
+  static std::ostream &write(std::ostream &stream, const Trie &trie,
+      FormatVersion format) {
     MARISA_THROW_IF(trie.trie_.get() == NULL, MARISA_STATE_ERROR);
     grimoire::Writer writer;
     writer.open(stream);
-    trie.trie_->write(writer);
+    trie.trie_->write(writer, format);
     return stream;
   }
 };
@@ -224,9 +462,9 @@ void fread(std::FILE *file, Trie *trie) {
   TrieIO::fread(file, trie);
 }
 
-void fwrite(std::FILE *file, const Trie &trie) {
+void fwrite(std::FILE *file, const Trie &trie, FormatVersion format) {
   MARISA_THROW_IF(file == NULL, MARISA_NULL_ERROR);
-  TrieIO::fwrite(file, trie);
+  TrieIO::fwrite(file, trie, format);
 }
 
 std::istream &read(std::istream &stream, Trie *trie) {
@@ -234,8 +472,9 @@ std::istream &read(std::istream &stream, Trie *trie) {
   return TrieIO::read(stream, trie);
 }
 
-std::ostream &write(std::ostream &stream, const Trie &trie) {
-  return TrieIO::write(stream, trie);
+std::ostream &write(std::ostream &stream, const Trie &trie,
+    FormatVersion format) {
+  return TrieIO::write(stream, trie, format);
 }
 
 std::istream &operator>>(std::istream &stream, Trie &trie) {
@@ -243,7 +482,7 @@ std::istream &operator>>(std::istream &stream, Trie &trie) {
 }
 
 std::ostream &operator<<(std::ostream &stream, const Trie &trie) {
-  return write(stream, trie);
+  return write(stream, trie, MARISA_DEFAULT_FORMAT);
 }
 
 }  // namespace marisa
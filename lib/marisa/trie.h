@@ -3,6 +3,9 @@
 
 #include "marisa/keyset.h"
 #include "marisa/agent.h"
+#include "marisa/observer.h"
+#include "marisa/allocator.h"
+#include "marisa/description.h"
 
 namespace marisa {
 namespace grimoire {
@@ -15,44 +18,138 @@ class LoudsTrie;
 
 class Trie {
   friend class TrieIO;
+  friend class TrieHandle;
+  friend class TrieSet;
+  friend class ResultCache;
 
  public:
   Trie();
   ~Trie();
 
-  void build(Keyset &keyset, int config_flags = 0);
-
-  void mmap(const char *filename);
+  // set_allocator() selects the allocator of the dictionaries built, merged,
+  // loaded or read afterwards, and `scratch_allocator' for the temporary
+  // arrays of build() and merge(). NULL selects new[]. A mapped dictionary
+  // does not allocate its arrays. The allocators must outlive the
+  // dictionaries, and clear() resets them.
+  void set_allocator(Allocator *allocator,
+      Allocator *scratch_allocator = NULL);
+
+  // If `observer' is not NULL, it receives the progress of the build.
+  void build(Keyset &keyset, int config_flags = 0,
+      BuildObserver *observer = NULL);
+  // This build() gives each trie its own cache level: `cache_levels[0]' to
+  // the first trie, `cache_levels[1]' to the second and so on. The tries
+  // beyond `num_cache_levels' use the cache level of `config_flags'. Larger
+  // caches for the nested tries speed up matching and restoring of links.
+  void build(Keyset &keyset, int config_flags,
+      const CacheLevel *cache_levels, std::size_t num_cache_levels,
+      BuildObserver *observer = NULL);
+
+  // merge() builds a dictionary from the keys of `tries', which are
+  // enumerated in label order and merged without restoring them as text.
+  // A key gets the weight of each source dictionary that contains it, which
+  // is given by `weights' (1.0 by default), combined by `merge_mode'. The
+  // result may replace one of the sources.
+  void merge(const Trie * const *tries, std::size_t num_tries,
+      int config_flags = 0, const float *weights = NULL,
+      MergeMode merge_mode = MARISA_DEFAULT_MERGE);
+
+  // `map_flags' is a combination of marisa_map_flags.
+  void mmap(const char *filename, int map_flags = MARISA_DEFAULT_MAP);
   void map(const void *ptr, std::size_t size);
 
   void load(const char *filename);
   void read(int fd);
 
-  void save(const char *filename) const;
-  void write(int fd) const;
+  // save() and write() use `format', which is MARISA_FORMAT_V1 by default.
+  // load(), read(), mmap() and map() accept both formats. `save_flags' is a
+  // combination of marisa_save_flags.
+  void save(const char *filename,
+      FormatVersion format = MARISA_DEFAULT_FORMAT,
+      int save_flags = MARISA_DEFAULT_SAVE) const;
+  void write(int fd, FormatVersion format = MARISA_DEFAULT_FORMAT) const;
+
+  // warm_up() touches up to `budget' bytes of the dictionary so that the
+  // first queries do not wait for page faults. The cache, the rank/select
+  // indexes and the top levels of the trie come first. If `in_background' is
+  // true, warm_up() returns at once and a thread touches the pages until it
+  // finishes or the dictionary is cleared. warm_up() returns the number of
+  // bytes to be touched.
+  std::size_t warm_up(std::size_t budget = MARISA_SIZE_MAX,
+      bool in_background = false);
+  // resident_size() returns the number of bytes of the dictionary which are
+  // in memory. A dictionary which is not mapped from a file is counted as a
+  // whole.
+  std::size_t resident_size() const;
+  // pin() is for a dictionary which is larger than memory. It locks the
+  // parts used by most traversal steps, that is the cache, the rank/select
+  // indexes and the first levels of the top trie, in memory and leaves the
+  // rest to demand paging. As many levels as fit in `budget' bytes are
+  // locked and their number is stored in `*num_levels' if it is not NULL.
+  // pin() returns the number of bytes locked, and the pages stay locked
+  // until the dictionary is cleared. It requires mmap() and throws
+  // MARISA_IO_ERROR if a lock fails.
+  std::size_t pin(std::size_t budget, std::size_t *num_levels = NULL);
 
   bool lookup(Agent &agent) const;
   void reverse_lookup(Agent &agent) const;
   bool common_prefix_search(Agent &agent) const;
   bool predictive_search(Agent &agent) const;
 
+  // profile() looks up a key like lookup() and counts the edges traversed.
+  // rebuild_cache() then fills the cache with the edges counted most often,
+  // so that queries sampled from a workload give a cache which fits it
+  // better than the weights given to build(). The rest of the dictionary is
+  // not changed, so it may be mapped from a file, and save() writes it with
+  // the new cache. clear_profile() discards the counts. These functions must
+  // not be called while the dictionary is used by other threads.
+  bool profile(Agent &agent);
+  void rebuild_cache();
+  void clear_profile();
+
+  // cache_size() returns the number of cache entries of a trie, where the
+  // first trie is level 0. cache_hits() and cache_misses() return how often
+  // profile() has found an edge of the trie in its cache or not, which is
+  // counted along the path of each key found. A level out of range throws
+  // MARISA_BOUND_ERROR.
+  std::size_t cache_size(std::size_t level = 0) const;
+  std::size_t cache_hits(std::size_t level = 0) const;
+  std::size_t cache_misses(std::size_t level = 0) const;
+
+  // describe() reports the structure of the dictionary: node counts,
+  // sizes of the components, histograms and ratios. See
+  // marisa/description.h.
+  void describe(Description *description) const;
+
+  // stats() returns the sum of the stats of the queries given to this
+  // dictionary by any agent, which are added at the end of each query, and
+  // clear_stats() resets it. Both are 0 unless the library is built with
+  // MARISA_ENABLE_STATS. See marisa/stats.h.
+  Stats stats() const;
+  void clear_stats();
+
   std::size_t num_tries() const;
   std::size_t num_keys() const;
   std::size_t num_nodes() const;
 
+  CacheLevel cache_level() const;
   TailMode tail_mode() const;
   NodeOrder node_order() const;
+  CacheLayout cache_layout() const;
+  RootTable root_table() const;
 
   bool empty() const;
   std::size_t size() const;
   std::size_t total_size() const;
-  std::size_t io_size() const;
+  std::size_t io_size(FormatVersion format = MARISA_DEFAULT_FORMAT) const;
 
   void clear();
   void swap(Trie &rhs);
 
  private:
   scoped_ptr<grimoire::trie::LoudsTrie> trie_;
+  Allocator *allocator_;
+  Allocator *scratch_allocator_;
 
   // Disallows copy and assignment.
   Trie(const Trie &);
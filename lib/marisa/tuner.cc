@@ -0,0 +1,187 @@
+#include "marisa/tuner.h"
+#include "marisa/trie.h"
+#include "marisa/grimoire/timer.h"
+#include "marisa/grimoire/vector.h"
+#include "marisa/grimoire/trie/config.h"
+
+namespace marisa {
+namespace {
+
+// Lookups are repeated until at least MIN_MEASURE_TIME seconds have passed,
+// so that short samples still give a stable measurement.
+const double MIN_MEASURE_TIME = 0.01;
+
+const CacheLevel CACHE_LEVELS[] = {
+  MARISA_TINY_CACHE,
+  MARISA_SMALL_CACHE,
+  MARISA_NORMAL_CACHE,
+  MARISA_LARGE_CACHE,
+  MARISA_HUGE_CACHE
+};
+
+const TailMode TAIL_MODES[] = {
+  MARISA_TEXT_TAIL,
+  MARISA_BINARY_TAIL
+};
+
+void sample_keys(const Keyset &keyset, std::size_t num_samples,
+    Keyset *samples, grimoire::Vector<float> *weights) {
+  if ((num_samples == 0) || (num_samples > keyset.size())) {
+    num_samples = keyset.size();
+  }
+  for (std::size_t i = 0; i < num_samples; ++i) {
+    const Key &key = keyset[(std::size_t)(
+        ((UInt64)i * keyset.size()) / num_samples)];
+    samples->push_back(key.ptr(), key.length(), key.weight());
+    weights->push_back(key.weight());
+  }
+}
+
+double measure_time(const Trie &trie, const Keyset &samples) {
+  if (samples.empty()) {
+    return 0.0;
+  }
+
+  Agent agent;
+  for (std::size_t i = 0; i < samples.size(); ++i) {
+    agent.set_query(samples[i].ptr(), samples[i].length());
+    trie.lookup(agent);
+  }
+
+  std::size_t num_lookups = 0;
+  grimoire::Timer timer;
+  do {
+    for (std::size_t i = 0; i < samples.size(); ++i) {
+      agent.set_query(samples[i].ptr(), samples[i].length());
+      trie.lookup(agent);
+    }
+    num_lookups += samples.size();
+  } while (timer.elapsed() < MIN_MEASURE_TIME);
+  return 1000000000.0 * timer.elapsed() / num_lookups;
+}
+
+}  // namespace
+
+Tuner::Tuner()
+    : objective_(MIN_TIME), max_size_(0), max_time_(0.0),
+      num_samples_(DEFAULT_NUM_SAMPLES), min_num_tries_(1),
+      max_num_tries_(5), flags_(0), size_(0), time_(0.0),
+      num_candidates_(0) {}
+
+void Tuner::set_objective(Objective objective) {
+  MARISA_THROW_IF((objective != MIN_SIZE) && (objective != MIN_TIME),
+      MARISA_CODE_ERROR);
+  objective_ = objective;
+}
+
+void Tuner::set_max_size(std::size_t max_size) {
+  max_size_ = max_size;
+}
+
+void Tuner::set_max_time(double max_time) {
+  MARISA_THROW_IF(max_time < 0.0, MARISA_RANGE_ERROR);
+  max_time_ = max_time;
+}
+
+void Tuner::set_num_samples(std::size_t num_samples) {
+  num_samples_ = num_samples;
+}
+
+void Tuner::set_num_tries(std::size_t min_num_tries,
+    std::size_t max_num_tries) {
+  MARISA_THROW_IF(min_num_tries < MARISA_MIN_NUM_TRIES, MARISA_RANGE_ERROR);
+  MARISA_THROW_IF(max_num_tries > MARISA_MAX_NUM_TRIES, MARISA_RANGE_ERROR);
+  MARISA_THROW_IF(min_num_tries > max_num_tries, MARISA_RANGE_ERROR);
+  min_num_tries_ = min_num_tries;
+  max_num_tries_ = max_num_tries;
+}
+
+int Tuner::tune(const Keyset &keyset, int config_flags) {
+  grimoire::trie::Config config;
+  config.parse(config_flags);
+
+  Keyset samples;
+  grimoire::Vector<float> weights;
+  sample_keys(keyset, num_samples_, &samples, &weights);
+  const double scale = samples.empty() ?
+      1.0 : ((double)keyset.size() / samples.size());
+
+  bool has_best = false;
+  bool best_satisfies = false;
+  int best_flags = 0;
+  std::size_t best_size = 0;
+  double best_time = 0.0;
+  std::size_t num_candidates = 0;
+
+  for (std::size_t num_tries = min_num_tries_;
+      num_tries <= max_num_tries_; ++num_tries) {
+    for (std::size_t i = 0; i < sizeof(TAIL_MODES) / sizeof(TAIL_MODES[0]);
+        ++i) {
+      for (std::size_t j = 0;
+          j < sizeof(CACHE_LEVELS) / sizeof(CACHE_LEVELS[0]); ++j) {
+        const int flags = (int)num_tries | TAIL_MODES[i] | CACHE_LEVELS[j] |
+            config.node_order();
+
+        // Trie::build() overwrites weights with key IDs.
+        for (std::size_t k = 0; k < samples.size(); ++k) {
+          samples[k].set_weight(weights[k]);
+        }
+        Trie trie;
+        trie.build(samples, flags);
+        if (trie.tail_mode() != TAIL_MODES[i]) {
+          // MARISA_TEXT_TAIL has been replaced with MARISA_BINARY_TAIL, which
+          // is tested as another candidate.
+          continue;
+        }
+        ++num_candidates;
+
+        const std::size_t size = (std::size_t)(trie.io_size() * scale);
+        const double time = measure_time(trie, samples);
+
+        bool satisfies;
+        bool is_better;
+        if (objective_ == MIN_SIZE) {
+          satisfies = (max_time_ == 0.0) || (time <= max_time_);
+          is_better = (satisfies != best_satisfies) ? satisfies :
+              (satisfies ? (size < best_size) : (time < best_time));
+        } else {
+          satisfies = (max_size_ == 0) || (size <= max_size_);
+          is_better = (satisfies != best_satisfies) ? satisfies :
+              (satisfies ? (time < best_time) : (size < best_size));
+        }
+        if (!has_best || is_better) {
+          has_best = true;
+          best_satisfies = satisfies;
+          best_flags = flags;
+          best_size = size;
+          best_time = time;
+        }
+      }
+    }
+  }
+
+  flags_ = best_flags;
+  size_ = best_size;
+  time_ = best_time;
+  num_candidates_ = num_candidates;
+  return flags_;
+}
+
+void Tuner::clear() {
+  Tuner().swap(*this);
+}
+
+void Tuner::swap(Tuner &rhs) {
+  marisa::swap(objective_, rhs.objective_);
+  marisa::swap(max_size_, rhs.max_size_);
+  marisa::swap(max_time_, rhs.max_time_);
+  marisa::swap(num_samples_, rhs.num_samples_);
+  marisa::swap(min_num_tries_, rhs.min_num_tries_);
+  marisa::swap(max_num_tries_, rhs.max_num_tries_);
+  marisa::swap(flags_, rhs.flags_);
+  marisa::swap(size_, rhs.size_);
+  marisa::swap(time_, rhs.time_);
+  marisa::swap(num_candidates_, rhs.num_candidates_);
+}
+
+}  // namespace marisa
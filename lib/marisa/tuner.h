@@ -0,0 +1,96 @@
+#ifndef MARISA_TUNER_H_
+#define MARISA_TUNER_H_
+
+#include "marisa/keyset.h"
+
+namespace marisa {
+
+// Tuner builds dictionaries with candidate settings on a sample of a keyset
+// and selects the settings that best meet an objective. The number of tries,
+// the cache level and the TAIL mode are tuned. The node order is not tuned
+// because it changes the order of predictive search.
+class Tuner {
+ public:
+  enum {
+    DEFAULT_NUM_SAMPLES = 100000
+  };
+
+  typedef enum Objective_ {
+    // MIN_SIZE selects the smallest dictionary whose lookup time does not
+    // exceed max_time(). If no candidate satisfies the limit, the fastest one
+    // is selected.
+    MIN_SIZE,
+
+    // MIN_TIME selects the fastest dictionary whose size does not exceed
+    // max_size(). If no candidate satisfies the limit, the smallest one is
+    // selected.
+    MIN_TIME
+  } Objective;
+
+  Tuner();
+
+  // 0 means that there is no limit. The size limit is compared with the
+  // dictionary size estimated from a sample, and the time limit is given in
+  // nanoseconds per lookup.
+  void set_objective(Objective objective);
+  void set_max_size(std::size_t max_size);
+  void set_max_time(double max_time);
+
+  void set_num_samples(std::size_t num_samples);
+  void set_num_tries(std::size_t min_num_tries, std::size_t max_num_tries);
+
+  // tune() returns the selected config flags. The node order is taken from
+  // `config_flags'. A dictionary built with the returned flags records them
+  // in its file, so that they can be seen after load.
+  int tune(const Keyset &keyset, int config_flags = 0);
+
+  Objective objective() const {
+    return objective_;
+  }
+  std::size_t max_size() const {
+    return max_size_;
+  }
+  double max_time() const {
+    return max_time_;
+  }
+  std::size_t num_samples() const {
+    return num_samples_;
+  }
+
+  // The following functions give the result of the last tune().
+  int flags() const {
+    return flags_;
+  }
+  std::size_t size() const {
+    return size_;
+  }
+  double time() const {
+    return time_;
+  }
+  std::size_t num_candidates() const {
+    return num_candidates_;
+  }
+
+  void clear();
+  void swap(Tuner &rhs);
+
+ private:
+  Objective objective_;
+  std::size_t max_size_;
+  double max_time_;
+  std::size_t num_samples_;
+  std::size_t min_num_tries_;
+  std::size_t max_num_tries_;
+  int flags_;
+  std::size_t size_;
+  double time_;
+  std::size_t num_candidates_;
+
+  // Disallows copy and assignment.
+  Tuner(const Tuner &);
+  Tuner &operator=(const Tuner &);
+};
+
+}  // namespace marisa
+
+#endif  // MARISA_TUNER_H_
@@ -1,3 +1,4 @@
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
@@ -208,6 +209,167 @@ void TestKeyset() {
   TEST_END();
 }
 
+void TestKeysetRef() {
+  TEST_START();
+
+  marisa::Keyset keyset;
+
+  const char *str = "appleorangebanana";
+  keyset.push_back_ref(str, 5, 2.0F);
+  ASSERT(keyset.size() == 1);
+  ASSERT(keyset.total_length() == 5);
+  ASSERT(keyset[0].ptr() == str);
+  ASSERT(keyset[0].length() == 5);
+  ASSERT(keyset[0].weight() == 2.0F);
+
+  const marisa::UInt32 offsets32[] = { 0, 5, 11, 11, 17 };
+  keyset.push_back_ref(str, offsets32, 4);
+  ASSERT(keyset.size() == 5);
+  ASSERT(keyset.total_length() == 22);
+  ASSERT(keyset[1].ptr() == str);
+  ASSERT(keyset[1].length() == 5);
+  ASSERT(keyset[2].ptr() == str + 5);
+  ASSERT(keyset[2].length() == 6);
+  ASSERT(keyset[3].length() == 0);
+  ASSERT(keyset[4].ptr() == str + 11);
+  ASSERT(keyset[4].length() == 6);
+  ASSERT(keyset[4].weight() == 1.0F);
+
+  const marisa::UInt64 offsets64[] = { 5, 11, 17 };
+  const float weights[] = { 3.0F, 4.0F };
+  keyset.push_back_ref(str, offsets64, 2, weights);
+  ASSERT(keyset.size() == 7);
+  ASSERT(keyset[5].ptr() == str + 5);
+  ASSERT(keyset[5].weight() == 3.0F);
+  ASSERT(keyset[6].ptr() == str + 11);
+  ASSERT(keyset[6].weight() == 4.0F);
+
+  const marisa::UInt32 bad_offsets[] = { 5, 0 };
+  EXCEPT(keyset.push_back_ref(str, bad_offsets, 1), MARISA_RANGE_ERROR);
+  EXCEPT(keyset.push_back_ref(NULL, 1), MARISA_NULL_ERROR);
+  ASSERT(keyset.size() == 7);
+
+  keyset.clear();
+
+  ASSERT(keyset.size() == 0);
+  ASSERT(keyset.total_length() == 0);
+
+  TEST_END();
+}
+
+void TestKeysetMmap() {
+  TEST_START();
+
+  {
+    std::FILE *file;
+#ifdef _MSC_VER
+    ASSERT(::fopen_s(&file, "base-test.dat", "wb") == 0);
+#else  // _MSC_VER
+    file = std::fopen("base-test.dat", "wb");
+    ASSERT(file != NULL);
+#endif  // _MSC_VER
+    const char data[] = "apple\norange\t2.5\n\nbanana\t\t-1e2\n"
+        "grape\tx\nlemon\t1e40\nmelon";
+    ASSERT(std::fwrite(data, 1, sizeof(data) - 1, file) == sizeof(data) - 1);
+    std::fclose(file);
+  }
+
+  marisa::Keyset keyset;
+  keyset.mmap("base-test.dat");
+
+  ASSERT(keyset.size() == 7);
+  ASSERT(keyset[0].length() == 5);
+  ASSERT(std::memcmp(keyset[0].ptr(), "apple", 5) == 0);
+  ASSERT(keyset[0].weight() == 1.0F);
+  ASSERT(keyset[1].length() == 6);
+  ASSERT(std::memcmp(keyset[1].ptr(), "orange", 6) == 0);
+  ASSERT(keyset[1].weight() == 2.5F);
+  ASSERT(keyset[2].length() == 0);
+  ASSERT(keyset[3].length() == 7);
+  ASSERT(std::memcmp(keyset[3].ptr(), "banana\t", 7) == 0);
+  ASSERT(keyset[3].weight() == -100.0F);
+  ASSERT(keyset[4].length() == 7);
+  ASSERT(std::memcmp(keyset[4].ptr(), "grape\tx", 7) == 0);
+  ASSERT(keyset[4].weight() == 0.0F);
+  ASSERT(keyset[5].length() == 5);
+  ASSERT(keyset[5].weight() == (float)1e40);
+  ASSERT(keyset[6].length() == 5);
+  ASSERT(std::memcmp(keyset[6].ptr(), "melon", 5) == 0);
+
+  keyset.reset();
+  keyset.mmap("base-test.dat", '\t', false);
+
+  ASSERT(keyset.size() == 6);
+  ASSERT(keyset[0].length() == 12);
+  ASSERT(std::memcmp(keyset[0].ptr(), "apple\norange", 12) == 0);
+  ASSERT(keyset[0].weight() == 1.0F);
+  ASSERT(keyset[2].length() == 0);
+
+  keyset.clear();
+
+  EXCEPT(keyset.mmap(NULL), MARISA_NULL_ERROR);
+  EXCEPT(keyset.mmap("base-test.none"), MARISA_IO_ERROR);
+
+  {
+    std::FILE *file;
+#ifdef _MSC_VER
+    ASSERT(::fopen_s(&file, "base-test.dat", "wb") == 0);
+#else  // _MSC_VER
+    file = std::fopen("base-test.dat", "wb");
+    ASSERT(file != NULL);
+#endif  // _MSC_VER
+    std::fclose(file);
+  }
+
+  // An empty file gives no keys.
+  keyset.mmap("base-test.dat");
+  ASSERT(keyset.size() == 0);
+  keyset.mmap("base-test.dat", '\n', true, 4);
+  ASSERT(keyset.size() == 0);
+  ASSERT(keyset.total_length() == 0);
+
+  {
+    std::FILE *file;
+#ifdef _MSC_VER
+    ASSERT(::fopen_s(&file, "base-test.dat", "wb") == 0);
+#else  // _MSC_VER
+    file = std::fopen("base-test.dat", "wb");
+    ASSERT(file != NULL);
+#endif  // _MSC_VER
+    std::size_t size = 0;
+    while (size < (marisa::Keyset::MIN_CHUNK_SIZE * 3)) {
+      std::string line(std::rand() % 64, 'a');
+      for (std::size_t i = 0; i < line.length(); ++i) {
+        line[i] = (char)('a' + (std::rand() % 26));
+      }
+      if ((std::rand() % 2) == 0) {
+        line += "\t0.5";
+      }
+      line += '\n';
+      ASSERT(std::fwrite(line.c_str(), 1, line.length(), file) ==
+          line.length());
+      size += line.length();
+    }
+    std::fclose(file);
+  }
+
+  marisa::Keyset keyset2;
+  keyset.mmap("base-test.dat");
+  keyset2.mmap("base-test.dat", '\n', true, 4);
+
+  ASSERT(keyset2.size() == keyset.size());
+  ASSERT(keyset2.total_length() == keyset.total_length());
+  for (std::size_t i = 0; i < keyset.size(); ++i) {
+    ASSERT(keyset2[i].ptr() != keyset[i].ptr());
+    ASSERT(keyset2[i].length() == keyset[i].length());
+    ASSERT(std::memcmp(keyset2[i].ptr(), keyset[i].ptr(),
+        keyset[i].length()) == 0);
+    ASSERT(keyset2[i].weight() == keyset[i].weight());
+  }
+
+  TEST_END();
+}
+
 void TestQuery() {
   TEST_START();
 
@@ -299,6 +461,8 @@ int main() try {
   TestException();
   TestKey();
   TestKeyset();
+  TestKeysetRef();
+  TestKeysetMmap();
   TestQuery();
   TestAgent();
 
@@ -9,6 +9,7 @@
 #include <fcntl.h>
 
 #include <sstream>
+#include <vector>
 
 #include <marisa/grimoire/io.h>
 
@@ -70,11 +71,42 @@ void TestFilename() {
     EXCEPT(mapper.map(&byte), MARISA_IO_ERROR);
   }
 
+  {
+    const int map_flags[] = {
+      MARISA_MAP_READ,
+      MARISA_MAP_READ | MARISA_MAP_HUGE_PAGES
+    };
+    for (std::size_t i = 0; i < 2; ++i) {
+      marisa::grimoire::Mapper mapper;
+      mapper.open("io-test.dat", map_flags[i]);
+      ASSERT(mapper.mapped_size() == 24);
+
+      marisa::UInt32 value;
+      mapper.map(&value);
+      ASSERT(value == 123);
+      mapper.map(&value);
+      ASSERT(value == 234);
+
+      const double *values;
+      mapper.map(&values, 2);
+      ASSERT(values[0] == 3.45);
+      ASSERT(values[1] == 4.56);
+
+      char byte;
+      EXCEPT(mapper.map(&byte), MARISA_IO_ERROR);
+    }
+  }
+
   {
     marisa::grimoire::Writer writer;
     writer.open("io-test.dat");
   }
 
+  {
+    marisa::grimoire::Mapper mapper;
+    EXCEPT(mapper.open("io-test.dat", MARISA_MAP_READ), MARISA_IO_ERROR);
+  }
+
   {
     marisa::grimoire::Reader reader;
     reader.open("io-test.dat");
@@ -108,6 +140,15 @@ void TestFd() {
     double values[] = { 34.5, 67.8 };
     writer.write(values, 2);
 
+    // The data stays in the buffer until flush().
+    ASSERT(writer.position() == 20);
+#ifndef _MSC_VER
+    struct stat file_stat;
+    ASSERT(::fstat(fd, &file_stat) == 0);
+    ASSERT(file_stat.st_size == 0);
+#endif  // _MSC_VER
+    writer.flush();
+
 #ifdef _MSC_VER
     ASSERT(::_close(fd) == 0);
 #else  // _MSC_VER
@@ -115,6 +156,22 @@ void TestFd() {
 #endif  // _MSC_VER
   }
 
+#ifndef _MSC_VER
+  {
+    // A write error is found by flush().
+    int fd = ::open("io-test.dat", O_RDONLY);
+    ASSERT(fd != -1);
+
+    marisa::grimoire::Writer writer;
+    writer.open(fd);
+    writer.write((marisa::UInt32)0);
+    EXCEPT(writer.flush(), MARISA_IO_ERROR);
+    writer.clear();
+
+    ASSERT(::close(fd) == 0);
+  }
+#endif  // _MSC_VER
+
   {
 #ifdef _MSC_VER
     int fd = -1;
@@ -237,6 +294,244 @@ void TestStream() {
   TEST_END();
 }
 
+void TestBufferedWriter() {
+  TEST_START();
+
+  // The large write goes past the buffer and is written with the buffered
+  // data. The values before and after it stay in the buffer.
+  std::vector<marisa::UInt32> values(300000);
+  for (std::size_t i = 0; i < values.size(); ++i) {
+    values[i] = (marisa::UInt32)(i * 7);
+  }
+
+  const int save_flags[] = { MARISA_DEFAULT_SAVE, MARISA_SAVE_DIRECT };
+  for (std::size_t i = 0; i < 2; ++i) {
+    marisa::grimoire::Crc32c crc;
+    {
+      marisa::grimoire::Writer writer;
+      writer.open("io-test.dat", save_flags[i]);
+      ASSERT(writer.can_rewrite());
+      writer.reserve(1 << 22);
+
+      writer.write((marisa::UInt32)0);
+      writer.set_checksum(&crc);
+      for (marisa::UInt32 j = 0; j < 1000; ++j) {
+        writer.write(j);
+      }
+      writer.write(&values[0], values.size());
+      writer.write((marisa::UInt32)123);
+      writer.set_checksum(NULL);
+      writer.seek(100);
+      ASSERT(writer.position() == (4 + 4000 + (values.size() * 4) + 4 + 100));
+
+      const marisa::UInt32 first = 999;
+      writer.rewrite(0, &first, sizeof(first));
+      const marisa::UInt32 last = 456;
+      writer.rewrite(writer.position() - 104, &last, sizeof(last));
+      EXCEPT(writer.rewrite(writer.position() - 2, &last, sizeof(last)),
+          MARISA_BOUND_ERROR);
+      writer.flush();
+    }
+    ASSERT(crc.size() == (4000 + (values.size() * 4) + 4));
+
+    marisa::grimoire::Crc32c expected_crc;
+    marisa::grimoire::Reader reader;
+    reader.open("io-test.dat");
+
+    marisa::UInt32 value;
+    reader.read(&value);
+    ASSERT(value == 999);
+    for (marisa::UInt32 j = 0; j < 1000; ++j) {
+      reader.read(&value);
+      ASSERT(value == j);
+      expected_crc.update(&value, sizeof(value));
+    }
+    std::vector<marisa::UInt32> values_read(values.size());
+    reader.read(&values_read[0], values_read.size());
+    ASSERT(values_read == values);
+    expected_crc.update(&values_read[0], values_read.size() * 4);
+    reader.read(&value);
+    ASSERT(value == 456);
+    value = 123;
+    expected_crc.update(&value, sizeof(value));
+    ASSERT(crc.value() == expected_crc.value());
+
+    reader.seek(100);
+    char byte;
+    EXCEPT(reader.read(&byte), MARISA_IO_ERROR);
+  }
+
+  {
+    std::stringstream stream;
+    marisa::grimoire::Writer writer;
+    writer.open(stream);
+    ASSERT(!writer.can_rewrite());
+    writer.write((marisa::UInt32)0);
+    EXCEPT(writer.rewrite(0, "", 0), MARISA_STATE_ERROR);
+    EXCEPT(writer.open("io-test.dat", 0x100), MARISA_CODE_ERROR);
+  }
+
+  TEST_END();
+}
+
+void TestCrc32c() {
+  TEST_START();
+
+  const char data[] = "123456789";
+
+  ASSERT(marisa::grimoire::Crc32c::compute(data, 0) == 0);
+  ASSERT(marisa::grimoire::Crc32c::compute(data, 9) == 0xE3069283U);
+
+  {
+    marisa::grimoire::Crc32c crc;
+    crc.update(data, 2);
+    crc.update(data + 2, 7);
+    ASSERT(crc.value() == 0xE3069283U);
+    ASSERT(crc.size() == 9);
+
+    crc.clear();
+    ASSERT(crc.value() == 0);
+    ASSERT(crc.size() == 0);
+  }
+
+  {
+    marisa::grimoire::Crc32c crc;
+    marisa::grimoire::Writer writer;
+    writer.open(crc);
+    ASSERT(writer.is_open());
+
+    writer.write(data, 4);
+    writer.seek(3);
+    writer.write(data + 4, 5);
+    ASSERT(crc.size() == 12);
+
+    const char expected[] = "1234\0\0\0" "56789";
+    ASSERT(crc.value() ==
+        marisa::grimoire::Crc32c::compute(expected, 12));
+  }
+
+  {
+    std::stringstream stream;
+    stream.write(data, 9);
+
+    marisa::grimoire::Crc32c crc;
+    marisa::grimoire::Reader reader;
+    reader.open(stream);
+    ASSERT(reader.avail() == MARISA_SIZE_MAX);
+    reader.set_checksum(&crc);
+    reader.set_limit(8);
+
+    char buf[9];
+    reader.read(buf, 4);
+    reader.seek(3);
+    ASSERT(reader.avail() == 1);
+    EXCEPT(reader.read(buf, 2), MARISA_FORMAT_ERROR);
+    reader.read(buf, 1);
+    ASSERT(reader.avail() == 0);
+    ASSERT(crc.value() == marisa::grimoire::Crc32c::compute(data, 8));
+
+    reader.set_checksum(NULL);
+    reader.set_limit(MARISA_SIZE_MAX);
+    reader.read(buf, 1);
+    ASSERT(buf[0] == '9');
+    ASSERT(crc.size() == 8);
+  }
+
+  TEST_END();
+}
+
+void TestMapperView() {
+  TEST_START();
+
+  const marisa::UInt32 values[] = { 1, 2, 3, 4, 5 };
+
+  marisa::grimoire::Mapper mapper;
+  mapper.open(values, sizeof(values));
+
+  marisa::UInt32 value;
+  mapper.map(&value);
+  ASSERT(value == 1);
+
+  marisa::grimoire::Mapper view;
+  view.open(mapper, sizeof(marisa::UInt32), sizeof(marisa::UInt32) * 2);
+  ASSERT(view.avail() == sizeof(marisa::UInt32) * 2);
+  view.map(&value);
+  ASSERT(value == 3);
+  view.map(&value);
+  ASSERT(value == 4);
+  EXCEPT(view.map(&value), MARISA_IO_ERROR);
+
+  ASSERT(mapper.avail() == sizeof(marisa::UInt32) * 4);
+  mapper.map(&value);
+  ASSERT(value == 2);
+
+  EXCEPT(view.open(mapper, sizeof(marisa::UInt32) * 4, 0), MARISA_IO_ERROR);
+  EXCEPT(view.open(mapper, 0, sizeof(marisa::UInt32) * 4), MARISA_IO_ERROR);
+
+  marisa::grimoire::Mapper closed_mapper;
+  EXCEPT(view.open(closed_mapper, 0, 0), MARISA_STATE_ERROR);
+
+  TEST_END();
+}
+
+void TestPrefetcher() {
+  TEST_START();
+
+  char buf[10000] = {};
+
+  marisa::grimoire::Prefetcher prefetcher;
+  ASSERT(prefetcher.num_regions() == 0);
+  ASSERT(prefetcher.total_size() == 0);
+  ASSERT(prefetcher.run(100) == 0);
+
+  EXCEPT(prefetcher.add(NULL, 1), MARISA_NULL_ERROR);
+
+  for (std::size_t i = 0; i < 100; ++i) {
+    prefetcher.add(buf + (i * 100), 100);
+  }
+  prefetcher.add(buf, 0);
+  ASSERT(prefetcher.num_regions() == 100);
+  ASSERT(prefetcher.total_size() == sizeof(buf));
+
+  ASSERT(prefetcher.run(0) == 0);
+  ASSERT(prefetcher.run(150) == 150);
+  ASSERT(prefetcher.run(MARISA_SIZE_MAX) == sizeof(buf));
+
+  ASSERT(prefetcher.start(MARISA_SIZE_MAX) == sizeof(buf));
+  EXCEPT(prefetcher.add(buf, 1), MARISA_STATE_ERROR);
+  prefetcher.stop();
+  ASSERT(!prefetcher.is_running());
+
+  prefetcher.start(MARISA_SIZE_MAX);
+  prefetcher.stop();
+  prefetcher.clear();
+  ASSERT(prefetcher.num_regions() == 0);
+
+  {
+    marisa::grimoire::Writer writer;
+    writer.open("io-test.dat");
+    writer.write(buf, sizeof(buf));
+  }
+
+  marisa::grimoire::Mapper mapper;
+  mapper.open("io-test.dat");
+  ASSERT(mapper.mapped_size() == sizeof(buf));
+  ASSERT(mapper.resident_size() <= sizeof(buf));
+
+  const char *ptr;
+  mapper.map(&ptr, sizeof(buf));
+  prefetcher.add(ptr, sizeof(buf));
+  prefetcher.run(MARISA_SIZE_MAX);
+  ASSERT(mapper.resident_size() == sizeof(buf));
+
+  marisa::grimoire::Mapper view;
+  view.open(static_cast<const void *>(buf), sizeof(buf));
+  ASSERT(view.mapped_size() == 0);
+  ASSERT(view.resident_size() == 0);
+
+  TEST_END();
+}
+
 }  // namespace
 
 int main() try {
@@ -244,6 +539,10 @@ int main() try {
   TestFd();
   TestFile();
   TestStream();
+  TestBufferedWriter();
+  TestCrc32c();
+  TestMapperView();
+  TestPrefetcher();
 
   return 0;
 } catch (const marisa::Exception &ex) {
@@ -2,6 +2,7 @@
 #include <cstring>
 #include <ctime>
 #include <sstream>
+#include <string>
 
 #include <marisa.h>
 
@@ -34,6 +35,7 @@ void TestEmptyTrie() {
   EXCEPT(trie.num_keys(), MARISA_STATE_ERROR);
   EXCEPT(trie.num_nodes(), MARISA_STATE_ERROR);
 
+  EXCEPT(trie.cache_level(), MARISA_STATE_ERROR);
   EXCEPT(trie.tail_mode(), MARISA_STATE_ERROR);
   EXCEPT(trie.node_order(), MARISA_STATE_ERROR);
 
@@ -54,6 +56,7 @@ void TestEmptyTrie() {
   ASSERT(trie.num_keys() == 0);
   ASSERT(trie.num_nodes() == 1);
 
+  ASSERT(trie.cache_level() == MARISA_DEFAULT_CACHE);
   ASSERT(trie.tail_mode() == MARISA_DEFAULT_TAIL);
   ASSERT(trie.node_order() == MARISA_DEFAULT_ORDER);
 
@@ -372,6 +375,1432 @@ void TestTrie() {
   TestTrie(MARISA_BINARY_TAIL);
 }
 
+void ReadFile(const char *filename, std::string *buf) {
+  std::FILE *file;
+#ifdef _MSC_VER
+  ASSERT(::fopen_s(&file, filename, "rb") == 0);
+#else  // _MSC_VER
+  file = std::fopen(filename, "rb");
+  ASSERT(file != NULL);
+#endif  // _MSC_VER
+  buf->clear();
+  char chunk[1024];
+  std::size_t size;
+  while ((size = std::fread(chunk, 1, sizeof(chunk), file)) != 0) {
+    buf->append(chunk, size);
+  }
+  std::fclose(file);
+}
+
+void WriteFile(const char *filename, const std::string &buf) {
+  std::FILE *file;
+#ifdef _MSC_VER
+  ASSERT(::fopen_s(&file, filename, "wb") == 0);
+#else  // _MSC_VER
+  file = std::fopen(filename, "wb");
+  ASSERT(file != NULL);
+#endif  // _MSC_VER
+  ASSERT(std::fwrite(buf.data(), 1, buf.size(), file) == buf.size());
+  std::fclose(file);
+}
+
+void TestFormat() {
+  TEST_START();
+
+  marisa::Keyset keyset;
+  MakeKeyset(1000, MARISA_TEXT_TAIL, &keyset);
+
+  marisa::Trie trie;
+  trie.build(keyset, 3);
+
+  EXCEPT(trie.save("marisa-test.dat", (marisa::FormatVersion)3),
+      MARISA_CODE_ERROR);
+
+  trie.save("marisa-test.dat", MARISA_FORMAT_V2);
+
+  std::string buf;
+  ReadFile("marisa-test.dat", &buf);
+  ASSERT(buf.size() == trie.io_size(MARISA_FORMAT_V2));
+  ASSERT((buf.size() % 64) == 0);
+  ASSERT(std::memcmp(buf.data(), "We love Marisa2", 16) == 0);
+
+  trie.clear();
+  trie.load("marisa-test.dat");
+  ASSERT(trie.num_tries() == 3);
+  TestLookup(trie, keyset);
+
+  trie.clear();
+  trie.mmap("marisa-test.dat");
+  ASSERT(trie.num_tries() == 3);
+  TestLookup(trie, keyset);
+
+  trie.clear();
+  trie.mmap("marisa-test.dat", MARISA_MAP_VERIFY);
+  ASSERT(trie.num_tries() == 3);
+  TestLookup(trie, keyset);
+
+  trie.clear();
+  trie.map(buf.data(), buf.size());
+  ASSERT(trie.num_tries() == 3);
+  TestLookup(trie, keyset);
+
+  {
+    std::stringstream stream;
+    stream.write(buf.data(), buf.size());
+    stream.write(buf.data(), buf.size());
+
+    marisa::Trie trie2;
+    stream >> trie >> trie2;
+    TestLookup(trie, keyset);
+    TestLookup(trie2, keyset);
+  }
+
+  {
+    // A file gets its checksums while it is written and a stream gets them
+    // in advance, which give the same bytes.
+    std::stringstream stream;
+    marisa::write(stream, trie, MARISA_FORMAT_V2);
+    ASSERT(stream.str() == buf);
+
+    const int save_flags[] = {
+      MARISA_SAVE_DIRECT,
+      MARISA_SAVE_PREALLOCATE,
+      MARISA_SAVE_DIRECT | MARISA_SAVE_PREALLOCATE
+    };
+    for (std::size_t i = 0; i < 3; ++i) {
+      trie.save("marisa-test.dat", MARISA_FORMAT_V2, save_flags[i]);
+      std::string saved_buf;
+      ReadFile("marisa-test.dat", &saved_buf);
+      ASSERT(saved_buf == buf);
+    }
+
+    EXCEPT(trie.save("marisa-test.dat", MARISA_FORMAT_V2, 0x100),
+        MARISA_CODE_ERROR);
+  }
+
+  {
+    // v1 is still the default format, which has no directory.
+    trie.save("marisa-test.dat", MARISA_FORMAT_V1);
+    ASSERT(trie.io_size() == trie.io_size(MARISA_FORMAT_V1));
+    std::string v1_buf;
+    ReadFile("marisa-test.dat", &v1_buf);
+    ASSERT(v1_buf.size() == trie.io_size());
+
+    trie.clear();
+    trie.map(v1_buf.data(), v1_buf.size());
+    TestLookup(trie, keyset);
+  }
+
+  {
+    // The 4th section is the bases of the first trie, whose elements follow
+    // an 8-byte size at a 64-byte boundary.
+    marisa::UInt64 offset;
+    std::memcpy(&offset, buf.data() + 144, sizeof(offset));
+    ASSERT(((offset + 8) % 64) == 0);
+    ASSERT(offset < buf.size());
+
+    std::string corrupt_buf = buf;
+    corrupt_buf[(std::size_t)offset + 8] ^= 1;
+    WriteFile("marisa-test.dat", corrupt_buf);
+    EXCEPT(trie.load("marisa-test.dat"), MARISA_FORMAT_ERROR);
+    EXCEPT(trie.mmap("marisa-test.dat", MARISA_MAP_VERIFY),
+        MARISA_FORMAT_ERROR);
+    trie.mmap("marisa-test.dat");
+    trie.clear();
+
+    // A broken size is found before it is allocated.
+    corrupt_buf = buf;
+    const marisa::UInt64 broken_size = 0x7FFFFFF8;
+    std::memcpy(&corrupt_buf[(std::size_t)offset], &broken_size,
+        sizeof(broken_size));
+    WriteFile("marisa-test.dat", corrupt_buf);
+    EXCEPT(trie.load("marisa-test.dat"), MARISA_FORMAT_ERROR);
+
+    corrupt_buf = buf;
+    corrupt_buf[144] ^= 1;
+    EXCEPT(trie.map(corrupt_buf.data(), corrupt_buf.size()),
+        MARISA_FORMAT_ERROR);
+
+    EXCEPT(trie.map(buf.data(), buf.size() - 64), MARISA_IO_ERROR);
+  }
+
+  TEST_END();
+}
+
+void TestMapFlags() {
+  TEST_START();
+
+  marisa::Keyset keyset;
+  MakeKeyset(1000, MARISA_TEXT_TAIL, &keyset);
+
+  marisa::Trie trie;
+  trie.build(keyset, 3);
+
+  for (int format = MARISA_FORMAT_V1; format <= MARISA_FORMAT_V2; ++format) {
+    trie.save("marisa-test.dat", (marisa::FormatVersion)format);
+
+    marisa::Trie mapped_trie;
+    mapped_trie.mmap("marisa-test.dat", MARISA_MAP_POPULATE);
+    TestLookup(mapped_trie, keyset);
+
+    mapped_trie.mmap("marisa-test.dat", MARISA_MAP_ADVISE);
+    TestLookup(mapped_trie, keyset);
+
+    mapped_trie.mmap("marisa-test.dat",
+        MARISA_MAP_POPULATE | MARISA_MAP_ADVISE | MARISA_MAP_HUGE_PAGES);
+    TestLookup(mapped_trie, keyset);
+
+    mapped_trie.mmap("marisa-test.dat", MARISA_MAP_READ);
+    TestLookup(mapped_trie, keyset);
+    ASSERT(mapped_trie.resident_size() ==
+        mapped_trie.io_size((marisa::FormatVersion)format));
+
+    mapped_trie.mmap("marisa-test.dat",
+        MARISA_MAP_READ | MARISA_MAP_ADVISE | MARISA_MAP_HUGE_PAGES);
+    TestLookup(mapped_trie, keyset);
+
+    // A lock may fail because of a resource limit.
+    try {
+      mapped_trie.mmap("marisa-test.dat", MARISA_MAP_LOCK);
+      TestLookup(mapped_trie, keyset);
+    } catch (const marisa::Exception &ex) {
+      ASSERT(ex.error_code() == MARISA_IO_ERROR);
+    }
+  }
+
+  marisa::Trie mapped_trie;
+  EXCEPT(mapped_trie.mmap("marisa-test.dat", 0x100), MARISA_CODE_ERROR);
+
+  TEST_END();
+}
+
+void TestWarmUp() {
+  TEST_START();
+
+  marisa::Keyset keyset;
+  MakeKeyset(1000, MARISA_TEXT_TAIL, &keyset);
+
+  marisa::Trie trie;
+  EXCEPT(trie.warm_up(), MARISA_STATE_ERROR);
+  EXCEPT(trie.resident_size(), MARISA_STATE_ERROR);
+
+  trie.build(keyset, 3);
+  ASSERT(trie.resident_size() == trie.total_size());
+  ASSERT(trie.warm_up(0) == 0);
+  ASSERT(trie.warm_up(100) == 100);
+  ASSERT(trie.warm_up() != 0);
+  ASSERT(trie.warm_up() <= trie.io_size());
+
+  trie.save("marisa-test.dat");
+  trie.mmap("marisa-test.dat");
+  ASSERT(trie.resident_size() <= trie.io_size());
+
+  const std::size_t size = trie.warm_up();
+  ASSERT(size != 0);
+  ASSERT(trie.resident_size() != 0);
+  TestLookup(trie, keyset);
+
+  ASSERT(trie.warm_up(MARISA_SIZE_MAX, true) == size);
+  TestLookup(trie, keyset);
+  ASSERT(trie.warm_up(MARISA_SIZE_MAX, true) == size);
+  trie.clear();
+
+  trie.mmap("marisa-test.dat");
+  trie.warm_up(MARISA_SIZE_MAX, true);
+  marisa::Trie trie2;
+  trie2.swap(trie);
+  TestLookup(trie2, keyset);
+
+  TEST_END();
+}
+
+void TestPin() {
+  TEST_START();
+
+  marisa::Keyset keyset;
+  MakeKeyset(10000, MARISA_TEXT_TAIL, &keyset);
+
+  marisa::Trie trie;
+  EXCEPT(trie.pin(MARISA_SIZE_MAX), MARISA_STATE_ERROR);
+
+  trie.build(keyset, 3);
+  EXCEPT(trie.pin(MARISA_SIZE_MAX), MARISA_STATE_ERROR);
+
+  for (int format = MARISA_FORMAT_V1; format <= MARISA_FORMAT_V2; ++format) {
+    marisa::Trie built_trie;
+    built_trie.build(keyset, 3);
+    trie.clear();
+    built_trie.save("marisa-test.dat", (marisa::FormatVersion)format);
+    trie.mmap("marisa-test.dat");
+
+    std::size_t num_levels = 100;
+    ASSERT(trie.pin(0, &num_levels) == 0);
+    ASSERT(num_levels == 0);
+
+    // A lock may fail because of a resource limit.
+    try {
+      std::size_t prev_size = 0;
+      std::size_t prev_num_levels = 0;
+      const std::size_t budgets[] = { 4096, 16384, 65536, MARISA_SIZE_MAX };
+      for (std::size_t i = 0; i < 4; ++i) {
+        const std::size_t size = trie.pin(budgets[i], &num_levels);
+        ASSERT(size >= prev_size);
+        ASSERT(num_levels >= prev_num_levels);
+        prev_size = size;
+        prev_num_levels = num_levels;
+      }
+      ASSERT(num_levels != 0);
+      ASSERT(prev_size <= (trie.io_size((marisa::FormatVersion)format) +
+          (4096 * 16)));
+    } catch (const marisa::Exception &ex) {
+      ASSERT(ex.error_code() == MARISA_IO_ERROR);
+    }
+    TestLookup(trie, keyset);
+  }
+
+  TEST_END();
+}
+
+void TestProfile() {
+  TEST_START();
+
+  marisa::Keyset keyset;
+  MakeKeyset(1000, MARISA_TEXT_TAIL, &keyset);
+
+  marisa::Trie trie;
+  marisa::Agent agent;
+  agent.set_query("");
+  EXCEPT(trie.profile(agent), MARISA_STATE_ERROR);
+  EXCEPT(trie.rebuild_cache(), MARISA_STATE_ERROR);
+
+  trie.build(keyset, 2);
+  trie.save("marisa-test.dat", MARISA_FORMAT_V2);
+  std::string buf;
+  ReadFile("marisa-test.dat", &buf);
+
+  // A cache without a profile is not changed.
+  trie.rebuild_cache();
+
+  trie.clear();
+  trie.mmap("marisa-test.dat");
+  for (std::size_t i = 0; i < keyset.size(); i += 10) {
+    for (std::size_t j = 0; j < 10; ++j) {
+      agent.set_query(keyset[i].ptr(), keyset[i].length());
+      ASSERT(trie.profile(agent));
+      ASSERT(agent.key().id() == keyset[i].id());
+    }
+  }
+  agent.set_query("x");
+  ASSERT(!trie.profile(agent));
+
+  trie.rebuild_cache();
+  ASSERT(trie.num_tries() == 2);
+  TestLookup(trie, keyset);
+  TestCommonPrefixSearch(trie, keyset);
+  TestPredictiveSearch(trie, keyset);
+
+  // The dictionary is saved with the new cache, which is all that differs.
+  marisa::Trie rebuilt_trie;
+  rebuilt_trie.map(buf.data(), buf.size());
+  ASSERT(rebuilt_trie.io_size(MARISA_FORMAT_V2) == buf.size());
+  std::stringstream stream;
+  marisa::write(stream, trie, MARISA_FORMAT_V2);
+  const std::string rebuilt_buf = stream.str();
+  ASSERT(rebuilt_buf.size() == buf.size());
+  ASSERT(rebuilt_buf != buf);
+
+  stream >> rebuilt_trie;
+  TestLookup(rebuilt_trie, keyset);
+  TestPredictiveSearch(rebuilt_trie, keyset);
+
+  trie.clear_profile();
+  trie.rebuild_cache();
+  TestLookup(trie, keyset);
+
+  TEST_END();
+}
+
+void TestCacheLayout() {
+  TEST_START();
+
+  marisa::Keyset keyset;
+  MakeKeyset(1000, MARISA_TEXT_TAIL, &keyset);
+
+  marisa::Trie trie;
+  trie.build(keyset, 3);
+  ASSERT(trie.cache_layout() == MARISA_DIRECT_CACHE);
+  const std::size_t direct_size = trie.io_size();
+
+  // build() overwrites the weights with the key IDs.
+  for (std::size_t i = 0; i < keyset.size(); ++i) {
+    keyset[i].set_weight(1.0F);
+  }
+  trie.build(keyset, 3 | MARISA_ASSOCIATIVE_CACHE);
+  ASSERT(trie.num_tries() == 3);
+  ASSERT(trie.cache_layout() == MARISA_ASSOCIATIVE_CACHE);
+  ASSERT(trie.io_size() < (direct_size + (128 * trie.num_tries())));
+  TestLookup(trie, keyset);
+  TestCommonPrefixSearch(trie, keyset);
+  TestPredictiveSearch(trie, keyset);
+
+  trie.save("marisa-test.dat");
+  trie.clear();
+  trie.load("marisa-test.dat");
+  ASSERT(trie.cache_layout() == MARISA_ASSOCIATIVE_CACHE);
+  TestLookup(trie, keyset);
+
+  trie.save("marisa-test.dat", MARISA_FORMAT_V2);
+  trie.clear();
+  trie.mmap("marisa-test.dat", MARISA_MAP_ADVISE);
+  ASSERT(trie.cache_layout() == MARISA_ASSOCIATIVE_CACHE);
+  TestLookup(trie, keyset);
+  TestPredictiveSearch(trie, keyset);
+
+  marisa::Agent agent;
+  for (std::size_t i = 0; i < keyset.size(); i += 7) {
+    agent.set_query(keyset[i].ptr(), keyset[i].length());
+    ASSERT(trie.profile(agent));
+  }
+  trie.rebuild_cache();
+  TestLookup(trie, keyset);
+  TestCommonPrefixSearch(trie, keyset);
+
+  {
+    std::stringstream stream;
+    marisa::write(stream, trie, MARISA_FORMAT_V2);
+    trie.clear();
+    stream >> trie;
+  }
+  ASSERT(trie.cache_layout() == MARISA_ASSOCIATIVE_CACHE);
+  TestLookup(trie, keyset);
+
+  EXCEPT(trie.build(keyset, MARISA_CACHE_LAYOUT_MASK), MARISA_CODE_ERROR);
+
+  TEST_END();
+}
+
+void TestCacheLevels() {
+  TEST_START();
+
+  marisa::Keyset keyset;
+  MakeKeyset(5000, MARISA_TEXT_TAIL, &keyset);
+
+  marisa::Trie trie;
+  EXCEPT(trie.cache_size(), MARISA_STATE_ERROR);
+
+  trie.build(keyset, 3 | MARISA_TINY_CACHE);
+  ASSERT(trie.num_tries() == 3);
+  std::size_t tiny_sizes[3];
+  for (std::size_t i = 0; i < 3; ++i) {
+    tiny_sizes[i] = trie.cache_size(i);
+  }
+  EXCEPT(trie.cache_size(3), MARISA_BOUND_ERROR);
+  for (std::size_t i = 0; i < keyset.size(); ++i) {
+    keyset[i].set_weight(1.0F);
+  }
+
+  // The nested tries get larger caches than the first trie.
+  const marisa::CacheLevel cache_levels[] = {
+    MARISA_TINY_CACHE, MARISA_HUGE_CACHE
+  };
+  trie.build(keyset, 3 | MARISA_TINY_CACHE, cache_levels, 2);
+  ASSERT(trie.cache_level() == MARISA_TINY_CACHE);
+  ASSERT(trie.cache_size(0) == tiny_sizes[0]);
+  ASSERT(trie.cache_size(1) > tiny_sizes[1]);
+  ASSERT(trie.cache_size(2) == tiny_sizes[2]);
+  TestLookup(trie, keyset);
+  TestCommonPrefixSearch(trie, keyset);
+  TestPredictiveSearch(trie, keyset);
+
+  trie.save("marisa-test.dat");
+  trie.clear();
+  trie.mmap("marisa-test.dat");
+  ASSERT(trie.cache_size(1) > tiny_sizes[1]);
+
+  ASSERT(trie.cache_hits(0) == 0);
+  ASSERT(trie.cache_misses(0) == 0);
+  marisa::Agent agent;
+  for (std::size_t i = 0; i < keyset.size(); ++i) {
+    agent.set_query(keyset[i].ptr(), keyset[i].length());
+    ASSERT(trie.profile(agent));
+  }
+  for (std::size_t i = 0; i < 3; ++i) {
+    ASSERT((trie.cache_hits(i) + trie.cache_misses(i)) != 0);
+  }
+  ASSERT(trie.cache_hits(1) != 0);
+  trie.clear_profile();
+  for (std::size_t i = 0; i < 3; ++i) {
+    ASSERT(trie.cache_hits(i) == 0);
+    ASSERT(trie.cache_misses(i) == 0);
+  }
+
+  const marisa::CacheLevel invalid_levels[] = {
+    (marisa::CacheLevel)(MARISA_TINY_CACHE | MARISA_HUGE_CACHE)
+  };
+  EXCEPT(trie.build(keyset, 0, invalid_levels, 1), MARISA_CODE_ERROR);
+  EXCEPT(trie.build(keyset, 0, NULL, 1), MARISA_NULL_ERROR);
+
+  TEST_END();
+}
+
+void TestRootTable(marisa::TailMode tail_mode, int num_tries) {
+  marisa::Keyset keyset;
+  MakeKeyset(1000, tail_mode, &keyset);
+
+  marisa::Trie plain_trie;
+  plain_trie.build(keyset, num_tries | tail_mode);
+  ASSERT(plain_trie.root_table() == MARISA_NO_ROOT_TABLE);
+
+  const marisa::RootTable root_tables[] = {
+    MARISA_ROOT_TABLE, MARISA_DEEP_ROOT_TABLE
+  };
+  for (std::size_t i = 0; i < 2; ++i) {
+    for (std::size_t j = 0; j < keyset.size(); ++j) {
+      keyset[j].set_weight(1.0F);
+    }
+    marisa::Trie trie;
+    trie.build(keyset, num_tries | tail_mode | root_tables[i]);
+    ASSERT(trie.root_table() == root_tables[i]);
+    ASSERT(trie.io_size(MARISA_FORMAT_V2) >
+        plain_trie.io_size(MARISA_FORMAT_V2));
+    ASSERT(trie.io_size() == plain_trie.io_size());
+    TestLookup(trie, keyset);
+    TestCommonPrefixSearch(trie, keyset);
+    TestPredictiveSearch(trie, keyset);
+
+    // Short and missing queries give the same results as without a table.
+    marisa::Agent agent;
+    marisa::Agent plain_agent;
+    char query[3];
+    for (std::size_t j = 0; j < 1000; ++j) {
+      const std::size_t length = j % 4;
+      for (std::size_t k = 0; k < length; ++k) {
+        query[k] = (char)(std::rand() % 12);
+        if (tail_mode == MARISA_TEXT_TAIL) {
+          query[k] += '0';
+        }
+      }
+      agent.set_query(query, length);
+      plain_agent.set_query(query, length);
+      ASSERT(trie.lookup(agent) == plain_trie.lookup(plain_agent));
+      bool found;
+      do {
+        found = trie.predictive_search(agent);
+        ASSERT(plain_trie.predictive_search(plain_agent) == found);
+        if (found) {
+          ASSERT(agent.key().id() == plain_agent.key().id());
+          ASSERT(agent.key().length() == plain_agent.key().length());
+          ASSERT(std::memcmp(agent.key().ptr(), plain_agent.key().ptr(),
+              agent.key().length()) == 0);
+        }
+      } while (found);
+    }
+
+    trie.save("marisa-test.dat", MARISA_FORMAT_V2);
+    trie.clear();
+    trie.mmap("marisa-test.dat", MARISA_MAP_ADVISE);
+    ASSERT(trie.root_table() == root_tables[i]);
+    TestLookup(trie, keyset);
+    TestPredictiveSearch(trie, keyset);
+
+    trie.clear();
+    trie.load("marisa-test.dat");
+    ASSERT(trie.root_table() == root_tables[i]);
+    TestLookup(trie, keyset);
+
+    // A v1 dictionary is saved without the table.
+    trie.save("marisa-test.dat");
+    trie.clear();
+    trie.load("marisa-test.dat");
+    ASSERT(trie.root_table() == MARISA_NO_ROOT_TABLE);
+    TestLookup(trie, keyset);
+  }
+}
+
+void TestRootTable() {
+  TEST_START();
+
+  for (int i = 1; i <= 3; ++i) {
+    TestRootTable(MARISA_TEXT_TAIL, i);
+    TestRootTable(MARISA_BINARY_TAIL, i);
+  }
+
+  TEST_END();
+}
+
+void TestLinkModes() {
+  TEST_START();
+
+  // A trie follows its links by the kernels selected for its TAIL or its
+  // next trie, which must be exchanged by swap().
+  marisa::Keyset text_keyset;
+  MakeKeyset(1000, MARISA_TEXT_TAIL, &text_keyset);
+  marisa::Keyset binary_keyset;
+  MakeKeyset(1000, MARISA_BINARY_TAIL, &binary_keyset);
+  marisa::Keyset nested_keyset;
+  MakeKeyset(1000, MARISA_TEXT_TAIL, &nested_keyset);
+
+  marisa::Trie text_trie;
+  text_trie.build(text_keyset, 1 | MARISA_TEXT_TAIL);
+  ASSERT(text_trie.tail_mode() == MARISA_TEXT_TAIL);
+  marisa::Trie binary_trie;
+  binary_trie.build(binary_keyset, 1 | MARISA_BINARY_TAIL);
+  ASSERT(binary_trie.tail_mode() == MARISA_BINARY_TAIL);
+  marisa::Trie nested_trie;
+  nested_trie.build(nested_keyset, 3);
+  ASSERT(nested_trie.num_tries() == 3);
+
+  text_trie.swap(binary_trie);
+  TestLookup(text_trie, binary_keyset);
+  TestPredictiveSearch(text_trie, binary_keyset);
+  TestLookup(binary_trie, text_keyset);
+  TestPredictiveSearch(binary_trie, text_keyset);
+
+  binary_trie.swap(nested_trie);
+  TestLookup(binary_trie, nested_keyset);
+  TestCommonPrefixSearch(binary_trie, nested_keyset);
+  TestPredictiveSearch(binary_trie, nested_keyset);
+  TestLookup(nested_trie, text_keyset);
+  TestCommonPrefixSearch(nested_trie, text_keyset);
+
+  text_trie.save("marisa-test.dat");
+  nested_trie.mmap("marisa-test.dat");
+  TestLookup(nested_trie, binary_keyset);
+  TestPredictiveSearch(nested_trie, binary_keyset);
+
+  binary_trie.save("marisa-test.dat", MARISA_FORMAT_V2);
+  text_trie.load("marisa-test.dat");
+  TestLookup(text_trie, nested_keyset);
+  TestPredictiveSearch(text_trie, nested_keyset);
+
+  TEST_END();
+}
+
+void TestDeepTries(marisa::TailMode tail_mode) {
+  TEST_START();
+
+  // Long keys over 2 labels make many nested tries, whose paths are
+  // followed without recursion. The keys are long enough to leave a TAIL
+  // in the last trie, so that its links are also followed.
+  marisa::Keyset keyset;
+  char key_buf[256];
+  for (std::size_t i = 0; i < 1000; ++i) {
+    const std::size_t length = 1 + (std::rand() % sizeof(key_buf));
+    for (std::size_t j = 0; j < length; ++j) {
+      key_buf[j] = (char)(std::rand() % 2);
+      if (tail_mode == MARISA_TEXT_TAIL) {
+        key_buf[j] += 'a';
+      }
+    }
+    keyset.push_back(key_buf, length);
+  }
+
+  marisa::Trie trie;
+  trie.build(keyset, 8 | tail_mode);
+  ASSERT(trie.num_tries() == 8);
+  ASSERT(trie.tail_mode() == tail_mode);
+
+  TestLookup(trie, keyset);
+  TestCommonPrefixSearch(trie, keyset);
+  TestPredictiveSearch(trie, keyset);
+
+  marisa::Agent agent;
+  agent.set_query("abc", 3);
+  ASSERT(!trie.lookup(agent));
+  agent.set_query("", 0);
+  std::size_t num_keys = 0;
+  while (trie.predictive_search(agent)) {
+    ++num_keys;
+  }
+  ASSERT(num_keys == trie.num_keys());
+
+  trie.save("marisa-test.dat", MARISA_FORMAT_V2);
+  trie.clear();
+  trie.mmap("marisa-test.dat");
+  TestLookup(trie, keyset);
+  TestPredictiveSearch(trie, keyset);
+
+  TEST_END();
+}
+
+void TestDeepTries() {
+  TestDeepTries(MARISA_TEXT_TAIL);
+  TestDeepTries(MARISA_BINARY_TAIL);
+}
+
+void TestTrieHandle() {
+  TEST_START();
+
+  marisa::Keyset keyset;
+  MakeKeyset(1000, MARISA_TEXT_TAIL, &keyset);
+
+  marisa::TrieHandle handle(2);
+  ASSERT(handle.empty());
+  ASSERT(handle.max_readers() == 2);
+
+  marisa::TrieHandle::Snapshot snapshot;
+  handle.acquire(&snapshot);
+  ASSERT(snapshot.empty());
+  EXCEPT(snapshot.trie(), MARISA_STATE_ERROR);
+
+  marisa::Trie trie;
+  EXCEPT(handle.publish(trie), MARISA_STATE_ERROR);
+
+  trie.build(keyset, 1);
+  trie.save("marisa-test.dat");
+  handle.publish(trie);
+  EXCEPT(trie.num_keys(), MARISA_STATE_ERROR);
+  ASSERT(!handle.empty());
+
+  handle.acquire(&snapshot);
+  ASSERT(!snapshot.empty());
+  ASSERT(snapshot->num_tries() == 1);
+  TestLookup(snapshot.trie(), keyset);
+
+  marisa::Agent agent;
+  agent.set_query(keyset[0].ptr(), keyset[0].length());
+  ASSERT(snapshot->lookup(agent));
+
+  // The old version is kept while the snapshot is held.
+  handle.mmap("marisa-test.dat");
+  ASSERT(handle.reclaim() == 1);
+  ASSERT(snapshot->num_tries() == 1);
+  ASSERT(std::string(agent.key().ptr(), agent.key().length()) ==
+      std::string(keyset[0].ptr(), keyset[0].length()));
+  TestLookup(snapshot.trie(), keyset);
+
+  marisa::TrieHandle::Snapshot snapshot2;
+  handle.acquire(&snapshot2);
+  TestLookup(snapshot2.trie(), keyset);
+
+  marisa::TrieHandle::Snapshot snapshot3;
+  EXCEPT(handle.acquire(&snapshot3), MARISA_SIZE_ERROR);
+
+  snapshot.release();
+  ASSERT(snapshot.empty());
+  ASSERT(handle.reclaim() == 0);
+
+  handle.acquire(&snapshot3);
+  ASSERT(!snapshot3.empty());
+  snapshot3.swap(snapshot);
+  ASSERT(snapshot3.empty());
+  TestLookup(snapshot.trie(), keyset);
+
+  trie.build(keyset, 2);
+  handle.publish(trie);
+  ASSERT(handle.reclaim() == 1);
+  snapshot.clear();
+  snapshot2.clear();
+  handle.synchronize();
+  ASSERT(handle.reclaim() == 0);
+
+  handle.acquire(&snapshot);
+  ASSERT(snapshot->num_tries() == 2);
+  TestLookup(snapshot.trie(), keyset);
+
+  EXCEPT(handle.load("no-such-file.dat"), MARISA_IO_ERROR);
+  ASSERT(handle.reclaim() == 0);
+  snapshot.release();
+
+  TEST_END();
+}
+
+void TestAllocator() {
+  TEST_START();
+
+  marisa::Keyset keyset;
+  MakeKeyset(1000, MARISA_TEXT_TAIL, &keyset);
+
+  marisa::HugePageAllocator allocator(4096);
+  marisa::ArenaAllocator arena;
+
+  marisa::Trie trie;
+  trie.set_allocator(&allocator, &arena);
+  trie.build(keyset, 3);
+  ASSERT(arena.used_size() != 0);
+  TestLookup(trie, keyset);
+  TestPredictiveSearch(trie, keyset);
+
+  trie.save("marisa-test.dat");
+  arena.clear();
+
+  marisa::Trie trie2;
+  trie2.set_allocator(&allocator);
+  trie2.load("marisa-test.dat");
+  ASSERT(arena.used_size() == 0);
+  TestLookup(trie2, keyset);
+
+  trie2.clear();
+  trie2.load("marisa-test.dat");
+  TestLookup(trie2, keyset);
+
+  TEST_END();
+}
+
+void TestNumaTrie() {
+  TEST_START();
+
+  marisa::Keyset keyset;
+  MakeKeyset(1000, MARISA_TEXT_TAIL, &keyset);
+
+  marisa::NumaTrie numa_trie;
+  ASSERT(numa_trie.num_replicas() == 0);
+  EXCEPT(numa_trie.local(), MARISA_STATE_ERROR);
+
+  const std::size_t num_nodes = marisa::NumaAllocator::num_nodes();
+  ASSERT(num_nodes != 0);
+  ASSERT(marisa::NumaAllocator::current_node() < num_nodes);
+  ASSERT(!marisa::NumaAllocator::has_memory(num_nodes));
+  std::size_t num_memory_nodes = 0;
+  for (std::size_t i = 0; i < num_nodes; ++i) {
+    if (marisa::NumaAllocator::has_memory(i)) {
+      ++num_memory_nodes;
+    }
+  }
+  ASSERT(num_memory_nodes != 0);
+
+  {
+    // A block which cannot be bound is kept and counted.
+    marisa::NumaAllocator allocator(num_nodes + 1000);
+    void * const ptr = allocator.allocate(100);
+    ASSERT(ptr != NULL);
+    ASSERT(allocator.unbound_size() == 100);
+    allocator.deallocate(ptr, 100);
+  }
+
+  marisa::Trie trie;
+  trie.build(keyset, 2);
+  numa_trie.replicate(trie);
+  ASSERT(numa_trie.num_replicas() == num_memory_nodes);
+  for (std::size_t i = 0; i < numa_trie.num_replicas(); ++i) {
+    ASSERT(marisa::NumaAllocator::has_memory(numa_trie.replica_node(i)));
+  }
+  ASSERT(numa_trie.num_keys() == trie.num_keys());
+  TestLookup(numa_trie.local(), keyset);
+
+  trie.save("marisa-test.dat");
+  numa_trie.load("marisa-test.dat", 2);
+  ASSERT(numa_trie.num_replicas() == 2);
+  ASSERT(numa_trie.replica_node(0) == 0);
+  ASSERT(numa_trie.replica_node(1) == 1);
+  ASSERT(numa_trie.replica_size(0) == trie.total_size());
+  ASSERT(numa_trie.replica_size(1) == trie.total_size());
+  ASSERT(numa_trie.total_size() == (trie.total_size() * 2));
+  EXCEPT(numa_trie.replica(2), MARISA_BOUND_ERROR);
+  TestLookup(numa_trie.replica(0), keyset);
+  TestLookup(numa_trie.replica(1), keyset);
+
+  marisa::Agent agent;
+  for (std::size_t i = 0; i < keyset.size(); ++i) {
+    agent.set_query(keyset[i].ptr(), keyset[i].length());
+    ASSERT(numa_trie.lookup(agent));
+    ASSERT(agent.key().id() == keyset[i].id());
+
+    agent.set_query(keyset[i].id());
+    numa_trie.reverse_lookup(agent);
+    ASSERT(agent.key().length() == keyset[i].length());
+  }
+
+  numa_trie.clear();
+  ASSERT(numa_trie.num_replicas() == 0);
+
+  TEST_END();
+}
+
+void TestTrieSet() {
+  TEST_START();
+
+  marisa::Keyset keysets[3];
+  marisa::Trie tries[3];
+  const char * const names[] = { "en", "ja", "fr" };
+  const marisa::Trie *trie_ptrs[3];
+  for (std::size_t i = 0; i < 3; ++i) {
+    MakeKeyset(100 * (i + 1), MARISA_TEXT_TAIL, &keysets[i]);
+    tries[i].build(keysets[i], (int)(i + 1));
+    trie_ptrs[i] = &tries[i];
+  }
+
+  for (int format = MARISA_FORMAT_V1; format <= MARISA_FORMAT_V2; ++format) {
+    marisa::TrieSet::save("marisa-test.dat", names, trie_ptrs, 3,
+        (marisa::FormatVersion)format);
+
+    marisa::TrieSet set;
+    set.mmap("marisa-test.dat");
+    ASSERT(set.size() == 3);
+    ASSERT(set.names().num_keys() == 3);
+    ASSERT(set.num_opened() == 0);
+
+    ASSERT(set.get("de") == NULL);
+    ASSERT(set.get("") == NULL);
+    const marisa::Trie *ja = set.get("ja");
+    ASSERT(ja != NULL);
+    ASSERT(set.num_opened() == 1);
+    ASSERT(ja->num_tries() == 2);
+    TestLookup(*ja, keysets[1]);
+    ASSERT(set.get("ja", 2) == ja);
+
+    for (std::size_t i = 0; i < 3; ++i) {
+      const marisa::Trie *trie = set.get(names[i]);
+      ASSERT(trie != NULL);
+      ASSERT(trie->num_keys() == tries[i].num_keys());
+      TestLookup(*trie, keysets[i]);
+    }
+    ASSERT(set.num_opened() == 3);
+    EXCEPT(set.get(3), MARISA_BOUND_ERROR);
+
+    set.clear();
+    ASSERT(set.size() == 0);
+  }
+
+  const char * const same_names[] = { "en", "en" };
+  EXCEPT(marisa::TrieSet::save("marisa-test.dat", same_names, trie_ptrs, 2),
+      MARISA_CODE_ERROR);
+
+  marisa::TrieSet set;
+  marisa::TrieSet::save("marisa-test.dat", names, trie_ptrs, 0);
+  set.mmap("marisa-test.dat");
+  ASSERT(set.size() == 0);
+  ASSERT(set.get("en") == NULL);
+
+  tries[0].save("marisa-test.dat");
+  EXCEPT(set.mmap("marisa-test.dat"), MARISA_FORMAT_ERROR);
+
+  TEST_END();
+}
+
+class CountingObserver : public marisa::BuildObserver {
+ public:
+  CountingObserver()
+      : BuildObserver(), num_begins_(0), num_ends_(0), max_trie_id_(0),
+        num_tail_builds_(0), num_terminal_builds_(0), num_nodes_(0),
+        prev_total_time_(0.0) {}
+
+  void begin(const Event &event) {
+    ASSERT(num_begins_ == num_ends_);
+    ASSERT(event.total_time() >= prev_total_time_);
+    ++num_begins_;
+  }
+
+  void end(const Event &event) {
+    ASSERT(num_begins_ == (num_ends_ + 1));
+    ASSERT(event.time() >= 0.0);
+    ASSERT(event.total_time() >= event.time());
+    ++num_ends_;
+    if (event.trie_id() > max_trie_id_) {
+      max_trie_id_ = event.trie_id();
+    }
+    // The peak is counted from the beginning of the build, so that it does
+    // not wrap around below 0.
+    ASSERT(event.peak_bytes() < ((std::size_t)1 << 30));
+    if (event.phase() == BUILD_TAIL) {
+      ASSERT(event.num_allocated_bytes() != 0);
+      ASSERT(event.peak_bytes() != 0);
+      ++num_tail_builds_;
+    } else if (event.phase() == BUILD_TERMINALS) {
+      ASSERT(event.trie_id() == 1);
+      ++num_terminal_builds_;
+      num_nodes_ = event.num_nodes();
+    }
+    prev_total_time_ = event.total_time();
+  }
+
+  std::size_t num_begins() const {
+    return num_begins_;
+  }
+  std::size_t max_trie_id() const {
+    return max_trie_id_;
+  }
+  std::size_t num_tail_builds() const {
+    return num_tail_builds_;
+  }
+  std::size_t num_terminal_builds() const {
+    return num_terminal_builds_;
+  }
+  std::size_t num_nodes() const {
+    return num_nodes_;
+  }
+
+ private:
+  std::size_t num_begins_;
+  std::size_t num_ends_;
+  std::size_t max_trie_id_;
+  std::size_t num_tail_builds_;
+  std::size_t num_terminal_builds_;
+  std::size_t num_nodes_;
+  double prev_total_time_;
+};
+
+void TestResultCache(const marisa::Trie &trie, const marisa::Keyset &keyset,
+    marisa::ResultCache &cache) {
+  marisa::Agent agent;
+  for (std::size_t i = 0; i < (keyset.size() * 4); ++i) {
+    // Half of the queries are for the first 8 keys.
+    const std::size_t key_pos = ((i % 2) == 0) ?
+        (std::rand() % 8) : (std::rand() % keyset.size());
+    const marisa::Key &key = keyset[key_pos];
+
+    agent.set_query(key.ptr(), key.length());
+    ASSERT(cache.lookup(trie, agent));
+    ASSERT(agent.key().id() == key.id());
+
+    agent.set_query(key.id());
+    cache.reverse_lookup(trie, agent);
+    ASSERT(agent.key().id() == key.id());
+    ASSERT(agent.key().length() == key.length());
+    ASSERT((key.length() == 0) ||
+        (std::memcmp(agent.key().ptr(), key.ptr(), key.length()) == 0));
+  }
+}
+
+std::size_t CountHotHits(const marisa::Trie &trie,
+    const marisa::Keyset &keyset, marisa::ResultCache &cache) {
+  // Each of 4 hot keys is queried between keys queried only once.
+  marisa::Agent agent;
+  for (std::size_t i = 4; i < keyset.size(); ++i) {
+    agent.set_query(keyset[i % 4].ptr(), keyset[i % 4].length());
+    cache.lookup(trie, agent);
+    agent.set_query(keyset[i].ptr(), keyset[i].length());
+    cache.lookup(trie, agent);
+  }
+  return cache.num_hits();
+}
+
+void TestResultCache() {
+  TEST_START();
+
+  marisa::Keyset keyset;
+  MakeKeyset(1000, MARISA_TEXT_TAIL, &keyset);
+  marisa::Trie trie;
+  marisa::ResultCache cache(62);
+  marisa::Agent agent;
+
+  EXCEPT(cache.lookup(trie, agent), MARISA_STATE_ERROR);
+  EXCEPT(marisa::ResultCache(4, (marisa::AdmissionPolicy)2),
+      MARISA_CODE_ERROR);
+
+  trie.build(keyset);
+
+  ASSERT(cache.capacity() == 64);
+  ASSERT(cache.admission_policy() == MARISA_DEFAULT_ADMISSION);
+  ASSERT(cache.max_key_length() ==
+      marisa::ResultCache::DEFAULT_MAX_KEY_LENGTH);
+  ASSERT(cache.size() == 0);
+  ASSERT(cache.hit_rate() == 0.0);
+
+  TestResultCache(trie, keyset, cache);
+  ASSERT(cache.num_hits() != 0);
+  ASSERT(cache.num_misses() != 0);
+  ASSERT(cache.size() != 0);
+  ASSERT(cache.size() <= cache.capacity());
+  ASSERT(cache.hit_rate() > 0.0);
+
+  cache.clear_counts();
+  ASSERT(cache.num_hits() == 0);
+  ASSERT(cache.num_misses() == 0);
+  ASSERT(cache.num_rejections() == 0);
+
+  // Missing keys are also kept.
+  marisa::ResultCache lru_cache(16, MARISA_ADMIT_ALL);
+  agent.set_query("x");
+  ASSERT(!lru_cache.lookup(trie, agent));
+  ASSERT(!lru_cache.lookup(trie, agent));
+  ASSERT(lru_cache.num_hits() == 1);
+  ASSERT(lru_cache.num_misses() == 1);
+  TestResultCache(trie, keyset, lru_cache);
+  ASSERT(lru_cache.num_rejections() == 0);
+
+  // The results of another dictionary are discarded.
+  marisa::Keyset keyset2;
+  MakeKeyset(1000, MARISA_BINARY_TAIL, &keyset2);
+  marisa::Trie trie2;
+  trie2.build(keyset2, MARISA_BINARY_TAIL);
+  trie.swap(trie2);
+  TestResultCache(trie, keyset2, cache);
+  TestResultCache(trie2, keyset, cache);
+
+  for (std::size_t i = 0; i < keyset.size(); ++i) {
+    keyset[i].set_weight(1.0F);
+  }
+  trie2.build(keyset, 2 | MARISA_LABEL_ORDER);
+  TestResultCache(trie2, keyset, cache);
+
+  cache.invalidate();
+  ASSERT(cache.size() == 0);
+
+  // Long keys are not kept.
+  marisa::ResultCache short_cache(16, MARISA_ADMIT_ALL, 2);
+  TestResultCache(trie2, keyset, short_cache);
+  ASSERT(short_cache.size() <= 16);
+
+  marisa::ResultCache empty_cache(0);
+  ASSERT(empty_cache.capacity() == 0);
+  TestResultCache(trie2, keyset, empty_cache);
+  ASSERT(empty_cache.num_hits() == 0);
+  ASSERT(empty_cache.size() == 0);
+
+  // Keys queried once do not evict hot keys.
+  marisa::ResultCache frequent_cache(4, MARISA_ADMIT_FREQUENT);
+  marisa::ResultCache recent_cache(4, MARISA_ADMIT_ALL);
+  ASSERT(CountHotHits(trie2, keyset, frequent_cache) >
+      CountHotHits(trie2, keyset, recent_cache));
+  ASSERT(frequent_cache.num_rejections() != 0);
+
+  marisa::ResultCache temp_cache(8);
+  temp_cache.swap(frequent_cache);
+  ASSERT(temp_cache.capacity() == 4);
+  ASSERT(temp_cache.num_rejections() != 0);
+  ASSERT(frequent_cache.capacity() == 8);
+
+  TEST_END();
+}
+
+void TestStats() {
+  TEST_START();
+
+  marisa::Stats stats;
+  for (std::size_t i = 0; i < marisa::Stats::NUM_COUNTERS; ++i) {
+    const marisa::Stats::Counter counter = (marisa::Stats::Counter)i;
+    ASSERT(stats[counter] == 0);
+    ASSERT(std::strcmp(marisa::Stats::counter_name(counter), "unknown") != 0);
+    stats.add(counter, i);
+  }
+  marisa::Stats stats2;
+  stats2.add(stats);
+  stats2.add(stats);
+  ASSERT(stats2[marisa::Stats::RANK1_CALLS] ==
+      (2 * marisa::Stats::RANK1_CALLS));
+  stats2.clear();
+  ASSERT(stats2[marisa::Stats::RANK1_CALLS] == 0);
+
+  marisa::Keyset keyset;
+  MakeKeyset(1000, MARISA_TEXT_TAIL, &keyset);
+  marisa::Trie trie;
+  EXCEPT(trie.stats(), MARISA_STATE_ERROR);
+  trie.build(keyset, 3);
+
+  marisa::Agent agent;
+  marisa::Agent agent2;
+  for (std::size_t i = 0; i < keyset.size(); ++i) {
+    agent.set_query(keyset[i].ptr(), keyset[i].length());
+    ASSERT(trie.lookup(agent));
+    agent2.set_query(keyset[i].id());
+    trie.reverse_lookup(agent2);
+  }
+  agent.set_query("");
+  while (trie.predictive_search(agent)) {
+    continue;
+  }
+
+  stats = agent.stats();
+  stats.add(agent2.stats());
+  for (std::size_t i = 0; i < marisa::Stats::NUM_COUNTERS; ++i) {
+    const marisa::Stats::Counter counter = (marisa::Stats::Counter)i;
+    ASSERT(trie.stats()[counter] == stats[counter]);
+    if (marisa::Stats::is_enabled()) {
+      ASSERT(stats[counter] != 0);
+    } else {
+      ASSERT(stats[counter] == 0);
+    }
+  }
+
+  marisa::Agent agent3;
+  const marisa::Agent &const_agent3 = agent3;
+  ASSERT(const_agent3.stats()[marisa::Stats::NODES_VISITED] == 0);
+  agent3.swap(agent);
+  ASSERT(const_agent3.stats()[marisa::Stats::NODES_VISITED] ==
+      stats[marisa::Stats::NODES_VISITED] -
+      agent2.stats()[marisa::Stats::NODES_VISITED]);
+  ASSERT(agent.stats()[marisa::Stats::NODES_VISITED] == 0);
+  agent3.clear();
+  ASSERT(const_agent3.stats()[marisa::Stats::NODES_VISITED] == 0);
+
+  agent2.stats().clear();
+  ASSERT(agent2.stats()[marisa::Stats::NODES_VISITED] == 0);
+  trie.clear_stats();
+  ASSERT(trie.stats()[marisa::Stats::NODES_VISITED] == 0);
+
+  TEST_END();
+}
+
+void TestDescribe() {
+  TEST_START();
+
+  marisa::Keyset keyset;
+  MakeKeyset(1000, MARISA_TEXT_TAIL, &keyset);
+
+  marisa::Trie trie;
+  marisa::Description description;
+  EXCEPT(trie.describe(&description), MARISA_STATE_ERROR);
+
+  trie.build(keyset, 3 | MARISA_ASSOCIATIVE_CACHE | MARISA_ROOT_TABLE);
+  EXCEPT(trie.describe(NULL), MARISA_NULL_ERROR);
+  trie.describe(&description);
+
+  ASSERT(description.num_levels() != 0);
+  ASSERT(description.num_levels() <= trie.num_tries());
+  ASSERT(description.get(0, marisa::Description::NUM_NODES) ==
+      trie.num_nodes());
+  ASSERT(description.get(0, marisa::Description::NUM_TERMINALS) ==
+      trie.num_keys());
+  ASSERT(description.get(0, marisa::Description::ROOT_TABLE_SIZE) != 0);
+  EXCEPT(description.get(description.num_levels(),
+      marisa::Description::NUM_NODES), MARISA_BOUND_ERROR);
+
+  std::size_t total_size = 0;
+  for (std::size_t i = 0; i < description.num_levels(); ++i) {
+    total_size += description.size(i);
+    std::size_t num_nodes = 0;
+    for (std::size_t j = 0; j < marisa::Description::NUM_FANOUT_BUCKETS;
+        ++j) {
+      num_nodes += description.fanout(i, j);
+    }
+    ASSERT(num_nodes == description.get(i, marisa::Description::NUM_NODES));
+    ASSERT(description.get(i, marisa::Description::NUM_CACHE_ENTRIES) != 0);
+    ASSERT(description.link_ratio(i) >= 0.0);
+    ASSERT(description.link_ratio(i) <= 1.0);
+    ASSERT(description.cache_fill_ratio(i) > 0.0);
+    ASSERT(description.cache_fill_ratio(i) <= 1.0);
+  }
+  ASSERT(total_size == trie.total_size());
+  ASSERT(description.sharing_ratio() >= 0.0);
+  ASSERT(description.sharing_ratio() < 1.0);
+
+  std::size_t num_keys = 0;
+  for (std::size_t i = 0; i < marisa::Description::NUM_DEPTH_BUCKETS; ++i) {
+    num_keys += description.key_depth(i);
+  }
+  ASSERT(num_keys == trie.num_keys());
+
+  for (std::size_t i = 0; i < marisa::Description::NUM_ITEMS; ++i) {
+    ASSERT(std::strcmp(marisa::Description::item_name(
+        (marisa::Description::Item)i), "unknown") != 0);
+  }
+
+  marisa::Description description2;
+  description2.swap(description);
+  ASSERT(description.num_levels() == 0);
+  ASSERT(description2.size(0) != 0);
+  description2.clear();
+  ASSERT(description2.num_levels() == 0);
+  ASSERT(description2.key_depth(0) == 0);
+
+  // A few keys leave most of the cache empty in either layout.
+  keyset.reset();
+  keyset.push_back("apple");
+  keyset.push_back("banana");
+  keyset.push_back("cherry");
+  trie.build(keyset, 1);
+  trie.describe(&description);
+  ASSERT(description.get(0, marisa::Description::NUM_FILLED_CACHE_ENTRIES) <
+      description.get(0, marisa::Description::NUM_CACHE_ENTRIES));
+  ASSERT(description.get(0, marisa::Description::NUM_FILLED_CACHE_ENTRIES) <
+      trie.num_nodes());
+  ASSERT(description.cache_fill_ratio(0) < 1.0);
+  trie.build(keyset, 1 | MARISA_ASSOCIATIVE_CACHE);
+  trie.describe(&description);
+  ASSERT(description.get(0, marisa::Description::NUM_FILLED_CACHE_ENTRIES) <
+      description.get(0, marisa::Description::NUM_CACHE_ENTRIES));
+  ASSERT(description.cache_fill_ratio(0) < 1.0);
+
+  TEST_END();
+}
+
+void TestObserver() {
+  TEST_START();
+
+  marisa::Keyset keyset;
+  MakeKeyset(1000, MARISA_TEXT_TAIL, &keyset);
+
+  CountingObserver observer;
+  marisa::Trie trie;
+  trie.build(keyset, 3, &observer);
+
+  ASSERT(observer.num_begins() > 0);
+  ASSERT(observer.max_trie_id() == trie.num_tries());
+  ASSERT(observer.num_tail_builds() == 1);
+  ASSERT(observer.num_terminal_builds() == 1);
+  ASSERT(observer.num_nodes() == trie.num_nodes());
+
+  ASSERT(std::strcmp(marisa::BuildObserver::phase_name(
+      marisa::BuildObserver::SORT_KEYS), "sort keys") == 0);
+
+  TEST_END();
+}
+
+void TestMerge() {
+  TEST_START();
+
+  marisa::Keyset keysets[3];
+  MakeKeyset(1000, MARISA_TEXT_TAIL, &keysets[0]);
+  MakeKeyset(1000, MARISA_BINARY_TAIL, &keysets[1]);
+  for (std::size_t i = 0; i < 500; ++i) {
+    keysets[2].push_back(keysets[0][i]);
+    keysets[2].push_back(keysets[1][i]);
+  }
+  keysets[2].push_back("");
+
+  marisa::Trie tries[3];
+  tries[0].build(keysets[0], 1 | MARISA_WEIGHT_ORDER);
+  tries[1].build(keysets[1], 2 | MARISA_LABEL_ORDER | MARISA_BINARY_TAIL);
+  tries[2].build(keysets[2], 3 | MARISA_WEIGHT_ORDER);
+
+  const marisa::Trie *sources[] = { &tries[0], &tries[1], &tries[2] };
+  const float weights[] = { 1.0F, 2.0F, 4.0F };
+
+  marisa::Trie trie;
+  trie.merge(sources, 3, MARISA_LABEL_ORDER, weights);
+
+  marisa::Agent agent;
+  std::size_t num_keys = 0;
+  for (std::size_t i = 0; i < 3; ++i) {
+    num_keys += tries[i].num_keys();
+    agent.set_query("");
+    while (tries[i].predictive_search(agent)) {
+      marisa::Agent query_agent;
+      query_agent.set_query(agent.key().ptr(), agent.key().length());
+      ASSERT(trie.lookup(query_agent));
+    }
+  }
+  ASSERT(trie.num_keys() < num_keys);
+
+  std::size_t num_merged_keys = 0;
+  std::string prev_key;
+  agent.set_query("");
+  while (trie.predictive_search(agent)) {
+    const std::string key(agent.key().ptr(), agent.key().length());
+    ASSERT((num_merged_keys == 0) || (prev_key < key));
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < 3; ++i) {
+      marisa::Agent query_agent;
+      query_agent.set_query(key.c_str(), key.length());
+      if (tries[i].lookup(query_agent)) {
+        ++count;
+      }
+    }
+    ASSERT(count > 0);
+    prev_key = key;
+    ++num_merged_keys;
+  }
+  ASSERT(num_merged_keys == trie.num_keys());
+
+  trie.merge(sources, 1, MARISA_WEIGHT_ORDER);
+  ASSERT(trie.num_keys() == tries[0].num_keys());
+  for (std::size_t i = 0; i < keysets[0].size(); ++i) {
+    agent.set_query(keysets[0][i].ptr(), keysets[0][i].length());
+    ASSERT(trie.lookup(agent));
+  }
+
+  const marisa::Trie *self[] = { &trie, &tries[1] };
+  trie.merge(self, 2, 0, NULL, MARISA_MAX_WEIGHTS);
+  ASSERT(trie.num_keys() > tries[0].num_keys());
+
+  // The weights of a key in more than one source are combined, and the
+  // keys get their IDs in descending order of the combined weights.
+  marisa::Keyset weighted_keysets[3];
+  weighted_keysets[0].push_back("a");
+  weighted_keysets[1].push_back("b");
+  weighted_keysets[1].push_back("c");
+  weighted_keysets[2].push_back("b");
+  marisa::Trie weighted_tries[3];
+  for (std::size_t i = 0; i < 3; ++i) {
+    weighted_tries[i].build(weighted_keysets[i]);
+  }
+  const marisa::Trie *weighted_sources[] = {
+    &weighted_tries[0], &weighted_tries[1], &weighted_tries[2]
+  };
+  const float source_weights[] = { 3.0F, 1.5F, 2.0F };
+
+  // MARISA_SUM_WEIGHTS: a = 3.0, b = 1.5 + 2.0, c = 1.5.
+  trie.merge(weighted_sources, 3, MARISA_WEIGHT_ORDER, source_weights,
+      MARISA_SUM_WEIGHTS);
+  ASSERT(trie.num_keys() == 3);
+  agent.set_query("");
+  ASSERT(trie.predictive_search(agent));
+  ASSERT(std::string(agent.key().ptr(), agent.key().length()) == "b");
+  ASSERT(agent.key().id() == 0);
+  ASSERT(trie.predictive_search(agent));
+  ASSERT(std::string(agent.key().ptr(), agent.key().length()) == "a");
+  ASSERT(agent.key().id() == 1);
+  ASSERT(trie.predictive_search(agent));
+  ASSERT(std::string(agent.key().ptr(), agent.key().length()) == "c");
+  ASSERT(agent.key().id() == 2);
+  ASSERT(!trie.predictive_search(agent));
+
+  // MARISA_MAX_WEIGHTS: a = 3.0, b = 2.0, c = 1.5.
+  trie.merge(weighted_sources, 3, MARISA_WEIGHT_ORDER, source_weights,
+      MARISA_MAX_WEIGHTS);
+  ASSERT(trie.num_keys() == 3);
+  agent.set_query("");
+  ASSERT(trie.predictive_search(agent));
+  ASSERT(std::string(agent.key().ptr(), agent.key().length()) == "a");
+  ASSERT(agent.key().id() == 0);
+  ASSERT(trie.predictive_search(agent));
+  ASSERT(std::string(agent.key().ptr(), agent.key().length()) == "b");
+  ASSERT(agent.key().id() == 1);
+  ASSERT(trie.predictive_search(agent));
+  ASSERT(std::string(agent.key().ptr(), agent.key().length()) == "c");
+  ASSERT(agent.key().id() == 2);
+  ASSERT(!trie.predictive_search(agent));
+
+  trie.merge(NULL, 0);
+  ASSERT(trie.num_keys() == 0);
+
+  marisa::Trie empty_trie;
+  const marisa::Trie *invalid_sources[] = { &empty_trie };
+  EXCEPT(trie.merge(invalid_sources, 1), MARISA_STATE_ERROR);
+  EXCEPT(trie.merge(sources, 3, 0, NULL, (marisa::MergeMode)2),
+      MARISA_CODE_ERROR);
+
+  TEST_END();
+}
+
+void TestTuner() {
+  TEST_START();
+
+  marisa::Keyset keyset;
+  MakeKeyset(1000, MARISA_TEXT_TAIL, &keyset);
+
+  marisa::Tuner tuner;
+  tuner.set_num_samples(500);
+  tuner.set_num_tries(1, 3);
+
+  for (int i = 0; i < 2; ++i) {
+    tuner.set_objective((i == 0) ?
+        marisa::Tuner::MIN_SIZE : marisa::Tuner::MIN_TIME);
+    const int flags = tuner.tune(keyset, MARISA_LABEL_ORDER);
+    ASSERT(flags == tuner.flags());
+    ASSERT(tuner.num_candidates() > 0);
+    ASSERT(tuner.size() > 0);
+
+    marisa::Trie trie;
+    trie.build(keyset, flags);
+
+    ASSERT(trie.num_tries() == (std::size_t)(flags & MARISA_NUM_TRIES_MASK));
+    ASSERT(trie.num_tries() >= 1);
+    ASSERT(trie.num_tries() <= 3);
+    ASSERT(trie.node_order() == MARISA_LABEL_ORDER);
+
+    TestLookup(trie, keyset);
+
+    trie.save("marisa-test.dat");
+    trie.clear();
+    trie.load("marisa-test.dat");
+
+    ASSERT(trie.num_tries() == (std::size_t)(flags & MARISA_NUM_TRIES_MASK));
+    ASSERT(trie.cache_level() == (flags & MARISA_CACHE_LEVEL_MASK));
+    ASSERT(trie.tail_mode() == (flags & MARISA_TAIL_MODE_MASK));
+    ASSERT(trie.node_order() == MARISA_LABEL_ORDER);
+
+    TestLookup(trie, keyset);
+  }
+
+  tuner.clear();
+  ASSERT(tuner.flags() == 0);
+  ASSERT(tuner.num_candidates() == 0);
+
+  TEST_END();
+}
+
 }  // namespace
 
 int main() try {
@@ -380,6 +1809,26 @@ int main() try {
   TestEmptyTrie();
   TestTinyTrie();
   TestTrie();
+  TestFormat();
+  TestMapFlags();
+  TestWarmUp();
+  TestPin();
+  TestProfile();
+  TestCacheLayout();
+  TestCacheLevels();
+  TestRootTable();
+  TestLinkModes();
+  TestDeepTries();
+  TestTrieHandle();
+  TestAllocator();
+  TestNumaTrie();
+  TestTrieSet();
+  TestResultCache();
+  TestStats();
+  TestDescribe();
+  TestObserver();
+  TestMerge();
+  TestTuner();
 
   return 0;
 } catch (const marisa::Exception &ex) {
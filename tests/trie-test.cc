@@ -1,10 +1,14 @@
 #include <algorithm>
 #include <cstring>
 #include <sstream>
+#include <string>
 
+#include <marisa/grimoire/trie/cache.h>
 #include <marisa/grimoire/trie/config.h>
 #include <marisa/grimoire/trie/header.h>
 #include <marisa/grimoire/trie/key.h>
+#include <marisa/grimoire/trie/louds-trie.h>
+#include <marisa/grimoire/trie/profile.h>
 #include <marisa/grimoire/trie/range.h>
 #include <marisa/grimoire/trie/tail.h>
 #include <marisa/grimoire/trie/state.h>
@@ -37,6 +41,48 @@ void TestConfig() {
   ASSERT(config.tail_mode() == MARISA_DEFAULT_TAIL);
   ASSERT(config.node_order() == MARISA_DEFAULT_ORDER);
   ASSERT(config.cache_level() == MARISA_DEFAULT_CACHE);
+  ASSERT(config.cache_layout() == MARISA_DEFAULT_CACHE_LAYOUT);
+  ASSERT(config.root_table() == MARISA_DEFAULT_ROOT_TABLE);
+
+  config.parse(MARISA_DIRECT_CACHE);
+  ASSERT(config.cache_layout() == MARISA_DIRECT_CACHE);
+  ASSERT((config.flags() & MARISA_CACHE_LAYOUT_MASK) == 0);
+
+  config.parse(MARISA_ASSOCIATIVE_CACHE);
+  ASSERT(config.cache_layout() == MARISA_ASSOCIATIVE_CACHE);
+  ASSERT((config.flags() & MARISA_CACHE_LAYOUT_MASK) ==
+      MARISA_ASSOCIATIVE_CACHE);
+
+  EXCEPT(config.parse(MARISA_CACHE_LAYOUT_MASK), MARISA_CODE_ERROR);
+
+  ASSERT(config.root_table() == MARISA_NO_ROOT_TABLE);
+  config.parse(MARISA_ROOT_TABLE);
+  ASSERT(config.root_table() == MARISA_ROOT_TABLE);
+  ASSERT((config.flags() & MARISA_ROOT_TABLE_MASK) == 0);
+  config.parse(MARISA_DEEP_ROOT_TABLE);
+  ASSERT(config.root_table() == MARISA_DEEP_ROOT_TABLE);
+  ASSERT((config.flags() & MARISA_ROOT_TABLE_MASK) == 0);
+  config.parse(MARISA_NO_ROOT_TABLE);
+  ASSERT(config.root_table() == MARISA_NO_ROOT_TABLE);
+
+  const marisa::CacheLevel cache_levels[] = {
+    MARISA_TINY_CACHE, MARISA_HUGE_CACHE
+  };
+  config.parse(MARISA_SMALL_CACHE);
+  config.set_cache_levels(cache_levels, 2);
+  ASSERT(config.cache_level() == MARISA_SMALL_CACHE);
+  ASSERT(config.cache_level(0) == MARISA_TINY_CACHE);
+  ASSERT(config.cache_level(1) == MARISA_HUGE_CACHE);
+  ASSERT(config.cache_level(2) == MARISA_SMALL_CACHE);
+
+  config.parse(0);
+  ASSERT(config.cache_level(0) == MARISA_DEFAULT_CACHE);
+
+  const marisa::CacheLevel invalid_levels[] = {
+    MARISA_TINY_CACHE, (marisa::CacheLevel)0
+  };
+  EXCEPT(config.set_cache_levels(invalid_levels, 2), MARISA_CODE_ERROR);
+  EXCEPT(config.set_cache_levels(NULL, 1), MARISA_NULL_ERROR);
 
   TEST_END();
 }
@@ -228,6 +274,76 @@ void TestEntry() {
   TEST_END();
 }
 
+void TestTailQueries(const marisa::grimoire::trie::Tail &tail,
+    const marisa::grimoire::Vector<marisa::grimoire::trie::Entry> &entries,
+    const marisa::grimoire::Vector<marisa::UInt32> &offsets) {
+  marisa::Agent agent;
+  agent.init_state();
+  marisa::grimoire::trie::State &state = agent.state();
+
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    const std::string key(entries[i].ptr(), entries[i].length());
+    state.key_buf().resize(0);
+    tail.restore(agent, offsets[i]);
+    ASSERT(state.key_buf().size() == key.length());
+    ASSERT(std::memcmp(state.key_buf().begin(), key.c_str(),
+        key.length()) == 0);
+
+    const std::string query = "x" + key + "y";
+    agent.set_query(query.c_str(), query.length());
+    state.set_query_pos(1);
+    ASSERT(tail.match(agent, offsets[i]));
+    ASSERT(state.query_pos() == (key.length() + 1));
+
+    state.key_buf().resize(0);
+    state.set_query_pos(1);
+    ASSERT(tail.prefix_match(agent, offsets[i]));
+    ASSERT(state.query_pos() == (key.length() + 1));
+    ASSERT(state.key_buf().size() == key.length());
+
+    // A mismatch in the first byte keeps the query position.
+    const std::string first_byte_query =
+        std::string("x") + (char)(key[0] ^ 1);
+    agent.set_query(first_byte_query.c_str(), first_byte_query.length());
+    state.set_query_pos(1);
+    ASSERT(!tail.match(agent, offsets[i]));
+    ASSERT(state.query_pos() == 1);
+    ASSERT(!tail.prefix_match(agent, offsets[i]));
+    ASSERT(state.query_pos() == 1);
+
+    if (key.length() < 2) {
+      continue;
+    }
+
+    // A query which ends in the suffix matches it as a prefix, and the
+    // whole suffix is restored.
+    agent.set_query(query.c_str(), key.length());
+    state.set_query_pos(1);
+    ASSERT(!tail.match(agent, offsets[i]));
+    ASSERT(state.query_pos() > 1);
+    state.key_buf().resize(0);
+    state.set_query_pos(1);
+    ASSERT(tail.prefix_match(agent, offsets[i]));
+    ASSERT(state.query_pos() == key.length());
+    ASSERT(state.key_buf().size() == key.length());
+    ASSERT(std::memcmp(state.key_buf().begin(), key.c_str(),
+        key.length()) == 0);
+
+    // A mismatch after the first byte moves the query position forward.
+    const std::string wrong_query = "x" + key.substr(0, 1) + "\xFF";
+    agent.set_query(wrong_query.c_str(), wrong_query.length());
+    state.set_query_pos(1);
+    agent.stats().clear();
+    ASSERT(!tail.match(agent, offsets[i]));
+    ASSERT(state.query_pos() > 1);
+    ASSERT(agent.stats()[marisa::Stats::TAIL_BYTES_COMPARED] ==
+        (marisa::Stats::is_enabled() ? 1U : 0U));
+    state.set_query_pos(1);
+    ASSERT(!tail.prefix_match(agent, offsets[i]));
+    ASSERT(state.query_pos() > 1);
+  }
+}
+
 void TestTextTail() {
   TEST_START();
 
@@ -286,6 +402,7 @@ void TestTextTail() {
     ASSERT(std::strlen(ptr) == entries[i].length());
     ASSERT(std::strcmp(ptr, entries[i].ptr()) == 0);
   }
+  TestTailQueries(tail, entries, offsets);
 
   {
     marisa::grimoire::Writer writer;
@@ -390,6 +507,7 @@ void TestBinaryTail() {
 
   ASSERT(offsets.size() == entries.size());
   ASSERT(offsets[0] == 0);
+  TestTailQueries(tail, entries, offsets);
 
   entries.clear();
   entry.set_str("abc", 3);
@@ -416,6 +534,7 @@ void TestBinaryTail() {
     const char * const ptr = &tail[offsets[i]];
     ASSERT(std::memcmp(ptr, entries[i].ptr(), entries[i].length()) == 0);
   }
+  TestTailQueries(tail, entries, offsets);
 
   TEST_END();
 }
@@ -487,6 +606,137 @@ void TestState() {
   TEST_END();
 }
 
+void TestCacheSet() {
+  TEST_START();
+
+  ASSERT(sizeof(marisa::grimoire::trie::CacheSet) == 64);
+
+  marisa::grimoire::trie::CacheSet set;
+
+  // The 4 heaviest of 6 entries are kept.
+  set.insert(1, 10, 3.0F, 'a');
+  set.insert(1, 11, 1.0F, 'b');
+  set.insert(2, 12, 5.0F, 'a');
+  set.insert(3, 13, 4.0F, 'c');
+  set.insert(4, 14, 2.0F, 'd');
+  set.insert(5, 15, 0.5F, 'e');
+  set.sort();
+
+  ASSERT(set[0].child() == 12);
+  ASSERT(set[1].child() == 13);
+  ASSERT(set[2].child() == 10);
+  ASSERT(set[3].child() == 14);
+  ASSERT(set.label(0) == 'a');
+  ASSERT(set.label(3) == 'd');
+
+  ASSERT(set.find(1, 'a') == &set[2]);
+  ASSERT(set.find(2, 'a') == &set[0]);
+  ASSERT(set.find(1, 'b') == NULL);
+  ASSERT(set.find(5, 'e') == NULL);
+
+  ASSERT(set.find(13) == &set[1]);
+  ASSERT(set.find(11) == NULL);
+
+  TEST_END();
+}
+
+bool IsAligned(const marisa::grimoire::trie::LoudsTrie &trie) {
+  return ((std::size_t)&trie.cache_sets()[0] %
+      marisa::grimoire::trie::CacheSet::ALIGNMENT) == 0;
+}
+
+void TestCacheSetAlignment() {
+  TEST_START();
+
+  marisa::Keyset keyset;
+  for (std::size_t i = 0; i < 1000; ++i) {
+    std::ostringstream stream;
+    stream << "key" << (i * 7919);
+    keyset.push_back(stream.str().c_str());
+  }
+
+  // The sets are aligned whether they are built, read or mapped from a v2
+  // dictionary, and with any allocator.
+  marisa::ArenaAllocator arena;
+  marisa::grimoire::trie::LoudsTrie trie;
+  trie.set_allocator(&arena, NULL);
+  trie.build(keyset, 2 | MARISA_ASSOCIATIVE_CACHE);
+  ASSERT(!trie.cache_sets().empty());
+  ASSERT(IsAligned(trie));
+
+  {
+    marisa::grimoire::Writer writer;
+    writer.open("trie-test.dat");
+    trie.write(writer, MARISA_FORMAT_V2);
+    writer.flush();
+  }
+
+  marisa::grimoire::trie::LoudsTrie read_trie;
+  {
+    marisa::grimoire::Reader reader;
+    reader.open("trie-test.dat");
+    read_trie.read(reader);
+  }
+  ASSERT(IsAligned(read_trie));
+
+  marisa::grimoire::trie::LoudsTrie mapped_trie;
+  {
+    marisa::grimoire::Mapper mapper;
+    mapper.open("trie-test.dat");
+    mapped_trie.map(mapper);
+  }
+  ASSERT(IsAligned(mapped_trie));
+
+  // A cache rebuilt from a profile gets new sets.
+  const marisa::grimoire::trie::CacheSet * const old_sets =
+      &trie.cache_sets()[0];
+  marisa::Agent agent;
+  agent.init_state();
+  for (std::size_t i = 0; i < keyset.size(); ++i) {
+    agent.set_query(keyset[i].ptr(), keyset[i].length());
+    ASSERT(trie.profile(agent));
+  }
+  trie.rebuild_cache();
+  ASSERT(&trie.cache_sets()[0] != old_sets);
+  ASSERT(IsAligned(trie));
+
+  TEST_END();
+}
+
+void TestProfile() {
+  TEST_START();
+
+  marisa::grimoire::trie::Profile profile;
+  ASSERT(profile.num_slots() == 0);
+
+  profile.resize(2);
+  ASSERT(profile.num_slots() == 2);
+  ASSERT(profile.top(0).count() == 0);
+  ASSERT(profile.top(1).count() == 0);
+
+  // Edge 10 is counted 4 times among 7 other edges, which replace one
+  // another but not edge 10.
+  profile.count(1, 1, 10);
+  for (std::size_t i = 0; i < 7; ++i) {
+    profile.count(1, 2, 20 + i);
+    if ((i % 3) == 0) {
+      profile.count(1, 1, 10);
+    }
+  }
+  ASSERT(profile.top(0).count() == 0);
+  ASSERT(profile.top(1).parent() == 1);
+  ASSERT(profile.top(1).child() == 10);
+  ASSERT(profile.top(1).count() == 4);
+
+  profile.resize(2);
+  ASSERT(profile.top(1).count() == 0);
+
+  profile.clear();
+  ASSERT(profile.num_slots() == 0);
+
+  TEST_END();
+}
+
 }  // namespace
 
 int main() try {
@@ -499,6 +749,9 @@ int main() try {
   TestBinaryTail();
   TestHistory();
   TestState();
+  TestCacheSet();
+  TestCacheSetAlignment();
+  TestProfile();
 
   return 0;
 } catch (const marisa::Exception &ex) {
@@ -234,18 +234,206 @@ void TestVector() {
   vec.resize(100);
   ASSERT(vec.capacity() == 100);
 
+  const int objs[] = { 3, 1, 4 };
+  vec.resize(2);
+  vec.append(objs, 3);
+  ASSERT(vec.size() == 5);
+  ASSERT(vec[2] == 3);
+  ASSERT(vec[3] == 1);
+  ASSERT(vec[4] == 4);
+  vec.append(objs, 0);
+  ASSERT(vec.size() == 5);
+
   EXCEPT(vec.resize(MARISA_SIZE_MAX), MARISA_SIZE_ERROR);
 
   vec.fix();
   ASSERT(vec.fixed());
   EXCEPT(vec.fix(), MARISA_STATE_ERROR);
   EXCEPT(vec.push_back(0), MARISA_STATE_ERROR);
+  EXCEPT(vec.append(objs, 1), MARISA_STATE_ERROR);
   EXCEPT(vec.resize(0), MARISA_STATE_ERROR);
   EXCEPT(vec.reserve(0), MARISA_STATE_ERROR);
 
   TEST_END();
 }
 
+void TestAllocation() {
+  TEST_START();
+
+  typedef marisa::grimoire::vector::Allocation Allocation;
+
+  // Nothing is counted unless counting is enabled.
+  ASSERT(!Allocation::enabled());
+  {
+    const std::size_t total = Allocation::total();
+    marisa::grimoire::Vector<marisa::UInt32> vec;
+    vec.resize(100);
+    ASSERT(Allocation::total() == total);
+  }
+
+  Allocation::enable();
+  ASSERT(Allocation::enabled());
+  const std::size_t total = Allocation::total();
+  const std::size_t current = Allocation::current();
+  {
+    marisa::grimoire::Vector<marisa::UInt32> vec;
+    ASSERT(Allocation::total() == total);
+
+    vec.resize(100);
+    ASSERT(Allocation::total() == (total + (sizeof(marisa::UInt32) * 100)));
+    ASSERT(Allocation::current() ==
+        (current + (sizeof(marisa::UInt32) * 100)));
+
+    Allocation::reset_peak();
+    ASSERT(Allocation::peak() == Allocation::current());
+
+    vec.resize(200);
+    ASSERT(Allocation::total() == (total + (sizeof(marisa::UInt32) * 300)));
+    ASSERT(Allocation::current() ==
+        (current + (sizeof(marisa::UInt32) * 200)));
+    ASSERT(Allocation::peak() == (current + (sizeof(marisa::UInt32) * 300)));
+
+    vec.shrink();
+    ASSERT(Allocation::current() ==
+        (current + (sizeof(marisa::UInt32) * 200)));
+  }
+  ASSERT(Allocation::current() == current);
+  Allocation::disable();
+  ASSERT(!Allocation::enabled());
+
+  TEST_END();
+}
+
+class CountingAllocator : public marisa::Allocator {
+ public:
+  CountingAllocator() : Allocator(), num_blocks_(0), num_bytes_(0) {}
+
+  void *allocate(std::size_t size) {
+    ++num_blocks_;
+    num_bytes_ += size;
+    return new char[size];
+  }
+  void deallocate(void *ptr, std::size_t size) {
+    --num_blocks_;
+    num_bytes_ -= size;
+    delete [] static_cast<char *>(ptr);
+  }
+
+  std::size_t num_blocks() const {
+    return num_blocks_;
+  }
+  std::size_t num_bytes() const {
+    return num_bytes_;
+  }
+
+ private:
+  std::size_t num_blocks_;
+  std::size_t num_bytes_;
+};
+
+void TestAllocator() {
+  TEST_START();
+
+  CountingAllocator allocator;
+  {
+    marisa::grimoire::Vector<marisa::UInt32> vec;
+    vec.set_allocator(&allocator);
+    ASSERT(vec.allocator() == &allocator);
+
+    vec.resize(100);
+    ASSERT(allocator.num_blocks() == 1);
+    ASSERT(allocator.num_bytes() == (sizeof(marisa::UInt32) * 100));
+    EXCEPT(vec.set_allocator(NULL), MARISA_STATE_ERROR);
+
+    vec.resize(200);
+    ASSERT(allocator.num_blocks() == 1);
+    ASSERT(allocator.num_bytes() == (sizeof(marisa::UInt32) * 200));
+
+    marisa::grimoire::Vector<marisa::UInt32> vec2;
+    vec2.swap(vec);
+    ASSERT(vec2.allocator() == &allocator);
+    ASSERT(vec.allocator() == NULL);
+
+    vec2.clear();
+    ASSERT(allocator.num_blocks() == 0);
+    ASSERT(vec2.allocator() == &allocator);
+
+    marisa::grimoire::BitVector bv;
+    bv.set_allocator(&allocator);
+    for (std::size_t i = 0; i < 10000; ++i) {
+      bv.push_back((i % 3) == 0);
+    }
+    bv.build(true, true);
+    ASSERT(allocator.num_blocks() == 4);
+    ASSERT(bv.allocator() == &allocator);
+    ASSERT(bv.num_1s() == 3334);
+    ASSERT(bv.select1(1) == 3);
+  }
+  ASSERT(allocator.num_blocks() == 0);
+  ASSERT(allocator.num_bytes() == 0);
+
+  marisa::ArenaAllocator arena(1024);
+  {
+    marisa::grimoire::Vector<char> vec;
+    vec.set_allocator(&arena);
+    for (std::size_t i = 0; i < 1000; ++i) {
+      vec.push_back((char)i);
+    }
+    for (std::size_t i = 0; i < 1000; ++i) {
+      ASSERT(vec[i] == (char)i);
+    }
+  }
+  ASSERT(arena.num_chunks() != 0);
+  ASSERT(arena.used_size() <= arena.total_size());
+  ASSERT(((std::size_t)arena.allocate(1) % 16) == 0);
+  ASSERT(((std::size_t)arena.allocate(3000) % 16) == 0);
+
+  {
+    // An aligned vector keeps its alignment when it grows or shrinks.
+    marisa::grimoire::Vector<char> vec;
+    vec.set_allocator(&arena);
+    EXCEPT(vec.set_alignment(0), MARISA_CODE_ERROR);
+    EXCEPT(vec.set_alignment(48), MARISA_CODE_ERROR);
+    vec.set_alignment(64);
+    for (std::size_t i = 0; i < 1000; ++i) {
+      arena.allocate(1);
+      vec.push_back((char)i);
+      ASSERT(((std::size_t)vec.begin() % 64) == 0);
+    }
+    EXCEPT(vec.set_alignment(64), MARISA_STATE_ERROR);
+    vec.shrink();
+    ASSERT(((std::size_t)vec.begin() % 64) == 0);
+    for (std::size_t i = 0; i < 1000; ++i) {
+      ASSERT(vec[i] == (char)i);
+    }
+    vec.clear();
+    vec.resize(3);
+    ASSERT(((std::size_t)vec.begin() % 64) == 0);
+  }
+  arena.clear();
+  ASSERT(arena.num_chunks() == 0);
+  ASSERT(arena.total_size() == 0);
+
+  marisa::HugePageAllocator huge_page_allocator(4096);
+  marisa::NumaAllocator numa_allocator(0);
+  marisa::Allocator * const allocators[] = {
+    &huge_page_allocator, &numa_allocator
+  };
+  for (std::size_t i = 0; i < 2; ++i) {
+    marisa::grimoire::Vector<marisa::UInt32> vec;
+    vec.set_allocator(allocators[i]);
+    for (std::size_t j = 0; j < 100000; ++j) {
+      vec.push_back((marisa::UInt32)j);
+    }
+    vec.shrink();
+    for (std::size_t j = 0; j < 100000; ++j) {
+      ASSERT(vec[j] == j);
+    }
+  }
+
+  TEST_END();
+}
+
 void TestFlatVector() {
   TEST_START();
 
@@ -391,6 +579,14 @@ void TestBitVector(std::size_t size) {
   ASSERT(bv.num_0s() == num_zeros);
   ASSERT(bv.num_1s() == num_ones);
 
+  std::size_t next = bits.size();
+  for (std::size_t i = bits.size(); i > 0; --i) {
+    if (bits[i - 1]) {
+      next = i - 1;
+    }
+    ASSERT(bv.next1(i - 1) == next);
+  }
+
   std::stringstream stream;
   {
     marisa::grimoire::Writer writer;
@@ -456,6 +652,8 @@ int main() try {
   TestRankIndex();
 
   TestVector();
+  TestAllocation();
+  TestAllocator();
   TestFlatVector();
   TestBitVector();
 
@@ -20,6 +20,15 @@ marisa::CacheLevel param_cache_level = MARISA_DEFAULT_CACHE;
 bool param_with_predict = true;
 bool param_print_speed = true;
 
+// The counts of stats are printed per key for the following queries.
+enum {
+  LOOKUP_STATS,
+  REVERSE_LOOKUP_STATS,
+  COMMON_PREFIX_SEARCH_STATS,
+  PREDICTIVE_SEARCH_STATS,
+  NUM_QUERY_STATS
+};
+
 class Clock {
  public:
   Clock() : cl_(std::clock()) {}
@@ -111,6 +120,9 @@ void print_config() {
       break;
     }
   }
+
+  std::cout << "Query stats: "
+      << (marisa::Stats::is_enabled() ? "on" : "off") << std::endl;
 }
 
 void print_time_info(std::size_t num_keys, double elasped) {
@@ -129,6 +141,21 @@ void print_time_info(std::size_t num_keys, double elasped) {
   }
 }
 
+void print_stats(const marisa::Stats *stats, std::size_t num_keys) {
+  for (std::size_t i = 0; i < marisa::Stats::NUM_COUNTERS; ++i) {
+    const marisa::Stats::Counter counter = (marisa::Stats::Counter)i;
+    std::printf("%6s %-19s", "", marisa::Stats::counter_name(counter));
+    for (std::size_t j = 0; j < NUM_QUERY_STATS; ++j) {
+      if (num_keys == 0) {
+        std::printf(" %8s", "-");
+      } else {
+        std::printf(" %8.2f", (double)stats[j][counter] / num_keys);
+      }
+    }
+    std::printf("\n");
+  }
+}
+
 void read_keys(std::istream &input, marisa::Keyset *keyset,
     std::vector<float> *weights) {
   std::string line;
@@ -178,7 +205,7 @@ void benchmark_build(marisa::Keyset &keyset,
 }
 
 void benchmark_lookup(const marisa::Trie &trie,
-    const marisa::Keyset &keyset) {
+    const marisa::Keyset &keyset, marisa::Stats *stats) {
   Clock cl;
   marisa::Agent agent;
   for (std::size_t i = 0; i < keyset.size(); ++i) {
@@ -189,10 +216,11 @@ void benchmark_lookup(const marisa::Trie &trie,
     }
   }
   print_time_info(keyset.size(), cl.elasped());
+  *stats = agent.stats();
 }
 
 void benchmark_reverse_lookup(const marisa::Trie &trie,
-    const marisa::Keyset &keyset) {
+    const marisa::Keyset &keyset, marisa::Stats *stats) {
   Clock cl;
   marisa::Agent agent;
   for (std::size_t i = 0; i < keyset.size(); ++i) {
@@ -207,10 +235,11 @@ void benchmark_reverse_lookup(const marisa::Trie &trie,
     }
   }
   print_time_info(keyset.size(), cl.elasped());
+  *stats = agent.stats();
 }
 
 void benchmark_common_prefix_search(const marisa::Trie &trie,
-    const marisa::Keyset &keyset) {
+    const marisa::Keyset &keyset, marisa::Stats *stats) {
   Clock cl;
   marisa::Agent agent;
   for (std::size_t i = 0; i < keyset.size(); ++i) {
@@ -227,10 +256,11 @@ void benchmark_common_prefix_search(const marisa::Trie &trie,
     }
   }
   print_time_info(keyset.size(), cl.elasped());
+  *stats = agent.stats();
 }
 
 void benchmark_predictive_search(const marisa::Trie &trie,
-    const marisa::Keyset &keyset) {
+    const marisa::Keyset &keyset, marisa::Stats *stats) {
   if (!param_with_predict) {
     print_time_info(keyset.size(), 0.0);
     return;
@@ -253,6 +283,7 @@ void benchmark_predictive_search(const marisa::Trie &trie,
     }
   }
   print_time_info(keyset.size(), cl.elasped());
+  *stats = agent.stats();
 }
 
 void benchmark(marisa::Keyset &keyset, const std::vector<float> &weights,
@@ -260,13 +291,19 @@ void benchmark(marisa::Keyset &keyset, const std::vector<float> &weights,
   std::printf("%6d", num_tries);
   marisa::Trie trie;
   benchmark_build(keyset, weights, num_tries, &trie);
+  marisa::Stats stats[NUM_QUERY_STATS];
   if (!trie.empty()) {
-    benchmark_lookup(trie, keyset);
-    benchmark_reverse_lookup(trie, keyset);
-    benchmark_common_prefix_search(trie, keyset);
-    benchmark_predictive_search(trie, keyset);
+    benchmark_lookup(trie, keyset, &stats[LOOKUP_STATS]);
+    benchmark_reverse_lookup(trie, keyset, &stats[REVERSE_LOOKUP_STATS]);
+    benchmark_common_prefix_search(trie, keyset,
+        &stats[COMMON_PREFIX_SEARCH_STATS]);
+    benchmark_predictive_search(trie, keyset,
+        &stats[PREDICTIVE_SEARCH_STATS]);
   }
   std::printf("\n");
+  if (marisa::Stats::is_enabled()) {
+    print_stats(stats, keyset.size());
+  }
 }
 
 int benchmark(const char * const *args, std::size_t num_args) try {
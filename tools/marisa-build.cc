@@ -19,6 +19,19 @@ int param_num_tries = MARISA_DEFAULT_NUM_TRIES;
 marisa::TailMode param_tail_mode = MARISA_DEFAULT_TAIL;
 marisa::NodeOrder param_node_order = MARISA_DEFAULT_ORDER;
 marisa::CacheLevel param_cache_level = MARISA_DEFAULT_CACHE;
+marisa::CacheLayout param_cache_layout = MARISA_DEFAULT_CACHE_LAYOUT;
+marisa::RootTable param_root_table = MARISA_DEFAULT_ROOT_TABLE;
+marisa::CacheLevel param_cache_levels[MARISA_MAX_NUM_TRIES];
+std::size_t param_num_cache_levels = 0;
+bool param_auto = false;
+marisa::Tuner::Objective param_objective = marisa::Tuner::MIN_TIME;
+std::size_t param_max_size = 0;
+double param_max_time = 0.0;
+bool param_mmap_input = false;
+char param_delimiter = '\n';
+std::size_t param_num_threads = 1;
+bool param_verbose = false;
+marisa::FormatVersion param_format = MARISA_DEFAULT_FORMAT;
 const char *output_filename = NULL;
 
 void print_help(const char *cmd) {
@@ -33,14 +46,101 @@ void print_help(const char *cmd) {
       "  -l, --label-order    arrange siblings in label order\n"
       "  -c, --cache-level=[N]    specify the cache size"
       " [1, 5] (default: 3)\n"
+      "  -C, --cache-levels=[N,...]  specify the cache size of each trie"
+      " [1, 5]\n"
+      "  -A, --associative-cache  arrange the cache in 4-way sets\n"
+      "  -r, --root-table=[N] map the first N bytes of queries with a table"
+      " [0, 2]\n"
+      "                       (default: 0, saved only in format 2)\n"
+      "  -a, --auto=[OBJ]     select the number of tries, the cache size and"
+      " the TAIL\n"
+      "                       mode automatically for OBJ (size or time)\n"
+      "  -S, --max-size=[N]   limit the dictionary size [bytes] in auto mode\n"
+      "  -T, --max-time=[N]   limit the lookup time [ns] in auto mode\n"
+      "  -m, --mmap-input     map input files instead of reading them, so that"
+      " keys\n"
+      "                       are not copied (input files must be kept"
+      " unchanged)\n"
+      "  -j, --threads=[N]    parse input files with N threads, which implies\n"
+      "                       --mmap-input (default: 1, 0: #processors)\n"
+      "  -z, --null-data      keys are separated by NUL instead of newline\n"
+      "  -F, --format=[N]     write tries in format version N [1, 2]"
+      " (default: 1)\n"
       "  -o, --output=[FILE]  write tries to FILE (default: stdout)\n"
+      "  -v, --verbose        print the time and memory of each build phase\n"
       "  -h, --help           print this help\n"
       << std::endl;
 }
 
+int get_cache_level(marisa::CacheLevel cache_level) {
+  switch (cache_level) {
+    case MARISA_TINY_CACHE: {
+      return 1;
+    }
+    case MARISA_SMALL_CACHE: {
+      return 2;
+    }
+    case MARISA_NORMAL_CACHE: {
+      return 3;
+    }
+    case MARISA_LARGE_CACHE: {
+      return 4;
+    }
+    case MARISA_HUGE_CACHE: {
+      return 5;
+    }
+  }
+  return 0;
+}
+
+const marisa::CacheLevel CACHE_LEVELS[] = {
+  MARISA_TINY_CACHE, MARISA_SMALL_CACHE, MARISA_NORMAL_CACHE,
+  MARISA_LARGE_CACHE, MARISA_HUGE_CACHE
+};
+
+// VerboseObserver prints each phase of a build and sums them up by phase.
+class VerboseObserver : public marisa::BuildObserver {
+ public:
+  VerboseObserver() : BuildObserver(), peak_bytes_(0) {
+    for (int i = 0; i < NUM_PHASES; ++i) {
+      times_[i] = 0.0;
+      num_allocated_bytes_[i] = 0;
+    }
+  }
+
+  void end(const Event &event) {
+    std::cerr << "trie " << event.trie_id() << ": "
+        << phase_name(event.phase()) << ": " << event.time() << " sec, "
+        << event.num_keys() << " keys, " << event.num_nodes() << " nodes, "
+        << event.num_allocated_bytes() << " bytes allocated, peak "
+        << event.peak_bytes() << " bytes" << std::endl;
+    times_[event.phase()] += event.time();
+    num_allocated_bytes_[event.phase()] += event.num_allocated_bytes();
+    if (event.peak_bytes() > peak_bytes_) {
+      peak_bytes_ = event.peak_bytes();
+    }
+  }
+
+  void print() const {
+    double total_time = 0.0;
+    for (int i = 0; i < NUM_PHASES; ++i) {
+      std::cerr << phase_name((Phase)i) << ": " << times_[i] << " sec, "
+          << num_allocated_bytes_[i] << " bytes allocated" << std::endl;
+      total_time += times_[i];
+    }
+    std::cerr << "build time: " << total_time << " sec" << std::endl;
+    std::cerr << "peak memory: " << peak_bytes_ << " bytes" << std::endl;
+  }
+
+ private:
+  double times_[NUM_PHASES];
+  std::size_t num_allocated_bytes_[NUM_PHASES];
+  std::size_t peak_bytes_;
+};
+
 void read_keys(std::istream &input, marisa::Keyset *keyset) {
   std::string line;
-  while (std::getline(input, line)) {
+  while (std::getline(input, line, param_delimiter)) {
     const std::string::size_type delim_pos = line.find_last_of('\t');
     float weight = 1.0F;
     if (delim_pos != line.npos) {
@@ -64,33 +164,73 @@ int build(const char * const *args, std::size_t num_args) {
   }
 
   for (std::size_t i = 0; i < num_args; ++i) try {
-    std::ifstream input_file(args[i], std::ios::binary);
-    if (!input_file) {
-      std::cerr << "error: failed to open: " << args[i] << std::endl;
-      return 11;
+    if (param_mmap_input) {
+      keyset.mmap(args[i], param_delimiter, true, param_num_threads);
+    } else {
+      std::ifstream input_file(args[i], std::ios::binary);
+      if (!input_file) {
+        std::cerr << "error: failed to open: " << args[i] << std::endl;
+        return 11;
+      }
+      read_keys(input_file, &keyset);
     }
-    read_keys(input_file, &keyset);
   } catch (const marisa::Exception &ex) {
     std::cerr << ex.what() << ": failed to read keys" << std::endl;
     return 12;
   }
 
+  int config_flags = param_num_tries | param_tail_mode | param_node_order |
+      param_cache_level | param_cache_layout | param_root_table;
+  if (param_auto) try {
+    marisa::Tuner tuner;
+    tuner.set_objective(param_objective);
+    tuner.set_max_size(param_max_size);
+    tuner.set_max_time(param_max_time);
+    config_flags = tuner.tune(keyset, param_node_order) |
+        param_cache_layout | param_root_table;
+    std::cerr << "#candidates: " << tuner.num_candidates() << std::endl;
+    std::cerr << "estimated size: " << tuner.size() << std::endl;
+    std::cerr << "estimated time: " << tuner.time() << std::endl;
+  } catch (const marisa::Exception &ex) {
+    std::cerr << ex.what() << ": failed to tune settings" << std::endl;
+    return 21;
+  }
+
   marisa::Trie trie;
+  VerboseObserver observer;
   try {
-    trie.build(keyset, param_num_tries | param_tail_mode | param_node_order |
-        param_cache_level);
+    trie.build(keyset, config_flags, param_cache_levels,
+        param_num_cache_levels, param_verbose ? &observer : NULL);
   } catch (const marisa::Exception &ex) {
     std::cerr << ex.what() << ": failed to build a dictionary" << std::endl;
     return 20;
   }
 
+  if (param_verbose) {
+    observer.print();
+  }
+
   std::cerr << "#keys: " << trie.num_keys() << std::endl;
   std::cerr << "#nodes: " << trie.num_nodes() << std::endl;
-  std::cerr << "size: " << trie.io_size() << std::endl;
+  std::cerr << "size: " << trie.io_size(param_format) << std::endl;
+  if (param_num_cache_levels != 0) {
+    std::cerr << "cache sizes:";
+    for (std::size_t i = 0; i < trie.num_tries(); ++i) {
+      std::cerr << ' ' << trie.cache_size(i);
+    }
+    std::cerr << std::endl;
+  }
+  if (param_auto) {
+    std::cerr << "#tries: " << trie.num_tries() << std::endl;
+    std::cerr << "cache level: " << get_cache_level(trie.cache_level())
+        << std::endl;
+    std::cerr << "TAIL mode: " << ((trie.tail_mode() == MARISA_TEXT_TAIL) ?
+        "text" : "binary") << std::endl;
+  }
 
   if (output_filename != NULL) {
     try {
-      trie.save(output_filename);
+      trie.save(output_filename, param_format);
     } catch (const marisa::Exception &ex) {
       std::cerr << ex.what() << ": failed to write a dictionary to file: "
           << output_filename << std::endl;
@@ -110,7 +250,7 @@ int build(const char * const *args, std::size_t num_args) {
     }
 #endif  // _WIN32
     try {
-      std::cout << trie;
+      marisa::write(std::cout, trie, param_format);
     } catch (const marisa::Exception &ex) {
       std::cerr << ex.what()
           << ": failed to write a dictionary to standard output" << std::endl;
@@ -132,12 +272,24 @@ int main(int argc, char *argv[]) {
     { "weight-order", 0, NULL, 'w' },
     { "label-order", 0, NULL, 'l' },
     { "cache-level", 1, NULL, 'c' },
+    { "cache-levels", 1, NULL, 'C' },
+    { "associative-cache", 0, NULL, 'A' },
+    { "root-table", 1, NULL, 'r' },
+    { "auto", 1, NULL, 'a' },
+    { "max-size", 1, NULL, 'S' },
+    { "max-time", 1, NULL, 'T' },
+    { "mmap-input", 0, NULL, 'm' },
+    { "threads", 1, NULL, 'j' },
+    { "null-data", 0, NULL, 'z' },
+    { "format", 1, NULL, 'F' },
     { "output", 1, NULL, 'o' },
+    { "verbose", 0, NULL, 'v' },
     { "help", 0, NULL, 'h' },
     { NULL, 0, NULL, 0 }
   };
   ::cmdopt_t cmdopt;
-  ::cmdopt_init(&cmdopt, argc, argv, "n:tbwlc:o:h", long_options);
+  ::cmdopt_init(&cmdopt, argc, argv, "n:tbwlc:C:Ar:a:S:T:mj:zF:o:vh",
+      long_options);
   int label;
   while ((label = ::cmdopt_get(&cmdopt)) != -1) {
     switch (label) {
@@ -189,10 +341,123 @@ int main(int argc, char *argv[]) {
         }
         break;
       }
+      case 'C': {
+        const char *ptr = cmdopt.optarg;
+        param_num_cache_levels = 0;
+        for ( ; ; ) {
+          char *end_of_value;
+          const long value = std::strtol(ptr, &end_of_value, 10);
+          if ((end_of_value == ptr) || (value < 1) || (value > 5) ||
+              ((*end_of_value != '\0') && (*end_of_value != ',')) ||
+              (param_num_cache_levels == MARISA_MAX_NUM_TRIES)) {
+            std::cerr << "error: option `-C' with an invalid argument: "
+                << cmdopt.optarg << std::endl;
+            return 2;
+          }
+          param_cache_levels[param_num_cache_levels++] =
+              CACHE_LEVELS[value - 1];
+          if (*end_of_value == '\0') {
+            break;
+          }
+          ptr = end_of_value + 1;
+        }
+        break;
+      }
+      case 'A': {
+        param_cache_layout = MARISA_ASSOCIATIVE_CACHE;
+        break;
+      }
+      case 'r': {
+        const std::string value = cmdopt.optarg;
+        if (value == "0") {
+          param_root_table = MARISA_NO_ROOT_TABLE;
+        } else if (value == "1") {
+          param_root_table = MARISA_ROOT_TABLE;
+        } else if (value == "2") {
+          param_root_table = MARISA_DEEP_ROOT_TABLE;
+        } else {
+          std::cerr << "error: option `-r' with an invalid argument: "
+              << cmdopt.optarg << std::endl;
+          return 2;
+        }
+        break;
+      }
+      case 'a': {
+        const std::string value = cmdopt.optarg;
+        if (value == "size") {
+          param_objective = marisa::Tuner::MIN_SIZE;
+        } else if (value == "time") {
+          param_objective = marisa::Tuner::MIN_TIME;
+        } else {
+          std::cerr << "error: option `-a' with an invalid argument: "
+              << cmdopt.optarg << std::endl;
+          return 3;
+        }
+        param_auto = true;
+        break;
+      }
+      case 'S': {
+        char *end_of_value;
+        const double value = std::strtod(cmdopt.optarg, &end_of_value);
+        if ((*end_of_value != '\0') || (value < 0.0)) {
+          std::cerr << "error: option `-S' with an invalid argument: "
+              << cmdopt.optarg << std::endl;
+          return 4;
+        }
+        param_max_size = (std::size_t)value;
+        break;
+      }
+      case 'T': {
+        char *end_of_value;
+        const double value = std::strtod(cmdopt.optarg, &end_of_value);
+        if ((*end_of_value != '\0') || (value < 0.0)) {
+          std::cerr << "error: option `-T' with an invalid argument: "
+              << cmdopt.optarg << std::endl;
+          return 5;
+        }
+        param_max_time = value;
+        break;
+      }
+      case 'm': {
+        param_mmap_input = true;
+        break;
+      }
+      case 'j': {
+        char *end_of_value;
+        const long value = std::strtol(cmdopt.optarg, &end_of_value, 10);
+        if ((*end_of_value != '\0') || (value < 0)) {
+          std::cerr << "error: option `-j' with an invalid argument: "
+              << cmdopt.optarg << std::endl;
+          return 6;
+        }
+        param_num_threads = (std::size_t)value;
+        param_mmap_input = true;
+        break;
+      }
+      case 'z': {
+        param_delimiter = '\0';
+        break;
+      }
       case 'o': {
         output_filename = cmdopt.optarg;
         break;
       }
+      case 'F': {
+        char *end_of_value;
+        const long value = std::strtol(cmdopt.optarg, &end_of_value, 10);
+        if ((*end_of_value != '\0') || (value < MARISA_FORMAT_V1) ||
+            (value > MARISA_FORMAT_V2)) {
+          std::cerr << "error: option `-F' with an invalid argument: "
+              << cmdopt.optarg << std::endl;
+          return 2;
+        }
+        param_format = (marisa::FormatVersion)value;
+        break;
+      }
+      case 'v': {
+        param_verbose = true;
+        break;
+      }
       case 'h': {
         print_help(argv[0]);
         return 0;
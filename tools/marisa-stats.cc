@@ -0,0 +1,274 @@
+#ifdef _WIN32
+ #include <fcntl.h>
+ #include <io.h>
+ #include <stdio.h>
+#endif  // _WIN32
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <marisa.h>
+
+#include "cmdopt.h"
+
+namespace {
+
+bool mmap_flag = true;
+bool json_flag = false;
+
+void print_help(const char *cmd) {
+  std::cerr << "Usage: " << cmd << " [OPTION]... DIC...\n\n"
+      "Options:\n"
+      "  -j, --json             print a JSON object per dictionary\n"
+      "  -t, --text             print text (default)\n"
+      "  -m, --mmap-dictionary  use memory-mapped I/O to load a dictionary"
+      " (default)\n"
+      "  -r, --read-dictionary  read an entire dictionary into memory\n"
+      "  -h, --help             print this help\n"
+      << std::endl;
+}
+
+const char *tail_mode_name(marisa::TailMode tail_mode) {
+  return (tail_mode == MARISA_BINARY_TAIL) ? "binary" : "text";
+}
+
+const char *node_order_name(marisa::NodeOrder node_order) {
+  return (node_order == MARISA_LABEL_ORDER) ? "label" : "weight";
+}
+
+std::string format_ratio(double ratio) {
+  char buf[32];
+  std::sprintf(buf, "%.4f", ratio);
+  return buf;
+}
+
+std::string format_json_string(const char *str) {
+  std::string result = "\"";
+  for (const char *p = str; *p != '\0'; ++p) {
+    if ((*p == '"') || (*p == '\\')) {
+      result += '\\';
+      result += *p;
+    } else if ((unsigned char)*p < 0x20) {
+      char buf[8];
+      std::sprintf(buf, "\\u%04x", (unsigned char)*p);
+      result += buf;
+    } else {
+      result += *p;
+    }
+  }
+  return result + "\"";
+}
+
+// print_text() prints a section for the dictionary and for each level. The
+// fan-out histogram is printed as "bucket:count" pairs for the non-empty
+// buckets, where bucket i is for [2^(i-1), 2^i) children.
+void print_text(const char *name, const marisa::Trie &trie,
+    const marisa::Description &description) {
+  std::cout << "dictionary: " << name << '\n'
+      << "  num_keys: " << trie.num_keys() << '\n'
+      << "  num_tries: " << description.num_levels() << '\n'
+      << "  num_nodes: " << trie.num_nodes() << '\n'
+      << "  tail_mode: " << tail_mode_name(trie.tail_mode()) << '\n'
+      << "  node_order: " << node_order_name(trie.node_order()) << '\n'
+      << "  total_size: " << trie.total_size() << '\n'
+      << "  io_size: " << trie.io_size() << '\n'
+      << "  sharing_ratio: " << format_ratio(description.sharing_ratio())
+      << '\n'
+      << "  key_depth:";
+  for (std::size_t i = 0; i < marisa::Description::NUM_DEPTH_BUCKETS; ++i) {
+    if (description.key_depth(i) != 0) {
+      std::cout << ' ' << i << ':' << description.key_depth(i);
+    }
+  }
+  std::cout << '\n';
+
+  for (std::size_t i = 0; i < description.num_levels(); ++i) {
+    std::cout << "  level " << i << ":\n";
+    for (std::size_t j = 0; j < marisa::Description::NUM_ITEMS; ++j) {
+      const marisa::Description::Item item = (marisa::Description::Item)j;
+      std::cout << "    " << marisa::Description::item_name(item) << ": "
+          << description.get(i, item) << '\n';
+    }
+    std::cout << "    size: " << description.size(i) << '\n'
+        << "    link_ratio: " << format_ratio(description.link_ratio(i))
+        << '\n'
+        << "    cache_fill_ratio: "
+        << format_ratio(description.cache_fill_ratio(i)) << '\n'
+        << "    fanout:";
+    for (std::size_t j = 0; j < marisa::Description::NUM_FANOUT_BUCKETS;
+        ++j) {
+      if (description.fanout(i, j) != 0) {
+        std::cout << ' ' << j << ':' << description.fanout(i, j);
+      }
+    }
+    std::cout << '\n';
+  }
+}
+
+// print_json() prints an object in a line. The histograms are arrays which
+// have all the buckets.
+void print_json(const char *name, const marisa::Trie &trie,
+    const marisa::Description &description) {
+  std::cout << "{\"dictionary\":" << format_json_string(name)
+      << ",\"num_keys\":" << trie.num_keys()
+      << ",\"num_tries\":" << description.num_levels()
+      << ",\"num_nodes\":" << trie.num_nodes()
+      << ",\"tail_mode\":\"" << tail_mode_name(trie.tail_mode()) << '"'
+      << ",\"node_order\":\"" << node_order_name(trie.node_order()) << '"'
+      << ",\"total_size\":" << trie.total_size()
+      << ",\"io_size\":" << trie.io_size()
+      << ",\"sharing_ratio\":" << format_ratio(description.sharing_ratio())
+      << ",\"key_depth\":[";
+  for (std::size_t i = 0; i < marisa::Description::NUM_DEPTH_BUCKETS; ++i) {
+    std::cout << ((i != 0) ? "," : "") << description.key_depth(i);
+  }
+  std::cout << "],\"levels\":[";
+  for (std::size_t i = 0; i < description.num_levels(); ++i) {
+    std::cout << ((i != 0) ? ",{" : "{");
+    for (std::size_t j = 0; j < marisa::Description::NUM_ITEMS; ++j) {
+      const marisa::Description::Item item = (marisa::Description::Item)j;
+      std::cout << ((j != 0) ? ",\"" : "\"")
+          << marisa::Description::item_name(item) << "\":"
+          << description.get(i, item);
+    }
+    std::cout << ",\"size\":" << description.size(i)
+        << ",\"link_ratio\":" << format_ratio(description.link_ratio(i))
+        << ",\"cache_fill_ratio\":"
+        << format_ratio(description.cache_fill_ratio(i))
+        << ",\"fanout\":[";
+    for (std::size_t j = 0; j < marisa::Description::NUM_FANOUT_BUCKETS;
+        ++j) {
+      std::cout << ((j != 0) ? "," : "") << description.fanout(i, j);
+    }
+    std::cout << "]}";
+  }
+  std::cout << "]}\n";
+}
+
+int print_stats(const char *name, const marisa::Trie &trie) {
+  marisa::Description description;
+  try {
+    trie.describe(&description);
+  } catch (const marisa::Exception &ex) {
+    std::cerr << ex.what() << ": describe() failed" << std::endl;
+    return 30;
+  }
+  if (json_flag) {
+    print_json(name, trie, description);
+  } else {
+    print_text(name, trie, description);
+  }
+  if (!std::cout.flush()) {
+    std::cerr << "error: failed to write results to standard output"
+        << std::endl;
+    return 31;
+  }
+  return 0;
+}
+
+int print_stats(const char *filename) {
+  marisa::Trie trie;
+  if (filename != NULL) {
+    if (mmap_flag) {
+      try {
+        trie.mmap(filename);
+      } catch (const marisa::Exception &ex) {
+        std::cerr << ex.what() << ": failed to mmap a dictionary file: "
+            << filename << std::endl;
+        return 10;
+      }
+    } else {
+      try {
+        trie.load(filename);
+      } catch (const marisa::Exception &ex) {
+        std::cerr << ex.what() << ": failed to load a dictionary file: "
+            << filename << std::endl;
+        return 11;
+      }
+    }
+    return print_stats(filename, trie);
+  }
+
+#ifdef _WIN32
+  const int stdin_fileno = ::_fileno(stdin);
+  if (stdin_fileno < 0) {
+    std::cerr << "error: failed to get the file descriptor of "
+        "standard input" << std::endl;
+    return 20;
+  }
+  if (::_setmode(stdin_fileno, _O_BINARY) == -1) {
+    std::cerr << "error: failed to set binary mode" << std::endl;
+    return 21;
+  }
+#endif  // _WIN32
+  try {
+    std::cin >> trie;
+  } catch (const marisa::Exception &ex) {
+    std::cerr << ex.what()
+        << ": failed to read a dictionary from standard input" << std::endl;
+    return 22;
+  }
+  return print_stats("<stdin>", trie);
+}
+
+int print_stats(const char * const *args, std::size_t num_args) {
+  if (num_args == 0) {
+    return print_stats(NULL);
+  }
+  for (std::size_t i = 0; i < num_args; ++i) {
+    const int result = print_stats(args[i]);
+    if (result != 0) {
+      return result;
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  std::ios::sync_with_stdio(false);
+
+  ::cmdopt_option long_options[] = {
+    { "json", 0, NULL, 'j' },
+    { "text", 0, NULL, 't' },
+    { "mmap-dictionary", 0, NULL, 'm' },
+    { "read-dictionary", 0, NULL, 'r' },
+    { "help", 0, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+  ::cmdopt_t cmdopt;
+  ::cmdopt_init(&cmdopt, argc, argv, "jtmrh", long_options);
+  int label;
+  while ((label = ::cmdopt_get(&cmdopt)) != -1) {
+    switch (label) {
+      case 'j': {
+        json_flag = true;
+        break;
+      }
+      case 't': {
+        json_flag = false;
+        break;
+      }
+      case 'm': {
+        mmap_flag = true;
+        break;
+      }
+      case 'r': {
+        mmap_flag = false;
+        break;
+      }
+      case 'h': {
+        print_help(argv[0]);
+        return 0;
+      }
+      default: {
+        return 1;
+      }
+    }
+  }
+  return print_stats(cmdopt.argv + cmdopt.optind,
+      cmdopt.argc - cmdopt.optind);
+}